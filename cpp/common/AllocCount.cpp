@@ -0,0 +1,38 @@
+/** @file AllocCount.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include "AllocCount.h"
+
+static std::atomic<uint64_t> allocs(0);	///< calls to operator new
+
+void* operator new(std::size_t n) {
+	allocs.fetch_add(1, std::memory_order_relaxed);
+	void *p = malloc(n == 0 ? 1 : n);
+	if (p == 0) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](std::size_t n) { return operator new(n); }
+
+void operator delete(void* p) noexcept { free(p); }
+
+void operator delete[](void* p) noexcept { free(p); }
+
+namespace forest {
+
+/** Get the number of heap allocations made so far.
+ *  @return the number of calls to operator new since the program started
+ */
+uint64_t AllocCount::count() {
+	return allocs.load(std::memory_order_relaxed);
+}
+
+} // ends namespace
@@ -0,0 +1,190 @@
+/** @file Bench.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include <chrono>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "Bench.h"
+#include "AllocCount.h"
+
+using namespace std::chrono;
+
+namespace forest {
+
+/** Constructor for Bench.
+ *  @param reps1 is the number of timed runs of each benchmark
+ *  @param tag1 is a label that is included in every result
+ */
+Bench::Bench(int reps1, const string& tag1) : reps(reps1), tag(tag1) {
+	if (reps < 1) reps = 1;
+	openCounters();
+}
+
+Bench::~Bench() {
+	for (int i = 0; i < NCTR; i++) if (fd[i] >= 0) close(fd[i]);
+}
+
+/** Open the hardware counters.
+ *  The counters form a group, led by the cycle counter, so that they
+ *  are started and stopped together. Counters that cannot be opened
+ *  (for example, because perf_event_paranoid forbids it, or because
+ *  we are in a virtual machine) are skipped.
+ */
+void Bench::openCounters() {
+	static const uint64_t config[NCTR] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+	};
+	for (int i = 0; i < NCTR; i++) {
+		perf_event_attr pe;
+		memset(&pe, 0, sizeof(pe));
+		pe.type = PERF_TYPE_HARDWARE; pe.size = sizeof(pe);
+		pe.config = config[i];
+		pe.disabled = (i == 0 ? 1 : 0);
+		pe.exclude_kernel = 1; pe.exclude_hv = 1;
+		int leader = (i == 0 ? -1 : fd[0]);
+		fd[i] = -1;
+		if (i > 0 && leader < 0) continue;
+		fd[i] = syscall(__NR_perf_event_open, &pe, 0, -1, leader, 0);
+	}
+}
+
+/** Reset and start the counters. */
+void Bench::startCounters() {
+	if (fd[0] < 0) return;
+	ioctl(fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/** Stop the counters and read them.
+ *  @param ctr is an array in which the counter values are returned;
+ *  -1 is returned for counters that are not available
+ */
+void Bench::stopCounters(int64_t *ctr) {
+	if (fd[0] >= 0) ioctl(fd[0], PERF_EVENT_IOC_DISABLE,
+			      PERF_IOC_FLAG_GROUP);
+	for (int i = 0; i < NCTR; i++) {
+		uint64_t v;
+		if (fd[i] < 0 || read(fd[i], &v, sizeof(v)) != sizeof(v))
+			ctr[i] = -1;
+		else
+			ctr[i] = v;
+	}
+}
+
+/** Run a benchmark.
+ *  @param name is the name of the benchmark
+ *  @param params is a list of name=value pairs, separated by spaces,
+ *  that describe the parameters of this run
+ *  @param ops is the number of operations done by one call to body
+ *  @param body is a function that does the operations
+ *  @return true if the benchmark was run, false if it was skipped
+ *  because of the filter
+ */
+bool Bench::run(const string& name, const string& params, uint64_t ops,
+		std::function<void()> body) {
+	if (filter.length() > 0 && name.find(filter) == string::npos)
+		return false;
+	body(); // warm up caches and branch predictors
+	Result best; best.ns = 0;
+	for (int i = 0; i < reps; i++) {
+		Result r;
+		uint64_t a0 = AllocCount::count();
+		startCounters();
+		steady_clock::time_point t0 = steady_clock::now();
+		body();
+		steady_clock::time_point t1 = steady_clock::now();
+		stopCounters(r.ctr);
+		r.allocs = AllocCount::count() - a0;
+		r.ns = duration_cast<nanoseconds>(t1 - t0).count();
+		if (i == 0 || r.ns < best.ns) best = r;
+	}
+	best.name = name; best.params = params; best.ops = ops;
+	results.push_back(best);
+	cerr << name << " " << params << ": "
+	     << perOp(best.ns, ops) << " ns/op\n";
+	return true;
+}
+
+/** Compute a per-operation value.
+ *  @param v is a total over all operations, or -1
+ *  @param ops is the number of operations
+ *  @return v/ops, or -1 if v is -1
+ */
+double Bench::perOp(int64_t v, uint64_t ops) {
+	if (v < 0) return -1;
+	return ((double) v) / max(ops, (uint64_t) 1);
+}
+
+/** Create a CSV table of the results.
+ *  @return a string with a header line and one line per benchmark
+ */
+string Bench::toCsv() const {
+	stringstream ss;
+	ss << "tag,name,params,ops,ns,ns_per_op,allocs_per_op,"
+	      "cycles_per_op,instr_per_op,cache_miss_per_op,"
+	      "branch_miss_per_op\n";
+	for (const Result& r : results) {
+		ss << tag << "," << r.name << ",\"" << r.params << "\","
+		   << r.ops << "," << r.ns << "," << perOp(r.ns, r.ops)
+		   << "," << perOp(r.allocs, r.ops);
+		for (int i = 0; i < NCTR; i++)
+			ss << "," << perOp(r.ctr[i], r.ops);
+		ss << "\n";
+	}
+	return ss.str();
+}
+
+/** Create a JSON description of the results.
+ *  @return a string containing a JSON object with the tag and an
+ *  array of results; unavailable counters are given as null
+ */
+string Bench::toJson() const {
+	static const char *ctrName[NCTR] = {
+		"cycles_per_op", "instr_per_op", "cache_miss_per_op",
+		"branch_miss_per_op"
+	};
+	stringstream ss;
+	ss << "{\"tag\": \"" << tag << "\", \"results\": [";
+	for (size_t k = 0; k < results.size(); k++) {
+		const Result& r = results[k];
+		ss << (k == 0 ? "\n" : ",\n")
+		   << "  {\"name\": \"" << r.name << "\", \"params\": \""
+		   << r.params << "\", \"ops\": " << r.ops
+		   << ", \"ns\": " << r.ns
+		   << ", \"ns_per_op\": " << perOp(r.ns, r.ops)
+		   << ", \"allocs_per_op\": " << perOp(r.allocs, r.ops);
+		for (int i = 0; i < NCTR; i++) {
+			ss << ", \"" << ctrName[i] << "\": ";
+			if (r.ctr[i] < 0) ss << "null";
+			else ss << perOp(r.ctr[i], r.ops);
+		}
+		ss << "}";
+	}
+	ss << "\n]}\n";
+	return ss.str();
+}
+
+/** Create a readable table of the results.
+ *  @return the string
+ */
+string Bench::toString() const {
+	stringstream ss;
+	for (const Result& r : results) {
+		ss << r.name << " " << r.params << ": "
+		   << perOp(r.ns, r.ops) << " ns/op";
+		if (r.ctr[0] >= 0)
+			ss << ", " << perOp(r.ctr[0], r.ops) << " cycles/op";
+		ss << ", " << perOp(r.allocs, r.ops) << " allocs/op\n";
+	}
+	return ss.str();
+}
+
+} // ends namespace
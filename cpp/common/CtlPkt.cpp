@@ -122,7 +122,7 @@ void CtlPkt::fmtAddIfaceReply(ipa_t ip, ipp_t port, int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrAddIfaceReply(ipa_t& ip, ipp_t& port) {
-	return	type == ADD_IFACE && mode == REQUEST
+	return	type == ADD_IFACE && mode == POS_REPLY
 		&& get(ip) && get(port) 
 		&& paylen >= (next - payload);
 }
@@ -161,7 +161,7 @@ void CtlPkt::fmtDropIfaceReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrDropIfaceReply() {
-	return	type == DROP_IFACE && mode == REQUEST
+	return	type == DROP_IFACE && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -201,7 +201,7 @@ void CtlPkt::fmtModIfaceReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrModIfaceReply() {
-	return	type == MOD_IFACE && mode == REQUEST
+	return	type == MOD_IFACE && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -251,7 +251,7 @@ void CtlPkt::fmtGetIfaceReply(int iface, ipa_t ip, ipp_t port, RateSpec rates, R
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrGetIfaceReply(int& iface, ipa_t& ip, ipp_t& port, RateSpec& rates, RateSpec& availRates) {
-	return	type == GET_IFACE && mode == REQUEST
+	return	type == GET_IFACE && mode == POS_REPLY
 		&& get(iface) && get(ip) && get(port) && get(rates) && get(availRates) 
 		&& paylen >= (next - payload);
 }
@@ -300,7 +300,7 @@ void CtlPkt::fmtGetIfaceSetReply(int count, int nexti, string s, int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrGetIfaceSetReply(int& count, int& nexti, string& s) {
-	return	type == GET_IFACE_SET && mode == REQUEST
+	return	type == GET_IFACE_SET && mode == POS_REPLY
 		&& get(count) && get(nexti) && get(s)
 		&& paylen >= (next - payload);
 }
@@ -366,7 +366,7 @@ void CtlPkt::fmtAddLinkReply(int lnk, fAdr_t peerAdr, int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrAddLinkReply(int& lnk, fAdr_t& peerAdr) {
-	return	type == ADD_LINK && mode == REQUEST
+	return	type == ADD_LINK && mode == POS_REPLY
 		&& get(lnk) && get(peerAdr) 
 		&& paylen >= (next - payload);
 }
@@ -410,7 +410,7 @@ void CtlPkt::fmtDropLinkReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrDropLinkReply() {
-	return	type == DROP_LINK && mode == REQUEST
+	return	type == DROP_LINK && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -450,7 +450,7 @@ void CtlPkt::fmtModLinkReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrModLinkReply() {
-	return	type == MOD_LINK && mode == REQUEST
+	return	type == MOD_LINK && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -497,7 +497,7 @@ void CtlPkt::fmtGetLinkReply(int lnk, int iface, Forest::ntyp_t ntyp,
 bool CtlPkt::xtrGetLinkReply(int& lnk, int& iface, Forest::ntyp_t& ntyp,
 		ipa_t& peerIp, ipp_t& peerPort, fAdr_t& peerAdr,
 		RateSpec& rates, RateSpec& availRates) {
-	return	type == GET_LINK && mode == REQUEST
+	return	type == GET_LINK && mode == POS_REPLY
 		&& get(lnk) && get(iface) && get(ntyp) && get(peerIp)
 		&& get(peerPort) && get(peerAdr)
 		&& get(rates) && get(availRates)
@@ -546,7 +546,7 @@ void CtlPkt::fmtGetLinkSetReply(int count, int nexti, string s, int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrGetLinkSetReply(int& count, int& nexti, string& s) {
-	return	type == GET_LINK_SET && mode == REQUEST
+	return	type == GET_LINK_SET && mode == POS_REPLY
 		&& get(count) && get(nexti) && get(s)
 		&& paylen >= (next - payload);
 }
@@ -585,7 +585,7 @@ void CtlPkt::fmtAddComtreeReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrAddComtreeReply() {
-	return	type == ADD_COMTREE && mode == REQUEST
+	return	type == ADD_COMTREE && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -627,7 +627,7 @@ void CtlPkt::fmtDropComtreeReply(RateSpec plnkAvailRates, int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrDropComtreeReply(RateSpec& plnkAvailRates) {
-	return	type == DROP_COMTREE && mode == REQUEST
+	return	type == DROP_COMTREE && mode == POS_REPLY
 		&& get(plnkAvailRates) 
 		&& paylen >= (next - payload);
 }
@@ -636,6 +636,7 @@ bool CtlPkt::xtrDropComtreeReply(RateSpec& plnkAvailRates) {
  *  @param comt is the number of the comtree to be modified
  *  @param coreFlag is 1 if the target router is a core node in the comtree, else 0,
  *  @param plnk is the link number for the link connecting to the comtree parent
+ *  (0 to leave it unchanged, negative to clear it)
  *  @param snum is the sequence number for the control packet
  */
 void CtlPkt::fmtModComtree(comt_t comt, int coreFlag, int plnk, int64_t snum) {
@@ -671,7 +672,7 @@ void CtlPkt::fmtModComtreeReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrModComtreeReply() {
-	return	type == MOD_COMTREE && mode == REQUEST
+	return	type == MOD_COMTREE && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -719,7 +720,7 @@ void CtlPkt::fmtGetComtreeReply(comt_t comt, int coreFlag, int plnk, int lnkCoun
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrGetComtreeReply(comt_t& comt, int& coreFlag, int& plnk, int& lnkCount) {
-	return	type == GET_COMTREE && mode == REQUEST
+	return	type == GET_COMTREE && mode == POS_REPLY
 		&& get(comt) && get(coreFlag) && get(plnk) && get(lnkCount) 
 		&& paylen >= (next - payload);
 }
@@ -769,7 +770,7 @@ void CtlPkt::fmtGetComtreeSetReply(int count, comt_t nextc, string s,
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrGetComtreeSetReply(int& count, comt_t& nextc, string& s) {
-	return	type == GET_COMTREE_SET && mode == REQUEST
+	return	type == GET_COMTREE_SET && mode == POS_REPLY
 		&& get(count) && get(nextc) && get(s)
 		&& paylen >= (next - payload);
 }
@@ -832,7 +833,7 @@ void CtlPkt::fmtAddComtreeLinkReply(int lnk, RateSpec availRates, int64_t snum){
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrAddComtreeLinkReply(int& lnk, RateSpec& availRates) {
-	return	type == ADD_COMTREE_LINK && mode == REQUEST
+	return	type == ADD_COMTREE_LINK && mode == POS_REPLY
 		&& get(lnk) && get(availRates) 
 		&& paylen >= (next - payload);
 }
@@ -884,7 +885,7 @@ void CtlPkt::fmtDropComtreeLinkReply(RateSpec availRates, int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrDropComtreeLinkReply(RateSpec& availRates) {
-	return	type == DROP_COMTREE_LINK && mode == REQUEST
+	return	type == DROP_COMTREE_LINK && mode == POS_REPLY
 		&& get(availRates) 
 		&& paylen >= (next - payload);
 }
@@ -937,7 +938,7 @@ void CtlPkt::fmtModComtreeLinkReply(RateSpec& availRates, int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrModComtreeLinkReply(RateSpec& availRates) {
-	return	type == MOD_COMTREE_LINK && mode == REQUEST
+	return	type == MOD_COMTREE_LINK && mode == POS_REPLY
 		&& get(availRates) 
 		&& paylen >= (next - payload);
 }
@@ -992,7 +993,7 @@ void CtlPkt::fmtGetComtreeLinkReply(comt_t comt, int lnk, RateSpec rates,
  */
 bool CtlPkt::xtrGetComtreeLinkReply(comt_t& comt, int& lnk, RateSpec& rates,
 		int& qid, fAdr_t& dest) {
-	return	type == GET_COMTREE_LINK && mode == REQUEST
+	return	type == GET_COMTREE_LINK && mode == POS_REPLY
 		&& get(comt) && get(lnk) && get(rates)
 		&& get(qid) && get(dest) 
 		&& paylen >= (next - payload);
@@ -1036,7 +1037,7 @@ void CtlPkt::fmtAddRouteReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrAddRouteReply() {
-	return	type == ADD_ROUTE && mode == REQUEST
+	return	type == ADD_ROUTE && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1078,7 +1079,7 @@ void CtlPkt::fmtDropRouteReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrDropRouteReply() {
-	return	type == DROP_ROUTE && mode == REQUEST
+	return	type == DROP_ROUTE && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1121,7 +1122,7 @@ void CtlPkt::fmtModRouteReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrModRouteReply() {
-	return	type == MOD_ROUTE && mode == REQUEST
+	return	type == MOD_ROUTE && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1171,7 +1172,7 @@ void CtlPkt::fmtGetRouteReply(comt_t comt, fAdr_t destAdr, int lnk, int64_t snum
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrGetRouteReply(comt_t& comt, fAdr_t& destAdr, int& lnk) {
-	return	type == GET_ROUTE && mode == REQUEST
+	return	type == GET_ROUTE && mode == POS_REPLY
 		&& get(comt) && get(destAdr) && get(lnk) 
 		&& paylen >= (next - payload);
 }
@@ -1223,7 +1224,7 @@ void CtlPkt::fmtGetRouteSetReply(int count, int nextRtx, string s,
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrGetRouteSetReply(int& count, int& nextRtx, string& s) {
-	return	type == GET_ROUTE_SET && mode == REQUEST
+	return	type == GET_ROUTE_SET && mode == POS_REPLY
 		&& get(count) && get(nextRtx) &&  get(s)
 		&& paylen >= (next - payload);
 }
@@ -1266,7 +1267,7 @@ void CtlPkt::fmtAddRouteLinkReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrAddRouteLinkReply() {
-	return	type == ADD_ROUTE_LINK && mode == REQUEST
+	return	type == ADD_ROUTE_LINK && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1308,10 +1309,135 @@ void CtlPkt::fmtDropRouteLinkReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrDropRouteLinkReply() {
-	return	type == DROP_ROUTE_LINK && mode == REQUEST
+	return	type == DROP_ROUTE_LINK && mode == POS_REPLY
+		&& paylen >= (next - payload);
+}
+
+/** Format an ADD_ROUTE_BATCH control packet (request).
+ *  @param pos is the position of the first tuple in the sender's
+ *  full sequence of tuples
+ *  @param v is a vector of route tuples (see CtlPkt)
+ *  @param snum is the sequence number for the control packet
+ */
+void CtlPkt::fmtAddRouteBatch(int pos, const vector<int32_t>& v,
+			      int64_t snum) {
+	type = ADD_ROUTE_BATCH; mode = REQUEST; seqNum = snum;
+	fmtBase();
+	put(pos); put(v);
+	paylen = next - payload;
+}
+
+/** Extract an ADD_ROUTE_BATCH control packet (request).
+ *  @param pos is the position of the first tuple
+ *  @param v is a vector of route tuples
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrAddRouteBatch(int& pos, vector<int32_t>& v) {
+	return	type == ADD_ROUTE_BATCH && mode == REQUEST
+		&& get(pos) && get(v)
+		&& paylen >= (next - payload);
+}
+
+/** Format an ADD_ROUTE_BATCH control packet reply.
+ *  @param pos is the position of the first tuple in the request
+ *  @param count is the number of tuples that were applied
+ *  @param failed is a vector listing the positions of the tuples
+ *  that were rejected
+ *  @param snum is the sequence number for the reply (optional)
+ */
+void CtlPkt::fmtAddRouteBatchReply(int pos, int count,
+				   const vector<int32_t>& failed, int64_t snum) {
+	type = ADD_ROUTE_BATCH; mode = POS_REPLY;
+	if (snum != 0) seqNum = snum;
+	fmtBase();
+	put(pos); put(count); put(failed);
+	paylen = next - payload;
+}
+
+/** Extract an ADD_ROUTE_BATCH control packet reply.
+ *  @param pos is the position of the first tuple in the request
+ *  @param count is the number of tuples that were applied
+ *  @param failed is the positions of the rejected tuples
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrAddRouteBatchReply(int& pos, int& count,
+				   vector<int32_t>& failed) {
+	return	type == ADD_ROUTE_BATCH && mode == POS_REPLY
+		&& get(pos) && get(count) && get(failed)
+		&& paylen >= (next - payload);
+}
+
+/** Format a DROP_ROUTE_BATCH control packet (request).
+ *  @param pos is the position of the first tuple in the sender's
+ *  full sequence of tuples
+ *  @param v is a vector of route tuples (see CtlPkt); a tuple with
+ *  no links removes the route, otherwise just the listed links
+ *  are removed from it
+ *  @param snum is the sequence number for the control packet
+ */
+void CtlPkt::fmtDropRouteBatch(int pos, const vector<int32_t>& v,
+			       int64_t snum) {
+	type = DROP_ROUTE_BATCH; mode = REQUEST; seqNum = snum;
+	fmtBase();
+	put(pos); put(v);
+	paylen = next - payload;
+}
+
+/** Extract a DROP_ROUTE_BATCH control packet (request).
+ *  @param pos is the position of the first tuple
+ *  @param v is a vector of route tuples
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrDropRouteBatch(int& pos, vector<int32_t>& v) {
+	return	type == DROP_ROUTE_BATCH && mode == REQUEST
+		&& get(pos) && get(v)
 		&& paylen >= (next - payload);
 }
 
+/** Format a DROP_ROUTE_BATCH control packet reply.
+ *  @param pos is the position of the first tuple in the request
+ *  @param count is the number of tuples that were applied
+ *  @param failed is a vector listing the positions of the tuples
+ *  that were rejected
+ *  @param snum is the sequence number for the reply (optional)
+ */
+void CtlPkt::fmtDropRouteBatchReply(int pos, int count,
+				    const vector<int32_t>& failed, int64_t snum) {
+	type = DROP_ROUTE_BATCH; mode = POS_REPLY;
+	if (snum != 0) seqNum = snum;
+	fmtBase();
+	put(pos); put(count); put(failed);
+	paylen = next - payload;
+}
+
+/** Extract a DROP_ROUTE_BATCH control packet reply.
+ *  @param pos is the position of the first tuple in the request
+ *  @param count is the number of tuples that were applied
+ *  @param failed is the positions of the rejected tuples
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrDropRouteBatchReply(int& pos, int& count,
+				    vector<int32_t>& failed) {
+	return	type == DROP_ROUTE_BATCH && mode == POS_REPLY
+		&& get(pos) && get(count) && get(failed)
+		&& paylen >= (next - payload);
+}
+
+/** Step over a tuple in a vector of route tuples.
+ *  @param v is a vector of route tuples
+ *  @param i is the index in v of the start of a tuple; on a successful
+ *  return, it is advanced to the start of the next one
+ *  @return true if the tuple lies within v, else false
+ */
+bool CtlPkt::nextRouteTuple(const vector<int32_t>& v, int& i) {
+	int n = v.size();
+	if (i < 0 || i + 3 > n) return false;
+	int nl = v[i+2];
+	if (nl < 0 || nl > n - (i+3)) return false;
+	i += 3 + nl;
+	return true;
+}
+
 /** Format a ADD_FILTER control packet (request).
  *  @param snum is the sequence number for the control packet
  */
@@ -1345,7 +1471,7 @@ void CtlPkt::fmtAddFilterReply(int filterNum, int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrAddFilterReply(int& filterNum) {
-	return	type == ADD_FILTER && mode == REQUEST
+	return	type == ADD_FILTER && mode == POS_REPLY
 		&& get(filterNum) 
 		&& paylen >= (next - payload);
 }
@@ -1384,7 +1510,7 @@ void CtlPkt::fmtDropFilterReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrDropFilterReply() {
-	return	type == DROP_FILTER && mode == REQUEST
+	return	type == DROP_FILTER && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1424,7 +1550,7 @@ void CtlPkt::fmtModFilterReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrModFilterReply() {
-	return	type == MOD_FILTER && mode == REQUEST
+	return	type == MOD_FILTER && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1466,7 +1592,7 @@ void CtlPkt::fmtGetFilterReply(string filterString, int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrGetFilterReply(string& filterString) {
-	return	type == GET_FILTER && mode == REQUEST
+	return	type == GET_FILTER && mode == POS_REPLY
 		&& get(filterString) 
 		&& paylen >= (next - payload);
 }
@@ -1514,7 +1640,7 @@ void CtlPkt::fmtGetFilterSetReply(int count, int nexti, string s,int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrGetFilterSetReply(int& count, int& nexti, string& s) {
-	return	type == GET_FILTER_SET && mode == REQUEST
+	return	type == GET_FILTER_SET && mode == POS_REPLY
 		&& get(count) && get(nexti) && get(s)
 		&& paylen >= (next - payload);
 }
@@ -1555,7 +1681,7 @@ void CtlPkt::fmtGetLoggedPacketsReply(int count, string logString,
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrGetLoggedPacketsReply(int& count, string& logString) {
-	return	type == GET_LOGGED_PACKETS && mode == REQUEST
+	return	type == GET_LOGGED_PACKETS && mode == POS_REPLY
 		&& get(count) && get(logString) 
 		&& paylen >= (next - payload);
 }
@@ -1596,7 +1722,59 @@ void CtlPkt::fmtEnablePacketLogReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrEnablePacketLogReply() {
-	return	type == ENABLE_PACKET_LOG && mode == REQUEST
+	return	type == ENABLE_PACKET_LOG && mode == POS_REPLY
+		&& paylen >= (next - payload);
+}
+
+/** Format a GET_HEAVY_HITTERS control packet (request).
+ *  @param keyType specifies how traffic is classified
+ *  (0 for source address, 1 for comtree, 2 for input link)
+ *  @param count is the number of heavy hitters to retrieve (at most 20)
+ *  @param reset is 1 if the router should start a new measurement
+ *  period after replying, else 0
+ *  @param snum is the sequence number for the control packet
+ */
+void CtlPkt::fmtGetHeavyHitters(int keyType, int count, int reset,
+				int64_t snum) {
+	type = GET_HEAVY_HITTERS; mode = REQUEST; seqNum = snum;
+	fmtBase();
+	put(keyType); put(count); put(reset);
+	paylen = next - payload;
+}
+
+/** Extract a GET_HEAVY_HITTERS control packet (request).
+ *  @param keyType specifies how traffic is classified
+ *  @param count is the number of heavy hitters to retrieve
+ *  @param reset is 1 if a new measurement period is to be started
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrGetHeavyHitters(int& keyType, int& count, int& reset) {
+	return	type == GET_HEAVY_HITTERS && mode == REQUEST
+		&& get(keyType) && get(count) && get(reset)
+		&& paylen >= (next - payload);
+}
+
+/** Format a GET_HEAVY_HITTERS control packet reply.
+ *  @param count is the number of heavy hitters listed
+ *  @param s is a string listing the heavy hitters, one per line
+ *  @param snum is the sequence number for the reply (optional)
+ */
+void CtlPkt::fmtGetHeavyHittersReply(int count, string s, int64_t snum) {
+	type = GET_HEAVY_HITTERS; mode = POS_REPLY; 
+	if (snum != 0) seqNum = snum;
+	fmtBase();
+	put(count); put(s); 
+	paylen = next - payload;
+}
+
+/** Extract a GET_HEAVY_HITTERS control packet reply.
+ *  @param count is the number of heavy hitters listed
+ *  @param s is a string listing the heavy hitters, one per line
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrGetHeavyHittersReply(int& count, string& s) {
+	return	type == GET_HEAVY_HITTERS && mode == POS_REPLY
+		&& get(count) && get(s) 
 		&& paylen >= (next - payload);
 }
 
@@ -1652,7 +1830,7 @@ void CtlPkt::fmtNewSessionReply(fAdr_t clientAdr, fAdr_t rtrAdr, ipa_t rtrIp, ip
  */
 bool CtlPkt::xtrNewSessionReply(fAdr_t& clientAdr, fAdr_t& rtrAdr, ipa_t&
 		rtrIp, ipp_t& rtrPort, uint64_t& nonce) {
-	return	type == NEW_SESSION && mode == REQUEST
+	return	type == NEW_SESSION && mode == POS_REPLY
 		&& get(clientAdr) && get(rtrAdr)
 		&& get(rtrIp) && get(rtrPort) && get(nonce) 
 		&& paylen >= (next - payload);
@@ -1694,7 +1872,7 @@ void CtlPkt::fmtCancelSessionReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrCancelSessionReply() {
-	return	type == CANCEL_SESSION && mode == REQUEST
+	return	type == CANCEL_SESSION && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1734,7 +1912,7 @@ void CtlPkt::fmtClientConnectReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrClientConnectReply() {
-	return	type == CLIENT_CONNECT && mode == REQUEST
+	return	type == CLIENT_CONNECT && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1774,7 +1952,7 @@ void CtlPkt::fmtClientDisconnectReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrClientDisconnectReply() {
-	return	type == CLIENT_DISCONNECT && mode == REQUEST
+	return	type == CLIENT_DISCONNECT && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1823,7 +2001,7 @@ void CtlPkt::fmtConfigLeafReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrConfigLeafReply() {
-	return	type == CONFIG_LEAF && mode == REQUEST
+	return	type == CONFIG_LEAF && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1864,7 +2042,7 @@ void CtlPkt::fmtSetLeafRangeReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrSetLeafRangeReply() {
-	return	type == SET_LEAF_RANGE && mode == REQUEST
+	return	type == SET_LEAF_RANGE && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1897,7 +2075,7 @@ void CtlPkt::fmtBootRouterReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrBootRouterReply() {
-	return	type == BOOT_ROUTER && mode == REQUEST
+	return	type == BOOT_ROUTER && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1930,7 +2108,7 @@ void CtlPkt::fmtBootLeafReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrBootLeafReply() {
-	return	type == BOOT_LEAF && mode == REQUEST
+	return	type == BOOT_LEAF && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1963,7 +2141,7 @@ void CtlPkt::fmtBootCompleteReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrBootCompleteReply() {
-	return	type == BOOT_COMPLETE && mode == REQUEST
+	return	type == BOOT_COMPLETE && mode == POS_REPLY
 		&& paylen >= (next - payload);
 }
 
@@ -1996,10 +2174,264 @@ void CtlPkt::fmtBootAbortReply(int64_t snum) {
  *  @return true if the extracted packet passes basic checks
  */
 bool CtlPkt::xtrBootAbortReply() {
-	return	type == BOOT_ABORT && mode == REQUEST
+	return	type == BOOT_ABORT && mode == POS_REPLY
+		&& paylen >= (next - payload);
+}
+
+/** Format a GET_TABLE control packet (request).
+ *  @param table identifies the table (see TableId)
+ *  @param first is the first index in the range of entries to return
+ *  (0 or 1 for the start of the table)
+ *  @param last is the last index in the range (0 for the end of the
+ *  table)
+ *  @param snum is the sequence number for the control packet
+ */
+void CtlPkt::fmtGetTable(int table, int first, int last, int64_t snum) {
+	type = GET_TABLE; mode = REQUEST; seqNum = snum;
+	fmtBase();
+	put(table); put(first); put(last);
+	paylen = next - payload;
+}
+
+/** Extract a GET_TABLE control packet (request).
+ *  @param table identifies the table (see TableId)
+ *  @param first is the first index in the range of entries to return
+ *  @param last is the last index in the range (0 for the end)
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrGetTable(int& table, int& first, int& last) {
+	return	type == GET_TABLE && mode == REQUEST
+		&& get(table) && get(first) && get(last)
 		&& paylen >= (next - payload);
 }
 
+/** Format a GET_TABLE control packet reply.
+ *  @param table identifies the table
+ *  @param first is the first index in the requested range
+ *  @param nxt is the index to continue from, or 0 if all entries in the
+ *  requested range are included
+ *  @param limit is the largest index in the table
+ *  @param v is the vector of encoded entries
+ *  @param snum is the sequence number for the reply (optional)
+ */
+void CtlPkt::fmtGetTableReply(int table, int first, int nxt, int limit,
+			      const vector<int32_t>& v, int64_t snum) {
+	type = GET_TABLE; mode = POS_REPLY;
+	if (snum != 0) seqNum = snum;
+	fmtBase();
+	put(TABLE_VERSION); put(table); put(first); put(nxt); put(limit);
+	put(v);
+	paylen = next - payload;
+}
+
+/** Extract a GET_TABLE control packet reply.
+ *  @param table identifies the table
+ *  @param first is the first index in the requested range
+ *  @param nxt is the index to continue from, or 0 if the range is done
+ *  @param limit is the largest index in the table
+ *  @param v is the vector of encoded entries
+ *  @return true if the extracted packet passes basic checks and uses
+ *  a version of the encoding that we understand
+ */
+bool CtlPkt::xtrGetTableReply(int& table, int& first, int& nxt, int& limit,
+			      vector<int32_t>& v) {
+	int version;
+	return	type == GET_TABLE && mode == POS_REPLY
+		&& get(version) && version == TABLE_VERSION
+		&& get(table) && get(first) && get(nxt) && get(limit)
+		&& get(v) && paylen >= (next - payload);
+}
+
+/** Format a SAVE_TABLES control packet (request).
+ *  @param snum is the sequence number for the control packet
+ */
+void CtlPkt::fmtSaveTables(int64_t snum) {
+	type = SAVE_TABLES; mode = REQUEST; seqNum = snum;
+	fmtBase();
+}
+
+/** Extract a SAVE_TABLES control packet (request).
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrSaveTables() {
+	return	type == SAVE_TABLES && mode == REQUEST
+		&& paylen >= (next - payload);
+}
+
+/** Format a SAVE_TABLES control packet reply.
+ *  @param snum is the sequence number for the reply (optional)
+ */
+void CtlPkt::fmtSaveTablesReply(int64_t snum) {
+	type = SAVE_TABLES; mode = POS_REPLY;
+	if (snum != 0) seqNum = snum;
+	fmtBase();
+}
+
+/** Extract a SAVE_TABLES control packet reply.
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrSaveTablesReply() {
+	return	type == SAVE_TABLES && mode == POS_REPLY
+		&& paylen >= (next - payload);
+}
+
+/** Format a STAGE_TRACE control packet (request).
+ *  @param rate is the new sample rate for pipeline tracing (every
+ *  rate-th packet is traced, 0 turns tracing off), or -1 to leave the
+ *  rate unchanged
+ *  @param fileName is the name of a file in the router's trace
+ *  directory to which the recorded events are to be written, or ""
+ *  to skip the dump
+ *  @param snum is the sequence number for the control packet
+ */
+void CtlPkt::fmtStageTrace(int rate, string fileName, int64_t snum) {
+	type = STAGE_TRACE; mode = REQUEST; seqNum = snum;
+	fmtBase();
+	put(rate); put(fileName);
+	paylen = next - payload;
+}
+
+/** Extract a STAGE_TRACE control packet (request).
+ *  @param rate is a reference used to return the new sample rate
+ *  @param fileName is a reference used to return the dump file name
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrStageTrace(int& rate, string& fileName) {
+	return	type == STAGE_TRACE && mode == REQUEST
+		&& get(rate) && get(fileName)
+		&& paylen >= (next - payload);
+}
+
+/** Format a STAGE_TRACE control packet reply.
+ *  @param rate is the sample rate now in effect
+ *  @param count is the number of events written to the file (0 if
+ *  no file was requested)
+ *  @param snum is the sequence number for the reply (optional)
+ */
+void CtlPkt::fmtStageTraceReply(int rate, int count, int64_t snum) {
+	type = STAGE_TRACE; mode = POS_REPLY;
+	if (snum != 0) seqNum = snum;
+	fmtBase();
+	put(rate); put(count);
+	paylen = next - payload;
+}
+
+/** Extract a STAGE_TRACE control packet reply.
+ *  @param rate is a reference used to return the sample rate
+ *  @param count is a reference used to return the number of events
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrStageTraceReply(int& rate, int& count) {
+	return	type == STAGE_TRACE && mode == POS_REPLY
+		&& get(rate) && get(count)
+		&& paylen >= (next - payload);
+}
+
+/** Format a GET_ROUTER_STATS control packet (request).
+ *  @param snum is the sequence number for the control packet
+ */
+void CtlPkt::fmtGetRouterStats(int64_t snum) {
+	type = GET_ROUTER_STATS; mode = REQUEST; seqNum = snum;
+	fmtBase();
+}
+
+/** Extract a GET_ROUTER_STATS control packet (request).
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrGetRouterStats() {
+	return	type == GET_ROUTER_STATS && mode == REQUEST
+		&& paylen >= (next - payload);
+}
+
+/** Format a GET_ROUTER_STATS control packet reply.
+ *  @param s is a string listing the router's statistics, one group
+ *  per line
+ *  @param snum is the sequence number for the reply (optional)
+ */
+void CtlPkt::fmtGetRouterStatsReply(string s, int64_t snum) {
+	type = GET_ROUTER_STATS; mode = POS_REPLY;
+	if (snum != 0) seqNum = snum;
+	fmtBase();
+	put(s);
+	paylen = next - payload;
+}
+
+/** Extract a GET_ROUTER_STATS control packet reply.
+ *  @param s is a string listing the router's statistics
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrGetRouterStatsReply(string& s) {
+	return	type == GET_ROUTER_STATS && mode == POS_REPLY
+		&& get(s) && paylen >= (next - payload);
+}
+
+/** Format a COMPOUND control packet (request).
+ *  The operations are added afterwards, using putOp.
+ *  @param snum is the sequence number for the control packet
+ */
+void CtlPkt::fmtCompound(int64_t snum) {
+	type = COMPOUND; mode = REQUEST; seqNum = snum;
+	fmtBase();
+}
+
+/** Extract a COMPOUND control packet (request).
+ *  The operations are retrieved afterwards, using getOp.
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrCompound() {
+	return	type == COMPOUND && mode == REQUEST && xtrBase();
+}
+
+/** Format a COMPOUND control packet reply.
+ *  The replies to the individual operations are added afterwards,
+ *  using putOp.
+ *  @param snum is the sequence number for the reply (optional)
+ */
+void CtlPkt::fmtCompoundReply(int64_t snum) {
+	type = COMPOUND; mode = POS_REPLY;
+	if (snum != 0) seqNum = snum;
+	fmtBase();
+}
+
+/** Extract a COMPOUND control packet reply.
+ *  The replies to the individual operations are retrieved afterwards,
+ *  using getOp.
+ *  @return true if the extracted packet passes basic checks
+ */
+bool CtlPkt::xtrCompoundReply() {
+	return	type == COMPOUND && mode == POS_REPLY && xtrBase();
+}
+
+/** Add a control packet to the end of a COMPOUND packet.
+ *  @param op is a formatted control packet
+ *  @return true on success, false if there is not enough space for it
+ */
+bool CtlPkt::putOp(const CtlPkt& op) {
+	if (op.paylen > availSpace()) return false;
+	*((int16_t*) next) = htons(ctlOp);		next+=sizeof(int16_t);
+	*((int16_t*) next) = htons((int16_t) op.paylen); next+=sizeof(int16_t);
+	std::copy(op.payload, op.payload+op.paylen, next); next+=op.paylen;
+	paylen = next - payload;
+	return true;
+}
+
+/** Get the next control packet from a COMPOUND packet.
+ *  @param op is a control packet that is set to refer to the next
+ *  operation in place; its base fields are extracted
+ *  @return true on success, false if there are no more operations
+ *  or the next one is malformed
+ */
+bool CtlPkt::getOp(CtlPkt& op) {
+	char *end = payload + paylen;
+	if (next + 2*sizeof(int16_t) > end) return false;
+	if (ntohs(*((int16_t*) next)) != ctlOp) return false;
+	int len = ntohs(*((int16_t*) (next+sizeof(int16_t))));
+	if (next + 2*sizeof(int16_t) + len > end) return false;
+	op.payload = next + 2*sizeof(int16_t); op.paylen = len;
+	next += 2*sizeof(int16_t) + len;
+	return op.xtrBase();
+}
+
 /** Create a string representing an (attribute,value) pair.
  *  @param attr is an attribute code
  *  @return a string representing attr
@@ -2121,6 +2553,8 @@ string CtlPkt::cpType2string(CpType type) {
 	case MOD_ROUTE: s = "mod_route"; break;
 	case ADD_ROUTE_LINK: s = "add_route_link"; break;
 	case DROP_ROUTE_LINK: s = "drop_route_link"; break;
+	case ADD_ROUTE_BATCH: s = "add_route_batch"; break;
+	case DROP_ROUTE_BATCH: s = "drop_route_batch"; break;
 
 	case ADD_FILTER: s = "add_filter"; break;
 	case DROP_FILTER: s = "drop_filter"; break;
@@ -2129,6 +2563,7 @@ string CtlPkt::cpType2string(CpType type) {
 	case GET_FILTER_SET: s = "get_filter_set"; break;
 	case GET_LOGGED_PACKETS: s = "get_logged_packets"; break;
 	case ENABLE_PACKET_LOG: s = "enable_packet_log"; break;
+	case GET_HEAVY_HITTERS: s = "get_heavy_hitters"; break;
 
 	case NEW_SESSION: s = "new_session"; break;
 	case CANCEL_SESSION: s = "cancel_session"; break;
@@ -2144,6 +2579,11 @@ string CtlPkt::cpType2string(CpType type) {
 	case ADD_NODE: s = "comtree_new_leaf"; break;
 	case ADD_BRANCH: s = "comtree_add_branch"; break;
 	case PRUNE: s = "comtree_prune"; break;
+	case GET_TABLE: s = "get_table"; break;
+	case SAVE_TABLES: s = "save_tables"; break;
+	case STAGE_TRACE: s = "stage_trace"; break;
+	case GET_ROUTER_STATS: s = "get_router_stats"; break;
+	case COMPOUND: s = "compound"; break;
 	default: s = "undefined"; break;
 	}
 	return s;
@@ -2179,6 +2619,8 @@ bool CtlPkt::string2cpType(string& s, CpType& type) {
 	else if (s == "mod_route") type = MOD_ROUTE;
 	else if (s == "add_route_link") type = ADD_ROUTE;
 	else if (s == "drop_route_link") type = DROP_ROUTE;
+	else if (s == "add_route_batch") type = ADD_ROUTE_BATCH;
+	else if (s == "drop_route_batch") type = DROP_ROUTE_BATCH;
 
 	else if (s == "add_filter") type = ADD_FILTER;
 	else if (s == "drop_filter") type = DROP_FILTER;
@@ -2187,6 +2629,7 @@ bool CtlPkt::string2cpType(string& s, CpType& type) {
 	else if (s == "get_filter_set") type = GET_FILTER_SET;
 	else if (s == "get_logged_packets") type = GET_LOGGED_PACKETS;
 	else if (s == "enable_packet_log") type = ENABLE_PACKET_LOG;
+	else if (s == "get_heavy_hitters") type = GET_HEAVY_HITTERS;
 
 	else if (s == "new_session") type = NEW_SESSION;
 	else if (s == "cancel_session") type = CANCEL_SESSION;
@@ -2205,6 +2648,11 @@ bool CtlPkt::string2cpType(string& s, CpType& type) {
 	else if (s == "comtree_new_leaf") type = ADD_NODE;
 	else if (s == "comtree_add_branch") type = ADD_BRANCH;
 	else if (s == "comtree_prune") type = PRUNE;
+	else if (s == "get_table") type = GET_TABLE;
+	else if (s == "save_tables") type = SAVE_TABLES;
+	else if (s == "stage_trace") type = STAGE_TRACE;
+	else if (s == "get_router_stats") type = GET_ROUTER_STATS;
+	else if (s == "compound") type = COMPOUND;
 
 	else return false;
 	return true;
@@ -2245,6 +2693,7 @@ string CtlPkt::toString() {
 	}
 
 	int iface, lnk, coreFlag, qid, fltr, count, enable, local;
+	int keyType, reset;
 	comt_t comt; RateSpec rs1, rs2;
 	ipa_t ip1; ipp_t port1;
 	fAdr_t adr1, adr2;
@@ -2509,6 +2958,24 @@ string CtlPkt::toString() {
 			ss << " " << lnk;
 		}
 		break;
+	case ADD_ROUTE_BATCH:
+	case DROP_ROUTE_BATCH: {
+		int pos; vector<int32_t> v;
+		if (mode == REQUEST) {
+			if (type == ADD_ROUTE_BATCH) xtrAddRouteBatch(pos,v);
+			else xtrDropRouteBatch(pos,v);
+			int n = 0;
+			for (int i = 0; nextRouteTuple(v,i); ) n++;
+			ss << " " << pos << " (" << n << " routes)";
+		} else {
+			if (type == ADD_ROUTE_BATCH)
+				xtrAddRouteBatchReply(pos,count,v);
+			else	xtrDropRouteBatchReply(pos,count,v);
+			ss << " " << pos << " " << count;
+			if (v.size() > 0) ss << " (" << v.size() << " failed)";
+		}
+		}
+		break;
 
 	case ADD_FILTER:
 		if (mode == POS_REPLY) {
@@ -2563,6 +3030,46 @@ string CtlPkt::toString() {
 			ss << " " << (local ? "local" : "remote");
 		}
 		break;
+	case GET_HEAVY_HITTERS:
+		if (mode == REQUEST) {
+			xtrGetHeavyHitters(keyType,count,reset);
+			ss << " " << keyType << " " << count;
+			ss << (reset ? " reset" : "");
+		} else {
+			xtrGetHeavyHittersReply(count,s);
+			ss << " " << count << " " << s;
+		}
+		break;
+	case GET_TABLE: {
+		int table, first, last, limit;
+		if (mode == REQUEST) {
+			xtrGetTable(table,first,last);
+			ss << " " << table << " " << first << " " << last;
+		} else {
+			vector<int32_t> v;
+			xtrGetTableReply(table,first,last,limit,v);
+			ss << " " << table << " " << first << " " << last
+			   << " " << limit << " (" << v.size() << " words)";
+		}
+		}
+		break;
+	case STAGE_TRACE: {
+		int rate;
+		if (mode == REQUEST) {
+			xtrStageTrace(rate,s);
+			ss << " " << rate << " " << s;
+		} else {
+			xtrStageTraceReply(rate,count);
+			ss << " " << rate << " " << count;
+		}
+		}
+		break;
+	case GET_ROUTER_STATS:
+		if (mode != REQUEST) {
+			xtrGetRouterStatsReply(s);
+			ss << "\n" << s;
+		}
+		break;
 
 	case NEW_SESSION:
 		if (mode == REQUEST) {
@@ -2621,6 +3128,14 @@ string CtlPkt::toString() {
 	case BOOT_COMPLETE:
 	case BOOT_ABORT:
 		break;
+	case COMPOUND: {
+		CtlPkt op;
+		while (getOp(op)) {
+			s = op.toString();
+			ss << "\n    " << s.substr(0,s.length()-1);
+		}
+		}
+		break;
 
 /*
 	case COMTREE_PATH:
@@ -0,0 +1,183 @@
+/** @file LinkSocks.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include <chrono>
+#include "LinkSocks.h"
+
+using namespace std::chrono;
+
+namespace forest {
+
+/** Constructor for LinkSocks.
+ *  @param ps1 is the packet store used for received packets
+ *  @param maxLnk1 is the largest link number
+ */
+LinkSocks::LinkSocks(PacketStore *ps1, int maxLnk1)
+		     : ps(ps1), maxLnk(maxLnk1) {
+	epfd = epoll_create1(0);
+	sock = new atomic<int>[maxLnk+1];
+	peerIp = new ipa_t[maxLnk+1]; peerPort = new ipp_t[maxLnk+1];
+	for (int lnk = 0; lnk <= maxLnk; lnk++) {
+		sock[lnk].store(-1); peerIp[lnk] = 0; peerPort[lnk] = 0;
+	}
+	rcvPkts = sndPkts = sndErrs = 0;
+}
+
+LinkSocks::~LinkSocks() {
+	for (int lnk = 1; lnk <= maxLnk; lnk++) {
+		if (sock[lnk] >= 0) ::close(sock[lnk]);
+	}
+	for (Retired& r : retired) ::close(r.sock);
+	if (epfd >= 0) ::close(epfd);
+	delete [] sock; delete [] peerIp; delete [] peerPort;
+}
+
+/** Allow a socket to share its address and port with link sockets.
+ *  Must be called before the socket is bound.
+ *  @param s is a socket
+ *  @return true on success, false on failure
+ */
+bool LinkSocks::shareSock(int s) {
+	int on = 1;
+	return setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == 0;
+}
+
+/** Open a connected socket for a link.
+ *  Any socket the link already has is closed first.
+ *  @param lnk is the link number
+ *  @param myIp is the IP address of the link's interface
+ *  @param myPort is the port number of the link's interface
+ *  @param ip is the IP address of the peer
+ *  @param port is the port number of the peer
+ *  @return true on success, false on failure
+ */
+bool LinkSocks::open(int lnk, ipa_t myIp, ipp_t myPort, ipa_t ip, ipp_t port) {
+	if (lnk < 1 || lnk > maxLnk || epfd < 0) return false;
+	close(lnk);
+	int s = Np4d::datagramSocket();
+	if (s < 0) return false;
+	if (!shareSock(s) || !Np4d::bind4d(s, myIp, myPort) ||
+	    !Np4d::connect4d(s, ip, port) || !Np4d::nonblock(s)) {
+		::close(s); return false;
+	}
+	int bsiz = (1 << 18);
+	setsockopt(s, SOL_SOCKET, SO_RCVBUF, (void *) &bsiz, sizeof(bsiz));
+	peerIp[lnk] = ip; peerPort[lnk] = port;
+	epoll_event ev; ev.events = EPOLLIN; ev.data.u32 = lnk;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, s, &ev) < 0) {
+		::close(s); return false;
+	}
+	sock[lnk].store(s);
+	return true;
+}
+
+/** Close the socket for a link, if it has one.
+ *  Packets from the peer are then received on the interface socket.
+ *  @param lnk is the link number
+ */
+void LinkSocks::close(int lnk) {
+	if (lnk < 1 || lnk > maxLnk) return;
+	int s = sock[lnk].exchange(-1);
+	if (s < 0) return;
+	epoll_ctl(epfd, EPOLL_CTL_DEL, s, 0);
+	Retired r; r.sock = s;
+	r.when = steady_clock::now().time_since_epoch().count();
+	unique_lock<mutex> lck(retMtx);
+	retired.push_back(r);
+}
+
+/** Release sockets that were closed at least a second ago.
+ */
+void LinkSocks::release() {
+	unique_lock<mutex> lck(retMtx, try_to_lock);
+	if (!lck.owns_lock() || retired.size() == 0) return;
+	int64_t limit = steady_clock::now().time_since_epoch().count()
+			- nanoseconds(seconds(1)).count();
+	for (int i = retired.size() - 1; i >= 0; i--) {
+		if (retired[i].when > limit) continue;
+		::close(retired[i].sock);
+		retired[i] = retired.back(); retired.pop_back();
+	}
+}
+
+/** Receive packets from the link sockets.
+ *  At most one packet is read from each ready socket.
+ *  @param pxv is an array in which the received packets are returned;
+ *  the bufferLen, tunIp, tunPort and inLink fields of each packet are
+ *  set, but the packets are not unpacked
+ *  @param lnkv is an array in which the links on which the packets
+ *  arrived are returned
+ *  @param n is the maximum number of packets to return
+ *  @return the number of packets returned, or -1 on an error
+ */
+int LinkSocks::recv(pktx *pxv, int *lnkv, int n) {
+	release();
+	int nRdy = epoll_wait(epfd, evt, min(n, (int) BATCH), 0);
+	if (nRdy < 0) return (errno == EINTR ? 0 : -1);
+	int cnt = 0;
+	for (int i = 0; i < nRdy; i++) {
+		int lnk = evt[i].data.u32;
+		int s = sock[lnk].load();
+		if (s < 0) continue;
+		pktx px = ps->alloc();
+		if (px == 0) break; // leave packet in socket buffer
+		Packet& p = ps->getPacket(px);
+		int nbytes = ::recv(s, (void *) p.buffer, 1500, MSG_DONTWAIT);
+		if (nbytes < 0) {
+			// ECONNREFUSED reports an ICMP error from the peer
+			ps->free(px);
+			if (errno == EAGAIN || errno == ECONNREFUSED) continue;
+			return -1;
+		}
+		p.bufferLen = nbytes; p.inLink = lnk;
+		p.tunIp = peerIp[lnk]; p.tunPort = peerPort[lnk];
+		pxv[cnt] = px; lnkv[cnt] = lnk; cnt++;
+	}
+	rcvPkts += cnt;
+	return cnt;
+}
+
+/** Send a packet on a link socket.
+ *  @param lnk is the link on which the packet is to be sent
+ *  @param px is the index of the packet; it is freed once sent
+ *  @return true on success, false on failure
+ */
+bool LinkSocks::send(int lnk, pktx px) {
+	Packet& p = ps->getPacket(px);
+	int s = sock[lnk].load();
+	if (s < 0) { // socket closed since caller checked
+		ps->free(px); sndErrs++; return true;
+	}
+	int rv, lim = 0;
+	do {
+		rv = ::send(s, (void *) p.buffer, p.length, 0);
+	} while (rv == -1 && errno == EAGAIN && lim++ < 10);
+	ps->free(px);
+	if (rv == -1) {
+		// peer not listening; same outcome as an unconnected sendto
+		if (errno == ECONNREFUSED) { sndErrs++; return true; }
+		return false;
+	}
+	sndPkts++;
+	return true;
+}
+
+/** Create a string representation of the link socket statistics.
+ *  @return the string
+ */
+string LinkSocks::toString() const {
+	stringstream ss;
+	int n = 0;
+	for (int lnk = 1; lnk <= maxLnk; lnk++) if (hasLink(lnk)) n++;
+	ss << n << " connected links, received " << rcvPkts
+	   << " packets, sent " << sndPkts << " packets, "
+	   << sndErrs << " not delivered";
+	return ss.str();
+}
+
+} // ends namespace
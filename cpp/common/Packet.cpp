@@ -12,7 +12,7 @@
 namespace forest {
 
 Packet::Packet() {
-	version = 1; buffer = 0;
+	version = 1; buffer = 0; rcvSeqNum = 0;
 }
 
 Packet::~Packet() {}
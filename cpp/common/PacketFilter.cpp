@@ -41,7 +41,29 @@ bool PacketFilter::fromString(string& s) {
 		 buf.readPktType(type) &&
 		 buf.readCpType(cpType));
 }
-		
+
+/** Constructor for FilterIndex, creates an index with no filters. */
+FilterIndex::FilterIndex() : defined(false) {}
+
+/** Add a filter to the index.
+ *  Disabled filters match nothing, but adding one still means that
+ *  a packet must match some filter to be logged.
+ *  @param f is the filter number (must be less than SIZE)
+ *  @param pf is the filter
+ */
+void FilterIndex::add(int f, const PacketFilter& pf) {
+	defined = true;
+	if (!pf.on) return;
+	if (pf.in) dir[0].set(f);
+	if (pf.out) dir[1].set(f);
+	lnk.add(f, pf.lnk);
+	comt.add(f, pf.comt);
+	srcAdr.add(f, pf.srcAdr);
+	dstAdr.add(f, pf.dstAdr);
+	if (pf.type == Forest::UNDEF_PKT) anyType.set(f);
+	else type[pf.type & 0xff].set(f);
+	cpType.add(f, pf.cpType);
+}
 
 } // ends namespace
 
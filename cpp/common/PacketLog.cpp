@@ -11,71 +11,129 @@
 namespace forest {
 
 /** Constructor for PacketLog, allocates space and initializes private data.
+ *  Also starts the exporter thread that drains the capture rings.
  */
 PacketLog::PacketLog(PacketStore *ps1) : ps(ps1) {
 	evec = new EventStruct[MAX_EVENTS];
 	eventCount = firstEvent = lastEvent = 0;
 	fvec = new PacketFilter[MAX_FILTERS+1];
 	filters = new ListPair(MAX_FILTERS);
+	findex = new FilterIndex();
+	hazard[IN_RING] = hazard[OUT_RING] = findex.load();
 
 	firstEvent = lastEvent = eventCount = 0;
 	dumpTime = 0;
 
+	cap = new PktCapture(2, RING_SLOTS, SNAP_LEN);
+	dropSeen = new uint64_t[cap->rings()];
+	for (int r = 0; r < cap->rings(); r++) dropSeen[r] = 0;
+	epoch = 0;
+	sbuf = new buffer_t[1]; sp.buffer = sbuf;
+
 	// default behavior just logs all packets to stdout
 	logOn = true; logLocal = true;
 	numOut = numDataOut = 0;
+
+	quit = false;
+	exporter = thread(&PacketLog::run, this);
+}
+
+/** Destructor for PacketLog, stops the exporter and deletes allocated space.
+ */
+PacketLog::~PacketLog() {
+	quit = true; exporter.join();
+	delete [] evec; delete [] fvec; delete filters;
+	delete cap; delete [] dropSeen; delete [] sbuf;
+	delete findex.load();
+	for (const FilterIndex *fi : retired) delete fi;
+}
+
+/** Start writing logged packets to a pcapng file.
+ *  Every packet that is saved in the log from now on is also written
+ *  to the file.
+ *  @param fileName is the name of the file
+ *  @param epoch1 is the wall-clock time (ns since the epoch) that
+ *  corresponds to the router's time 0
+ *  @return true on success, false if the file could not be created
+ */
+bool PacketLog::openPcap(const string& fileName, uint64_t epoch1) {
+	unique_lock<recursive_mutex> lck(mtx);
+	epoch = epoch1;
+	return pcap.create(fileName, SNAP_LEN);
 }
 
-/** Destructor for PacketLog, deletes allocated space */
-PacketLog::~PacketLog() { delete [] evec; delete [] fvec; delete filters; }
+/** Main loop of the exporter thread.
+ *  Drains the capture rings, sleeping briefly whenever they are empty.
+ *  On exit, whatever is left in the rings is drained and the pcapng
+ *  file is closed.
+ */
+void PacketLog::run() {
+	while (!quit) {
+		if (drain() == 0)
+			this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	while (drain() > 0) {}
+	unique_lock<recursive_mutex> lck(mtx);
+	pcap.close();
+}
 
-/** Log a packet if it matches a stored filter.
- *  @param p is the number of the packet to be logged
- *  @param lnk is the link the packet is being sent on (or was received from)
- *  @param sendFlag is true if the packet is being sent; else it is false
- *  @param now is the time at which the packet is being sent/received
- *  Received packet is compared to all enabled filters. If it matches
- *  any filter, a copy is made and saved in the log. If the packet
- *  can't be saved, we record a "gap" in the log. If several packets
- *  in a row cannot be logged, the number of missing packets is
- *  recorded as part of the gap record.
- *  If no filters are defined, we log every packet.
+/** Move captured packets from the capture rings into the log.
+ *  Records are taken from the rings in time order, so packets sent
+ *  and received are interleaved correctly.
+ *  @return the number of records processed
  */
-void PacketLog::loggit(pktx px, int lnk, bool sendFlag, uint64_t now) {
+int PacketLog::drain() {
 	unique_lock<recursive_mutex> lck(mtx);
-	if (firstFilter() != 0) {
-		for (fltx f = firstFilter(); f != 0; f = nextFilter(f)) {
-			if (match(f,px,lnk,sendFlag)) break;
-			if (nextFilter(f) == 0) return; // no filters match
+	int n = 0;
+	for (int r = 0; r < cap->rings(); r++) {
+		uint64_t d = cap->dropped(r);
+		if (d != dropSeen[r]) {
+			const PktCapture::RecHdr *h = cap->peek(r);
+			uint64_t t = (h != 0 ? h->time : (eventCount > 0 ?
+					evec[lastEvent].time : 0));
+			addGap(d - dropSeen[r], t);
+			dropSeen[r] = d;
 		}
 	}
-	// reach here if no filters or packet matched some filter
-	// make a record in event vector
-	int px1 = ps->fullCopy(px);
-	if (px1 == 0 || eventCount == MAX_EVENTS) { // record gap
-		if (px1 != 0) ps->free(px1);
-		// use px == 0 to indicate gap in sequence
-		// for these records, link field is used to record
-		// number of packets that were missed (size of gap)
-		if (eventCount > 0 && evec[lastEvent].px == 0) {
-			// existing gap record
-			evec[lastEvent].link++;
-		} else {
-			// convert last record to a gap record
-			evec[lastEvent].px = 0;
-			evec[lastEvent].link = 1;
-			evec[lastEvent].time = now;
-			if (eventCount == 0) eventCount = 1;
+	while (n < DRAIN_BATCH) {
+		int rr = -1; const PktCapture::RecHdr *hh = 0;
+		for (int r = 0; r < cap->rings(); r++) {
+			const PktCapture::RecHdr *h = cap->peek(r);
+			if (h != 0 && (hh == 0 || h->time < hh->time)) {
+				rr = r; hh = h;
+			}
 		}
+		if (hh == 0) break;
+		loggit(hh); cap->pop(rr); n++;
+	}
+	return n;
+}
+
+/** Save a captured packet in the log.
+ *  @param h points to the header of a record in a capture ring
+ *  The packet has already been matched against the filters in log().
+ *  A copy is saved in the log (and written to the pcapng file, if
+ *  there is one). If the log is full, we record a "gap" in the log.
+ *  If several packets in a row cannot be logged, the number of missing
+ *  packets is recorded as part of the gap record.
+ */
+void PacketLog::loggit(const PktCapture::RecHdr *h) {
+	const char *data = PktCapture::data(h);
+	if (pcap.isOpen())
+		pcap.write(epoch + h->time, h->link, h->out, data,
+			   h->capLen, h->len);
+	uint64_t now = h->time;
+	if (eventCount == MAX_EVENTS) {
+		addGap(1, now);
 	} else {
 		// common case - just add new record for packet
 		if (eventCount > 0)
 			if (++lastEvent >= MAX_EVENTS) lastEvent = 0;
 		eventCount++;
-		evec[lastEvent].px = px1;
-		evec[lastEvent].sendFlag = sendFlag;
-		evec[lastEvent].link = lnk;
-		evec[lastEvent].time = now;
+		EventStruct& e = evec[lastEvent];
+		e.len = h->len; e.capLen = h->capLen;
+		e.sendFlag = h->out; e.link = h->link; e.time = now;
+		memcpy(e.data, data, h->capLen);
 	}
 	if (!logLocal) return;
 	// optionally write log entries to cout once per second
@@ -84,7 +142,71 @@ void PacketLog::loggit(pktx px, int lnk, bool sendFlag, uint64_t now) {
 	write(cout);
 	// stop logging when we hit the output limit while logging locally
 	// can stil re-enable logging
-	if (numOut > OUT_LIMIT) logOn = logLocal = false;
+	if (numOut > OUT_LIMIT) { logOn = false; logLocal = false; }
+}
+
+/** Record a gap in the log.
+ *  Gaps are recorded using event records with len == 0; for these
+ *  records, the link field is used to record the number of packets
+ *  that were missed (size of gap).
+ *  @param n is the number of missing packets
+ *  @param now is the time of the gap
+ */
+void PacketLog::addGap(int n, uint64_t now) {
+	if (eventCount > 0 && evec[lastEvent].len == 0) {
+		// existing gap record
+		evec[lastEvent].link += n;
+	} else if (eventCount < MAX_EVENTS) {
+		// add a new gap record
+		if (eventCount > 0)
+			if (++lastEvent >= MAX_EVENTS) lastEvent = 0;
+		eventCount++;
+		evec[lastEvent].len = 0;
+		evec[lastEvent].link = n;
+		evec[lastEvent].time = now;
+	} else {
+		// convert last record to a gap record
+		evec[lastEvent].len = 0;
+		evec[lastEvent].link = n + 1;
+		evec[lastEvent].time = now;
+	}
+}
+
+/** Copy a saved packet into the scratch buffer and unpack its header.
+ *  Bytes of the packet that were not captured are set to zero.
+ *  @param data points to the saved bytes
+ *  @param capLen is the number of saved bytes
+ *  @param len is the length of the original packet
+ *  @return true if the header was unpacked successfully
+ */
+bool PacketLog::unpackScratch(const char* data, int capLen, int len) {
+	int bufLen = sizeof(buffer_t);
+	if (len > bufLen) len = bufLen;
+	if (capLen > len) capLen = len;
+	memcpy(sbuf, data, capLen);
+	if (len > capLen) memset(((char*) sbuf) + capLen, 0, len - capLen);
+	return sp.unpack();
+}
+
+/** Create a string representation of an event record.
+ *  @param e is an event record
+ *  @return the string
+ */
+string PacketLog::event2string(const EventStruct& e) {
+	stringstream ss;
+	ss << nstime2string(e.time);
+	if (e.len == 0) {
+		ss << " missing " << e.link << " packets " << endl;
+		return ss.str();
+	}
+	if (e.sendFlag) ss << " send ";
+	else		ss << " recv ";
+	ss << "link " << setw(2) << e.link;
+	if (unpackScratch(e.data, e.capLen, e.len))
+		ss << " " << sp.toString();
+	else
+		ss << " bad packet header" << endl;
+	return ss.str();
 }
 
 /** Write all logged packets.
@@ -92,34 +214,19 @@ void PacketLog::loggit(pktx px, int lnk, bool sendFlag, uint64_t now) {
  */
 void PacketLog::write(ostream& out) {
 	unique_lock<recursive_mutex> lck(mtx);
-	stringstream ss;
 	while (eventCount > 0) {
-		int px = evec[firstEvent].px;
+		EventStruct& e = evec[firstEvent];
 		if (numOut <= OUT_LIMIT) {
-			string s;
-			out << nstime2string(evec[firstEvent].time);
-			if (px == 0) {
-				out << " missing " << evec[firstEvent].link
-				    << " packets " << endl;
+			bool isData = (e.len != 0 && e.capLen >= 4 &&
+				       (Forest::ptyp_t) ((ntohl(*(uint32_t*)
+					e.data) >> 8) & 0xff) ==
+				       Forest::CLIENT_DATA);
+			if (!isData || numDataOut <= DATA_OUT_LIMIT) {
+				out << event2string(e);
 				numOut++;
-			} else {
-				Packet& p = ps->getPacket(px);
-				if (p.type != Forest::CLIENT_DATA ||
-				    numDataOut <= DATA_OUT_LIMIT) {
-					if (evec[firstEvent].sendFlag)
-						out << " send ";
-					else
-						out << " recv ";
-					out << "link " << setw(2)
-					    << evec[firstEvent].link;
-					out << " " << p.toString();
-					numOut++;
-					if (p.type == Forest::CLIENT_DATA)
-						numDataOut++;
-				}
+				if (isData) numDataOut++;
 			}
 		}
-		ps->free(px);
 		if (--eventCount > 0)
 			if (++firstEvent >= MAX_EVENTS) firstEvent = 0;
 	}
@@ -130,11 +237,7 @@ void PacketLog::write(ostream& out) {
  */
 void PacketLog::purge() {
 	unique_lock<recursive_mutex> lck(mtx);
-	while (eventCount > 0) {
-		ps->free(evec[firstEvent].px);
-		eventCount--;
-		if (++firstEvent >= MAX_EVENTS) firstEvent = 0;
-	}
+	eventCount = firstEvent = lastEvent = 0;
 }
 
 /** Extract event records from the log for delivery to remote client.
@@ -149,24 +252,11 @@ int PacketLog::extract(int maxLen, string& s) {
 	unique_lock<recursive_mutex> lck(mtx);
 	if (firstFilter() == 0) { return 0; }
 	logLocal = false;
-	stringstream ss;
 	int count = 0; s = "";
 	while (eventCount > 0) {
-		ss.str("");
-		int px = evec[firstEvent].px;
-		ss << nstime2string(evec[firstEvent].time);
-		if (px == 0) {
-			ss << " missing " << evec[firstEvent].link
-			   << " packets " << endl;
-		} else {
-			if (evec[firstEvent].sendFlag)	ss << " send ";
-			else				ss << " recv ";
-			ss << "link " << setw(2) << evec[firstEvent].link;
-			ss << " " << ps->getPacket(px).toString();
-		}
-		if (s.length() + ss.str().length() > maxLen) break;
-		s += ss.str();
-		ps->free(px);
+		string es = event2string(evec[firstEvent]);
+		if (s.length() + es.length() > maxLen) break;
+		s += es;
 		count++;
 		if (--eventCount > 0)
 			if (++firstEvent >= MAX_EVENTS) firstEvent = 0;
@@ -186,11 +276,58 @@ int PacketLog::addFilter() {
 	return f;
 }
 
+/** Replace a filter.
+ *  @param f is the index of some valid filter
+ *  @param pf is the new value of the filter
+ */
+void PacketLog::setFilter(fltx f, const PacketFilter& pf) {
+	unique_lock<recursive_mutex> lck(mtx);
+	if (!filters->isIn(f)) return;
+	fvec[f] = pf; recompile();
+}
+
 /** Remves a filter from the table.  */
 void PacketLog::dropFilter(fltx f) {
 	unique_lock<recursive_mutex> lck(mtx);
 	if (!filters->isIn(f)) return;
-	disable(f); filters->swap(f);
+	fvec[f].on = false; filters->swap(f);
+	recompile();
+}
+
+/** Build a new filter index and swap it in for the current one.
+ *  The old index is retired and deleted once no packet thread is
+ *  using it. Must be called with mtx held.
+ */
+void PacketLog::recompile() {
+	FilterIndex *fi = new FilterIndex();
+	for (fltx f = filters->firstIn(); f != 0; f = filters->nextIn(f))
+		fi->add(f, fvec[f]);
+	retired.push_back(findex.exchange(fi));
+	size_t n = 0;
+	for (size_t i = 0; i < retired.size(); i++) {
+		if (retired[i] == hazard[IN_RING].load() ||
+		    retired[i] == hazard[OUT_RING].load())
+			retired[n++] = retired[i];
+		else
+			delete retired[i];
+	}
+	retired.resize(n);
+}
+
+/** Publish the current filter index in a thread's hazard pointer.
+ *  Called by a packet thread when the index has changed since it last
+ *  used it.
+ *  @param r is the number of the caller's capture ring
+ *  @return the current index, which is safe to use until the next call
+ */
+const FilterIndex* PacketLog::protect(int r) {
+	const FilterIndex *fi = findex.load();
+	while (true) {
+		hazard[r].store(fi);
+		const FilterIndex *fi1 = findex.load();
+		if (fi1 == fi) return fi;
+		fi = fi1;
+	}
 }
 
 } // ends namespace
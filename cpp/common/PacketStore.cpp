@@ -61,7 +61,7 @@ pktx PacketStore::alloc() {
 		freePkts->push(px); return 0;
 	}
 	int bx = freeBufs->pop();
-	pkt[px].buffer = &buff[bx];
+	pkt[px].buffer = &buff[bx]; pkt[px].rcvSeqNum = 0;
 	return px;
 }
 
@@ -85,7 +85,7 @@ pktx PacketStore::alloc(int cx) {
 	}
 	int px = pxCache[cx]->pop();
 	int bx = bxCache[cx]->pop();
-	pkt[px].buffer = &buff[bx];
+	pkt[px].buffer = &buff[bx]; pkt[px].rcvSeqNum = 0;
         return px;
 }
 
@@ -0,0 +1,134 @@
+/** @file Pcapng.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include "Pcapng.h"
+
+namespace forest {
+
+Pcapng::Pcapng() : fp(0), snapLen(0) {}
+
+Pcapng::~Pcapng() { close(); }
+
+/** Create a new pcapng file and write its section header block.
+ *  @param fileName is the name of the file; an existing file with that
+ *  name is replaced
+ *  @param snapLen1 is the maximum number of bytes stored per packet
+ *  @return true on success, false if the file could not be written
+ */
+bool Pcapng::create(const string& fileName, int snapLen1) {
+	close();
+	fp = fopen(fileName.c_str(), "wb");
+	if (fp == 0) return false;
+	setvbuf(fp, 0, _IOFBF, 1 << 20);
+	snapLen = snapLen1; ifaceId.clear();
+
+	// byte order magic, version 1.0, unspecified section length
+	struct { uint32_t magic; uint16_t major, minor; int64_t secLen; }
+		shb = { 0x1a2b3c4d, 1, 0, -1 };
+	string opts;
+	string app = "forest router";
+	addOption(opts, 4, app.c_str(), app.length());	// shb_userappl
+	addOption(opts, 0, 0, 0);
+	if (!writeBlock(0x0a0d0d0a, &shb, sizeof(shb), 0, 0, opts)) {
+		close(); return false;
+	}
+	return true;
+}
+
+/** Close the file, if it is open. */
+void Pcapng::close() {
+	if (fp != 0) { fclose(fp); fp = 0; }
+}
+
+/** Write an enhanced packet block for a captured packet.
+ *  @param t is the time the packet was captured, in ns since the epoch
+ *  @param lnk is the link the packet arrived on or was sent on
+ *  @param out is true for an outgoing packet, false for an incoming one
+ *  @param buf points to the captured bytes
+ *  @param capLen is the number of captured bytes
+ *  @param len is the original length of the packet
+ *  @return true on success, false if the file could not be written
+ */
+bool Pcapng::write(uint64_t t, int lnk, bool out, const void* buf,
+		   int capLen, int len) {
+	if (fp == 0) return false;
+	map<int,int>::iterator p = ifaceId.find(lnk);
+	if (p == ifaceId.end()) {
+		if (!writeIface(lnk)) return false;
+		p = ifaceId.find(lnk);
+	}
+	struct { uint32_t iface, tsHigh, tsLow, capLen, len; } epb =
+		{ (uint32_t) p->second, (uint32_t) (t >> 32), (uint32_t) t,
+		  (uint32_t) capLen, (uint32_t) len };
+	string opts;
+	uint32_t flags = (out ? 2 : 1);		// outbound or inbound
+	addOption(opts, 2, &flags, sizeof(flags));	// epb_flags
+	addOption(opts, 0, 0, 0);
+	return writeBlock(6, &epb, sizeof(epb), buf, capLen, opts);
+}
+
+/** Write an interface description block for a link.
+ *  @param lnk is the link number
+ *  @return true on success
+ */
+bool Pcapng::writeIface(int lnk) {
+	struct { uint16_t linkType, reserved; uint32_t snapLen; } idb =
+		{ LINKTYPE_FOREST, 0, (uint32_t) snapLen };
+	string opts;
+	string name = "link" + to_string(lnk);
+	uint8_t tsresol = 9;			// timestamps in ns
+	addOption(opts, 2, name.c_str(), name.length());	// if_name
+	addOption(opts, 9, &tsresol, 1);			// if_tsresol
+	addOption(opts, 0, 0, 0);
+	if (!writeBlock(1, &idb, sizeof(idb), 0, 0, opts)) return false;
+	int id = ifaceId.size();
+	ifaceId[lnk] = id;
+	return true;
+}
+
+/** Write a complete block to the file.
+ *  @param type is the block type
+ *  @param body points to the fixed part of the block body
+ *  @param bodyLen is the length of the fixed part
+ *  @param data points to variable length data following the fixed
+ *  part (may be 0)
+ *  @param dataLen is the length of the data; it is padded to a
+ *  multiple of 4 bytes
+ *  @param opts is the formatted option list
+ *  @return true on success
+ */
+bool Pcapng::writeBlock(uint32_t type, const void* body, int bodyLen,
+			const void* data, int dataLen, const string& opts) {
+	static const char zeros[4] = { 0, 0, 0, 0 };
+	int pad = (4 - (dataLen & 3)) & 3;
+	uint32_t total = 12 + bodyLen + dataLen + pad + opts.length();
+	bool ok = fwrite(&type, 4, 1, fp) == 1 &&
+		  fwrite(&total, 4, 1, fp) == 1 &&
+		  fwrite(body, bodyLen, 1, fp) == 1;
+	if (ok && dataLen > 0) ok = fwrite(data, dataLen, 1, fp) == 1;
+	if (ok && pad > 0) ok = fwrite(zeros, pad, 1, fp) == 1;
+	if (ok && opts.length() > 0)
+		ok = fwrite(opts.data(), opts.length(), 1, fp) == 1;
+	return ok && fwrite(&total, 4, 1, fp) == 1;
+}
+
+/** Append an option to an option list.
+ *  @param opts is the option list
+ *  @param code is the option code (0 for the end of the list)
+ *  @param val points to the option's value
+ *  @param len is the length of the value; it is padded to a multiple
+ *  of 4 bytes
+ */
+void Pcapng::addOption(string& opts, int code, const void* val, int len) {
+	uint16_t hdr[2] = { (uint16_t) code, (uint16_t) len };
+	opts.append((const char*) hdr, sizeof(hdr));
+	if (len > 0) opts.append((const char*) val, len);
+	opts.append((4 - (len & 3)) & 3, '\0');
+}
+
+} // ends namespace
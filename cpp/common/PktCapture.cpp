@@ -0,0 +1,36 @@
+/** @file PktCapture.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include "PktCapture.h"
+
+namespace forest {
+
+/** Constructor for PktCapture, allocates space for the rings.
+ *  @param nRings1 is the number of rings (one per producer thread)
+ *  @param nSlots1 is the number of records per ring; it is rounded up
+ *  to a power of 2
+ *  @param snap1 is the maximum number of bytes of a packet to capture
+ */
+PktCapture::PktCapture(int nRings1, int nSlots1, int snap1)
+		: nRings(nRings1), snap(snap1) {
+	for (nSlots = 1; nSlots < nSlots1; nSlots <<= 1) {}
+	slotSize = (sizeof(RecHdr) + snap + 7) & ~7;
+	ring = new Ring[nRings];
+	for (int r = 0; r < nRings; r++) {
+		ring[r].slots = new char[nSlots * slotSize];
+		ring[r].head.store(0); ring[r].tail.store(0);
+		ring[r].nCap.store(0); ring[r].nDrop.store(0);
+	}
+}
+
+PktCapture::~PktCapture() {
+	for (int r = 0; r < nRings; r++) delete [] ring[r].slots;
+	delete [] ring;
+}
+
+} // ends namespace
@@ -0,0 +1,507 @@
+/** @file PktIo.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include <netinet/udp.h>
+#include "PktIo.h"
+#ifdef HAVE_LIBURING
+#include "UringIo.h"
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+namespace forest {
+
+/** Constructor for PktIo.
+ *  @param ps1 is the packet store used for received packets
+ */
+PktIo::PktIo(PacketStore *ps1) : ps(ps1) {
+	for (int i = 0; i <= Forest::MAXINTF; i++) sock[i] = -1;
+	maxIf = maxSock = 0;
+	rcvCalls = rcvPkts = sndCalls = sndPkts = noBufs = 0;
+	for (int t = 0; t < 256; t++) typeDrops[t] = 0;
+}
+
+PktIo::~PktIo() {}
+
+/** Create a packet I/O backend.
+ *  @param mode is the name of the backend ("socket", "mmsg", "gso"
+ *  or "uring")
+ *  @param ps is the packet store to be used for received packets
+ *  @return a pointer to the new backend, or 0 if the mode is not
+ *  recognized or not supported on this system
+ */
+PktIo* PktIo::create(const string& mode, PacketStore *ps) {
+	if (mode.compare("socket") == 0) {
+		return new SockIo(ps);
+	} else if (mode.compare("mmsg") == 0) {
+		return new MmsgIo(ps);
+	} else if (mode.compare("gso") == 0) {
+		return new MmsgIo(ps, true);
+	} else if (mode.compare("uring") == 0) {
+#ifdef HAVE_LIBURING
+		UringIo *uio = new UringIo(ps);
+		if (uio->init()) return uio;
+		delete uio;
+#endif
+		return 0;
+	}
+	return 0;
+}
+
+/** Register the socket for an interface.
+ *  @param iface is an interface number
+ *  @param sock1 is the socket used to send and receive packets on iface
+ *  @return true on success, false if iface is out of range
+ */
+bool PktIo::addSock(int iface, int sock1) {
+	if (iface < 1 || iface > Forest::MAXINTF) return false;
+	sock[iface] = sock1;
+	maxIf = max(maxIf, iface); maxSock = max(maxSock, sock1);
+	return true;
+}
+
+/** Find the sockets that have packets waiting to be received.
+ *  @param rdy is a reference to a file descriptor set; on return,
+ *  it identifies the ready sockets
+ *  @return the number of ready sockets, or -1 on error
+ */
+int PktIo::ready(fd_set& rdy) {
+	FD_ZERO(&rdy);
+	for (int i = 1; i <= maxIf; i++) {
+		if (sock[i] >= 0) FD_SET(sock[i], &rdy);
+	}
+	struct timeval zero; zero.tv_sec = zero.tv_usec = 0;
+	int nRdy, cnt = 0;
+	do {
+		nRdy = select(maxSock+1, &rdy, (fd_set *) NULL,
+			      (fd_set *) NULL, &zero);
+	} while (nRdy < 0 && errno == EINTR && cnt++ < 10);
+	return nRdy;
+}
+
+/** Read and discard a packet, when the packet store is exhausted.
+ *  Reading the packet, rather than leaving it in the socket buffer,
+ *  lets the router keep up with the control packets that follow.
+ *  @param s is a socket with a packet waiting
+ */
+void PktIo::discard(int s) {
+	int leng = ::recv(s, (void *) &scratch[0], Forest::BUF_SIZ,
+			  MSG_DONTWAIT);
+	if (leng >= 0) countDiscard((void *) &scratch[0], leng);
+	rcvCalls++;
+}
+
+/** Create a string representation of the I/O statistics.
+ *  @return the string
+ */
+string PktIo::toString() const {
+	stringstream ss;
+	ss << "received " << rcvPkts << " packets in " << rcvCalls
+	   << " calls, sent " << sndPkts << " packets in " << sndCalls
+	   << " calls, discarded " << noBufs << " (no buffers)";
+	return ss.str();
+}
+
+/** Constructor for SockIo.
+ *  @param ps1 is the packet store used for received packets
+ */
+SockIo::SockIo(PacketStore *ps1) : PktIo(ps1) {}
+
+/** Receive packets from the interface sockets.
+ *  At most one packet is read from each ready socket.
+ *  @param pxv is an array in which the received packets are returned;
+ *  the bufferLen, tunIp and tunPort fields of each packet are set,
+ *  but the packets are not unpacked
+ *  @param ifv is an array in which the interfaces on which the
+ *  packets arrived are returned
+ *  @param n is the maximum number of packets to return
+ *  @return the number of packets returned, or -1 on an error
+ */
+int SockIo::recv(pktx *pxv, int *ifv, int n) {
+	fd_set rdy;
+	int nRdy = ready(rdy);
+	if (nRdy <= 0) return nRdy;
+	int cnt = 0;
+	for (int i = 1; i <= maxIf && nRdy > 0 && cnt < n; i++) {
+		if (sock[i] < 0 || !FD_ISSET(sock[i], &rdy)) continue;
+		nRdy--;
+		pktx px = ps->alloc();
+		if (px == 0) { discard(sock[i]); continue; }
+		Packet& p = ps->getPacket(px);
+		ipa_t ip; ipp_t port;
+		int nbytes = Np4d::recvfrom4d(sock[i], (void *) p.buffer,
+					      1500, ip, port);
+		rcvCalls++;
+		if (nbytes < 0) { ps->free(px); return -1; }
+		p.bufferLen = nbytes; p.tunIp = ip; p.tunPort = port;
+		pxv[cnt] = px; ifv[cnt] = i; cnt++;
+	}
+	rcvPkts += cnt;
+	return cnt;
+}
+
+/** Send a packet.
+ *  @param s is the socket on which the packet is to be sent
+ *  @param px is the index of the packet; it is freed once sent
+ *  @param sa is the socket address of the destination
+ *  @return true on success, false on failure
+ */
+bool SockIo::send(int s, pktx px, const sockaddr_in& sa) {
+	Packet& p = ps->getPacket(px);
+	int rv, lim = 0;
+	do {
+		rv = sendto(s, (void *) p.buffer, p.length, 0,
+			    (const struct sockaddr *) &sa, sizeof(sa));
+		sndCalls++;
+	} while (rv == -1 && errno == EAGAIN && lim++ < 10);
+	ps->free(px);
+	if (rv == -1) return false;
+	sndPkts++;
+	return true;
+}
+
+/** Complete pending sends; nothing to do for this backend.
+ *  @return true
+ */
+bool SockIo::flush() { return true; }
+
+/** Constructor for MmsgIo.
+ *  @param ps1 is the packet store used for received packets
+ *  @param gso1 is true if UDP segmentation offload is to be used
+ */
+MmsgIo::MmsgIo(PacketStore *ps1, bool gso1)
+		: PktIo(ps1), gso(gso1), gsoTx(gso1) {
+	nSpare = 0; txSock = -1; nTx = 0;
+	memset(rxHdr, 0, sizeof(rxHdr)); memset(txHdr, 0, sizeof(txHdr));
+	for (int i = 0; i < BATCH; i++) {
+		rxHdr[i].msg_hdr.msg_iov = &rxVec[i];
+		rxHdr[i].msg_hdr.msg_iovlen = 1;
+		rxHdr[i].msg_hdr.msg_name = &rxAdr[i];
+		txHdr[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+	}
+	groBuf = (gso ? new char[GRO_BUFS*GRO_SIZ] : 0);
+	nGro = groNext = groOff = 0;
+	gsoMsgs = groMsgs = 0;
+}
+
+MmsgIo::~MmsgIo() {
+	for (int i = 0; i < nSpare; i++) ps->free(spare[i]);
+	for (int i = 0; i < nTx; i++) ps->free(txPkt[i]);
+	delete [] groBuf;
+}
+
+/** Register the socket for an interface.
+ *  When GSO is used, UDP_GRO is enabled on the socket; if the kernel
+ *  does not support it, packets are simply received one at a time.
+ *  If the socket does not support UDP_SEGMENT, GSO is not used for
+ *  sending.
+ *  @param iface is an interface number
+ *  @param sock1 is the socket used to send and receive packets on iface
+ *  @return true on success, false if iface is out of range
+ */
+bool MmsgIo::addSock(int iface, int sock1) {
+	if (gso) {
+		int one = 1;
+		if (setsockopt(sock1, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0)
+			cerr << "MmsgIo::addSock: cannot enable UDP_GRO\n";
+		int seg; socklen_t len = sizeof(seg);
+		if (gsoTx &&
+		    getsockopt(sock1, SOL_UDP, UDP_SEGMENT, &seg, &len) < 0) {
+			cerr << "MmsgIo::addSock: no UDP_SEGMENT support, "
+				"sending without GSO\n";
+			gsoTx = false;
+		}
+	}
+	return PktIo::addSock(iface, sock1);
+}
+
+/** Receive packets from the interface sockets.
+ *  Packets are read in batches from each ready socket, until n
+ *  packets have been received or all ready sockets have been read.
+ *  Packets are allocated from the packet store ahead of time and kept
+ *  in a spare list, so unused packets need not be returned to the store.
+ *  @param pxv is an array in which the received packets are returned;
+ *  the bufferLen, tunIp and tunPort fields of each packet are set,
+ *  but the packets are not unpacked
+ *  @param ifv is an array in which the interfaces on which the
+ *  packets arrived are returned
+ *  @param n is the maximum number of packets to return
+ *  @return the number of packets returned, or -1 on an error
+ */
+int MmsgIo::recv(pktx *pxv, int *ifv, int n) {
+	if (gso) return recvGro(pxv, ifv, n);
+	fd_set rdy;
+	int nRdy = ready(rdy);
+	if (nRdy <= 0) return nRdy;
+	int cnt = 0;
+	for (int i = 1; i <= maxIf && nRdy > 0 && cnt < n; i++) {
+		if (sock[i] < 0 || !FD_ISSET(sock[i], &rdy)) continue;
+		nRdy--;
+		while (nSpare < BATCH) {
+			pktx px = ps->alloc();
+			if (px == 0) break;
+			spare[nSpare++] = px;
+		}
+		if (nSpare == 0) { discard(sock[i]); continue; }
+		int k = min(nSpare, n - cnt);
+		for (int j = 0; j < k; j++) {
+			Packet& p = ps->getPacket(spare[nSpare-1-j]);
+			rxVec[j].iov_base = (void *) p.buffer;
+			rxVec[j].iov_len = 1500;
+			rxHdr[j].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		}
+		int m = recvmmsg(sock[i], rxHdr, k, MSG_DONTWAIT, NULL);
+		rcvCalls++;
+		if (m < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) continue;
+			return -1;
+		}
+		for (int j = 0; j < m; j++) {
+			pktx px = spare[--nSpare];
+			Packet& p = ps->getPacket(px);
+			p.bufferLen = rxHdr[j].msg_len;
+			Np4d::extractSockAdr(rxAdr[j], p.tunIp, p.tunPort);
+			pxv[cnt] = px; ifv[cnt] = i; cnt++;
+		}
+	}
+	rcvPkts += cnt;
+	return cnt;
+}
+
+/** Send a packet.
+ *  The packet is added to a batch of pending packets, which is sent
+ *  when it is full, or when a packet for a different socket is sent.
+ *  @param s is the socket on which the packet is to be sent
+ *  @param px is the index of the packet; it is freed once sent
+ *  @param sa is the socket address of the destination
+ *  @return true on success, false on failure
+ */
+bool MmsgIo::send(int s, pktx px, const sockaddr_in& sa) {
+	if (nTx > 0 && s != txSock && !flush()) {
+		ps->free(px); return false;
+	}
+	Packet& p = ps->getPacket(px);
+	txSock = s; txPkt[nTx] = px; txAdr[nTx] = sa;
+	txVec[nTx].iov_base = (void *) p.buffer;
+	txVec[nTx].iov_len = p.length;
+	if (++nTx < BATCH) return true;
+	return flush();
+}
+
+/** Receive packets from the interface sockets, when GRO is enabled.
+ *  Each datagram returned by the kernel may contain several packets
+ *  of the same size (except possibly the last); these are copied into
+ *  separate packets. Datagrams that are not completely split in one call
+ *  are finished on the next call, before any socket is read.
+ *  @param pxv is an array in which the received packets are returned
+ *  @param ifv is an array in which the interfaces on which the
+ *  packets arrived are returned
+ *  @param n is the maximum number of packets to return
+ *  @return the number of packets returned, or -1 on an error
+ */
+int MmsgIo::recvGro(pktx *pxv, int *ifv, int n) {
+	int cnt = split(pxv, ifv, n);
+	if (cnt >= n || groNext < nGro) return cnt;
+	fd_set rdy;
+	int nRdy = ready(rdy);
+	if (nRdy < 0) return -1;
+	for (int i = 1; i <= maxIf && nRdy > 0 && cnt < n; i++) {
+		if (sock[i] < 0 || !FD_ISSET(sock[i], &rdy)) continue;
+		nRdy--;
+		for (int j = 0; j < GRO_BUFS; j++) {
+			msghdr& mh = rxHdr[j].msg_hdr;
+			rxVec[j].iov_base = (void *) &groBuf[j*GRO_SIZ];
+			rxVec[j].iov_len = GRO_SIZ;
+			mh.msg_namelen = sizeof(sockaddr_in);
+			mh.msg_control = rxCtl[j];
+			mh.msg_controllen = sizeof(rxCtl[j]);
+		}
+		int m = recvmmsg(sock[i], rxHdr, GRO_BUFS, MSG_DONTWAIT, NULL);
+		rcvCalls++;
+		if (m < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) continue;
+			return -1;
+		}
+		for (int j = 0; j < m; j++) {
+			msghdr& mh = rxHdr[j].msg_hdr;
+			groLen[j] = groSeg[j] = rxHdr[j].msg_len; groIf[j] = i;
+			for (cmsghdr *cm = CMSG_FIRSTHDR(&mh); cm != 0;
+			     cm = CMSG_NXTHDR(&mh, cm)) {
+				if (cm->cmsg_level == SOL_UDP &&
+				    cm->cmsg_type == UDP_GRO) {
+					int seg; memcpy(&seg, CMSG_DATA(cm),
+							sizeof(seg));
+					if (seg > 0) groSeg[j] = seg;
+				}
+			}
+			if (groLen[j] > groSeg[j]) groMsgs++;
+		}
+		nGro = m; groNext = groOff = 0;
+		cnt += split(&pxv[cnt], &ifv[cnt], n - cnt);
+		if (groNext < nGro) break; // finish these next time
+	}
+	return cnt;
+}
+
+/** Copy received segments into separate packets.
+ *  @param pxv is an array in which the packets are returned
+ *  @param ifv is an array in which their interfaces are returned
+ *  @param n is the maximum number of packets to return
+ *  @return the number of packets returned
+ */
+int MmsgIo::split(pktx *pxv, int *ifv, int n) {
+	int cnt = 0;
+	while (cnt < n && groNext < nGro) {
+		int j = groNext;
+		if (groOff >= groLen[j]) { groNext++; groOff = 0; continue; }
+		int leng = min(groSeg[j], groLen[j] - groOff);
+		pktx px = (leng <= 1500 ? ps->alloc() : 0);
+		if (px != 0) {
+			Packet& p = ps->getPacket(px);
+			memcpy((void *) p.buffer, &groBuf[j*GRO_SIZ + groOff],
+			       leng);
+			p.bufferLen = leng;
+			Np4d::extractSockAdr(rxAdr[j], p.tunIp, p.tunPort);
+			pxv[cnt] = px; ifv[cnt] = groIf[j]; cnt++;
+		} else if (leng <= 1500) {
+			countDiscard(&groBuf[j*GRO_SIZ + groOff], leng);
+		}
+		groOff += leng;
+	}
+	rcvPkts += cnt;
+	return cnt;
+}
+
+/** Determine if two socket addresses are equal.
+ *  @param a is a socket address
+ *  @param b is another socket address
+ *  @return true if they have the same IP address and port
+ */
+static bool sameAdr(const sockaddr_in& a, const sockaddr_in& b) {
+	return a.sin_addr.s_addr == b.sin_addr.s_addr &&
+	       a.sin_port == b.sin_port;
+}
+
+/** Send all pending packets.
+ *  Without GSO, each packet is sent as a separate message. With GSO,
+ *  each pending packet is grouped with later packets for the same
+ *  destination, so long as they are no longer than the first one;
+ *  the group ends after a shorter packet, since only the last segment
+ *  of a GSO message may be short. Packets for each destination remain
+ *  in order. If the kernel rejects a GSO message, GSO is turned off and
+ *  the unsent packets are sent one per message.
+ *  @return true on success, false on failure
+ */
+bool MmsgIo::flush() {
+	if (nTx == 0) return true;
+	bool used[BATCH];
+	for (int i = 0; i < nTx; i++) used[i] = false;
+	int nMsg = 0, k = 0;
+	for (int i = 0; i < nTx; i++) {
+		if (used[i]) continue;
+		int first = k;
+		size_t seg = txVec[i].iov_len; size_t total = seg;
+		msgVec[k++] = txVec[i]; used[i] = true;
+		for (int j = i+1; gsoTx && j < nTx &&
+				  msgVec[k-1].iov_len == seg; j++) {
+			if (used[j] || !sameAdr(txAdr[i], txAdr[j])) continue;
+			if (txVec[j].iov_len > seg ||
+			    total + txVec[j].iov_len > GSO_MAX)
+				break;
+			total += txVec[j].iov_len;
+			msgVec[k++] = txVec[j]; used[j] = true;
+		}
+		msghdr& mh = txHdr[nMsg].msg_hdr;
+		mh.msg_name = &txAdr[i];
+		mh.msg_iov = &msgVec[first]; mh.msg_iovlen = k - first;
+		msgSegs[nMsg] = k - first;
+		if (k - first > 1) {
+			mh.msg_control = txCtl[nMsg];
+			mh.msg_controllen = sizeof(txCtl[nMsg]);
+			cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+			cm->cmsg_level = SOL_UDP; cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			uint16_t segSize = seg;
+			memcpy(CMSG_DATA(cm), &segSize, sizeof(segSize));
+			gsoMsgs++;
+		} else {
+			mh.msg_control = 0; mh.msg_controllen = 0;
+		}
+		nMsg++;
+	}
+
+	int done = 0, lim = 0;
+	while (done < nMsg) {
+		int m = sendmmsg(txSock, &txHdr[done], nMsg - done, 0);
+		sndCalls++;
+		if (m < 0) {
+			if (errno == EAGAIN && lim++ < 10) continue;
+			if ((errno == EIO || errno == EINVAL) &&
+			    msgSegs[done] > 1) {
+				cerr << "MmsgIo::flush: GSO send failed, "
+					"sending without GSO\n";
+				gsoTx = false;
+				nMsg = unsegment(done, nMsg); done = 0;
+				continue;
+			}
+			break;
+		}
+		for (int i = done; i < done + m; i++) sndPkts += msgSegs[i];
+		done += m;
+	}
+	for (int i = 0; i < nTx; i++) ps->free(txPkt[i]);
+	nTx = 0;
+	return done == nMsg;
+}
+
+/** Replace a range of pending messages by single-packet messages.
+ *  The new messages are placed at the start of txHdr.
+ *  @param first is the index of the first message to be replaced
+ *  @param nMsg is the number of messages
+ *  @return the number of new messages
+ */
+int MmsgIo::unsegment(int first, int nMsg) {
+	iovec vec[BATCH]; sockaddr_in *adr[BATCH];
+	int n = 0;
+	for (int i = first; i < nMsg; i++) {
+		msghdr& mh = txHdr[i].msg_hdr;
+		for (size_t j = 0; j < mh.msg_iovlen; j++) {
+			vec[n] = mh.msg_iov[j];
+			adr[n] = (sockaddr_in *) mh.msg_name; n++;
+		}
+	}
+	for (int i = 0; i < n; i++) {
+		msgVec[i] = vec[i];
+		msghdr& mh = txHdr[i].msg_hdr;
+		mh.msg_name = adr[i];
+		mh.msg_iov = &msgVec[i]; mh.msg_iovlen = 1;
+		mh.msg_control = 0; mh.msg_controllen = 0;
+		msgSegs[i] = 1;
+	}
+	return n;
+}
+
+/** Create a string representation of the I/O statistics.
+ *  @return the string
+ */
+string MmsgIo::toString() const {
+	stringstream ss;
+	ss << PktIo::toString();
+	if (gso) {
+		ss << ", " << gsoMsgs << " GSO messages sent, "
+		   << groMsgs << " GRO datagrams received";
+	}
+	return ss.str();
+}
+
+} // ends namespace
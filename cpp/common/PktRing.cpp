@@ -0,0 +1,396 @@
+/** @file PktRing.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/ethernet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
+#include <chrono>
+#include "PktRing.h"
+
+using namespace std::chrono;
+
+namespace forest {
+
+/** Constructor for PktRing.
+ *  @param ps1 is the packet store used for received packets
+ */
+PktRing::PktRing(PacketStore *ps1) : PktIo(ps1) {
+	for (int i = 0; i <= Forest::MAXINTF; i++) {
+		Ring& r = ring[i];
+		r.rxFd = r.txFd = -1; r.rxMap = r.txMap = 0;
+		r.curBlock = r.pktsLeft = 0; r.nextPkt = 0;
+		r.txCur = r.txQueued = 0; r.ipId = 0;
+	}
+	arp = new HashMap<ipa_t,ArpEntry,Hash::u32>(64);
+	fallback = 0;
+}
+
+PktRing::~PktRing() {
+	for (int i = 1; i <= Forest::MAXINTF; i++) closeRing(ring[i]);
+	delete arp;
+}
+
+/** Release the sockets and memory of a ring.
+ *  @param r is a reference to a ring
+ */
+void PktRing::closeRing(Ring& r) {
+	if (r.rxMap != 0) munmap(r.rxMap, RX_BLOCK*RX_BLOCKS);
+	if (r.txMap != 0) munmap(r.txMap, TX_FRAME*TX_FRAMES);
+	if (r.rxFd >= 0) close(r.rxFd);
+	if (r.txFd >= 0) close(r.txFd);
+	r.rxFd = r.txFd = -1; r.rxMap = r.txMap = 0;
+}
+
+/** Put an interface in ring mode.
+ *  @param iface is the interface number
+ *  @param s is the interface's UDP socket, which must already be bound
+ *  @param dev is the name of the network device for the interface
+ *  @param ipa is the IP address of the interface; if zero, the address
+ *  of the device is used
+ *  @param port is the UDP port number of the interface
+ *  @return true on success, false on failure
+ */
+bool PktRing::addRing(int iface, int s, const string& dev,
+		      ipa_t ipa, ipp_t port) {
+	if (iface < 1 || iface > Forest::MAXINTF || ring[iface].rxFd >= 0)
+		return false;
+	Ring& r = ring[iface];
+	r.dev = dev; r.ipa = ipa; r.port = port;
+	int ifindex = if_nametoindex(dev.c_str());
+	if (ifindex == 0) return false;
+
+	// filter passing UDP frames to (ipa,port); dropping fragments
+	sock_filter code[] = {
+		BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 12),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, ETH_P_IP, 0, 10),
+		BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 23),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, IPPROTO_UDP, 0, 8),
+		BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 20),
+		BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x1fff, 6, 0),
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 30),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0, 0, 4),
+		BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, 14),
+		BPF_STMT(BPF_LD|BPF_H|BPF_IND, 16),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, port, 0, 1),
+		BPF_STMT(BPF_RET|BPF_K, 0xffff),
+		BPF_STMT(BPF_RET|BPF_K, 0),
+	};
+	sock_fprog prog; prog.len = sizeof(code)/sizeof(code[0]);
+	prog.filter = code;
+	sock_filter none[] = { BPF_STMT(BPF_RET|BPF_K, 0) };
+	sock_fprog dropAll; dropAll.len = 1; dropAll.filter = none;
+
+	// create rx socket, but bind only after the filter is in place
+	int fd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (fd < 0) return false;
+	struct ifreq ifr; memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, dev.c_str(), IFNAMSIZ-1);
+	if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) { close(fd); return false; }
+	memcpy(r.mac, ifr.ifr_hwaddr.sa_data, 6);
+	if (r.ipa == 0) {
+		if (ioctl(fd, SIOCGIFADDR, &ifr) < 0) {
+			close(fd); return false;
+		}
+		r.ipa = ntohl(((sockaddr_in *) &ifr.ifr_addr)->sin_addr.s_addr);
+	}
+	code[7].k = r.ipa;
+
+	int ver = TPACKET_V3;
+	tpacket_req3 req; memset(&req, 0, sizeof(req));
+	req.tp_block_size = RX_BLOCK; req.tp_block_nr = RX_BLOCKS;
+	req.tp_frame_size = TX_FRAME;
+	req.tp_frame_nr = (RX_BLOCK/TX_FRAME) * RX_BLOCKS;
+	req.tp_retire_blk_tov = 1; // ms
+	sockaddr_ll sll; memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET; sll.sll_protocol = htons(ETH_P_IP);
+	sll.sll_ifindex = ifindex;
+	void *map;
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)) < 0 ||
+	    setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0 ||
+	    (map = mmap(0, RX_BLOCK*RX_BLOCKS, PROT_READ|PROT_WRITE,
+			MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd); return false;
+	}
+	r.rxMap = (char *) map;
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER,
+		       &prog, sizeof(prog)) < 0 ||
+	    bind(fd, (sockaddr *) &sll, sizeof(sll)) < 0) {
+		close(fd); closeRing(r); return false;
+	}
+
+	// create tx socket; it receives nothing
+	r.txFd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (r.txFd < 0) { close(fd); closeRing(r); return false; }
+	ver = TPACKET_V2;
+	tpacket_req treq; memset(&treq, 0, sizeof(treq));
+	treq.tp_frame_size = TX_FRAME; treq.tp_frame_nr = TX_FRAMES;
+	treq.tp_block_size = 16*TX_FRAME; treq.tp_block_nr = TX_FRAMES/16;
+	if (setsockopt(r.txFd, SOL_PACKET, PACKET_VERSION,
+		       &ver, sizeof(ver)) < 0 ||
+	    setsockopt(r.txFd, SOL_PACKET, PACKET_TX_RING,
+		       &treq, sizeof(treq)) < 0 ||
+	    (map = mmap(0, TX_FRAME*TX_FRAMES, PROT_READ|PROT_WRITE,
+			MAP_SHARED, r.txFd, 0)) == MAP_FAILED) {
+		close(fd); closeRing(r); return false;
+	}
+	r.txMap = (char *) map;
+	if (setsockopt(r.txFd, SOL_SOCKET, SO_ATTACH_FILTER,
+		       &dropAll, sizeof(dropAll)) < 0 ||
+	    bind(r.txFd, (sockaddr *) &sll, sizeof(sll)) < 0) {
+		close(fd); closeRing(r); return false;
+	}
+
+	// packets now come through the ring, so UDP socket discards them
+	if (setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER,
+		       &dropAll, sizeof(dropAll)) < 0) {
+		close(fd); closeRing(r); return false;
+	}
+	r.curBlock = r.pktsLeft = 0; r.nextPkt = 0;
+	r.txCur = r.txQueued = 0;
+	addSock(iface, s);
+	atomic_thread_fence(memory_order_release);
+	r.rxFd = fd;
+	return true;
+}
+
+/** Receive packets from the rings.
+ *  @param pxv is an array in which the received packets are returned;
+ *  the bufferLen, tunIp and tunPort fields of each packet are set,
+ *  but the packets are not unpacked
+ *  @param ifv is an array in which the interfaces on which the
+ *  packets arrived are returned
+ *  @param n is the maximum number of packets to return
+ *  @return the number of packets returned
+ */
+int PktRing::recv(pktx *pxv, int *ifv, int n) {
+	int cnt = 0;
+	for (int i = 1; i <= maxIf && cnt < n; i++) {
+		Ring& r = ring[i];
+		if (r.rxFd < 0) continue;
+		while (cnt < n) {
+			tpacket_block_desc *bd = (tpacket_block_desc *)
+					(r.rxMap + r.curBlock * RX_BLOCK);
+			if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+				break;
+			atomic_thread_fence(memory_order_acquire);
+			if (r.nextPkt == 0) {
+				r.pktsLeft = bd->hdr.bh1.num_pkts;
+				r.nextPkt = (tpacket3_hdr *) ((char *) bd +
+					    bd->hdr.bh1.offset_to_first_pkt);
+				rcvCalls++;
+			}
+			while (r.pktsLeft > 0 && cnt < n) {
+				tpacket3_hdr *h = r.nextPkt;
+				r.nextPkt = (tpacket3_hdr *)
+					    ((char *) h + h->tp_next_offset);
+				r.pktsLeft--;
+				pktx px = extract(r, h);
+				if (px != 0) { pxv[cnt] = px; ifv[cnt++] = i; }
+			}
+			if (r.pktsLeft > 0) break;
+			// return block to kernel
+			atomic_thread_fence(memory_order_release);
+			bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+			r.nextPkt = 0;
+			r.curBlock = (r.curBlock + 1) % RX_BLOCKS;
+		}
+	}
+	rcvPkts += cnt;
+	return cnt;
+}
+
+/** Copy a Forest packet from a received frame into a new packet.
+ *  @param r is the ring that received the frame
+ *  @param h is a pointer to the frame's header in the ring
+ *  @return the index of the new packet, or 0 if the frame is not
+ *  a valid Forest-over-UDP frame or no packet is available
+ */
+pktx PktRing::extract(Ring& r, tpacket3_hdr *h) {
+	sockaddr_ll *sll = (sockaddr_ll *)
+			   ((char *) h + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+	if (sll->sll_pkttype == PACKET_OUTGOING) return 0;
+	uint8_t *frame = (uint8_t *) h + h->tp_mac;
+	uint8_t *end = frame + h->tp_snaplen;
+	iphdr *ip = (iphdr *) (frame + ETH_HLEN);
+	if ((uint8_t *) ip + sizeof(iphdr) > end) return 0;
+	udphdr *udp = (udphdr *) ((uint8_t *) ip + 4*ip->ihl);
+	uint8_t *payload = (uint8_t *) udp + sizeof(udphdr);
+	int nbytes = ntohs(udp->len) - sizeof(udphdr);
+	if (payload > end || nbytes < 0 || nbytes > 1500 ||
+	    payload + nbytes > end)
+		return 0;
+
+	pktx px = ps->alloc();
+	if (px == 0) { countDiscard(payload, nbytes); return 0; }
+	Packet& p = ps->getPacket(px);
+	memcpy((void *) p.buffer, payload, nbytes);
+	p.bufferLen = nbytes;
+	p.tunIp = ntohl(ip->saddr); p.tunPort = ntohs(udp->source);
+	return px;
+}
+
+/** Compute the checksum of an IP header with no options.
+ *  @param ip is a pointer to the header
+ *  @return the checksum, in network byte order
+ */
+static uint16_t ipChecksum(const iphdr *ip) {
+	const uint16_t *w = (const uint16_t *) ip;
+	uint32_t sum = 0;
+	for (unsigned int i = 0; i < sizeof(iphdr)/2; i++) sum += w[i];
+	while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+	return (uint16_t) ~sum;
+}
+
+/** Send a packet.
+ *  The packet is copied to the transmit ring of the interface that
+ *  owns the socket; the kernel is told to send the frames in the ring
+ *  when BATCH have been queued, or when flush is called.
+ *  @param s is the UDP socket for the interface on which the packet
+ *  is to be sent
+ *  @param px is the index of the packet; it is freed once it is copied
+ *  @param sa is the socket address of the destination
+ *  @return true on success, false on failure
+ */
+bool PktRing::send(int s, pktx px, const sockaddr_in& sa) {
+	Packet& p = ps->getPacket(px);
+	int i;
+	for (i = 1; i <= maxIf; i++) {
+		if (sock[i] == s && ring[i].rxFd >= 0) break;
+	}
+	uint64_t mac = 0;
+	tpacket2_hdr *th = 0;
+	if (i <= maxIf) {
+		Ring& r = ring[i];
+		mac = lookupMac(r, ntohl(sa.sin_addr.s_addr));
+		th = (tpacket2_hdr *) (r.txMap + r.txCur * TX_FRAME);
+		if (mac != 0 && th->tp_status != TP_STATUS_AVAILABLE) {
+			if (!kick(r)) { ps->free(px); return false; }
+			if (th->tp_status != TP_STATUS_AVAILABLE) mac = 0;
+		}
+	}
+	if (mac == 0) {
+		// no ring, no MAC address or ring full; use the socket
+		int rv = sendto(s, (void *) p.buffer, p.length, 0,
+				(const struct sockaddr *) &sa, sizeof(sa));
+		sndCalls++; fallback++;
+		ps->free(px);
+		if (rv == -1) return (errno == EAGAIN || errno == ENOBUFS);
+		sndPkts++;
+		return true;
+	}
+
+	Ring& r = ring[i];
+	uint8_t *frame = (uint8_t *) th + TPACKET2_HDRLEN - sizeof(sockaddr_ll);
+	ether_header *eh = (ether_header *) frame;
+	for (int k = 0; k < 6; k++)
+		eh->ether_dhost[k] = (mac >> (8*(5-k))) & 0xff;
+	memcpy(eh->ether_shost, r.mac, 6);
+	eh->ether_type = htons(ETHERTYPE_IP);
+
+	iphdr *ip = (iphdr *) (frame + ETH_HLEN);
+	int ipLeng = sizeof(iphdr) + sizeof(udphdr) + p.length;
+	ip->version = 4; ip->ihl = sizeof(iphdr)/4; ip->tos = 0;
+	ip->tot_len = htons(ipLeng); ip->id = htons(r.ipId++);
+	ip->frag_off = htons(IP_DF); ip->ttl = 64;
+	ip->protocol = IPPROTO_UDP; ip->check = 0;
+	ip->saddr = htonl(r.ipa); ip->daddr = sa.sin_addr.s_addr;
+	ip->check = ipChecksum(ip);
+
+	udphdr *udp = (udphdr *) (ip + 1);
+	udp->source = htons(r.port); udp->dest = sa.sin_port;
+	udp->len = htons(sizeof(udphdr) + p.length);
+	udp->check = 0; // optional for IPv4
+	memcpy((void *) (udp + 1), (void *) p.buffer, p.length);
+	ps->free(px);
+
+	th->tp_len = ETH_HLEN + ipLeng;
+	atomic_thread_fence(memory_order_release);
+	th->tp_status = TP_STATUS_SEND_REQUEST;
+	r.txCur = (r.txCur + 1) % TX_FRAMES;
+	if (++r.txQueued >= BATCH) return kick(r);
+	return true;
+}
+
+/** Tell the kernel to send the frames queued in a transmit ring.
+ *  @param r is a reference to a ring
+ *  @return true on success, false on failure
+ */
+bool PktRing::kick(Ring& r) {
+	if (r.txQueued == 0) return true;
+	int rv = ::send(r.txFd, NULL, 0, MSG_DONTWAIT);
+	sndCalls++; sndPkts += r.txQueued; r.txQueued = 0;
+	return (rv >= 0 || errno == EAGAIN || errno == ENOBUFS);
+}
+
+/** Send all queued frames.
+ *  @return true on success, false on failure
+ */
+bool PktRing::flush() {
+	bool ok = true;
+	for (int i = 1; i <= maxIf; i++) {
+		if (ring[i].rxFd >= 0 && !kick(ring[i])) ok = false;
+	}
+	return ok;
+}
+
+/** Find the MAC address for a peer.
+ *  Addresses are taken from the kernel's ARP cache. If the kernel
+ *  has no complete entry, the lookup is repeated only occasionally,
+ *  since the packets sent to the peer in the meantime go through
+ *  the UDP socket and lead the kernel to resolve the address.
+ *  A known address is looked up again once it is ARP_TTL old; if the
+ *  kernel's entry has gone or is incomplete, the address is forgotten
+ *  and packets go through the UDP socket until it is resolved again.
+ *  @param r is the ring on which a packet is to be sent
+ *  @param ipa is the IP address of the peer
+ *  @return the MAC address in the low order 48 bits, or 0 if it is
+ *  not known
+ */
+uint64_t PktRing::lookupMac(Ring& r, ipa_t ipa) {
+	int x = arp->find(ipa);
+	if (x == 0) {
+		ArpEntry e; e.mac = 0; e.misses = 0; e.expires = 0;
+		x = arp->put(ipa, e);
+		if (x == 0) return 0;
+	}
+	ArpEntry& e = arp->getValue(x);
+	int64_t now = steady_clock::now().time_since_epoch().count();
+	if (e.mac != 0) {
+		if (now < e.expires) return e.mac;
+		e.mac = 0; e.misses = 0;
+	}
+	if ((e.misses++ % 64) != 0) return 0;
+
+	arpreq req; memset(&req, 0, sizeof(req));
+	sockaddr_in *pa = (sockaddr_in *) &req.arp_pa;
+	pa->sin_family = AF_INET; pa->sin_addr.s_addr = htonl(ipa);
+	strncpy(req.arp_dev, r.dev.c_str(), sizeof(req.arp_dev)-1);
+	if (ioctl(r.txFd, SIOCGARP, &req) < 0 || !(req.arp_flags & ATF_COM))
+		return 0;
+	uint64_t mac = 0;
+	for (int k = 0; k < 6; k++)
+		mac = (mac << 8) | (uint8_t) req.arp_ha.sa_data[k];
+	e.mac = mac; e.expires = now + ARP_TTL;
+	return mac;
+}
+
+/** Create a string representation of the I/O statistics.
+ *  @return the string
+ */
+string PktRing::toString() const {
+	stringstream ss;
+	ss << PktIo::toString() << ", " << fallback << " sent via socket";
+	return ss.str();
+}
+
+} // ends namespace
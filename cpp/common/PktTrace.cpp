@@ -0,0 +1,107 @@
+/** @file PktTrace.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include <chrono>
+#include "PktTrace.h"
+
+using namespace std::chrono;
+
+namespace forest {
+
+PktTrace::PktTrace() : fp(0), data(0), size(0), pos(0), nRecs(0) {}
+
+PktTrace::~PktTrace() { close(); delete [] data; }
+
+/** Create a new trace file.
+ *  @param fileName is the name of the file; an existing file is replaced
+ *  @return true on success, false on failure
+ */
+bool PktTrace::create(const string& fileName) {
+	close();
+	fp = fopen(fileName.c_str(), "wb");
+	if (fp == 0) return false;
+	setvbuf(fp, 0, _IOFBF, 1 << 20);
+	FileHdr h;
+	h.magic = MAGIC; h.version = VERSION;
+	h.epoch = duration_cast<nanoseconds>(
+			system_clock::now().time_since_epoch()).count();
+	if (fwrite(&h, sizeof(h), 1, fp) != 1) { close(); return false; }
+	nRecs = 0;
+	return true;
+}
+
+/** Add a packet to a trace file.
+ *  @param t is the time the packet arrived
+ *  @param lnk is the link the packet arrived on
+ *  @param buf points to the packet, as received
+ *  @param len is the length of the packet in bytes
+ *  @return true on success, false on failure
+ */
+bool PktTrace::write(uint64_t t, int lnk, const void* buf, int len) {
+	if (fp == 0 || len < 0 || len > (int) sizeof(buffer_t)) return false;
+	RecHdr h;
+	h.time = t; h.inLink = lnk; h.len = len; h.pad = 0;
+	static const char zeros[8] = {0};
+	int padLen = (8 - (len & 7)) & 7;
+	if (fwrite(&h, sizeof(h), 1, fp) != 1 ||
+	    fwrite(buf, 1, len, fp) != (size_t) len ||
+	    fwrite(zeros, 1, padLen, fp) != (size_t) padLen)
+		return false;
+	nRecs++;
+	return true;
+}
+
+/** Flush and close a trace file that is being written. */
+void PktTrace::close() {
+	if (fp != 0) { fclose(fp); fp = 0; }
+}
+
+/** Read a trace file into memory.
+ *  @param fileName is the name of the file
+ *  @return true on success, false on failure
+ */
+bool PktTrace::open(const string& fileName) {
+	close(); delete [] data; data = 0; size = pos = 0;
+	FILE *in = fopen(fileName.c_str(), "rb");
+	if (in == 0) return false;
+	fseek(in, 0, SEEK_END); long n = ftell(in); fseek(in, 0, SEEK_SET);
+	if (n < (long) sizeof(FileHdr)) { fclose(in); return false; }
+	data = new char[n];
+	size = fread(data, 1, n, in);
+	fclose(in);
+	FileHdr* h = (FileHdr*) data;
+	if (size != (size_t) n || h->magic != MAGIC || h->version != VERSION) {
+		delete [] data; data = 0; size = 0;
+		return false;
+	}
+	rewind();
+	return true;
+}
+
+/** Get the next record from a trace that has been read into memory.
+ *  @param t is a reference in which the packet's arrival time is returned
+ *  @param lnk is a reference in which its link is returned
+ *  @param buf is a reference in which a pointer to the packet is returned
+ *  @param len is a reference in which its length is returned
+ *  @return true on success, false at the end of the trace
+ */
+bool PktTrace::next(uint64_t& t, int& lnk, const char*& buf, int& len) {
+	if (data == 0 || pos + sizeof(RecHdr) > size) return false;
+	RecHdr* h = (RecHdr*) &data[pos];
+	size_t end = pos + sizeof(RecHdr) + ((h->len + 7) & ~7);
+	if (end > size) return false;
+	t = h->time; lnk = h->inLink; len = h->len;
+	buf = &data[pos + sizeof(RecHdr)];
+	pos = end; nRecs++;
+	return true;
+}
+
+/** Go back to the first record of a trace that has been read. */
+void PktTrace::rewind() { pos = sizeof(FileHdr); nRecs = 0; }
+
+} // ends namespace
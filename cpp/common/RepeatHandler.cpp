@@ -10,81 +10,153 @@
 
 namespace forest {
 
-/** Constructor for RepeatHandler.  */
+/** Constructor for RepeatHandler.
+ *  @param size is the maximum number of records
+ */
 RepeatHandler::RepeatHandler(int size) : n(size) {
-	pmap = new HashMap<Pair<fAdr_t,int64_t>, int, Hash::s32s64>(n);
-	deadlines = new Dheap<int64_t>(n);
+	pmap = new HashMap<Pair<fAdr_t,int64_t>, Reply, Hash::s32s64>(n);
+	deadlines = new TimerWheel(n, TICK, SLOTS);
+	nChunks = n * CHUNKS_PER_REC;
+	slab = new char[(nChunks+1) * CHUNK];
+	nextChunk = new int[nChunks+1];
+	for (int c = 1; c < nChunks; c++) nextChunk[c] = c+1;
+	nextChunk[nChunks] = 0; nextChunk[0] = 0;
+	freeChunk = 1;
 }
 
 /** Destructor for RepeatHandler. */
-RepeatHandler::~RepeatHandler() { delete pmap; delete deadlines; } 
+RepeatHandler::~RepeatHandler() {
+	delete pmap; delete deadlines;
+	delete [] slab; delete [] nextChunk;
+} 
 
-/** Look for a saved packet with a given peer address and sequence number.
+/** Look for a record with a given peer address and sequence number.
  *  @param peerAdr is the peer address for the packet
  *  @param seqNum is the packet's sequence number
- *  @return the packet index for the packet, or 0 if no match;
+ *  @return the index of the record, or 0 if no match
  */
 int RepeatHandler::find(fAdr_t peerAdr, int64_t seqNum) {
-	int x = pmap->find(Pair<fAdr_t,int64_t>(peerAdr, seqNum));
-	if (x == 0) return 0;
-	return pmap->getValue(x);
+	return pmap->find(Pair<fAdr_t,int64_t>(peerAdr, seqNum));
+}
+
+/** Copy a saved reply into a packet.
+ *  @param x is the index of a record that contains a reply
+ *  @param p is a packet with a buffer; on return, it holds a copy
+ *  of the reply, ready to send
+ *  @return true on success, false if x has no reply
+ */
+bool RepeatHandler::getReply(int x, Packet& p) const {
+	Reply& r = pmap->getValue(x);
+	if (r.type == 0) return false;
+	p.version = Forest::FOREST_VERSION; p.length = r.length;
+	p.type = (Forest::ptyp_t) r.type; p.flags = r.flags;
+	p.comtree = r.comtree; p.srcAdr = r.srcAdr; p.dstAdr = r.dstAdr;
+	p.pack(); p.hdrErrUpdate();
+	char *dst = ((char *) p.buffer) + Forest::HDR_LENG;
+	int len = r.length - Forest::HDR_LENG;
+	for (int c = r.chunk; c != 0 && len > 0; c = nextChunk[c]) {
+		int k = min(len, CHUNK);
+		memcpy(dst, &slab[c*CHUNK], k);
+		dst += k; len -= k;
+	}
+	return true;
 }
 
-/** Save a copy of a received request packet.
- *  @param cx is a copy of a received request packet
+/** Record a received request.
+ *  If the table is full, the oldest record is discarded to make room.
  *  @param peerAdr is the Forest address of the sender
  *  @param seqNum is the sequence number assigned to the packet
  *  @param now is the current time
  *  @return true on success, false on failure
  */
-bool RepeatHandler::saveReq(int cx, fAdr_t peerAdr, int64_t seqNum,
-			    int64_t now) {
-	if (pmap->size() == n) {
-		// when full, remove the oldest to make room
-		int x = deadlines->deletemin();
-		pktx ox = pmap->getValue(x);
-		pmap->remove(pmap->getKey(x));
-		return ox;
-	}
-	int x = pmap->put(Pair<fAdr_t,int64_t>(peerAdr,seqNum),cx);
-	if (x != 0) 
-		deadlines->insert(x, now + 20000000000); // keep for 20 seconds
-	return 0;
+bool RepeatHandler::saveReq(fAdr_t peerAdr, int64_t seqNum, int64_t now) {
+	if (pmap->size() == n) discard(deadlines->earliest());
+	Reply r; r.type = 0; r.chunk = 0;
+	int x = pmap->put(Pair<fAdr_t,int64_t>(peerAdr,seqNum),r);
+	if (x == 0) return false;
+	deadlines->insert(x, now + HOLD);
+	return true;
 }
 
-/** Match a reply to a saved request and update.
- *  The request packet's index is removed from the saved entry and replaced
- *  with the reply packet's index.
- *  @param cx is the packet index for the reply packet corresponding to
- *  a saved request packet
- *  @param peerAdr is the Forest address of the sender of the original request
- *  @param seqNum is the sequence number assigned to the reply
- *  @return the index associated with the saved copy of the original request,
- *  or 0 if no matching request was found 
+/** Save a copy of the reply to a recorded request.
+ *  @param peerAdr is the Forest address of the sender of the request
+ *  @param seqNum is the sequence number of the request and reply
+ *  @param p is the reply packet
+ *  @return true on success, false if no matching request was found,
+ *  or there was no room to save the reply; in the latter case, the
+ *  record is discarded
  */
-int RepeatHandler::saveRep(int cx, fAdr_t peerAdr, int64_t seqNum) {
-	Pair<fAdr_t,int64_t> kee(peerAdr,seqNum);
-	int x = pmap->find(kee);
-	if (x == 0) return 0;
-	int px = pmap->getValue(x);
-	pmap->getValue(x) = cx;
-	deadlines->remove(x);
-	pmap->remove(kee);
-	return px;
+bool RepeatHandler::saveRep(fAdr_t peerAdr, int64_t seqNum,
+			    const Packet& p) {
+	int x = pmap->find(Pair<fAdr_t,int64_t>(peerAdr,seqNum));
+	if (x == 0) return false;
+	Reply& r = pmap->getValue(x);
+	int len = p.length - Forest::HDR_LENG;
+	if (r.chunk != 0) freeChunks(r.chunk);
+	r.chunk = allocChunks(len);
+	if (r.chunk == 0 && len > 0) { discard(x); return false; }
+	r.comtree = p.comtree; r.srcAdr = p.srcAdr; r.dstAdr = p.dstAdr;
+	r.length = p.length; r.type = p.type; r.flags = p.flags;
+	const char *src = ((const char *) p.buffer) + Forest::HDR_LENG;
+	for (int c = r.chunk; c != 0; c = nextChunk[c]) {
+		int k = min(len, CHUNK);
+		memcpy(&slab[c*CHUNK], src, k);
+		src += k; len -= k;
+	}
+	return true;
 }
 
-/** Check for an expired packet and delete it.
+/** Discard expired records.
  *  @param now is the current time
- *  @return the packet index of the oldest expired packet, or 0 if there
- *  is no expired packet
+ *  @return the number of records discarded
  */
 int RepeatHandler::expired(int64_t now) {
-	int x = deadlines->findmin();
-	if (x == 0 || now < deadlines->key(x)) return 0;
-	int px = pmap->getValue(x);
+	const int BATCH = 64;
+	int tv[BATCH]; int total = 0;
+	int cnt;
+	do {
+		cnt = deadlines->expired(now, tv, BATCH);
+		for (int i = 0; i < cnt; i++) discard(tv[i]);
+		total += cnt;
+	} while (cnt == BATCH);
+	return total;
+}
+
+/** Discard a record.
+ *  @param x is the index of a record
+ */
+void RepeatHandler::discard(int x) {
+	if (x == 0 || !pmap->valid(x)) return;
+	Reply& r = pmap->getValue(x);
+	if (r.chunk != 0) freeChunks(r.chunk);
 	deadlines->remove(x);
 	pmap->remove(pmap->getKey(x));
-	return px;
+}
+
+/** Allocate a chain of chunks.
+ *  @param len is the number of bytes to be stored
+ *  @return the first chunk of the chain, or 0 if len is zero or there
+ *  are not enough free chunks
+ */
+int RepeatHandler::allocChunks(int len) {
+	int k = (len + CHUNK - 1) / CHUNK;
+	if (k <= 0) return 0;
+	int first = freeChunk, last = 0;
+	for (int c = freeChunk; k > 0; c = nextChunk[c], k--) {
+		if (c == 0) return 0;
+		last = c;
+	}
+	freeChunk = nextChunk[last]; nextChunk[last] = 0;
+	return first;
+}
+
+/** Return a chain of chunks to the free list.
+ *  @param c is the first chunk of the chain
+ */
+void RepeatHandler::freeChunks(int c) {
+	int last = c;
+	while (nextChunk[last] != 0) last = nextChunk[last];
+	nextChunk[last] = freeChunk; freeChunk = c;
 }
 		
 } // ends namespace
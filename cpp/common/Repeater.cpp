@@ -13,65 +13,141 @@ namespace forest {
 /** Constructor for Repeater.
  */
 Repeater::Repeater(int size) : n(size) {
-	pmap = new HashMap<int64_t, Pair<int,int>, Hash::s64>(n);
-	deadlines = new Dheap<int64_t>(n);
+	pmap = new HashMap<int64_t, Request, Hash::s64>(n);
+	deadlines = new TimerWheel(n, TICK, SLOTS);
+	peers = new HashMap<fAdr_t, PeerStats, Hash::s32>(20, true);
 }
 
 /** Destructor for Repeater. */
-Repeater::~Repeater() { delete pmap; delete deadlines; } 
+Repeater::~Repeater() { delete pmap; delete deadlines; delete peers; }
+
+/** Get the stats entry for a peer, creating it if need be.
+ *  @param peer is the forest address of a peer
+ *  @return a reference to its entry
+ */
+Repeater::PeerStats& Repeater::peerEntry(fAdr_t peer) {
+	int x = peers->find(peer);
+	if (x == 0) {
+		PeerStats ps;
+		ps.srtt = ps.rttvar = 0; ps.rto = INIT_RTO;
+		ps.nSamples = ps.nSent = ps.nRetrans = ps.nFailed = 0;
+		x = peers->put(peer, ps);
+	}
+	return peers->getValue(x);
+}
+
+/** Update a peer's round-trip estimates with a new measurement.
+ *  @param ps is the stats entry for the peer
+ *  @param rtt is the measured round-trip time
+ */
+void Repeater::sample(PeerStats& ps, int64_t rtt) {
+	if (ps.nSamples == 0) {
+		ps.srtt = rtt; ps.rttvar = rtt/2;
+	} else {
+		int64_t err = ps.srtt - rtt; if (err < 0) err = -err;
+		ps.rttvar = (3*ps.rttvar + err)/4;
+		ps.srtt = (7*ps.srtt + rtt)/8;
+	}
+	ps.nSamples++;
+	ps.rto = ps.srtt + (4*ps.rttvar > TICK ? 4*ps.rttvar : TICK);
+	if (ps.rto < MIN_RTO) ps.rto = MIN_RTO;
+	if (ps.rto > MAX_RTO) ps.rto = MAX_RTO;
+}
 
 /** Save a copy of an outgoing request packet.
  *  @param cx is a copy of some outgoing request packet
  *  @param seqNum is the sequence number assigned to the packet
+ *  @param peer is the address of the node the packet was sent to
  *  @param now is the current time
  *  @param idx is an optional index that identifies the saved copy;
  *  if zero, an index is assigned automatically
  *  @return the index associated with the saved copy or 0 if a specified
  *  index is not available
  */
-int Repeater::saveReq(int cx, int64_t seqNum, int64_t now, int idx) {
-	int x = pmap->put(seqNum, Pair<int,int>(cx,3), idx);
+int Repeater::saveReq(int cx, int64_t seqNum, fAdr_t peer, int64_t now,
+		      int idx) {
+	PeerStats& ps = peerEntry(peer);
+	Request r; r.cx = cx; r.repCount = MAX_REPEATS; r.peer = peer;
+	r.sendTime = now; r.rto = ps.rto;
+	int x = pmap->put(seqNum, r, idx);
 	if (x == 0) return 0;
-	deadlines->insert(x, now + 1000000000);
+	ps.nSent++;
+	deadlines->insert(x, now + r.rto);
 	return x;
 }
 
 /** Match a reply to a saved request and update.
+ *  If the request was only sent once, the time since it was sent is
+ *  used to update the round-trip estimate for the peer.
  *  @param seqNum is the sequence number assigned to the reply
+ *  @param now is the current time
  *  @return a pair consisting of the packet index of the saved request packet
  *  and the internal index that was associated with the saved copy; if
  *  no matching request is found, the pair (0,0) is returned
  */
-pair<int,int> Repeater::deleteMatch(int64_t seqNum) {
+pair<int,int> Repeater::deleteMatch(int64_t seqNum, int64_t now) {
 	int idx = pmap->find(seqNum);
 	if (idx == 0) return pair<int,int>(0,0);
-	Pair<int,int>& vp = pmap->getValue(idx);
+	Request& r = pmap->getValue(idx);
+	int cx = r.cx;
+	if (r.repCount == MAX_REPEATS && now >= r.sendTime)
+		sample(peerEntry(r.peer), now - r.sendTime);
 	deadlines->remove(idx);
 	pmap->remove(seqNum);
-	return pair<int,int>(vp.first,idx);
+	return pair<int,int>(cx,idx);
 }
 
-/** Check for an overdue packet.
+/** Collect overdue packets.
  *  @param now is the current time
- *  @return a pair (cx, idx) where cx is the packet index for an overdue packet
- *  that was saved earlier; idx is the index under which the packet
- *  was saved; if the packet has been overdue more than the allowed number
- *  of times (3), the value of cx is negated to signal this condition
- *  and the save copy is removed
+ *  @param pv is an array of pairs in which overdue packets are returned;
+ *  each pair (cx, idx) gives the packet index of an overdue packet that
+ *  was saved earlier and the index under which it was saved; if the
+ *  packet has been overdue more than the allowed number of times (3),
+ *  the value of cx is negated to signal this condition and the saved
+ *  copy is removed; otherwise its timeout is doubled and its deadline
+ *  is pushed back
+ *  @param max is the size of pv
+ *  @return the number of pairs returned in pv
+ */
+int Repeater::overdue(int64_t now, pair<int,int> *pv, int max) {
+	vector<int> tv(max);
+	int cnt = deadlines->expired(now, tv.data(), max);
+	for (int i = 0; i < cnt; i++) {
+		int idx = tv[i];
+		Request& r = pmap->getValue(idx);
+		PeerStats& ps = peerEntry(r.peer);
+		if (r.repCount == 0) {
+			ps.nFailed++;
+			pv[i] = pair<int,int>(-r.cx,idx);
+			pmap->remove(pmap->getKey(idx));
+			continue;
+		}
+		// back off, push deadline back and decrement repeat count
+		r.rto = (2*r.rto < MAX_RTO ? 2*r.rto : MAX_RTO);
+		if (ps.rto < r.rto) ps.rto = r.rto;
+		ps.nRetrans++;
+		deadlines->insert(idx, now + r.rto); r.repCount--;
+		pv[i] = pair<int,int>(r.cx,idx);
+	}
+	return cnt;
+}
+
+/** Create a string listing the round-trip statistics for each peer.
+ *  @return the string, with one line per peer
  */
-pair<int,int> Repeater::overdue(int64_t now) {
-	int idx = deadlines->findmin();
-	if (idx == 0 || now < deadlines->key(idx))
-		return pair<int,int>(0,0);
-	Pair<int, int>& vp = pmap->getValue(idx);
-	if (vp.second == 0) {
-		deadlines->remove(idx);
-		pmap->remove(pmap->getKey(idx));
-		return pair<int,int>(-vp.first,idx);
+string Repeater::toString() const {
+	stringstream ss;
+	for (int x = peers->first(); x != 0; x = peers->next(x)) {
+		const PeerStats& ps = peers->getValue(x);
+		ss << Forest::fAdr2string(peers->getKey(x))
+		   << " srtt=" << ps.srtt/1000 << "us"
+		   << " rttvar=" << ps.rttvar/1000 << "us"
+		   << " rto=" << ps.rto/1000 << "us"
+		   << " samples=" << ps.nSamples << " sent=" << ps.nSent
+		   << " repeats=" << ps.nRetrans << " failed=" << ps.nFailed
+		   << endl;
 	}
-	// push deadline back by one second and decrement repeat count
-	deadlines->changekey(idx, now + 1000000000); vp.second--; 
-	return pair<int,int>(vp.first,idx);
+	return ss.str();
 }
 		
 } // ends namespace
@@ -0,0 +1,339 @@
+/** @file ShmLink.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include <poll.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include "ShmLink.h"
+
+namespace forest {
+
+ShmLink::ShmLink() {
+	rgn = 0; memFd = listenSock = -1; bell[0] = bell[1] = -1;
+	tx = rx = 0; txBell = rxBell = -1;
+	peer.store(false);
+}
+
+ShmLink::~ShmLink() {
+	if (rgn != 0) munmap((void *) rgn, sizeof(Region));
+	if (memFd >= 0) ::close(memFd);
+	if (bell[0] >= 0) ::close(bell[0]);
+	if (bell[1] >= 0) ::close(bell[1]);
+	if (listenSock >= 0) ::close(listenSock);
+}
+
+/** Build the address of the abstract unix socket for a link.
+ *  @param name is the name of the link
+ *  @param sa is a reference to a socket address, which is set on return
+ *  @return the length of the address
+ */
+socklen_t ShmLink::sockAdr(const string& name, sockaddr_un& sa) {
+	string path = "forest-shm-" + name;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	int n = min((int) path.length(), (int) sizeof(sa.sun_path) - 1);
+	memcpy(&sa.sun_path[1], path.c_str(), n); // sun_path[0] == 0
+	return offsetof(sockaddr_un, sun_path) + 1 + n;
+}
+
+/** Map the shared memory region.
+ *  @param server is true for the end that creates the region
+ *  @return true on success, false on failure
+ */
+bool ShmLink::map(bool server) {
+	void *m = mmap(0, sizeof(Region), PROT_READ | PROT_WRITE,
+		       MAP_SHARED, memFd, 0);
+	if (m == MAP_FAILED) return false;
+	rgn = (Region *) m;
+	if (server) {
+		memset(m, 0, sizeof(Region)); // all indexes and flags 0
+		rgn->magic = MAGIC;
+	} else if (rgn->magic != MAGIC) {
+		return false;
+	}
+	int t = (server ? 0 : 1);
+	tx = &rgn->ring[t]; rx = &rgn->ring[1-t];
+	txBell = bell[t]; rxBell = bell[1-t];
+	return true;
+}
+
+/** Create the server end of a shared-memory link.
+ *  @param name is the name of the link, which the peer uses to attach
+ *  @return a pointer to the new endpoint, or 0 on failure
+ */
+ShmLink* ShmLink::create(const string& name) {
+	ShmLink *l = new ShmLink();
+	sockaddr_un sa; socklen_t len = sockAdr(name, sa);
+	l->memFd = memfd_create(("forest-" + name).c_str(), 0);
+	l->bell[0] = eventfd(0, EFD_NONBLOCK);
+	l->bell[1] = eventfd(0, EFD_NONBLOCK);
+	l->listenSock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (l->memFd < 0 || l->bell[0] < 0 || l->bell[1] < 0 ||
+	    l->listenSock < 0 ||
+	    ftruncate(l->memFd, sizeof(Region)) < 0 || !l->map(true) ||
+	    bind(l->listenSock, (sockaddr *) &sa, len) < 0 ||
+	    listen(l->listenSock, 4) < 0) {
+		delete l; return 0;
+	}
+	return l;
+}
+
+/** Attach to the server end of a shared-memory link.
+ *  Blocks until the server responds.
+ *  @param name is the name of the link
+ *  @return a pointer to the new endpoint, or 0 on failure
+ */
+ShmLink* ShmLink::attach(const string& name) {
+	sockaddr_un sa; socklen_t len = sockAdr(name, sa);
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0) return 0;
+	if (connect(s, (sockaddr *) &sa, len) < 0) { ::close(s); return 0; }
+
+	char data;
+	iovec iov; iov.iov_base = &data; iov.iov_len = 1;
+	char ctl[CMSG_SPACE(3*sizeof(int))];
+	msghdr msg; memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov; msg.msg_iovlen = 1;
+	msg.msg_control = ctl; msg.msg_controllen = sizeof(ctl);
+	int rv = recvmsg(s, &msg, 0);
+	::close(s);
+	cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+	if (rv != 1 || cm == 0 || cm->cmsg_type != SCM_RIGHTS ||
+	    cm->cmsg_len != CMSG_LEN(3*sizeof(int)))
+		return 0;
+	int fd[3]; memcpy(fd, CMSG_DATA(cm), sizeof(fd));
+
+	ShmLink *l = new ShmLink();
+	l->memFd = fd[0]; l->bell[0] = fd[1]; l->bell[1] = fd[2];
+	if (!l->map(false)) { delete l; return 0; }
+	l->peer.store(true);
+	return l;
+}
+
+/** Hand the link to a peer that is waiting to attach, if there is one.
+ *  Called only at the server end, by the thread that receives from
+ *  the link; does not block. Any packets left in the rings by an
+ *  earlier peer are discarded before the new peer gets the rings,
+ *  so it sees only packets sent after it attached. An earlier peer
+ *  must have stopped using the rings by then.
+ *  @return true if a peer attached, else false
+ */
+bool ShmLink::accept() {
+	int s = ::accept(listenSock, 0, 0);
+	if (s < 0) return false;
+
+	// reset the consumer side of both rings; we consume rx ourselves,
+	// and no peer consumes tx until it receives the descriptors below
+	rx->head.store(rx->tail.load());
+	tx->head.store(tx->tail.load());
+	tx->asleep.store(0);
+	uint64_t cnt;
+	if (read(txBell, &cnt, sizeof(cnt)) < 0) { /* not rung */ }
+
+	int fd[3] = { memFd, bell[0], bell[1] };
+	char data = 0;
+	iovec iov; iov.iov_base = &data; iov.iov_len = 1;
+	char ctl[CMSG_SPACE(sizeof(fd))];
+	msghdr msg; memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov; msg.msg_iovlen = 1;
+	msg.msg_control = ctl; msg.msg_controllen = sizeof(ctl);
+	cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET; cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(fd));
+	memcpy(CMSG_DATA(cm), fd, sizeof(fd));
+	int rv = sendmsg(s, &msg, 0);
+	::close(s);
+	if (rv != 1) return false;
+	peer.store(true);
+	return true;
+}
+
+/** Send a packet to the peer.
+ *  @param buf points to the packet, in network byte order
+ *  @param leng is its length in bytes
+ *  @return true on success, false if the ring is full or no peer
+ *  has attached
+ */
+bool ShmLink::send(const void *buf, int leng) {
+	if (!peer.load(memory_order_relaxed)) return false;
+	uint32_t t = tx->tail.load(memory_order_relaxed);
+	if (t - tx->head.load(memory_order_acquire) >= SLOTS) return false;
+	uint32_t i = t % SLOTS;
+	leng = min(leng, (int) Forest::BUF_SIZ);
+	memcpy((void *) tx->slot[i], buf, leng);
+	tx->len[i] = leng;
+	tx->tail.store(t+1); // sequentially consistent, ordered with load
+			     // of asleep, so a waiting peer is not missed
+	if (tx->asleep.load() != 0) {
+		uint64_t one = 1;
+		if (write(txBell, &one, sizeof(one)) < 0) { /* already rung */ }
+	}
+	return true;
+}
+
+/** Receive a packet from the peer.
+ *  @param buf points to a buffer where the packet is to be placed
+ *  @param maxLeng is the size of the buffer
+ *  @return the length of the packet, or 0 if there is none
+ */
+int ShmLink::recv(void *buf, int maxLeng) {
+	uint32_t h = rx->head.load(memory_order_relaxed);
+	if (h == rx->tail.load(memory_order_acquire)) return 0;
+	uint32_t i = h % SLOTS;
+	int leng = min((int) rx->len[i], maxLeng);
+	memcpy(buf, (void *) rx->slot[i], leng);
+	rx->head.store(h+1, memory_order_release);
+	return leng;
+}
+
+/** Wait for a packet to arrive.
+ *  @param timeout is the maximum time to wait, in milliseconds
+ *  @return true if a packet is waiting, else false
+ */
+bool ShmLink::wait(int timeout) {
+	uint32_t h = rx->head.load(memory_order_relaxed);
+	if (h != rx->tail.load(memory_order_acquire)) return true;
+	rx->asleep.store(1);
+	if (h == rx->tail.load()) {
+		pollfd pfd; pfd.fd = rxBell; pfd.events = POLLIN;
+		poll(&pfd, 1, timeout);
+		uint64_t cnt;
+		if (read(rxBell, &cnt, sizeof(cnt)) < 0) { /* not rung */ }
+	}
+	rx->asleep.store(0);
+	return h != rx->tail.load(memory_order_acquire);
+}
+
+/** Constructor for ShmLinks.
+ *  @param ps1 is the packet store used for received packets
+ *  @param maxLnk1 is the largest link number
+ */
+ShmLinks::ShmLinks(PacketStore *ps1, int maxLnk1) : ps(ps1), maxLnk(maxLnk1) {
+	maxLnk = min(maxLnk, (int) Forest::MAXLNK);
+	link = new atomic<ShmLink*>[maxLnk+1];
+	peerIp = new ipa_t[maxLnk+1]; peerPort = new ipp_t[maxLnk+1];
+	for (int lnk = 0; lnk <= maxLnk; lnk++) {
+		link[lnk].store(0); peerIp[lnk] = 0; peerPort[lnk] = 0;
+	}
+	nLnks.store(0); nextLnk = 0; polls = 0;
+	rcvPkts = sndPkts = sndFull = 0;
+}
+
+ShmLinks::~ShmLinks() {
+	for (int lnk = 1; lnk <= maxLnk; lnk++) delete link[lnk].load();
+	for (ShmLink *l : retired) delete l;
+	delete [] link; delete [] peerIp; delete [] peerPort;
+}
+
+/** Create a shared-memory ring for a link.
+ *  @param lnk is the link number
+ *  @param name is the name that the peer uses to attach to the ring
+ *  @param ip is the IP address of the peer, which is placed in the
+ *  tunnel fields of packets received from it
+ *  @param port is the port number of the peer, likewise
+ *  @return true on success, false on failure
+ */
+bool ShmLinks::open(int lnk, const string& name, ipa_t ip, ipp_t port) {
+	if (lnk < 1 || lnk > maxLnk) return false;
+	unique_lock<mutex> lck(mtx);
+	if (link[lnk].load() != 0) return false;
+	ShmLink *l = ShmLink::create(name);
+	if (l == 0) return false;
+	peerIp[lnk] = ip; peerPort[lnk] = port;
+	link[lnk].store(l);
+	int n = nLnks.load();
+	for (int i = 0; i < n; i++) if (lnkList[i] == lnk) return true;
+	lnkList[n] = lnk; nLnks.store(n+1);
+	return true;
+}
+
+/** Stop using the shared-memory ring for a link.
+ *  The endpoint is not deleted until the ShmLinks object is,
+ *  since the input and output threads may still be using it.
+ *  @param lnk is the link number
+ */
+void ShmLinks::close(int lnk) {
+	if (lnk < 1 || lnk > maxLnk) return;
+	unique_lock<mutex> lck(mtx);
+	ShmLink *l = link[lnk].exchange(0);
+	if (l != 0) retired.push_back(l);
+}
+
+/** Receive packets from the shared-memory rings.
+ *  The rings are polled round-robin, starting with a different ring
+ *  on each call. Peers waiting to attach are checked for periodically.
+ *  @param pxv is an array in which the received packets are returned;
+ *  the bufferLen, tunIp, tunPort and inLink fields of each packet are
+ *  set, but the packets are not unpacked
+ *  @param lnkv is an array in which the links on which the packets
+ *  arrived are returned
+ *  @param n is the maximum number of packets to return
+ *  @return the number of packets returned
+ */
+int ShmLinks::recv(pktx *pxv, int *lnkv, int n) {
+	int k = nLnks.load();
+	if (k == 0) return 0;
+	if (++polls >= ACCEPT_INTERVAL) {
+		polls = 0;
+		for (int i = 0; i < k; i++) {
+			ShmLink *l = link[lnkList[i]].load();
+			if (l != 0) l->accept();
+		}
+	}
+	int cnt = 0; pktx px = 0;
+	for (int j = 0; j < k && cnt < n; j++) {
+		int lnk = lnkList[(nextLnk + j) % k];
+		ShmLink *l = link[lnk].load();
+		if (l == 0) continue;
+		while (cnt < n) {
+			if (px == 0 && (px = ps->alloc()) == 0) break;
+			Packet& p = ps->getPacket(px);
+			int leng = l->recv((void *) p.buffer, Forest::BUF_SIZ);
+			if (leng == 0) break;
+			p.bufferLen = leng; p.inLink = lnk;
+			p.tunIp = peerIp[lnk]; p.tunPort = peerPort[lnk];
+			pxv[cnt] = px; lnkv[cnt] = lnk; cnt++;
+			px = 0;
+		}
+	}
+	if (px != 0) ps->free(px);
+	nextLnk = (nextLnk + 1) % k;
+	rcvPkts += cnt;
+	return cnt;
+}
+
+/** Send a packet on a shared-memory ring.
+ *  If the ring is full, the packet is discarded, as it would be
+ *  if a socket buffer overflowed. Callers check hasLink first, so
+ *  packets are not sent to a ring that no peer has attached to.
+ *  @param lnk is the link on which the packet is to be sent
+ *  @param px is the index of the packet; it is freed once sent
+ *  @return true
+ */
+bool ShmLinks::send(int lnk, pktx px) {
+	Packet& p = ps->getPacket(px);
+	ShmLink *l = link[lnk].load();
+	if (l != 0 && l->send((void *) p.buffer, p.length)) sndPkts++;
+	else sndFull++;
+	ps->free(px);
+	return true;
+}
+
+/** Create a string representation of the shared-memory link statistics.
+ *  @return the string
+ */
+string ShmLinks::toString() const {
+	stringstream ss;
+	ss << nLnks.load() << " shared-memory links, received " << rcvPkts
+	   << " packets, sent " << sndPkts << " packets, "
+	   << sndFull << " dropped (ring full)";
+	return ss.str();
+}
+
+} // ends namespace
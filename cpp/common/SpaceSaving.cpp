@@ -0,0 +1,51 @@
+/** @file SpaceSaving.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include "SpaceSaving.h"
+
+namespace forest {
+
+/** Constructor for SpaceSaving objects.
+ *  @param size is the number of keys to monitor
+ */
+SpaceSaving::SpaceSaving(int size) : n(size) {
+	map = new HashMap<uint64_t,Counter,Hash::u64>(n,false);
+	counts = new Dheap<uint64_t>(n);
+	totalBytes = 0;
+}
+
+/** Destructor for SpaceSaving objects. */
+SpaceSaving::~SpaceSaving() { delete map; delete counts; }
+
+/** Get the keys with the largest byte counts.
+ *  @param k is the number of keys to return
+ *  @param v is a vector in which the counters for the (up to) k keys
+ *  with the largest counts are returned, in decreasing order
+ *  @return the number of counters returned in v
+ */
+int SpaceSaving::top(int k, vector<Counter>& v) const {
+	v.clear();
+	for (int x = map->first(); x != 0; x = map->next(x))
+		v.push_back(map->getValue(x));
+	sort(v.begin(), v.end(), [](const Counter& a, const Counter& b) {
+					return a.bytes > b.bytes; });
+	if ((int) v.size() > k) v.resize(k);
+	return v.size();
+}
+
+/** Remove all monitored keys and reset the total. */
+void SpaceSaving::clear() {
+	while (counts->findmin() != 0) {
+		int x = counts->findmin();
+		counts->remove(x);
+		map->remove(map->getKey(x));
+	}
+	totalBytes = 0;
+}
+
+} // ends namespace
@@ -0,0 +1,146 @@
+/** @file StageTrace.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include "StageTrace.h"
+
+namespace forest {
+
+/** Constructor for StageTrace, allocates space for the rings.
+ *  @param nEvents1 is the number of events per ring; it is rounded up
+ *  to a power of 2
+ *  @param rate1 is the initial sample rate (0 to disable tracing)
+ */
+StageTrace::StageTrace(int nEvents1, int rate1) : nRings(2) {
+	for (nEvents = 1; nEvents < nEvents1; nEvents <<= 1) {}
+	ring = new Ring[nRings];
+	for (int r = 0; r < nRings; r++) {
+		ring[r].ev = new Event[nEvents];
+		ring[r].count.store(0);
+	}
+	setSampleRate(rate1);
+}
+
+StageTrace::~StageTrace() {
+	for (int r = 0; r < nRings; r++) delete [] ring[r].ev;
+	delete [] ring;
+}
+
+/** Copy the events in a ring.
+ *  The ring may be written while it is being copied, so events that
+ *  may have been overwritten during the copy are discarded.
+ *  @param r is the ring number
+ *  @param v is a vector to which the events are appended
+ */
+void StageTrace::snapshot(int r, vector<Event>& v) const {
+	Ring& rg = ring[r];
+	uint64_t hi = rg.count.load(memory_order_acquire);
+	uint64_t lo = (hi > (uint64_t) nEvents ? hi - nEvents : 0);
+	size_t base = v.size();
+	for (uint64_t i = lo; i < hi; i++)
+		v.push_back(rg.ev[i & (nEvents-1)]);
+	std::atomic_thread_fence(memory_order_acquire);
+	uint64_t hi2 = rg.count.load(memory_order_relaxed);
+	if (hi2 - lo > (uint64_t) nEvents) {
+		// the oldest (hi2 - lo - nEvents) copied events are suspect
+		size_t bad = min(hi2 - lo - nEvents, hi - lo);
+		v.erase(v.begin() + base, v.begin() + base + bad);
+	}
+}
+
+/** Order events by packet, and then by time.  */
+bool StageTrace::bySeq(const Event& a, const Event& b) {
+	if (a.seq != b.seq) return a.seq < b.seq;
+	if (a.time != b.time) return a.time < b.time;
+	return a.stage < b.stage;
+}
+
+/** Write the recorded events to a file in Chrome trace event format.
+ *  Each event appears as an instant event on the track for the thread
+ *  that recorded it. Each sampled packet also appears as an async track,
+ *  with one span per stage, running from the time the packet reached
+ *  that stage to the time it reached the next one. Times are given in
+ *  microseconds since the router started.
+ *  @param fileName is the name of the file
+ *  @param epoch is the wall-clock time (ns since the epoch) at which the
+ *  router started; it is recorded in the file's metadata
+ *  @return the number of events written, or -1 if the file could not
+ *  be written
+ */
+int StageTrace::dump(const string& fileName, uint64_t epoch) {
+	vector<Event> v;
+	for (int r = 0; r < nRings; r++) snapshot(r, v);
+
+	FILE *fp = fopen(fileName.c_str(), "w");
+	if (fp == 0) return -1;
+	fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"otherData\":"
+		    "{\"epoch_ns\":\"%llu\",\"sample_rate\":%d},\n"
+		    "\"traceEvents\":[\n", (unsigned long long) epoch,
+		    getSampleRate());
+	static const char* tname[2] = { "input", "output" };
+	for (int r = 0; r < nRings; r++) {
+		fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\","
+			    "\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+			r+1, tname[r]);
+	}
+	// instant events on thread tracks
+	for (const Event& e : v) {
+		fprintf(fp, "{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"i\","
+			    "\"s\":\"t\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":%d,"
+			    "\"args\":{\"seq\":%u,\"px\":%u,\"link\":%u,"
+			    "\"qid\":%u}},\n",
+			stage2string((Stage) e.stage).c_str(),
+			(unsigned long long) (e.time/1000),
+			(unsigned) (e.time%1000), e.thread+1,
+			e.seq, e.px, e.link, e.qid);
+	}
+	// per packet spans
+	sort(v.begin(), v.end(), bySeq);
+	for (size_t i = 0; i+1 < v.size(); i++) {
+		const Event& e = v[i]; const Event& f = v[i+1];
+		if (e.seq != f.seq) continue;
+		string name = stage2string((Stage) e.stage);
+		fprintf(fp, "{\"name\":\"%s\",\"cat\":\"pkt\",\"ph\":\"b\","
+			    "\"id\":%u,\"ts\":%llu.%03u,\"pid\":2,\"tid\":1},\n",
+			name.c_str(), e.seq,
+			(unsigned long long) (e.time/1000),
+			(unsigned) (e.time%1000));
+		fprintf(fp, "{\"name\":\"%s\",\"cat\":\"pkt\",\"ph\":\"e\","
+			    "\"id\":%u,\"ts\":%llu.%03u,\"pid\":2,\"tid\":1},\n",
+			name.c_str(), e.seq,
+			(unsigned long long) (f.time/1000),
+			(unsigned) (f.time%1000));
+	}
+	fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,"
+		    "\"args\":{\"name\":\"packets\"}}\n]}\n");
+	bool ok = (ferror(fp) == 0);
+	if (fclose(fp) != 0) ok = false;
+	return (ok ? v.size() : -1);
+}
+
+/** Create a string representation of a pipeline stage.
+ *  @param s is a stage
+ *  @return the name of the stage
+ */
+string StageTrace::stage2string(Stage s) {
+	switch (s) {
+	case RECV:	return "recv";
+	case FORWARD:	return "forward";
+	case MFORWARD:	return "mforward";
+	case XFER_ENQ:	return "xfer_enq";
+	case XFER_DEQ:	return "xfer_deq";
+	case QM_ENQ:	return "qm_enq";
+	case QM_DEQ:	return "qm_deq";
+	case SEND:	return "send";
+	case DROP:	return "drop";
+	}
+	return "undefined";
+}
+
+} // ends namespace
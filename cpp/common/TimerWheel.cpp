@@ -0,0 +1,117 @@
+/** @file TimerWheel.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include "TimerWheel.h"
+
+namespace forest {
+
+/** Constructor for TimerWheel.
+ *  @param n1 is the largest timer number
+ *  @param tick1 is the length of a tick, in ns
+ *  @param nSlots1 is the number of slots in the wheel; the wheel
+ *  works best when most deadlines are less than tick1*nSlots1 in
+ *  the future
+ */
+TimerWheel::TimerWheel(int n1, int64_t tick1, int nSlots1)
+		: n(n1), tick(tick1), nSlots(nSlots1) {
+	count = 0; curTick = 0;
+	head = new int[nSlots];
+	for (int s = 0; s < nSlots; s++) head[s] = 0;
+	next = new int[n+1]; prev = new int[n+1]; dl = new int64_t[n+1];
+	for (int i = 0; i <= n; i++) { next[i] = prev[i] = 0; dl[i] = -1; }
+}
+
+TimerWheel::~TimerWheel() {
+	delete [] head; delete [] next; delete [] prev; delete [] dl;
+}
+
+/** Set a timer.
+ *  @param i is a timer that is not in the wheel
+ *  @param d is its deadline; if d is in a tick that has already been
+ *  visited, the timer is placed in the current slot
+ */
+void TimerWheel::insert(int i, int64_t d) {
+	if (i < 1 || i > n || dl[i] >= 0) return;
+	if (d < 0) d = 0;
+	int64_t t = max(d / tick, curTick);
+	int s = t % nSlots;
+	dl[i] = d;
+	next[i] = head[s]; prev[i] = -(s+1);
+	if (head[s] != 0) prev[head[s]] = i;
+	head[s] = i;
+	count++;
+}
+
+/** Clear a timer.
+ *  @param i is a timer; if it is not in the wheel, nothing is done
+ */
+void TimerWheel::remove(int i) {
+	if (!member(i)) return;
+	if (prev[i] < 0) head[-prev[i]-1] = next[i];
+	else next[prev[i]] = next[i];
+	if (next[i] != 0) prev[next[i]] = prev[i];
+	next[i] = prev[i] = 0; dl[i] = -1;
+	count--;
+}
+
+/** Collect expired timers.
+ *  The slots for all ticks up to the current one are visited, and
+ *  timers whose deadlines have passed are removed from the wheel.
+ *  If more than max timers have expired, the rest are left for the
+ *  next call.
+ *  @param now is the current time
+ *  @param tv is an array in which expired timers are returned
+ *  @param max is the size of tv
+ *  @return the number of timers returned in tv
+ */
+int TimerWheel::expired(int64_t now, int *tv, int max) {
+	int64_t nowTick = now / tick;
+	if (count == 0) {
+		// nothing to find; just catch up
+		if (nowTick > curTick) curTick = nowTick;
+		return 0;
+	}
+	// if far behind, one visit to each slot is enough
+	if (nowTick - curTick > nSlots) curTick = nowTick - nSlots;
+	int cnt = 0;
+	while (true) {
+		int s = curTick % nSlots;
+		for (int i = head[s]; i != 0; ) {
+			int nxt = next[i];
+			if (dl[i] <= now) {
+				if (cnt >= max) return cnt;
+				remove(i); tv[cnt++] = i;
+			}
+			i = nxt;
+		}
+		if (curTick >= nowTick) break;
+		curTick++;
+	}
+	return cnt;
+}
+
+/** Find the timer with the earliest deadline.
+ *  The result is exact when all deadlines lie within one revolution
+ *  of the wheel; otherwise it is the earliest timer in the first
+ *  non-empty slot.
+ *  @return the timer, or 0 if the wheel is empty
+ */
+int TimerWheel::earliest() const {
+	if (count == 0) return 0;
+	for (int k = 0; k < nSlots; k++) {
+		int s = (curTick + k) % nSlots;
+		if (head[s] == 0) continue;
+		int best = head[s];
+		for (int i = next[best]; i != 0; i = next[i])
+			if (dl[i] < dl[best]) best = i;
+		return best;
+	}
+	return 0;
+}
+
+} // ends namespace
@@ -0,0 +1,238 @@
+/** @file UringIo.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifdef HAVE_LIBURING
+
+#include "UringIo.h"
+
+namespace forest {
+
+/** Constructor for UringIo.
+ *  The rings are not created until init is called.
+ *  @param ps1 is the packet store used for received packets
+ */
+UringIo::UringIo(PacketStore *ps1) : PktIo(ps1) {
+	rxReady = txReady = false; br = 0;
+	nEmpty = 0;
+	for (int b = 0; b < NBUFS; b++) {
+		bufPkt[b] = 0; emptyBuf[nEmpty++] = b;
+	}
+	for (int i = 0; i <= Forest::MAXINTF; i++) armed[i] = false;
+	memset(&rxMsg, 0, sizeof(rxMsg));
+	rxMsg.msg_namelen = sizeof(sockaddr_in);
+	rxErr = 0;
+
+	nFree = 0; nPending = 0; txErr = 0; sndErrs = 0;
+	for (int x = TXSLOTS-1; x >= 0; x--) freeSlot[nFree++] = x;
+}
+
+UringIo::~UringIo() {
+	if (rxReady) {
+		if (br != 0) io_uring_free_buf_ring(&rx, br, NBUFS, BGID);
+		io_uring_queue_exit(&rx);
+	}
+	if (txReady) {
+		if (nPending > 0) io_uring_submit(&tx);
+		for (int k = 0; nFree < TXSLOTS && k < TXSLOTS; k++)
+			reap(true);
+		io_uring_queue_exit(&tx);
+	}
+	for (int b = 0; b < NBUFS; b++) {
+		if (bufPkt[b] != 0) ps->free(bufPkt[b]);
+	}
+}
+
+/** Create the rings and the provided buffer ring.
+ *  @return true on success, false if the kernel does not support
+ *  the required io_uring features
+ */
+bool UringIo::init() {
+	if (io_uring_queue_init(2*NBUFS, &rx, 0) < 0) return false;
+	rxReady = true;
+	int ret;
+	br = io_uring_setup_buf_ring(&rx, NBUFS, BGID, 0, &ret);
+	if (br == 0) return false;
+	if (io_uring_queue_init(2*TXSLOTS, &tx, 0) < 0) return false;
+	txReady = true;
+	refill();
+	return true;
+}
+
+/** Add packets to the provided buffer ring, to replace those consumed.
+ */
+void UringIo::refill() {
+	int mask = io_uring_buf_ring_mask(NBUFS);
+	int k = 0;
+	while (nEmpty > 0) {
+		pktx px = ps->alloc();
+		if (px == 0) break;
+		int b = emptyBuf[--nEmpty];
+		bufPkt[b] = px;
+		io_uring_buf_ring_add(br, (void *) ps->getPacket(px).buffer,
+				      Forest::BUF_SIZ, b, mask, k++);
+	}
+	if (k > 0) io_uring_buf_ring_advance(br, k);
+}
+
+/** Start a multishot recvmsg on an interface socket.
+ *  @param i is an interface with a registered socket
+ */
+void UringIo::arm(int i) {
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&rx);
+	if (sqe == 0) return;
+	io_uring_prep_recvmsg_multishot(sqe, sock[i], &rxMsg, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BGID;
+	io_uring_sqe_set_data64(sqe, i);
+	armed[i] = true;
+}
+
+/** Receive packets from the interface sockets.
+ *  @param pxv is an array in which the received packets are returned;
+ *  the bufferLen, tunIp and tunPort fields of each packet are set,
+ *  but the packets are not unpacked
+ *  @param ifv is an array in which the interfaces on which the
+ *  packets arrived are returned
+ *  @param n is the maximum number of packets to return
+ *  @return the number of packets returned, or -1 on an error; an error
+ *  that follows some received packets is reported by the next call
+ */
+int UringIo::recv(pktx *pxv, int *ifv, int n) {
+	if (rxErr != 0) { errno = rxErr; rxErr = 0; return -1; }
+	refill();
+	if (nEmpty < NBUFS) {
+		bool newArm = false;
+		for (int i = 1; i <= maxIf; i++) {
+			if (sock[i] >= 0 && !armed[i]) { arm(i); newArm = true; }
+		}
+		if (newArm) { io_uring_submit(&rx); rcvCalls++; }
+	}
+
+	int cnt = 0;
+	struct io_uring_cqe *cqe;
+	while (cnt < n && io_uring_peek_cqe(&rx, &cqe) == 0) {
+		int i = (int) io_uring_cqe_get_data64(cqe);
+		if (!(cqe->flags & IORING_CQE_F_MORE)) armed[i] = false;
+		if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+			int res = cqe->res;
+			io_uring_cqe_seen(&rx, cqe);
+			if (res == -ENOBUFS) { noBufs++; continue; }
+			if (res < 0) {
+				if (cnt > 0) { rxErr = -res; break; }
+				errno = -res; return -1;
+			}
+			continue;
+		}
+		int b = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		pktx px = bufPkt[b];
+		bufPkt[b] = 0; emptyBuf[nEmpty++] = b;
+		Packet& p = ps->getPacket(px);
+		char *base = (char *) p.buffer;
+		struct io_uring_recvmsg_out *out =
+			io_uring_recvmsg_validate(base, cqe->res, &rxMsg);
+		if (cqe->res < 0 || out == 0 || (out->flags & MSG_TRUNC)) {
+			io_uring_cqe_seen(&rx, cqe); ps->free(px); continue;
+		}
+		// extract source address before it is overwritten
+		sockaddr_in *sa = (sockaddr_in *) io_uring_recvmsg_name(out);
+		Np4d::extractSockAdr(*sa, p.tunIp, p.tunPort);
+		int nbytes = io_uring_recvmsg_payload_length(out, cqe->res,
+							     &rxMsg);
+		memmove(base, io_uring_recvmsg_payload(out, &rxMsg), nbytes);
+		io_uring_cqe_seen(&rx, cqe);
+
+		p.bufferLen = nbytes;
+		pxv[cnt] = px; ifv[cnt] = i; cnt++;
+	}
+	rcvPkts += cnt;
+	return cnt;
+}
+
+/** Send a packet.
+ *  A sendmsg request is prepared for the packet; requests are
+ *  submitted in batches.
+ *  @param s is the socket on which the packet is to be sent
+ *  @param px is the index of the packet; it is freed once sent
+ *  @param sa is the socket address of the destination
+ *  @return true on success, false if an earlier send failed with
+ *  an error that was not transient
+ */
+bool UringIo::send(int s, pktx px, const sockaddr_in& sa) {
+	if (nFree == 0) {
+		if (nPending > 0) {
+			io_uring_submit(&tx); sndCalls++; nPending = 0;
+		}
+		reap(true);
+	}
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&tx);
+	if (sqe == 0) {
+		io_uring_submit(&tx); sndCalls++; nPending = 0;
+		sqe = io_uring_get_sqe(&tx);
+	}
+	int x = freeSlot[--nFree];
+	TxSlot& ts = txSlot[x];
+	Packet& p = ps->getPacket(px);
+	ts.px = px; ts.sa = sa;
+	ts.iov.iov_base = (void *) p.buffer; ts.iov.iov_len = p.length;
+	memset(&ts.msg, 0, sizeof(ts.msg));
+	ts.msg.msg_name = &ts.sa; ts.msg.msg_namelen = sizeof(ts.sa);
+	ts.msg.msg_iov = &ts.iov; ts.msg.msg_iovlen = 1;
+	io_uring_prep_sendmsg(sqe, s, &ts.msg, 0);
+	io_uring_sqe_set_data64(sqe, x);
+	if (++nPending >= BATCH) {
+		io_uring_submit(&tx); sndCalls++; nPending = 0;
+	}
+	if (txErr != 0) { errno = txErr; txErr = 0; return false; }
+	return true;
+}
+
+/** Submit pending sends and reap completed ones.
+ *  @return true on success, false if some send failed with an error
+ *  that was not transient
+ */
+bool UringIo::flush() {
+	if (nPending > 0) {
+		io_uring_submit(&tx); sndCalls++; nPending = 0;
+	}
+	reap(false);
+	if (txErr != 0) { errno = txErr; txErr = 0; return false; }
+	return true;
+}
+
+/** Process completed sends, freeing their packets.
+ *  A packet whose send failed with a transient error is counted and
+ *  dropped; any other error is saved for the next send or flush.
+ *  @param wait is true if the caller should wait for at least one
+ *  completion
+ */
+void UringIo::reap(bool wait) {
+	struct io_uring_cqe *cqe;
+	if (wait && io_uring_wait_cqe(&tx, &cqe) < 0) return;
+	while (io_uring_peek_cqe(&tx, &cqe) == 0) {
+		int x = (int) io_uring_cqe_get_data64(cqe);
+		if (cqe->res >= 0) sndPkts++;
+		else if (transient(-cqe->res)) sndErrs++;
+		else txErr = -cqe->res;
+		io_uring_cqe_seen(&tx, cqe);
+		ps->free(txSlot[x].px);
+		freeSlot[nFree++] = x;
+	}
+}
+
+/** Create a string representation of the I/O statistics.
+ *  @return the string
+ */
+string UringIo::toString() const {
+	stringstream ss;
+	ss << PktIo::toString() << ", " << sndErrs << " lost to send errors";
+	return ss.str();
+}
+
+} // ends namespace
+
+#endif
@@ -1113,9 +1113,60 @@ bool setupPath(int ctx, list<LinkMod>& path, CpHandler& cph) {
 			return false;
 		}
 	}
+
+	// Finally, install routes among the routers on the path;
+	// routers learn any that are missing, so failures are not fatal
+	if (!setupPathRoutes(ctx,path,cph)) {
+		logger->log("setupPath: could not install all routes in comtree "
+			    + to_string(comtrees->getComtree(ctx)),1);
+	}
 	return true;
 }
 
+/** Install routes between the routers on a new comtree path.
+ *  Each router on the path, including the one at the top, gets a
+ *  unicast route in the comtree to each of the others, so that traffic
+ *  between them is not flooded while the routes are being learned.
+ *  All the routes for one router are sent in a single batch.
+ *  A router that fails to respond or rejects a route does not stop
+ *  routes from being sent to the others.
+ *  @param ctx is a valid comtree index
+ *  @param path is a list of LinkMod objects defining a path in
+ *  bottom-up order
+ *  @return false if any router fails to respond or rejects a route
+ */
+bool setupPathRoutes(int ctx, list<LinkMod>& path, CpHandler& cph) {
+	if (path.empty()) return true;
+	comt_t comt = comtrees->getComtree(ctx);
+	vector<int> rtrs, lnks;
+	for (LinkMod& lm : path) {
+		rtrs.push_back(lm.child); lnks.push_back(lm.lnk);
+	}
+	rtrs.push_back(net->getPeer(path.back().child,path.back().lnk));
+
+	int n = rtrs.size(); bool ok = true;
+	for (int k = 0; k < n; k++) {
+		// routers below k are reached through lnks[k-1],
+		// those above through lnks[k]
+		vector<int32_t> routes, failed;
+		for (int j = 0; j < n; j++) {
+			if (j == k) continue;
+			int lnk = (j < k ? lnks[k-1] : lnks[k]);
+			routes.push_back(comt);
+			routes.push_back(net->getNodeAdr(rtrs[j]));
+			routes.push_back(1);
+			routes.push_back(net->getLLnum(lnk,rtrs[k]));
+		}
+		if (!cph.addRouteBatch(net->getNodeAdr(rtrs[k]),routes,failed)
+		    || !failed.empty()) {
+			logger->log("setupPathRoutes: route installation failed "
+				    "at " + net->getNodeName(rtrs[k]),1);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
 /** Teardown a path in a comtree.
  *  This method sends configuration messages to routers in order to
  *  remove a path from a comtree. For each node in the path,
@@ -789,6 +789,255 @@ int CpHandler::sendAndWait(pktx px, CtlPkt& cp) {
 
 
 
+/** Retrieve a complete table from a router, using GET_TABLE requests.
+ *  Up to window requests are kept outstanding, each for a range of
+ *  table indexes. The first reply gives the largest index in the table
+ *  and shows how many indexes fit in one reply; the rest of the table
+ *  is requested in ranges of that size. When a reply does not complete
+ *  its range, a follow-up request is sent for the rest of it. If no
+ *  reply arrives for a second, the outstanding requests are sent again;
+ *  after three timeouts in a row, the transfer is abandoned.
+ *  @param dest is the address of the router
+ *  @param table identifies the table (see CtlPkt::TableId)
+ *  @param window is the maximum number of requests outstanding
+ *  @param entries is a vector in which the encoded entries are
+ *  returned, in index order (see CtlPkt for the encoding)
+ *  @return true on success, false on failure
+ */
+bool CpHandler::getTable(fAdr_t dest, int table, int window,
+			 vector<int32_t>& entries) {
+	map<int,int> pending;		// first index -> last index of
+					// ranges requested but not received
+	map<int,vector<int32_t>> pages;	// first index -> entries in range
+	int limit = 0;			// largest index in table
+	int span = 0;			// # of indexes per request
+	int nextFirst = 1;		// first index not yet requested
+
+	sendTableReq(dest, table, 1, 0); pending[1] = 0;
+	int timeouts = 0;
+	while (!pending.empty()) {
+		pktx reply = inq->deq(1000000000); // 1 sec timeout
+		if (reply == Queue::TIMEOUT) {
+			if (++timeouts >= 3) {
+				logger->log("CpHandler::getTable: no response "
+					    "from router",2);
+				return false;
+			}
+			for (auto& r : pending)
+				sendTableReq(dest, table, r.first, r.second);
+			continue;
+		}
+		Packet& p = ps->getPacket(reply);
+		CtlPkt cp(p);
+		if (cp.type != CtlPkt::GET_TABLE) { ps->free(reply); continue; }
+		if (cp.mode == CtlPkt::NEG_REPLY) {
+			string s; cp.xtrError(s);
+			logger->log("CpHandler::getTable: negative reply (" +
+				    s + ")",1,p);
+			ps->free(reply); return false;
+		}
+		int tbl, first, nxt, lim; vector<int32_t> v;
+		bool ok = cp.xtrGetTableReply(tbl, first, nxt, lim, v);
+		ps->free(reply);
+		if (!ok || tbl != table) continue;
+		auto it = pending.find(first);
+		if (it == pending.end()) continue; // duplicate reply
+		timeouts = 0;
+		int last = it->second; pending.erase(it);
+		pages[first] = std::move(v);
+
+		if (limit == 0) {
+			// reply to first request; use it to size the rest
+			limit = lim;
+			span = (nxt == 0 ? lim : nxt - first);
+			nextFirst = (nxt == 0 ? lim + 1 : nxt);
+		} else if (nxt != 0) {
+			// range not complete, so ask for the rest of it
+			sendTableReq(dest, table, nxt, last); pending[nxt] = last;
+		}
+		while ((int) pending.size() < window && nextFirst <= limit) {
+			int l = min(nextFirst + span - 1, limit);
+			sendTableReq(dest, table, nextFirst, l);
+			pending[nextFirst] = l; nextFirst = l + 1;
+		}
+	}
+	entries.clear();
+	for (auto& pg : pages)
+		entries.insert(entries.end(), pg.second.begin(), pg.second.end());
+	return true;
+}
+
+/** Send a GET_TABLE request through the main thread.
+ *  @param dest is the address of the router
+ *  @param table identifies the table
+ *  @param first is the first index in the range requested
+ *  @param last is the last index in the range (0 for the end of table)
+ */
+void CpHandler::sendTableReq(fAdr_t dest, int table, int first, int last) {
+	pktx px = ps->alloc();
+	if (px == 0) {
+		logger->log("CpHandler::sendTableReq: no packets "
+			    "left in packet store\n",4);
+		// terminates
+	}
+	Packet& p = ps->getPacket(px);
+	CtlPkt cp; cp.payload = (char*) p.payload();
+	cp.fmtGetTable(table, first, last);
+	p.length = Forest::OVERHEAD + cp.paylen;
+	p.type = Forest::NET_SIG; p.comtree = Forest::NET_SIG_COMT;
+	p.flags = 0; p.dstAdr = dest; p.srcAdr = myAdr;
+	p.tunIp = tunIp; p.tunPort = tunPort;
+	p.pack();
+	outq->enq(px);
+}
+
+/** Install a batch of routes at a router, using ADD_ROUTE_BATCH requests.
+ *  @param dest is the address of the router
+ *  @param routes is a vector of route tuples (see CtlPkt)
+ *  @param failed is a vector in which the positions of the tuples that
+ *  the router rejected are returned
+ *  @return true if the router replied to every request, else false
+ */
+bool CpHandler::addRouteBatch(fAdr_t dest, const vector<int32_t>& routes,
+			      vector<int32_t>& failed) {
+	return routeBatch(dest, CtlPkt::ADD_ROUTE_BATCH, routes, failed);
+}
+
+/** Remove a batch of routes at a router, using DROP_ROUTE_BATCH requests.
+ *  @param dest is the address of the router
+ *  @param routes is a vector of route tuples (see CtlPkt)
+ *  @param failed is a vector in which the positions of the tuples that
+ *  the router rejected are returned
+ *  @return true if the router replied to every request, else false
+ */
+bool CpHandler::dropRouteBatch(fAdr_t dest, const vector<int32_t>& routes,
+			       vector<int32_t>& failed) {
+	return routeBatch(dest, CtlPkt::DROP_ROUTE_BATCH, routes, failed);
+}
+
+/** Send a sequence of route tuples to a router in batch requests.
+ *  The tuples are split into as few packets as possible and up to four
+ *  requests are kept outstanding. Each request carries the position of
+ *  its first tuple, which the reply echoes, so replies can be matched
+ *  to requests. Applying a batch twice does no harm, so if no reply
+ *  arrives for a second, the outstanding requests are sent again;
+ *  after three timeouts in a row, the operation is abandoned.
+ *  @param dest is the address of the router
+ *  @param type is ADD_ROUTE_BATCH or DROP_ROUTE_BATCH
+ *  @param routes is a vector of route tuples
+ *  @param failed is a vector in which the positions of rejected tuples
+ *  are returned, in increasing order; this includes any tuple too large
+ *  to fit in a packet
+ *  @return true if the router replied to every request, else false
+ */
+bool CpHandler::routeBatch(fAdr_t dest, CtlPkt::CpType type,
+			   const vector<int32_t>& routes,
+			   vector<int32_t>& failed) {
+	const int window = 4;
+	failed.clear();
+
+	// split tuples into chunks; chunks maps the position of the first
+	// tuple in a chunk to the range of words in routes that it covers
+	map<int,pair<int,int>> chunks;
+	int pos = 0, first = 0, start = 0;
+	for (int i = 0; i < (int) routes.size(); pos++) {
+		int j = i;
+		if (!CtlPkt::nextRouteTuple(routes, j)) {
+			logger->log("CpHandler::routeBatch: malformed route "
+				    "tuple",2);
+			return false;
+		}
+		if (j - i > CtlPkt::ROUTE_BATCH_WORDS) {
+			if (i > start) chunks[first] = {start, i};
+			failed.push_back(pos);
+			first = pos+1; start = i = j;
+			continue;
+		}
+		if (j - start > CtlPkt::ROUTE_BATCH_WORDS) {
+			chunks[first] = {start, i};
+			first = pos; start = i;
+		}
+		i = j;
+	}
+	if ((int) routes.size() > start) chunks[first] = {start, (int) routes.size()};
+
+	set<int> pending;	// positions of chunks sent but not acked
+	auto nextChunk = chunks.begin();
+	int timeouts = 0;
+	while (nextChunk != chunks.end() || !pending.empty()) {
+		while ((int) pending.size() < window &&
+		       nextChunk != chunks.end()) {
+			sendRouteBatch(dest, type, nextChunk->first, routes,
+				       nextChunk->second.first,
+				       nextChunk->second.second);
+			pending.insert(nextChunk->first); nextChunk++;
+		}
+		pktx reply = inq->deq(1000000000); // 1 sec timeout
+		if (reply == Queue::TIMEOUT) {
+			if (++timeouts >= 3) {
+				logger->log("CpHandler::routeBatch: no "
+					    "response from router",2);
+				return false;
+			}
+			for (int p : pending) {
+				pair<int,int>& c = chunks[p];
+				sendRouteBatch(dest, type, p, routes,
+					       c.first, c.second);
+			}
+			continue;
+		}
+		Packet& p = ps->getPacket(reply);
+		CtlPkt cp(p);
+		if (cp.type != type) { ps->free(reply); continue; }
+		if (cp.mode == CtlPkt::NEG_REPLY) {
+			string s; cp.xtrError(s);
+			logger->log("CpHandler::routeBatch: negative reply (" +
+				    s + ")",1,p);
+			ps->free(reply); return false;
+		}
+		int rpos, count; vector<int32_t> rfailed;
+		bool ok = (type == CtlPkt::ADD_ROUTE_BATCH ?
+			   cp.xtrAddRouteBatchReply(rpos, count, rfailed) :
+			   cp.xtrDropRouteBatchReply(rpos, count, rfailed));
+		ps->free(reply);
+		if (!ok || pending.erase(rpos) == 0) continue;
+		timeouts = 0;
+		failed.insert(failed.end(), rfailed.begin(), rfailed.end());
+	}
+	sort(failed.begin(), failed.end());
+	return true;
+}
+
+/** Send a route batch request through the main thread.
+ *  @param dest is the address of the router
+ *  @param type is ADD_ROUTE_BATCH or DROP_ROUTE_BATCH
+ *  @param pos is the position of the first tuple in the request
+ *  @param routes is a vector of route tuples
+ *  @param start is the index in routes of the first word to send
+ *  @param end is one more than the index of the last word to send
+ */
+void CpHandler::sendRouteBatch(fAdr_t dest, CtlPkt::CpType type, int pos,
+			       const vector<int32_t>& routes,
+			       int start, int end) {
+	pktx px = ps->alloc();
+	if (px == 0) {
+		logger->log("CpHandler::sendRouteBatch: no packets "
+			    "left in packet store\n",4);
+		// terminates
+	}
+	Packet& p = ps->getPacket(px);
+	vector<int32_t> v(routes.begin()+start, routes.begin()+end);
+	CtlPkt cp; cp.payload = (char*) p.payload();
+	if (type == CtlPkt::ADD_ROUTE_BATCH) cp.fmtAddRouteBatch(pos, v);
+	else cp.fmtDropRouteBatch(pos, v);
+	p.length = Forest::OVERHEAD + cp.paylen;
+	p.type = Forest::NET_SIG; p.comtree = Forest::NET_SIG_COMT;
+	p.flags = 0; p.dstAdr = dest; p.srcAdr = myAdr;
+	p.tunIp = tunIp; p.tunPort = tunPort;
+	p.pack();
+	outq->enq(px);
+}
+
 /** Send a control packet reply back through the main thread.
  *  The control packet object is assumed to be already initialized.
  *  @param cp is the pre-formatted control packet
@@ -11,21 +11,27 @@
 using namespace forest;
 
 /** usage:
- *       NetMgr topoFile prefixFile finTime
+ *       NetMgr topoFile prefixFile finTime [shm=name]
  * 
  *  The first argument is the topology file (aka NetInfo file) that
  *  describes the network topology.
  *  PrefixFile is a file that maps IP prefixes of clients to forest routers.
  *  FinTime is the number of seconds to run.
  *  If zero, the NetMgr runs forever.
+ *  If the NetMgr runs on the same machine as its access router, the
+ *  optional last argument names the shared-memory ring defined for it
+ *  in the router's link table.
  */
 int main(int argc, char *argv[]) {
 	uint32_t finTime = 0;
 
-	if (argc != 4 ||
-	     sscanf(argv[3],"%d", &finTime) != 1)
-		Util::fatal("usage: NetMgr topoFile prefixFile finTime");
-	if (!NetMgr::init(argv[1], argv[2], finTime)) {
+	if ((argc != 4 && argc != 5) ||
+	     sscanf(argv[3],"%d", &finTime) != 1 ||
+	     (argc == 5 && strncmp(argv[4],"shm=",4) != 0))
+		Util::fatal("usage: NetMgr topoFile prefixFile finTime "
+			    "[shm=name]");
+	string shmName = (argc == 5 ? &argv[4][4] : "");
+	if (!NetMgr::init(argv[1], argv[2], finTime, shmName)) {
 		Util::fatal("NetMgr: initialization failure");
 	}
 	NetMgr::runAll();
@@ -38,9 +44,12 @@ namespace forest {
  *  @param topoFile is the name of the topology file
  *  @param pfxFile is the name of the prefix file
  *  @param finTime is the number of seconds to run (if zero, run forever)
+ *  @param shmName is the name of a shared-memory ring to the access
+ *  router, or the empty string if the ring is not to be used
  *  @return true on success, false on failure
  */
-bool NetMgr::init(const char *topoFile, const char *pfxFile, int finTime) {
+bool NetMgr::init(const char *topoFile, const char *pfxFile, int finTime,
+		  const string& shmName) {
 	int nPkts = 10000;
 	ps = new PacketStore(nPkts+1);
 	logger = new Logger();
@@ -140,6 +149,7 @@ bool NetMgr::init(const char *topoFile, const char *pfxFile, int finTime) {
 		return false;
 	}
 	sub->setRtrReady(false);
+	sub->setShmName(shmName);
 
 	return true;
 }
@@ -907,6 +917,11 @@ bool NetMgr::handleNewSession(pktx px, CtlPkt& cp) {
 }
 
 /** Setup a leaf by sending configuration packets to its access router.
+ *  The link to the leaf, its rate and its comtree links are configured
+ *  with a single COMPOUND request, so the router applies them together
+ *  (or not at all) and the setup takes one round trip. The operations
+ *  after the ADD_LINK give 0 as the link number; the router applies
+ *  them to the link it assigns.
  *  @param leaf is the node number for the leaf if this is a pre-configured
  *  leaf for which NetInfo object specifies various leaf parameters;
  *  it is 0 for leaf nodes that are added dynamically
@@ -926,7 +941,6 @@ fAdr_t NetMgr::setupLeaf(int leaf, pktx px, CtlPkt& cp, int rtr, int iface,
 	Forest::ntyp_t leafType; int leafLink; fAdr_t leafAdr; RateSpec rates;
 	ipa_t leafIp;
 
-	// first add the link at the router
 	if (leaf == 0) { // dynamic client
 		leafType = Forest::CLIENT; leafLink = leafIp = leafAdr = 0;
 	} else { // static leaf with specified parameters
@@ -939,81 +953,50 @@ fAdr_t NetMgr::setupLeaf(int leaf, pktx px, CtlPkt& cp, int rtr, int iface,
 	}
 	fAdr_t rtrAdr = net->getNodeAdr(rtr);
 	fAdr_t dest = (useTunnel ? 0 : rtrAdr); // TODO - check this
+
 	pktx qx = ps->alloc(); CtlPkt cq(ps->getPacket(qx));
-	cq.fmtAddLink(leafType, iface, leafLink, leafIp, 0, leafAdr, nonce);
+	cq.fmtCompound();
+	char opBuf[Forest::MAX_PLENG]; CtlPkt op; op.payload = opBuf;
+	bool ok = true;
+
+	// add the link and set its rate
+	op.fmtAddLink(leafType, iface, leafLink, leafIp, 0, leafAdr, nonce);
+	ok &= cq.putOp(op);
+	op.fmtModLink(leafLink,rates);
+	ok &= cq.putOp(op);
+
+	// add the leaf to the neighbor and client signalling comtrees
+	// and, for controllers, to the network signalling comtree
+	comt_t comts[3] = { Forest::NABOR_COMT, Forest::CLIENT_SIG_COMT,
+			    Forest::NET_SIG_COMT };
+	int nComt = (leafType == Forest::CLIENT ? 2 : 3);
+	for (int i = 0; i < nComt; i++) {
+		int ctx = comtrees->getComtIndex(comts[i]);
+		RateSpec crates = comtrees->getDefLeafRates(ctx);
+		comtrees->releaseComtree(ctx);
+		op.fmtAddComtreeLink(comts[i],leafLink,0,0,0,0);
+		ok &= cq.putOp(op);
+		op.fmtModComtreeLink(comts[i],leafLink,crates,0);
+		ok &= cq.putOp(op);
+	}
+	if (!ok) {
+		ps->free(qx);
+		errReply(px,cp,"could not configure leaf (request too long)");
+		return 0;
+	}
 	pktx rx = sendRequest(qx, cq.paylen, dest, px,
-				"could not add link to leaf");
-	if (rx == 0) return 0;
-	CtlPkt cr(ps->getPacket(rx));
-	cr.xtrAddLinkReply(leafLink, leafAdr);
-	ps->free(rx);
-
-	// next set the link rate
-	qx = ps->alloc(); cq.reset(ps->getPacket(qx));
-	cq.fmtModLink(leafLink,rates);
-	rx = sendRequest(qx, cq.paylen, dest, px, "could not set link rates");
-	if (rx == 0) return 0;
-	ps->free(rx);
-
-	// now add the new leaf to the neighbor comtree
-	qx = ps->alloc(); cq.reset(ps->getPacket(qx));
-	cq.fmtAddComtreeLink(Forest::NABOR_COMT,leafLink,0,0,0,0);
-	rx = sendRequest(qx, cq.paylen, dest, px,
-			 "could not add leaf to connection comtree");
-	if (rx == 0) return 0;
-	ps->free(rx);
-
-	// now modify comtree link rate
-	int ctx = comtrees->getComtIndex(Forest::NABOR_COMT);
-	rates = comtrees->getDefLeafRates(ctx);
-	comtrees->releaseComtree(ctx);
-	qx = ps->alloc(); cq.reset(ps->getPacket(qx));
-	cq.fmtModComtreeLink(Forest::NABOR_COMT,leafLink,rates);
-	rx = sendRequest(qx, cq.paylen, dest, px,
-			 "could not set rate on connection comtree");
-	if (rx == 0) return 0;
-	ps->free(rx);
-
-	// now add the new leaf to the client signalling comtree
-	qx = ps->alloc(); cq.reset(ps->getPacket(qx));
-	cq.fmtAddComtreeLink(Forest::CLIENT_SIG_COMT,leafLink,0,0,0,0);
-	rx = sendRequest(qx, cq.paylen, dest, px,
-			 "could not add leaf to client signalling comtree");
-	if (rx == 0) return 0;
-	ps->free(rx);
-
-	// now modify its comtree link rate
-	ctx = comtrees->getComtIndex(Forest::CLIENT_SIG_COMT);
-	rates = comtrees->getDefLeafRates(ctx);
-	comtrees->releaseComtree(ctx);
-	qx = ps->alloc(); cq.reset(ps->getPacket(qx));
-	cq.fmtModComtreeLink(Forest::CLIENT_SIG_COMT,leafLink,rates);
-	rx = sendRequest(qx, cq.paylen, dest, px,
-			 "could not set rate on client signalling comtree");
-	if (rx == 0) return 0;
-	ps->free(rx);
-	
-	if (leafType == Forest::CLIENT) return leafAdr;
-
-	// for controllers, also add to the network signaling comtree
-	qx = ps->alloc(); cq.reset(ps->getPacket(qx));
-	cq.fmtAddComtreeLink(Forest::NET_SIG_COMT,leafLink,0,0,0,0);
-	rx = sendRequest(qx, cq.paylen, dest, px,
-			 "could not add leaf to client signalling comtree");
+			      "could not configure leaf");
 	if (rx == 0) return 0;
-	ps->free(rx);
 
-	// and modify its comtree link rate
-	ctx = comtrees->getComtIndex(Forest::NET_SIG_COMT);
-	rates = comtrees->getDefLeafRates(ctx);
-	comtrees->releaseComtree(ctx);
-	qx = ps->alloc(); cq.reset(ps->getPacket(qx));
-	cq.fmtModComtreeLink(Forest::NET_SIG_COMT,leafLink,rates);
-	rx = sendRequest(qx, cq.paylen, dest, px,
-			 "could not set rate on client signalling comtree");
-	if (rx == 0) return 0;
+	// the first operation's reply gives the link and leaf address
+	CtlPkt cr(ps->getPacket(rx)); CtlPkt rop;
+	ok = cr.xtrCompoundReply() && cr.getOp(rop) &&
+	     rop.xtrAddLinkReply(leafLink, leafAdr);
 	ps->free(rx);
-
+	if (!ok) {
+		errReply(px,cp,"could not configure leaf (bad reply)");
+		return 0;
+	}
 	return leafAdr;
 }
 
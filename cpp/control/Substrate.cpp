@@ -21,12 +21,13 @@ Substrate::Substrate(int threadCount1, Controller *pool1,
 
 	rtrReady = false;
 	dgSock = listenSock = -1;
+	shm = 0;
 }
 
 Substrate::~Substrate() {
 	if (dgSock > 0) close(dgSock);
 	if (listenSock > 0) close(listenSock);
-	delete thredIdx; delete rptr; delete repH;
+	delete thredIdx; delete rptr; delete repH; delete shm;
 }
 
 bool Substrate::init(fAdr_t myAdr1, ipa_t myIp1, fAdr_t rtrAdr1,
@@ -99,9 +100,8 @@ bool Substrate::run() {
 		}
 
 		if (nothing2do) {
-			// check for expired entries in repH & remove oldest
-			int ox = repH->expired(now);
-			if (ox != 0) ps->free(ox);
+			// check for expired entries in repH
+			repH->expired(now);
 			nothing2do = false;
 		}
 		if (nothing2do && thredIdx->firstIn() == 0)
@@ -121,25 +121,20 @@ void Substrate::inbound(pktx px) {
 	}
 	CtlPkt cp(p);
 	if (cp.mode == CtlPkt::REQUEST) {
-		pktx sx;
+		int sx;
 		if ((sx = repH->find(p.srcAdr,cp.seqNum)) != 0) {
 			// repeat of a request we've already received
-			ps->free(px);
-			Packet& saved = ps->getPacket(sx);
-			CtlPkt scp(saved);
-			if (scp.mode != CtlPkt::REQUEST) {
+			if (repH->replied(sx)) {
 				// already replied, reply again
-				pktx cx = ps->clone(sx);
-				if (cx != 0) sendToForest(cx);
+				repH->getReply(sx,p);
+				sendToForest(px);
+			} else {
+				ps->free(px);
 			}
 			return;
 		}
-		// new request, save a copy
-		pktx cx = ps->clone(px);
-		pktx ox = repH->saveReq(cx,p.srcAdr,cp.seqNum,now);
-		if (ox != 0) { // old entry was removed to make room
-			ps->free(ox);
-		}
+		// new request, remember it
+		repH->saveReq(p.srcAdr,cp.seqNum,now);
 
 		// assign a thread to handle it
 		int thx = thredIdx->firstOut();
@@ -153,7 +148,7 @@ void Substrate::inbound(pktx px) {
 		return;
 	}
 	// reply; drop matching request
-	pair<int,int> pp = rptr->deleteMatch(cp.seqNum);
+	pair<int,int> pp = rptr->deleteMatch(cp.seqNum, now);
 	if (pp.first == 0) { // no matching request
 		ps->free(px); return;
 	}
@@ -176,12 +171,8 @@ void Substrate::outbound(pktx px, int thx) {
 	Packet& p = ps->getPacket(px);
 	CtlPkt cp(p);
 	if (cp.mode != CtlPkt::REQUEST) {
-		// save reply in repH, and free saved copy of request
-		pktx cx = ps->clone(px);
-		if (cx != 0) {
-			pktx sx = repH->saveRep(cx, p.dstAdr, cp.seqNum);
-			if (sx != 0) ps->free(sx);
-		}
+		// save copy of reply in repH
+		repH->saveRep(p.dstAdr, cp.seqNum, p);
 		// and send reply
 		sendToForest(px); return;
 	}
@@ -193,11 +184,13 @@ void Substrate::outbound(pktx px, int thx) {
 	}
 	// assign sequence number to outgoing request, send it and save copy
 	cp.seqNum = seqNum++; cp.updateSeqNum(); p.payErrUpdate();
+	fAdr_t peer = p.dstAdr;
 	sendToForest(px);
-	rptr->saveReq(cx, cp.seqNum, now, thx);
+	rptr->saveReq(cx, cp.seqNum, peer, now, thx);
 }
 
 /** Check for next packet from the Forest network.
+ *  Packets on the shared-memory ring (if any) are taken first.
  *  The sender's IP and port are placed in the packet's tunnel fields.
  *  @return next packet or 0, if no report has been received.
  */
@@ -207,7 +200,12 @@ pktx Substrate::recvFromForest() {
 	Packet& p = ps->getPacket(px);
 
 	ipa_t srcIp; ipp_t srcPort;
-	int nbytes = Np4d::recvfrom4d(dgSock,p.buffer,1500,srcIp,srcPort);
+	int nbytes = 0;
+	if (shm != 0 && (nbytes = shm->recv((void *) p.buffer,Forest::BUF_SIZ)) > 0) {
+		srcIp = rtrIp; srcPort = rtrPort;
+	} else {
+		nbytes = Np4d::recvfrom4d(dgSock,p.buffer,1500,srcIp,srcPort);
+	}
 	if (nbytes < Forest::OVERHEAD || !p.unpack()) {
 		ps->free(px); return 0;
 	}
@@ -223,7 +221,8 @@ cerr << p.toString() << endl;
 /** Send packet to Forest network.
  *  If the packet has a zero destination address, it is sent to the
  *  (ip,port) specified in the packet's tunnel fields. Otherwise,
- *  it is sent to the router.
+ *  it is sent to the router, through the shared-memory ring if there
+ *  is one and it has room.
  */
 void Substrate::sendToForest(pktx px) {
 	Packet p = ps->getPacket(px); p.pack();
@@ -237,6 +236,9 @@ void Substrate::sendToForest(pktx px) {
 cerr << "substrate sending to " << Np4d::ip2string(ip) << " " << port << endl;
 cerr << p.toString() << endl;
 */
+	if (p.dstAdr != 0 && shm != 0 && shm->send((void *) p.buffer, p.length)) {
+		ps->free(px); return;
+	}
 	if (port == 0) Util::fatal("Substrate::sendToForest: zero port number");
 	int rv = Np4d::sendto4d(dgSock,(void *) p.buffer, p.length,ip,port);
 	if (rv == -1) Util::fatal("Substrate::sendToForest: failure in sendto");
@@ -245,8 +247,18 @@ cerr << p.toString() << endl;
 
 /** Send initial connect packet to forest router
  *  Uses comtree 1, which is for user signalling.
+ *  If a shared-memory ring has been named, attach to it first;
+ *  failing to attach is an error, as it is for a host, since the
+ *  router sends to this end of the link on the ring once attached.
  */
 bool Substrate::connect() {
+	if (shmName.length() > 0 && shm == 0 &&
+	    (shm = ShmLink::attach(shmName)) == 0) {
+		logger->log("Substrate: could not attach to shared-memory "
+			    "ring " + shmName,4);
+		return false;
+	}
+
 	pktx px = ps->alloc();
 	Packet& p = ps->getPacket(px);
 
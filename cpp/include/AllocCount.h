@@ -0,0 +1,33 @@
+/** @file AllocCount.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef ALLOCCOUNT_H
+#define ALLOCCOUNT_H
+
+#include <cstdint>
+
+namespace forest {
+
+/** Counts heap allocations, so that benchmarks can report how many
+ *  allocations a code path makes.
+ *
+ *  A program that calls AllocCount::count gets a replacement for the
+ *  global operator new that counts its calls and then calls malloc.
+ *  Other programs are not affected. The router calls it only when it
+ *  is compiled with COUNT_ALLOCS defined (make COUNTALLOCS=1), so that
+ *  trace replays can report allocations without slowing down every
+ *  allocation in a normal build.
+ */
+class AllocCount {
+public:
+	static uint64_t count();
+};
+
+} // ends namespace
+
+#endif
@@ -0,0 +1,78 @@
+/** @file Bench.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <functional>
+#include <vector>
+#include "Forest.h"
+
+namespace forest {
+
+/** Harness for microbenchmarks.
+ *
+ *  A benchmark is a function that performs some number of operations
+ *  and leaves the data structure it uses as it found it, so that it can
+ *  be run repeatedly. Bench runs it once to warm up and then a given
+ *  number of times, and records the fastest run.
+ *
+ *  For each run, Bench measures the elapsed time and the number of
+ *  heap allocations and, where the kernel allows it, reads hardware
+ *  counters for cycles, instructions, cache misses and branch misses
+ *  using perf_event_open. Counters that cannot be read are reported
+ *  as -1. The results are written in CSV or JSON, one record per
+ *  benchmark, tagged with a label (usually a commit id), so that runs
+ *  made on different commits can be compared.
+ */
+class Bench {
+public:
+		Bench(int=5, const string& ="");
+		~Bench();
+
+	void	setFilter(const string&);
+	bool	run(const string&, const string&, uint64_t,
+		    std::function<void()>);
+
+	string	toCsv() const;
+	string	toJson() const;
+	string	toString() const;
+private:
+	static const int NCTR = 4;	///< number of hardware counters
+
+	/** result of one benchmark */
+	struct Result {
+	string	name;			///< name of benchmark
+	string	params;			///< parameters, as name=value list
+	uint64_t ops;			///< number of operations per run
+	uint64_t ns;			///< elapsed time of fastest run
+	uint64_t allocs;		///< heap allocations in fastest run
+	int64_t	ctr[NCTR];		///< counter values, or -1
+	};
+
+	int	reps;			///< number of timed runs
+	string	tag;			///< label included in results
+	string	filter;			///< if not empty, only run benchmarks
+					///< whose names contain filter
+	int	fd[NCTR];		///< perf event file descriptors, or -1
+	std::vector<Result> results;	///< results so far
+
+	void	openCounters();
+	void	startCounters();
+	void	stopCounters(int64_t*);
+	static double perOp(int64_t, uint64_t);
+};
+
+/** Restrict the benchmarks that are run.
+ *  @param f is a string; only benchmarks whose names contain f are run
+ */
+inline void Bench::setFilter(const string& f) { filter = f; }
+
+} // ends namespace
+
+#endif
@@ -108,6 +108,7 @@ void	releaseComtreeNum(int);
 // helper funnctions for coniguring routers to add/remove paths to comtrees
 bool	setupPath(int, list<LinkMod>&, CpHandler&);
 bool	teardownPath(int, list<LinkMod>&, CpHandler&);
+bool	setupPathRoutes(int, list<LinkMod>&, CpHandler&);
 bool	setupComtNode(int, int, CpHandler&);
 bool	teardownComtNode(int, int, CpHandler&);
 bool	setupComtLink(int, int, int, CpHandler&);
@@ -14,6 +14,7 @@
 #include "Dlist.h"
 #include "Hash.h"
 #include "HashMap.h"
+#include "Policer.h"
 #include "LinkTable.h"
 
 using namespace grafalgo;
@@ -48,6 +49,7 @@ public:
 	fAdr_t	dest;			///< if non-zero, allowed dest address
 	int	qnum;			///< queue number used by comtree
 	RateSpec rates;			///< rate spec for link (up=in,down=out)
+	Policer	pol;			///< ingress policer for untrusted peers
 	};
 
 	///< comtree table entry
@@ -96,6 +98,7 @@ public:
 	int	nextCoreLink(int, int) const;
 
 	// access routines 
+	int	maxComtIndex() const;
 	int	getComtIndex(comt_t) const;		
 	Entry&	getEntry(int) const;
 	comt_t	getComtree(int) const;
@@ -221,6 +224,11 @@ inline bool ComtreeTable::validComtree(comt_t comt) const {
 	return comtMap->contains(comt);
 }
 
+/** Get the largest comtree index.
+ *  @return the largest comtree index that can be used
+ */
+inline int ComtreeTable::maxComtIndex() const { return maxCtx; }
+
 /** Determine if a comtree index is being used in this table.
  *  @param ctx is a comtree index
  *  @return true if the table contains an entry matching ctx, else false.
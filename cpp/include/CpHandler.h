@@ -15,6 +15,8 @@
 #include "RateSpec.h"
 #include "Queue.h"
 #include "PacketStoreTs.h"
+#include <map>
+#include <set>
 
 namespace forest {
 
@@ -68,6 +70,10 @@ public:
 
         pktx getRouteSet(fAdr_t,int,int,CtlPkt&);
 
+	bool getTable(fAdr_t,int,int,vector<int32_t>&);
+	bool addRouteBatch(fAdr_t,const vector<int32_t>&,vector<int32_t>&);
+	bool dropRouteBatch(fAdr_t,const vector<int32_t>&,vector<int32_t>&);
+
 	pktx addFilter(fAdr_t,CtlPkt&);
 	pktx dropFilter(fAdr_t,int,CtlPkt&);
 	pktx modFilter(fAdr_t,int,string&,CtlPkt&);
@@ -105,6 +111,11 @@ private:
 	Logger* logger;		///< for reporting error messages
 
 	int sendAndWait(pktx, CtlPkt&);
+	void sendTableReq(fAdr_t, int, int, int);
+	bool routeBatch(fAdr_t, CtlPkt::CpType, const vector<int32_t>&,
+			vector<int32_t>&);
+	void sendRouteBatch(fAdr_t, CtlPkt::CpType, int,
+			    const vector<int32_t>&, int, int);
 };
 
 inline void CpHandler::setTunnel(ipa_t ip, ipp_t port) {
@@ -0,0 +1,109 @@
+/** @file CtlExecutor.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef CTLEXECUTOR_H
+#define CTLEXECUTOR_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Forest.h"
+#include "List.h"
+#include "Pair.h"
+#include "Hash.h"
+#include "HashMap.h"
+#include "PacketStore.h"
+#include "BlockingQ.h"
+
+using std::thread;
+using std::mutex;
+using std::unique_lock;
+using std::condition_variable;
+
+using namespace grafalgo;
+
+namespace forest {
+
+class Router;
+class RouterControl;
+
+/** Runs the router's control handlers on a small, fixed set of
+ *  worker threads.
+ *
+ *  Each incoming signalling request becomes a task. A task that
+ *  modifies a comtree has the comtree number as its key; tasks with
+ *  the same key are run one at a time, in the order they were
+ *  submitted, while tasks with different keys (or with no key) may run
+ *  concurrently. A task holds its key until it completes. Tasks waiting
+ *  for a key take no thread, so the number of requests in progress is
+ *  limited by the size of the task table, not by the number of threads.
+ *
+ *  Submit is called by the router's input thread.
+ */
+class CtlExecutor {
+public:
+	/** status of a task */
+	enum Status {
+		QUEUED,			///< ready, or waiting for its key
+		RUNNING			///< handler is running
+	};
+
+	/** a control task */
+	struct Task {
+	pktx	px;			///< request packet that started task
+	comt_t	key;			///< comtree the task is serialized on,
+					///< or 0
+	Status	status;			///< where the task is in its life
+	int	next;			///< next task waiting for same key
+	};
+
+		CtlExecutor(Router*, int, int, BlockingQ<pair<int,int>>*);
+		~CtlExecutor();
+
+	bool	submit(comt_t, pktx);
+	void	stop();
+
+	int	workers() const;
+	string	toString() const;
+private:
+	Router	*rtr;			///< router whose requests we handle
+	int	nWorkers;		///< number of worker threads
+	int	maxTasks;		///< max number of tasks in progress
+	bool	stopping;		///< set to stop the workers
+
+	Task	*tasks;			///< tasks[i] is task with index i
+	List	*freeTasks;		///< unused task indexes
+	List	*ready;			///< tasks ready to run
+	HashMap<comt_t,Pair<int,int>,Hash::u32> *waiting;
+					///< maps each busy key to the first
+					///< and last tasks waiting for it
+
+	thread	*thred;			///< worker threads
+	RouterControl *rc;		///< per-worker control handlers
+
+	mutable mutex mtx;		///< protects all of the above
+	condition_variable readyCond;	///< signalled when a task is ready
+
+	// statistics
+	uint64_t nSubmit;		///< # of tasks submitted
+	uint64_t nDelayed;		///< # of tasks that waited for a key
+	uint64_t nRejected;		///< # of tasks rejected when full
+	int	maxActive;		///< max # of tasks in progress at once
+
+	void	run(int);
+	void	finish(int);
+};
+
+/** Get the number of worker threads.
+ *  @return the number of workers
+ */
+inline int CtlExecutor::workers() const { return nWorkers; }
+
+} // ends namespace
+
+#endif
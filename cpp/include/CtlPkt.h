@@ -39,6 +39,37 @@ namespace forest {
  *
  *  Methods are provided to conveniently create control packets to
  *  be sent, or to "unpack" received control packets.
+ *
+ *  A GET_TABLE request asks for the entries of a router table whose
+ *  indexes lie in a given range. The reply carries as many of them as
+ *  fit, as a vector of 32 bit words in network byte order, together
+ *  with the index to continue from (0 if the range is complete) and
+ *  the largest index in the table. Each entry is encoded as its index,
+ *  the number of words that follow, and then the fields of the entry.
+ *  For version 1 these are
+ *
+ *  interface	ip, port, rates (4 words), available rates (4 words)
+ *  link	iface, peer type, peer ip, peer port, peer address,
+ *		rates (4 words), available rates (4 words)
+ *  comtree	comtree, core flag, parent link, then for each comtree
+ *		link: link, dest, rates (4 words)
+ *  route	comtree, address, then the link numbers of the route
+ *
+ *  Since each request names its own range, a client can have several
+ *  requests outstanding, for consecutive ranges.
+ *
+ *  ADD_ROUTE_BATCH and DROP_ROUTE_BATCH requests carry many routes at
+ *  once, as a vector of tuples (comtree, address, n, link 1,.., link n)
+ *  together with the position of the first tuple in a larger sequence
+ *  that the sender has split across packets. The reply echoes the
+ *  position and gives the number of tuples applied, along with the
+ *  positions of those that were rejected. Applying a batch a second
+ *  time has no further effect, so lost requests can simply be resent.
+ *
+ *  A COMPOUND packet carries a sequence of other control packets,
+ *  each packed as a single ctlOp attribute. A router applies the
+ *  operations in a compound request together, and its reply carries
+ *  the reply to each operation, in the same order.
  */
 class CtlPkt {
 public:
@@ -69,11 +100,15 @@ public:
 		GET_ROUTE = 72, MOD_ROUTE = 73,
 		ADD_ROUTE_LINK = 74, DROP_ROUTE_LINK = 75,
 		GET_ROUTE_SET = 76,
+		ADD_ROUTE_BATCH = 77, DROP_ROUTE_BATCH = 78,
 
 		ADD_FILTER = 80, DROP_FILTER = 81,
 		GET_FILTER = 82, MOD_FILTER = 83,
 		GET_FILTER_SET = 84, GET_LOGGED_PACKETS = 85,
-		ENABLE_PACKET_LOG = 86,
+		ENABLE_PACKET_LOG = 86, GET_HEAVY_HITTERS = 87,
+
+		GET_TABLE = 90, SAVE_TABLES = 91, STAGE_TRACE = 92,
+		GET_ROUTER_STATS = 93,
 
 		NEW_SESSION = 100, CANCEL_SESSION = 103,
 		CLIENT_CONNECT = 101, CLIENT_DISCONNECT = 102,
@@ -85,7 +120,9 @@ public:
 
 		COMTREE_PATH = 130,
 		ADD_BRANCH = 131, CONFIRM = 132, ABORT = 133,
-		PRUNE = 134, ADD_NODE = 135, DROP_NODE = 136
+		PRUNE = 134, ADD_NODE = 135, DROP_NODE = 136,
+
+		COMPOUND = 140
 	};
 
 	// Control packet attribute types
@@ -96,9 +133,22 @@ public:
 		s64 = 5, u64=6,
 		rateSpec = 7,
 		attrString = 8,
-		intVec = 9
+		intVec = 9,
+		ctlOp = 10
 	};
 
+	/** Tables that can be retrieved with GET_TABLE */
+	enum TableId {
+		IFACE_TABLE = 1, LINK_TABLE = 2,
+		COMTREE_TABLE = 3, ROUTE_TABLE = 4
+	};
+
+	/** Version of the binary table encoding used by GET_TABLE */
+	static const int TABLE_VERSION = 1;
+
+	/** Max number of words of route tuples in one batch packet */
+	static const int ROUTE_BATCH_WORDS = 300;
+
 	/** Control packet modes */
 	enum CpMode {
 		UNDEF_MODE = 0, REQUEST = 1, POS_REPLY = 2, NEG_REPLY = 3,
@@ -286,6 +336,19 @@ public:
 	void	fmtDropRouteLinkReply(int64_t=0);
 	bool	xtrDropRouteLinkReply();
 
+	void	fmtAddRouteBatch(int, const vector<int32_t>&, int64_t=0);
+	bool	xtrAddRouteBatch(int&, vector<int32_t>&);
+	void	fmtAddRouteBatchReply(int, int, const vector<int32_t>&,
+				      int64_t=0);
+	bool	xtrAddRouteBatchReply(int&, int&, vector<int32_t>&);
+
+	void	fmtDropRouteBatch(int, const vector<int32_t>&, int64_t=0);
+	bool	xtrDropRouteBatch(int&, vector<int32_t>&);
+	void	fmtDropRouteBatchReply(int, int, const vector<int32_t>&,
+				       int64_t=0);
+	bool	xtrDropRouteBatchReply(int&, int&, vector<int32_t>&);
+	static bool nextRouteTuple(const vector<int32_t>&, int&);
+
 	void	fmtAddFilter(int64_t=0);
 	bool	xtrAddFilter();
 	void	fmtAddFilterReply(int, int64_t=0);
@@ -321,6 +384,32 @@ public:
 	void	fmtEnablePacketLogReply(int64_t=0);
 	bool	xtrEnablePacketLogReply();
 
+	void	fmtGetHeavyHitters(int, int, int, int64_t=0);
+	bool	xtrGetHeavyHitters(int&, int&, int&);
+	void	fmtGetHeavyHittersReply(int, string, int64_t=0);
+	bool	xtrGetHeavyHittersReply(int&, string&);
+
+	void	fmtGetTable(int, int, int, int64_t=0);
+	bool	xtrGetTable(int&, int&, int&);
+	void	fmtGetTableReply(int, int, int, int, const vector<int32_t>&,
+				 int64_t=0);
+	bool	xtrGetTableReply(int&, int&, int&, int&, vector<int32_t>&);
+
+	void	fmtSaveTables(int64_t=0);
+	bool	xtrSaveTables();
+	void	fmtSaveTablesReply(int64_t=0);
+	bool	xtrSaveTablesReply();
+
+	void	fmtStageTrace(int, string, int64_t=0);
+	bool	xtrStageTrace(int&, string&);
+	void	fmtStageTraceReply(int, int, int64_t=0);
+	bool	xtrStageTraceReply(int&, int&);
+
+	void	fmtGetRouterStats(int64_t=0);
+	bool	xtrGetRouterStats();
+	void	fmtGetRouterStatsReply(string, int64_t=0);
+	bool	xtrGetRouterStatsReply(string&);
+
 	void	fmtNewSession(ipa_t, RateSpec, int64_t=0);
 	bool	xtrNewSession(ipa_t&, RateSpec&);
 	void	fmtNewSessionReply(fAdr_t, fAdr_t, ipa_t, ipp_t,
@@ -374,6 +463,13 @@ public:
 	void	fmtBootAbortReply(int64_t=0);
 	bool	xtrBootAbortReply();
 
+	void	fmtCompound(int64_t=0);
+	bool	xtrCompound();
+	void	fmtCompoundReply(int64_t=0);
+	bool	xtrCompoundReply();
+	bool	putOp(const CtlPkt&);
+	bool	getOp(CtlPkt&);
+
 	static string cpType2string(CpType);
 	static string cpMode2string(CpMode);
 	static bool string2cpType(string&, CpType&);
@@ -526,10 +622,11 @@ inline void CtlPkt::put(const string& s) {
  */
 inline void CtlPkt::put(const vector<int32_t>& v) {
 	*((int16_t*) next) = htons(intVec);		next+=sizeof(int16_t);
-	*((int16_t*) next) = htons((int16_t) v.size()*sizeof(int32_t));
+	*((int16_t*) next) = htons((int16_t) (v.size()*sizeof(int32_t)));
 							next+=sizeof(int16_t);
-	std::copy(v.begin(),v.end(),(int32_t*) next);
-						next+=v.size()*sizeof(int32_t);
+	for (int32_t x : v) {
+		*((int32_t*) next) = htonl(x);		next+=sizeof(int32_t);
+	}
 }
 
 /** Determine how much space is available for the next attribute.
@@ -656,7 +753,7 @@ inline bool CtlPkt::get(string& s) {
 	next += sizeof(int16_t);
 	int len = ntohs(*((int16_t*) next));
 	next += sizeof(int16_t);
-	std::copy(next, next+len, s.begin());
+	s.assign(next, len);
 	next += len;
 	return true;
 }
@@ -665,13 +762,14 @@ inline bool CtlPkt::get(string& s) {
  *  @param v is used to return the retrieved value
  */
 inline bool CtlPkt::get(vector<int32_t>& v) {
-	if (ntohs(*((int16_t*) next)) != attrString) return false;
+	if (ntohs(*((int16_t*) next)) != intVec) return false;
 	next += sizeof(int16_t);
 	int len = ntohs(*((int16_t*) next))/sizeof(int32_t);
 	next += sizeof(int16_t);
-	int32_t* vv = (int32_t*) next;
-	std::copy(vv, vv+len, v.begin());
-	next += len * sizeof(int32_t);
+	v.resize(len);
+	for (int i = 0; i < len; i++) {
+		v[i] = ntohl(*((int32_t*) next)); next += sizeof(int32_t);
+	}
 	return true;
 }
 
@@ -125,6 +125,12 @@ public:
 	static const flgs_t RTE_REQ = 0x01;	///< route request
 	static const flgs_t ACK_FLAG = 0x02;	///< acknowledgment
 	static const flgs_t NACK_FLAG = 0x02;	///< negative acknowledgment
+	static const flgs_t AGG_FLAG = 0x04;	///< in CONNECT, sender accepts
+						///< aggregate datagrams
+	static const flgs_t AGG_ACK = 0x08;	///< in CONNECT ack, aggregation
+						///< accepted by peer
+	static const uint8_t AGG_VERSION = 2;	///< version field used in
+						///< aggregate datagrams
 
 	// well-known ports
 	static const ipp_t NM_PORT = 30120; 	///< port # used by netMgr
@@ -0,0 +1,86 @@
+/** @file HeavyHitters.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef HEAVYHITTERS_H
+#define HEAVYHITTERS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include "Forest.h"
+#include "SpaceSaving.h"
+
+using std::atomic;
+using std::condition_variable;
+using std::mutex;
+using std::unique_lock;
+
+namespace forest {
+
+/** This class identifies the heaviest sources of traffic arriving
+ *  at a router. Every received packet is recorded in three Space-Saving
+ *  sketches, keyed by source address, comtree and input link.
+ *  The sketches belong to the input thread, which updates them without
+ *  locking. Control threads that answer GET_HEAVY_HITTERS requests read
+ *  a snapshot of the heaviest keys instead; they ask for one and the
+ *  input thread copies it, under a lock, at its next timer check (see
+ *  publish). Resets are requested the same way.
+ *  Rates are computed over the period since the sketches were last reset.
+ */
+class HeavyHitters {
+public:
+	/** keys by which traffic is classified */
+	enum KeyType { BY_SRC=0, BY_COMT=1, BY_LINK=2, NUM_KEYS=3 };
+	static const int MAXTOP = 20;	///< max keys in a snapshot
+
+		HeavyHitters(int, int64_t);
+		~HeavyHitters();
+
+	void	update(fAdr_t, comt_t, int, int);
+	void	publish(int64_t);
+
+	void	reset();
+	string	toString(int, int);
+private:
+	SpaceSaving *sketch[NUM_KEYS];	///< one sketch per key type
+	int64_t	startTime;		///< time of last reset (ns)
+
+	atomic<bool> snapReq;		///< set when a reader wants a snapshot
+	atomic<bool> resetReq;		///< set when a reader wants a reset
+
+	// snapshot, protected by mtx
+	vector<SpaceSaving::Counter> top[NUM_KEYS]; ///< heaviest keys
+	uint64_t total[NUM_KEYS];	///< total bytes for each key type
+	int64_t	snapStart;		///< start of period in snapshot (ns)
+	int64_t	snapTime;		///< time snapshot was taken (ns)
+	uint64_t snapCount;		///< number of snapshots taken
+	mutex	mtx;			///< protects snapshot
+	condition_variable snapReady;	///< signalled when snapshot taken
+};
+
+/** Record a received packet.
+ *  Called only by the input thread.
+ *  @param src is the packet's source address
+ *  @param comt is the packet's comtree
+ *  @param lnk is the link on which the packet arrived
+ *  @param leng is the packet length in bytes
+ */
+inline void HeavyHitters::update(fAdr_t src, comt_t comt, int lnk, int leng) {
+	sketch[BY_SRC]->update((uint32_t) src, leng);
+	sketch[BY_COMT]->update(comt, leng);
+	sketch[BY_LINK]->update(lnk, leng);
+}
+
+/** Request that the sketches be cleared.
+ *  The reset takes effect at the input thread's next call to publish.
+ */
+inline void HeavyHitters::reset() { resetReq.store(true); }
+
+} // ends namespace
+
+#endif
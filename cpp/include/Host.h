@@ -17,6 +17,7 @@ using namespace std::chrono;
 #include "Forest.h"
 #include "Packet.h"
 #include "PacketStore.h"
+#include "ShmLink.h"
 
 namespace forest {
 
@@ -30,7 +31,7 @@ namespace forest {
  */
 class Host {
 public:
-		Host(ipa_t, ipa_t);
+		Host(ipa_t, ipa_t, const string&);
 		~Host();
 
 	bool	init();			
@@ -43,6 +44,8 @@ private:
 	ipa_t	myIpAdr;		// IP address of interface
 	ipa_t	rtrIpAdr;		// IP address of router
 	int	sock;			// socket number
+	string	shmName;		// name of shared-memory ring, or ""
+	ShmLink	*shm;			// shared-memory ring to router, or 0
 
 	PacketStore *ps;		// pointer to packet store
 };
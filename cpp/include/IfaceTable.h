@@ -27,6 +27,8 @@ public:
 	int	sock;			///< socket number of interface
 	RateSpec rates;			///< total rates for interface
 	RateSpec availRates;		///< available rates for interface
+	string	dev;			///< network device for ring mode,
+					///< or empty for a plain UDP socket
 
 	string	toString() const;
 	friend	ostream& operator<<(ostream& out, const Entry& a) {
@@ -45,6 +47,7 @@ public:
 	int	nextIface(int) const;
 
 	// access methods 
+	int	maxIface() const;
 	Entry&	getEntry(int);
 	int	getDefaultIface() const;
 	int	getFreeIface() const;
@@ -70,6 +73,11 @@ private:
 
 };
 
+/** Get the largest interface number.
+ *  @return the largest interface number that can be used
+ */
+inline int IfaceTable::maxIface() const { return maxIf; }
+
 /** Check an interface number for validity.
  *  @param iface is the interface to be checked
  *  @return true if iface is a valid interface number, else false
@@ -0,0 +1,66 @@
+/** @file LinkIo.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef LINKIO_H
+#define LINKIO_H
+
+#include "Forest.h"
+#include "PacketStore.h"
+
+namespace forest {
+
+/** Abstract base class for transports that carry the packets of
+ *  individual links, in place of the interface sockets.
+ *
+ *  A packet received by a link transport identifies its link
+ *  directly; recv sets the packet's inLink field, along with its
+ *  tunnel fields, so the router skips the link table lookup.
+ *  As with the interface backends (PktIo), recv is called only by the
+ *  input thread and send only by the output thread.
+ */
+class LinkIo {
+public:
+	virtual	~LinkIo() {}
+
+	/** Determine if a link uses this transport.
+	 *  @param lnk is a link number
+	 *  @return true if packets for lnk are sent using this transport
+	 */
+	virtual bool hasLink(int lnk) const = 0;
+
+	/** Stop using this transport for a link.
+	 *  @param lnk is a link number
+	 */
+	virtual void close(int lnk) = 0;
+
+	/** Receive packets.
+	 *  @param pxv is an array in which the received packets are returned
+	 *  @param lnkv is an array in which their links are returned
+	 *  @param n is the maximum number of packets to return
+	 *  @return the number of packets returned, or -1 on an error
+	 */
+	virtual int recv(pktx* pxv, int* lnkv, int n) = 0;
+
+	/** Send a packet.
+	 *  @param lnk is the link on which the packet is to be sent
+	 *  @param px is the index of the packet; it is freed once sent
+	 *  @return true on success, false on failure
+	 */
+	virtual bool send(int lnk, pktx px) = 0;
+
+	/** Push out packets held by the transport.
+	 *  @return true on success, false on failure
+	 */
+	virtual bool flush() { return true; }
+
+	virtual string toString() const = 0;
+};
+
+} // ends namespace
+
+#endif
@@ -0,0 +1,98 @@
+/** @file LinkSocks.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef LINKSOCKS_H
+#define LINKSOCKS_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <sys/epoll.h>
+#include "Forest.h"
+#include "Np4d.h"
+#include "PacketStore.h"
+#include "LinkIo.h"
+
+using std::atomic;
+using std::mutex;
+
+namespace forest {
+
+/** Connected UDP sockets for long-lived links to peer routers.
+ *
+ *  Each such link gets its own UDP socket, bound to the address and port
+ *  of the link's interface (using SO_REUSEPORT, which must also be set
+ *  on the interface socket before it is bound) and connected to the peer.
+ *  The kernel delivers packets from the peer to the connected socket,
+ *  in preference to the interface socket, so the link of a received packet
+ *  is known without a table lookup, and packets sent on the socket need
+ *  no destination address.
+ *
+ *  The sockets are registered with an epoll instance, with the link
+ *  number as the event data, so finding the ready sockets takes a single
+ *  system call, however many links there are.
+ *
+ *  recv is called only by the input thread and send only by the output
+ *  thread. Sockets are opened and closed by other threads, so a closed
+ *  socket is not released for a second, letting a send that is already
+ *  in progress complete harmlessly.
+ */
+class LinkSocks : public LinkIo {
+public:
+		LinkSocks(PacketStore*, int);
+		~LinkSocks();
+
+	static bool shareSock(int);
+
+	bool	open(int, ipa_t, ipp_t, ipa_t, ipp_t);
+	void	close(int);
+	bool	hasLink(int) const;
+
+	int	recv(pktx*, int*, int);
+	bool	send(int, pktx);
+
+	string	toString() const;
+private:
+	static const int BATCH = 32;	///< max events per epoll_wait call
+
+	PacketStore *ps;		///< packet store for received packets
+	int	maxLnk;			///< largest link number
+	int	epfd;			///< epoll instance for link sockets
+	atomic<int> *sock;		///< sock[lnk] is socket for lnk, or -1
+	ipa_t	*peerIp;		///< peerIp[lnk] is IP address of peer
+	ipp_t	*peerPort;		///< peerPort[lnk] is port of peer
+
+	epoll_event evt[BATCH];		///< ready sockets from epoll_wait
+
+	/** socket that has been closed but not yet released */
+	struct Retired {
+	int	sock;			///< socket number
+	int64_t	when;			///< time it was closed (ns)
+	};
+	std::vector<Retired> retired;	///< sockets waiting to be released
+	mutex	retMtx;			///< lock for retired
+
+	// statistics
+	uint64_t rcvPkts;		///< # of packets received
+	uint64_t sndPkts;		///< # of packets sent
+	uint64_t sndErrs;		///< # of packets that could not be sent
+
+	void	release();
+};
+
+/** Determine if a link has a connected socket.
+ *  @param lnk is a link number
+ *  @return true if lnk has a socket
+ */
+inline bool LinkSocks::hasLink(int lnk) const {
+	return 1 <= lnk && lnk <= maxLnk && sock[lnk].load() >= 0;
+}
+
+} // ends namespace
+
+#endif
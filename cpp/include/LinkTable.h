@@ -38,6 +38,12 @@ public:
 	RateSpec rates;			///< rate spec for link rates
 	RateSpec availRates;		///< rate spec for available rates
 	StatCounts stats;		///< rate statistics for link
+	uint64_t policedPkts;		///< # of packets dropped by policer
+	uint64_t policedBytes;		///< # of bytes dropped by policer
+	bool	aggregate;		///< true if packets sent to peer may
+					///< be aggregated
+	string	shm;			///< name of shared-memory ring used
+					///< to reach a co-located peer, or ""
 
 		Entry();
 		Entry(const Entry&);
@@ -123,6 +129,7 @@ inline LinkTable::Entry::Entry() {
 	iface  = 0;
 	peerIp = 0; peerPort = 0; peerType = Forest::UNDEF_NODE; peerAdr = 0;
 	isConnected = false; nonce = 0;
+	policedPkts = policedBytes = 0; aggregate = false;
 }
 	
 inline LinkTable::Entry::Entry(const Entry& e) {
@@ -131,6 +138,8 @@ inline LinkTable::Entry::Entry(const Entry& e) {
 	peerType = e.peerType; peerAdr = e.peerAdr;
 	isConnected = e.isConnected; nonce = e.nonce;
 	rates = e.rates; availRates = e.availRates;
+	policedPkts = policedBytes = 0; aggregate = e.aggregate;
+	shm = e.shm;
 }
 
 inline string LinkTable::Entry::toString() const {
@@ -140,6 +149,7 @@ inline string LinkTable::Entry::toString() const {
            << setw(10) << left << Forest::nodeType2string(peerType)
            << " " << setw(10) << left <<Forest::fAdr2string(peerAdr)
            << " " << rates.toString() << " " << nonce;
+	if (shm.length() > 0) ss << " shm=" << shm;
 	return ss.str();
 }
 
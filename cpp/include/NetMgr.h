@@ -60,7 +60,7 @@ public:
 		NetMgr();
 		~NetMgr();
 
-	static bool init(const char*, const char*, int);
+	static bool init(const char*, const char*, int, const string&);
 	static void cleanup();
 	static bool runAll();
 
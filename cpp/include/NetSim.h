@@ -0,0 +1,163 @@
+/** @file NetSim.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef NETSIM_H
+#define NETSIM_H
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include "stdinc.h"
+#include "Dheap.h"
+#include "HashSet.h"
+#include "Forest.h"
+#include "PacketStore.h"
+#include "LinkTable.h"
+#include "ComtreeTable.h"
+#include "RouteTable.h"
+#include "QuManager.h"
+#include "NetInfo.h"
+#include "ComtInfo.h"
+
+using std::vector;
+
+namespace forest {
+
+/** Discrete-event simulator for a Forest network.
+ *
+ *  All the routers of a network are simulated in one process. Each
+ *  router has its own link table, comtree table, route table and queue
+ *  manager, configured from the same NetInfo/ComtInfo topology file that
+ *  the network manager uses; the packet store is shared. Links carry
+ *  packets with a propagation delay proportional to the link length
+ *  and a transmission time given by the link rate. Time is simulated;
+ *  nothing waits on the wall clock.
+ *
+ *  Each node of a comtree (leaf or router) is a traffic source that
+ *  sends unicast packets to randomly chosen nodes in the same comtree,
+ *  with exponentially distributed inter-packet times. Routers learn
+ *  routes as traffic arrives, much as they do in a live network, but
+ *  the route is computed directly from the comtree topology rather
+ *  than by flooding a route request.
+ */
+class NetSim {
+public:
+		NetSim(NetInfo*, ComtInfo*, int, int);
+		~NetSim();
+
+	bool	setup(uint64_t, uint64_t);
+	void	setTraffic(double, int);
+	void	run(uint64_t);
+
+	string	toString() const;
+	string	linkStats() const;
+private:
+	NetInfo	*net;			///< network topology
+	ComtInfo *comtrees;		///< comtree topology
+	int	nPkts;			///< number of packets in packet store
+	int	nRts;			///< max routes per router
+
+	PacketStore *ps;		///< packets for all routers
+	uint64_t now;			///< current simulated time in ns
+
+	/** a link at a simulated router */
+	struct SimLink {
+	int	peer;			///< node number of peer
+	int	peerLnk;		///< link number used by peer, if
+					///< peer is a router, else 0
+	uint32_t nsPerByte;		///< transmission time per byte
+	uint64_t delay;			///< propagation delay in ns
+	uint64_t busy;			///< total transmission time in ns
+	uint64_t pkts;			///< packets sent on link
+	uint64_t bytes;			///< bytes sent on link
+	};
+
+	/** a simulated router */
+	struct SimRtr {
+	fAdr_t	adr;			///< forest address of router
+	int	maxLnk;			///< largest local link number
+	LinkTable *lt;			///< router's link table
+	ComtreeTable *ctt;		///< router's comtree table
+	RouteTable *rt;			///< router's route table
+	QuManager *qm;			///< router's queue manager
+	SimLink	*lnk;			///< lnk[i] describes local link i
+	int	svcEv;			///< pending service event, or 0
+	uint64_t fwdPkts;		///< packets queued for output
+	};
+	SimRtr	*rtr;			///< rtr[r] is router with node number r
+	int	maxRtr;			///< largest router node number
+
+	/** a simulated comtree */
+	struct SimComt {
+	comt_t	comt;			///< comtree number
+	int	ctx;			///< index of comtree in comtrees
+	vector<fAdr_t> nodes;		///< routers and leaves in comtree
+	};
+	vector<SimComt> comts;		///< comts[sc] is simulated comtree
+	HashSet<comt_t,Hash::u32> *comtSet; ///< maps comtree number to sc
+
+	/** a traffic source */
+	struct Source {
+	int	sc;			///< index in comts
+	fAdr_t	adr;			///< address of source
+	int	rtr;			///< router the source sends to
+	int	lnk;			///< link at rtr, or 0 if the source
+					///< is the router itself
+	uint64_t delay;			///< propagation delay to rtr
+	};
+	vector<Source> srcs;		///< traffic sources
+	double	meanGap;		///< mean time between packets (ns)
+	int	pktLen;			///< length of generated packets
+
+	/** types of events */
+	enum EvType { SOURCE, ARRIVE, SERVICE };
+	/** a pending event */
+	struct Event {
+	EvType	type;			///< type of event
+	int	node;			///< source index or router node number
+	int	lnk;			///< link on which packet arrives
+	pktx	px;			///< arriving packet
+	};
+	Event	*evt;			///< evt[e] is event with index e
+	int	maxEv;			///< largest event index
+	Dheap<uint64_t> *evq;		///< pending events, ordered by time
+	vector<int> freeEv;		///< unused event indexes
+
+	// statistics
+	uint64_t nEvents;		///< events processed
+	uint64_t sentPkts;		///< packets generated by sources
+	uint64_t rcvdPkts;		///< packets delivered
+	uint64_t rcvdBytes;		///< bytes delivered
+	uint64_t totDelay;		///< sum of delivered packet latencies
+	uint64_t maxDelay;		///< largest latency
+	uint64_t noBufs;		///< packets not sent, store empty
+	uint64_t noRoute;		///< packets discarded, no route
+	uint64_t qDrops;		///< packets discarded, queue full
+	uint64_t routes;		///< routes learned
+	uint64_t simTime;		///< length of last run in ns
+	double	wallTime;		///< seconds of real time for last run
+
+	bool	setupRouter(int, int, int, uint64_t, uint64_t);
+	bool	setupComtrees();
+	bool	addComtLink(int, comt_t, int, bool, bool);
+	void	setupSources();
+
+	int	schedule(uint64_t, EvType, int, int, pktx);
+	uint64_t gap() const;
+	void	inject(int);
+	void	forward(int, pktx);
+	int	learnRoute(int, int, Packet&);
+	void	service(int);
+	void	depart(int, int, pktx);
+	void	deliver(pktx, uint64_t);
+	int	localLink(int, int, fAdr_t) const;
+};
+
+} // ends namespace
+
+#endif
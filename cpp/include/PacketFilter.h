@@ -9,12 +9,17 @@
 #ifndef PACKETFILTER
 #define PACKETFILTER
 
+#include <bitset>
+#include <unordered_map>
 #include "Forest.h"
 #include "Util.h"
 #include "NetBuffer.h"
 #include "Packet.h"
 #include "CtlPkt.h"
 
+using std::bitset;
+using std::unordered_map;
+
 namespace forest {
 
 /** Support class used by PacketLog to control packet logging */
@@ -35,6 +40,89 @@ public:
 	bool fromString(string& s);
 };
 
+/** A compiled form of a set of packet filters, used to decide quickly
+ *  whether a packet matches any of them.
+ *
+ *  For each packet field, the index keeps the set of filters that
+ *  accept any value of the field, plus a table that maps each specific
+ *  value to the set of filters that require that value. Sets of filters
+ *  are bit vectors indexed by filter number. A packet matches if the
+ *  intersection of the sets selected by its field values is non-empty,
+ *  so the cost of a match is one lookup per field, no matter how many
+ *  filters there are. An index is never modified once built; to change
+ *  the filters, a new index is built and swapped in.
+ */
+class FilterIndex {
+public:
+	static const int SIZE = 128;	///< max filter number + 1
+	typedef bitset<SIZE> fset;
+
+		FilterIndex();
+
+	void	add(int, const PacketFilter&);
+	bool	match(const Packet&, int, bool) const;
+private:
+	/** filters sets for one field */
+	struct Field {
+	fset	any;			///< filters that ignore the field
+	unordered_map<int,fset> val;	///< filters needing a given value
+
+	void	add(int, int);
+	fset	get(int) const;
+	};
+
+	bool	defined;		///< true if any filter has been added
+	fset	dir[2];			///< dir[1] for out-going packets
+	Field	lnk;			///< link field
+	Field	comt;			///< comtree field
+	Field	srcAdr;			///< source address field
+	Field	dstAdr;			///< destination address field
+	fset	anyType;		///< filters that ignore the packet type
+	fset	type[256];		///< type[t] filters needing type t
+	Field	cpType;			///< control packet type field
+};
+
+/** Add a filter to the set needing a given value of a field.
+ *  @param f is the filter number
+ *  @param v is the value required by the filter, or 0 for any value
+ */
+inline void FilterIndex::Field::add(int f, int v) {
+	if (v == 0) any.set(f);
+	else val[v].set(f);
+}
+
+/** Get the filters that accept a given value of a field.
+ *  @param v is the field value
+ *  @return the set of filters
+ */
+inline FilterIndex::fset FilterIndex::Field::get(int v) const {
+	unordered_map<int,fset>::const_iterator p = val.find(v);
+	return (p == val.end() ? any : any | p->second);
+}
+
+/** Determine if a packet matches some filter in the index.
+ *  If no filters have been added, every packet matches.
+ *  @param p is a packet with its header unpacked
+ *  @param lnk is the link the packet is being sent on (or was received
+ *  from)
+ *  @param sendFlag is true if the packet is being sent; else it is false
+ *  @return true if p matches some enabled filter
+ */
+inline bool FilterIndex::match(const Packet& p, int lnk, bool sendFlag) const {
+	if (!defined) return true;
+	fset m = dir[sendFlag ? 1 : 0];
+	if (m.none()) return false;
+	m &= this->lnk.get(lnk);
+	if (m.none()) return false;
+	m &= comt.get(p.comtree) & srcAdr.get(p.srcAdr) & dstAdr.get(p.dstAdr)
+	     & (anyType | type[p.type & 0xff]);
+	if (m.none()) return false;
+	if (p.type != Forest::CLIENT_SIG && p.type != Forest::NET_SIG)
+		return true;
+	m &= cpType.get(ntohl(p.payload()[0]));
+	return m.any();
+}
+
 } // ends namespace
 
 #endif
@@ -11,10 +11,13 @@
 
 #include <thread>
 #include <mutex>
+#include <chrono>
+#include <atomic>
 
 using std::thread;
 using std::mutex;
 using std::recursive_mutex;
+using std::atomic;
 
 #include "Forest.h"
 #include "Util.h"
@@ -22,12 +25,30 @@ using std::recursive_mutex;
 #include "Packet.h"
 #include "CtlPkt.h"
 #include "PacketFilter.h"
+#include "PktCapture.h"
+#include "Pcapng.h"
 #include "ListPair.h"
 
 namespace forest {
 
 typedef int fltx;	// filter index
 
+/** Maintains a log of packets sent and received by a router.
+ *
+ *  The packet processing threads call log(), which checks the packet
+ *  against a compiled index of the filters and, if it matches, copies
+ *  the first SNAP_LEN bytes of the packet into a lock-free capture ring,
+ *  one ring per thread. An exporter thread drains the rings in time
+ *  order and saves the packets in the event log, from which they are
+ *  extracted for remote clients, or written to cout. They can also be
+ *  written to a pcapng file. Packets lost because a capture ring was
+ *  full are recorded as gaps in the log.
+ *
+ *  Whenever the filters change, a new index is built and swapped in
+ *  atomically. Each packet thread publishes the index it is using in a
+ *  hazard pointer, so an old index is only deleted once neither thread
+ *  can still be using it.
+ */
 class PacketLog {
 public:
 		PacketLog(PacketStore*);
@@ -42,21 +63,31 @@ public:
 	void	disable(fltx);
 	fltx	addFilter();
 	void	dropFilter(fltx);
-	PacketFilter& getFilter(fltx);
+	const PacketFilter& getFilter(fltx);
+	void	setFilter(fltx, const PacketFilter&);
 	void	turnOnLogging(bool);
 	void	enableLocalLog(bool);
 
+	bool	openPcap(const string&, uint64_t);
+
 	int	size();
 	void 	log(int,int,bool,uint64_t);	
 	int	extract(int, string&);
 	void	write(ostream&);
 	void	purge();
 
+	static const int IN_RING = 0;		///< ring for input thread
+	static const int OUT_RING = 1;		///< ring for output thread
 private:
 	static const int MAX_EVENTS=10000;	///< max # of event records
 	static const int MAX_FILTERS=100;	///< max # of filters
+	static_assert(MAX_FILTERS < FilterIndex::SIZE,
+		      "MAX_FILTERS too large for FilterIndex");
+	static const int SNAP_LEN=256;		///< max bytes saved per packet
+	static const int RING_SLOTS=4096;	///< records per capture ring
+	static const int DRAIN_BATCH=1000;	///< max records per drain pass
 
-	bool	logOn;			///< turns on capture of packets
+	atomic<bool> logOn;		///< turns on capture of packets
 	bool	logLocal;		///< if true, dump events to cout
 	uint64_t dumpTime;		///< next time to dump events to cout
 	int	numOut;			///< number of packets sent to cout
@@ -66,10 +97,12 @@ private:
 	static const int DATA_OUT_LIMIT = 10000; ///< max # data pkts to cout
 
 	struct EventStruct {
-	pktx px;			///< index of some packet
-        int sendFlag;			///< true for outgoing packets
-	int link;			///< link used by packet
+	int	len;			///< packet length, or 0 for a gap
+	int	capLen;			///< number of bytes saved
+        int	sendFlag;		///< true for outgoing packets
+	int	link;			///< link used by packet, or gap size
 	uint64_t time;			///< time packet was logged
+	char	data[SNAP_LEN];		///< first capLen bytes of packet
         };
 	EventStruct *evec;
 
@@ -80,10 +113,31 @@ private:
 	PacketFilter *fvec;		///< table of filters
 	ListPair *filters;		///< in-use/free filter indexes
 
+	atomic<const FilterIndex*> findex; ///< compiled form of filters
+	atomic<const FilterIndex*> hazard[2]; ///< index in use by thread
+	vector<const FilterIndex*> retired; ///< old indexes to delete
+
 	PacketStore *ps;
 
-	void 	loggit(int,int,bool,uint64_t);	
-	bool	match(fltx, pktx, int, bool) const;
+	PktCapture *cap;		///< capture rings for packet threads
+	uint64_t *dropSeen;		///< dropSeen[r] is drops already noted
+	Pcapng	pcap;			///< optional pcapng output file
+	uint64_t epoch;			///< wall-clock time of time 0, in ns
+
+	buffer_t *sbuf;			///< scratch buffer for formatting
+	Packet	sp;			///< scratch packet for formatting
+
+	thread	exporter;		///< drains the capture rings
+	atomic<bool> quit;		///< tells exporter to stop
+
+	void	run();
+	int	drain();
+	void 	loggit(const PktCapture::RecHdr*);
+	void	addGap(int, uint64_t);
+	bool	unpackScratch(const char*, int, int);
+	void	recompile();
+	const FilterIndex* protect(int);
+	string	event2string(const EventStruct&);
 	static string nstime2string(uint64_t);
 
 	recursive_mutex mtx;
@@ -111,40 +165,42 @@ inline bool PacketLog::validFilter(int f) {
 
 inline void PacketLog::enable(fltx f) {
 	unique_lock<recursive_mutex> lck(mtx);
-	fvec[f].on = true;
+	fvec[f].on = true; recompile();
 }
 inline void PacketLog::disable(fltx f) {
 	unique_lock<recursive_mutex> lck(mtx);
-	fvec[f].on = false;
+	fvec[f].on = false; recompile();
 }
 
+/** Capture a packet for the log.
+ *  This is called from the packet processing threads. If the packet
+ *  matches some filter, a snapshot of the packet is copied into the
+ *  caller's capture ring, for the exporter thread to pick up.
+ *  @param px is the index of the packet
+ *  @param lnk is the link the packet is being sent on (or was received
+ *  from)
+ *  @param sendFlag is true if the packet is being sent; else it is false
+ *  @param now is the time at which the packet is being sent/received
+ */
 inline void PacketLog::log(pktx px, int lnk, bool sendFlag, uint64_t now) {
-	if (logOn) loggit(px,lnk,sendFlag,now);
-}
-
-inline bool PacketLog::match(fltx f, pktx px, int lnk, bool sendFlag) const {
+	if (!logOn.load(memory_order_relaxed)) return;
+	int r = (sendFlag ? OUT_RING : IN_RING);
+	// hazard[r] is only written by this thread, so if it is still the
+	// current index, it is already protected
+	const FilterIndex *fi = hazard[r].load(memory_order_relaxed);
+	if (fi != findex.load(memory_order_acquire)) fi = protect(r);
 	Packet& p = ps->getPacket(px);
-	if (fvec[f].on && 
-	    (fvec[f].lnk == 0 || fvec[f].lnk == lnk) &&
-	    (fvec[f].comt == 0 || fvec[f].comt == p.comtree) &&
-	    (fvec[f].srcAdr == 0 || fvec[f].srcAdr == p.srcAdr) &&
-	    (fvec[f].dstAdr == 0 || fvec[f].dstAdr == p.dstAdr) &&
-	    (fvec[f].type == Forest::UNDEF_PKT || fvec[f].type == p.type) &&
-	    ((fvec[f].in && !sendFlag) || (fvec[f].out && sendFlag))) {
-		if (p.type != Forest::CLIENT_SIG && p.type != Forest::NET_SIG)
-			return true;
-		CtlPkt::CpType cpt = (CtlPkt::CpType) ntohl(p.payload()[0]);
-	    	return (fvec[f].cpType == CtlPkt::UNDEF_CPTYPE ||
-		        fvec[f].cpType == cpt);
-	}
-	return false;
+	if (!fi->match(p, lnk, sendFlag)) return;
+	cap->put(r, now, lnk, sendFlag, p.buffer, p.length);
 }
 
 /** Get a reference to a packet filter.
+ *  Filters may only be changed using setFilter, so that the compiled
+ *  index is kept up to date.
  *  @param f is the index of some valid filter
  *  @return a reference to the PacketFilter object for f
  */
-inline PacketFilter& PacketLog::getFilter(fltx f) {
+inline const PacketFilter& PacketLog::getFilter(fltx f) {
 	return fvec[f];
 }
 
@@ -152,7 +208,8 @@ inline PacketFilter& PacketLog::getFilter(fltx f) {
  *  Whenever logging is enabled, purge any left-over packets.
  */
 inline void PacketLog::turnOnLogging(bool on) {
-	logOn = on; if (logOn) purge();
+	if (on) purge();
+	logOn = on;
 }
 
 /** Enable or disable local logging of packets.
@@ -53,6 +53,9 @@ public:
         pktx  fullCopy(pktx);   
         pktx  fullCopy(pktx,int);   
 
+	int	capacity() const;
+	int	numFree() const;
+
 	string toString() const;
 
 private:
@@ -86,6 +89,20 @@ inline Packet& PacketStore::getPacket(pktx px) const {
 	return pkt[px];
 }
 
+/** Get the number of packets that can be allocated at one time.
+ *  @return the smaller of the number of packets and number of buffers
+ */
+inline int PacketStore::capacity() const { return min(N,M); }
+
+/** Get the number of packets available for allocation.
+ *  The value is read without locking, so it is only a snapshot
+ *  and does not include packets held in per-thread caches.
+ *  @return the smaller of the number of free packets and free buffers
+ */
+inline int PacketStore::numFree() const {
+	return min(freePkts->length(), freeBufs->length());
+}
+
 } // ends namespace
 
 
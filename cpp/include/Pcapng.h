@@ -0,0 +1,60 @@
+/** @file Pcapng.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef PCAPNG_H
+#define PCAPNG_H
+
+#include <cstdio>
+#include <map>
+#include "Forest.h"
+
+using std::map;
+
+namespace forest {
+
+/** Writes captured Forest packets to a file in pcapng format, for use
+ *  with wireshark and similar tools.
+ *
+ *  Each router link appears as a separate interface, described when
+ *  the first packet for the link is written. Packets are stored as
+ *  raw Forest packets (starting with the Forest header, without the
+ *  UDP/IP encapsulation), with link type LINKTYPE_USER0, so that a
+ *  Forest dissector can be attached to it in wireshark's user DLT
+ *  table. Timestamps have nanosecond resolution and the direction of
+ *  each packet is recorded in its flags option.
+ */
+class Pcapng {
+public:
+		Pcapng();
+		~Pcapng();
+
+	bool	create(const string&, int);
+	bool	write(uint64_t, int, bool, const void*, int, int);
+	void	close();
+	bool	isOpen() const;
+
+	static const int LINKTYPE_FOREST = 147;	///< LINKTYPE_USER0
+private:
+	FILE	*fp;			///< file being written, or 0
+	int	snapLen;		///< max bytes captured per packet
+	map<int,int> ifaceId;		///< maps link to interface id
+
+	bool	writeIface(int);
+	bool	writeBlock(uint32_t, const void*, int, const void*, int,
+			   const string&);
+	static void addOption(string&, int, const void*, int);
+};
+
+/** Determine if a file is open for writing.
+ *  @return true if create has succeeded and close has not been called
+ */
+inline bool Pcapng::isOpen() const { return fp != 0; }
+
+} // ends namespace
+
+#endif
@@ -0,0 +1,157 @@
+/** @file PktCapture.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef PKTCAPTURE_H
+#define PKTCAPTURE_H
+
+#include <atomic>
+#include "Forest.h"
+
+using std::atomic;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+
+namespace forest {
+
+/** A set of rings used to capture snapshots of packets on the fast path.
+ *
+ *  Each ring has a single producer (one of the router's packet
+ *  processing threads) and a single consumer (the thread that exports
+ *  the captured packets), so no locks are needed. A record holds the
+ *  time, the link, the direction and the length of a packet, together
+ *  with its first snapLen bytes, copied into a fixed-size slot in the
+ *  ring. When a ring is full, new packets are dropped and counted.
+ */
+class PktCapture {
+public:
+	/** header of a captured packet record */
+	struct RecHdr {
+	uint64_t time;			///< time packet was captured
+	uint16_t link;			///< link packet arrived or left on
+	uint8_t	out;			///< 1 for an outgoing packet, else 0
+	uint8_t	pad;			///< unused
+	uint16_t len;			///< length of packet in bytes
+	uint16_t capLen;		///< number of bytes captured
+	};
+
+		PktCapture(int, int, int);
+		~PktCapture();
+
+	bool	put(int, uint64_t, int, bool, const void*, int);
+	const RecHdr* peek(int) const;
+	void	pop(int);
+	static const char* data(const RecHdr*);
+
+	int	rings() const;
+	int	snapLen() const;
+	uint64_t captured(int) const;
+	uint64_t dropped(int) const;
+private:
+	int	nRings;			///< number of rings
+	int	nSlots;			///< slots per ring (a power of 2)
+	int	snap;			///< max bytes captured per packet
+	int	slotSize;		///< bytes per slot
+
+	/** a single-producer, single-consumer ring of records; head and
+	 *  tail are kept on separate cache lines */
+	struct Ring {
+	char	*slots;			///< storage for records
+	char	pad0[64];
+	atomic<uint32_t> head;		///< next slot to read (consumer)
+	char	pad1[64];
+	atomic<uint32_t> tail;		///< next slot to write (producer)
+	atomic<uint64_t> nCap;		///< # of packets captured
+	atomic<uint64_t> nDrop;		///< # of packets dropped
+	char	pad2[64];
+	};
+	Ring	*ring;			///< ring[r] is ring number r
+};
+
+/** Add a packet to a ring.
+ *  Must only be called by the producer for the ring.
+ *  @param r is the ring number
+ *  @param now is the current time
+ *  @param lnk is the link the packet arrived on or is being sent on
+ *  @param out is true for an outgoing packet
+ *  @param buf points to the packet
+ *  @param len is the length of the packet in bytes
+ *  @return true if the packet was captured, false if the ring was full
+ */
+inline bool PktCapture::put(int r, uint64_t now, int lnk, bool out,
+			    const void* buf, int len) {
+	Ring& rg = ring[r];
+	uint32_t t = rg.tail.load(memory_order_relaxed);
+	if (t - rg.head.load(memory_order_acquire) >= (uint32_t) nSlots) {
+		rg.nDrop.store(rg.nDrop.load(memory_order_relaxed) + 1,
+			       memory_order_relaxed);
+		return false;
+	}
+	RecHdr *h = (RecHdr*) &rg.slots[(t & (nSlots-1)) * slotSize];
+	h->time = now; h->link = lnk; h->out = out; h->pad = 0;
+	h->len = len; h->capLen = (len < snap ? len : snap);
+	memcpy(h+1, buf, h->capLen);
+	rg.tail.store(t+1, memory_order_release);
+	rg.nCap.store(rg.nCap.load(memory_order_relaxed) + 1,
+		      memory_order_relaxed);
+	return true;
+}
+
+/** Get the oldest record in a ring, without removing it.
+ *  Must only be called by the consumer.
+ *  @param r is the ring number
+ *  @return a pointer to the record's header, or 0 if the ring is empty
+ */
+inline const PktCapture::RecHdr* PktCapture::peek(int r) const {
+	Ring& rg = ring[r];
+	uint32_t h = rg.head.load(memory_order_relaxed);
+	if (h == rg.tail.load(memory_order_acquire)) return 0;
+	return (const RecHdr*) &rg.slots[(h & (nSlots-1)) * slotSize];
+}
+
+/** Remove the oldest record from a ring.
+ *  Must only be called by the consumer, after a successful peek.
+ *  @param r is the ring number
+ */
+inline void PktCapture::pop(int r) {
+	Ring& rg = ring[r];
+	rg.head.store(rg.head.load(memory_order_relaxed) + 1,
+		      memory_order_release);
+}
+
+/** Get the captured bytes of a record.
+ *  @param h points to the header of a record
+ *  @return a pointer to the first captured byte
+ */
+inline const char* PktCapture::data(const RecHdr* h) {
+	return (const char*) (h+1);
+}
+
+/** Get the number of rings.  */
+inline int PktCapture::rings() const { return nRings; }
+
+/** Get the maximum number of bytes captured per packet. */
+inline int PktCapture::snapLen() const { return snap; }
+
+/** Get the number of packets captured in a ring.
+ *  @param r is the ring number
+ */
+inline uint64_t PktCapture::captured(int r) const {
+	return ring[r].nCap.load(memory_order_relaxed);
+}
+
+/** Get the number of packets dropped because a ring was full.
+ *  @param r is the ring number
+ */
+inline uint64_t PktCapture::dropped(int r) const {
+	return ring[r].nDrop.load(memory_order_relaxed);
+}
+
+} // ends namespace
+
+#endif
@@ -0,0 +1,175 @@
+/** @file PktIo.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef PKTIO_H
+#define PKTIO_H
+
+#include <sys/socket.h>
+#include "Forest.h"
+#include "Np4d.h"
+#include "PacketStore.h"
+
+namespace forest {
+
+/** Abstract base class for the packet I/O backends used to move
+ *  packets between the interface sockets and a PacketStore.
+ *
+ *  Receive operations are done by one thread (the input thread)
+ *  and send operations by another (the output thread); a backend
+ *  keeps separate state for the two sides, so no locking is needed.
+ *  Sockets are registered with addSock as interfaces are configured.
+ *
+ *  The backend is selected at startup by name, using create().
+ *  The "socket" backend does one recvfrom/sendto call per packet,
+ *  the "mmsg" backend uses recvmmsg/sendmmsg to move batches of packets
+ *  per system call, the "gso" backend adds UDP segmentation offload to
+ *  the "mmsg" backend and the "uring" backend (available only when
+ *  compiled with HAVE_LIBURING) uses io_uring.
+ */
+class PktIo {
+public:
+		PktIo(PacketStore*);
+	virtual	~PktIo();
+
+	static PktIo* create(const string&, PacketStore*);
+
+	virtual bool addSock(int, int);
+	virtual int  recv(pktx*, int*, int) = 0;
+	virtual bool send(int, pktx, const sockaddr_in&) = 0;
+	virtual bool flush() = 0;
+
+	virtual string toString() const;
+	uint64_t discards(Forest::ptyp_t) const;
+protected:
+	PacketStore *ps;		///< packet store for received packets
+	int	sock[Forest::MAXINTF+1]; ///< sock[i] is socket for iface i
+	int	maxIf;			///< largest iface with a socket
+	int	maxSock;		///< largest socket number
+
+	// statistics
+	uint64_t rcvCalls;		///< # of receive system calls
+	uint64_t rcvPkts;		///< # of packets received
+	uint64_t sndCalls;		///< # of send system calls
+	uint64_t sndPkts;		///< # of packets sent
+	uint64_t noBufs;		///< # of packets discarded because
+					///< packet store was exhausted
+	uint64_t typeDrops[256];	///< typeDrops[t] is # of those packets
+					///< with packet type t
+	buffer_t scratch;		///< used to discard packets
+
+	int	ready(fd_set&);
+	void	discard(int);
+	void	countDiscard(const void*, int);
+};
+
+/** Get the number of packets of a given type that were discarded
+ *  because the packet store was exhausted.
+ *  @param ptype is a packet type
+ *  @return the number of discarded packets of that type
+ */
+inline uint64_t PktIo::discards(Forest::ptyp_t ptype) const {
+	return typeDrops[ptype & 0xff];
+}
+
+/** Count a packet discarded because the packet store was exhausted.
+ *  @param buf points to the packet, in network byte order
+ *  @param leng is its length in bytes
+ */
+inline void PktIo::countDiscard(const void *buf, int leng) {
+	noBufs++;
+	if (leng < (int) sizeof(uint32_t)) return;
+	uint32_t w0; memcpy(&w0, buf, sizeof(w0));
+	typeDrops[(ntohl(w0) >> 8) & 0xff]++;
+}
+
+/** Packet I/O backend that uses one system call per packet.
+ */
+class SockIo : public PktIo {
+public:
+		SockIo(PacketStore*);
+
+	int	recv(pktx*, int*, int);
+	bool	send(int, pktx, const sockaddr_in&);
+	bool	flush();
+};
+
+/** Packet I/O backend that uses recvmmsg and sendmmsg to transfer
+ *  up to BATCH packets per system call. Outgoing packets are held
+ *  until BATCH are waiting, a packet for a different socket is sent,
+ *  or flush is called; the output thread should call flush whenever
+ *  it has nothing else to do.
+ *
+ *  Optionally, UDP segmentation offload can be used (requires Linux 5.0
+ *  or later). On the send side, pending packets for the same destination
+ *  are then passed to the kernel as a single message with the UDP_SEGMENT
+ *  option, which requires all but the last to have the same length;
+ *  a longer packet starts a new message. On the receive side, UDP_GRO
+ *  is enabled on the sockets and the coalesced datagrams delivered by
+ *  the kernel are split back into separate packets. If a socket does
+ *  not support UDP_SEGMENT, or the kernel rejects a segmented message,
+ *  packets are sent one per message from then on.
+ */
+class MmsgIo : public PktIo {
+public:
+		MmsgIo(PacketStore*, bool=false);
+		~MmsgIo();
+
+	static const int BATCH = 32;	///< max packets per system call
+	static const int GRO_BUFS = 8;	///< max coalesced datagrams per call
+	static const int GRO_SIZ = 1 << 16; ///< max coalesced datagram size
+	static const int GSO_MAX = 60000; ///< max bytes per GSO message
+
+	bool	addSock(int, int);
+	int	recv(pktx*, int*, int);
+	bool	send(int, pktx, const sockaddr_in&);
+	bool	flush();
+
+	string	toString() const;
+private:
+	bool	gso;			///< true if GSO/GRO are used
+	bool	gsoTx;			///< true if GSO is used for sending
+
+	// receive side
+	pktx	spare[BATCH];		///< packets allocated for receiving
+	int	nSpare;			///< number of packets in spare
+	mmsghdr	rxHdr[BATCH];		///< headers for recvmmsg
+	iovec	rxVec[BATCH];		///< buffer descriptors for recvmmsg
+	sockaddr_in rxAdr[BATCH];	///< source addresses
+
+	// receive side, when GRO is used
+	char	*groBuf;		///< buffers for coalesced datagrams
+	char	rxCtl[GRO_BUFS][CMSG_SPACE(sizeof(int))]; ///< ancillary data
+	int	groLen[GRO_BUFS];	///< length of each coalesced datagram
+	int	groSeg[GRO_BUFS];	///< segment size of each
+	int	groIf[GRO_BUFS];	///< interface each arrived on
+	int	nGro;			///< # of datagrams in groBuf
+	int	groNext;		///< next datagram to be split
+	int	groOff;			///< offset of next segment in it
+
+	// send side
+	int	txSock;			///< socket for pending packets
+	int	nTx;			///< number of pending packets
+	pktx	txPkt[BATCH];		///< pending packets
+	mmsghdr	txHdr[BATCH];		///< headers for sendmmsg
+	iovec	txVec[BATCH];		///< buffer descriptors for packets
+	sockaddr_in txAdr[BATCH];	///< destination addresses
+	iovec	msgVec[BATCH];		///< buffer descriptors, by message
+	int	msgSegs[BATCH];		///< # of packets in each message
+	char	txCtl[BATCH][CMSG_SPACE(sizeof(uint16_t))]; ///< for UDP_SEGMENT
+
+	uint64_t gsoMsgs;		///< # of messages with several packets
+	uint64_t groMsgs;		///< # of coalesced datagrams received
+
+	int	recvGro(pktx*, int*, int);
+	int	split(pktx*, int*, int);
+	int	unsegment(int, int);
+};
+
+} // ends namespace
+
+#endif
@@ -0,0 +1,113 @@
+/** @file PktRing.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef PKTRING_H
+#define PKTRING_H
+
+#include <linux/if_packet.h>
+#include "PktIo.h"
+#include "Hash.h"
+#include "HashMap.h"
+
+using namespace grafalgo;
+
+namespace forest {
+
+/** Packet I/O backend that uses memory-mapped AF_PACKET rings, for
+ *  interfaces in "ring mode".
+ *
+ *  Each ring-mode interface is bound to a network device (possibly a
+ *  veth). Arriving Forest-over-UDP frames are received through a
+ *  TPACKET_V3 ring; a BPF program attached to the ring passes only
+ *  UDP frames addressed to the interface's IP address and port.
+ *  The IP and UDP headers are parsed here and the Forest packet is
+ *  copied into a PacketStore packet. The interface's UDP socket stays
+ *  bound to its port, so the kernel does not report the port as
+ *  unreachable, but a filter that discards everything is attached to it.
+ *
+ *  Outgoing packets are placed in a TPACKET_V2 transmit ring, with
+ *  Ethernet, IP and UDP headers built here. The destination MAC address
+ *  is taken from the kernel's ARP cache. If the peer has no ARP entry
+ *  (or is not on the local subnet), the packet is sent through the UDP
+ *  socket instead, which also leads the kernel to resolve the address.
+ *  Cached addresses are checked against the kernel's entry again after
+ *  ARP_TTL, so a peer that moves or goes away is noticed.
+ *
+ *  As with other backends, recv is called only by the input thread and
+ *  send/flush only by the output thread.
+ */
+class PktRing : public PktIo {
+public:
+		PktRing(PacketStore*);
+		~PktRing();
+
+	bool	addRing(int, int, const string&, ipa_t, ipp_t);
+	bool	hasIface(int) const;
+
+	int	recv(pktx*, int*, int);
+	bool	send(int, pktx, const sockaddr_in&);
+	bool	flush();
+
+	string	toString() const;
+private:
+	static const int RX_BLOCK = 1 << 18;	///< rx block size (bytes)
+	static const int RX_BLOCKS = 16;	///< # of rx blocks
+	static const int TX_FRAME = 2048;	///< tx frame size (bytes)
+	static const int TX_FRAMES = 512;	///< # of tx frames
+	static const int BATCH = 32;		///< tx frames per send call
+	static const int64_t ARP_TTL = 30000000000; ///< ns before MAC recheck
+
+	/** ring state for one interface */
+	struct Ring {
+	int	rxFd;			///< AF_PACKET socket for rx ring
+	char	*rxMap;			///< start of mapped rx ring
+	int	curBlock;		///< rx block now being processed
+	int	pktsLeft;		///< packets left in current block
+	tpacket3_hdr *nextPkt;		///< next packet in current block
+
+	int	txFd;			///< AF_PACKET socket for tx ring
+	char	*txMap;			///< start of mapped tx ring
+	int	txCur;			///< next tx frame to fill
+	int	txQueued;		///< frames filled but not yet kicked
+	uint16_t ipId;			///< IP identifier for next frame
+
+	ipa_t	ipa;			///< IP address of interface
+	ipp_t	port;			///< UDP port of interface
+	string	dev;			///< name of network device
+	uint8_t	mac[6];			///< MAC address of device
+	};
+	Ring	ring[Forest::MAXINTF+1];
+
+	/** ARP cache entry; mac is 0 if the address is not yet known */
+	struct ArpEntry {
+	uint64_t mac;			///< MAC address in low order 48 bits
+	int	misses;			///< # of sends since last lookup
+	int64_t	expires;		///< time at which mac must be rechecked
+	};
+	HashMap<ipa_t,ArpEntry,Hash::u32> *arp; ///< peer IP -> MAC
+
+	uint64_t fallback;		///< # of packets sent via UDP socket
+
+	pktx	extract(Ring&, tpacket3_hdr*);
+	bool	kick(Ring&);
+	uint64_t lookupMac(Ring&, ipa_t);
+	void	closeRing(Ring&);
+};
+
+/** Determine if an interface is handled by this backend.
+ *  @param iface is an interface number
+ *  @return true if iface has a packet ring
+ */
+inline bool PktRing::hasIface(int iface) const {
+	return 1 <= iface && iface <= Forest::MAXINTF &&
+	       ring[iface].rxFd >= 0;
+}
+
+} // ends namespace
+
+#endif
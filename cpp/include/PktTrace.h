@@ -0,0 +1,77 @@
+/** @file PktTrace.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef PKTTRACE_H
+#define PKTTRACE_H
+
+#include <cstdio>
+#include "Forest.h"
+
+namespace forest {
+
+/** A file of packets received by a router, used to replay the
+ *  router's traffic for benchmarking.
+ *
+ *  The file starts with a 16 byte header: a magic number, a version
+ *  number and the wall-clock time (ns since the epoch) when the trace
+ *  was started. Each packet then has a 16 byte record header giving
+ *  its arrival time (ns since the router started), the link it arrived
+ *  on and its length, followed by the raw packet, exactly as received,
+ *  padded to a multiple of 8 bytes. Numbers are in host byte order.
+ *
+ *  A trace is written one record at a time, through a stdio buffer.
+ *  For replay, the whole file is read into memory, so that stepping
+ *  through it costs no system calls.
+ */
+class PktTrace {
+public:
+		PktTrace();
+		~PktTrace();
+
+	bool	create(const string&);
+	bool	write(uint64_t, int, const void*, int);
+	void	close();
+
+	bool	open(const string&);
+	bool	next(uint64_t&, int&, const char*&, int&);
+	void	rewind();
+
+	uint64_t count() const;
+private:
+	static const uint32_t MAGIC = 0x46545231;	///< "FTR1"
+	static const uint32_t VERSION = 1;
+
+	/** file header */
+	struct FileHdr {
+	uint32_t magic;			///< identifies a trace file
+	uint32_t version;		///< version of file format
+	uint64_t epoch;			///< start time of trace
+	};
+	/** record header */
+	struct RecHdr {
+	uint64_t time;			///< arrival time of packet
+	uint16_t inLink;		///< link packet arrived on
+	uint16_t len;			///< length of packet in bytes
+	uint32_t pad;			///< unused
+	};
+
+	FILE	*fp;			///< file being written, or 0
+	char	*data;			///< contents of file being read, or 0
+	size_t	size;			///< number of bytes in data
+	size_t	pos;			///< offset of next record in data
+	uint64_t nRecs;			///< records written or read so far
+};
+
+/** Get the number of records written, or read since the last rewind.
+ *  @return the record count
+ */
+inline uint64_t PktTrace::count() const { return nRecs; }
+
+} // ends namespace
+
+#endif
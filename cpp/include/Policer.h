@@ -0,0 +1,79 @@
+/** @file Policer.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef POLICER_H
+#define POLICER_H
+
+#include "Forest.h"
+#include "RateSpec.h"
+
+namespace forest {
+
+/** This class implements a dual token bucket used to police the
+ *  traffic arriving on a comtree link. One bucket limits the bit rate,
+ *  the other the packet rate. The rates are taken from the upstream
+ *  fields of a RateSpec on each call, so changes to the rate spec take
+ *  effect immediately. Each bucket can hold enough credit for a burst
+ *  lasting BURST ns (but never less than two maximum size packets).
+ *
+ *  Credits are kept in scaled units, so that all arithmetic is done
+ *  with integers. Bit credits are in units of 10^-6 bits (so a rate
+ *  of r Kb/s adds r units per ns) and packet credits in units of
+ *  10^-9 packets (so a rate of r p/s adds r units per ns).
+ */
+class Policer {
+public:
+	static const int64_t BURST = 20000000; ///< burst duration in ns
+
+	/** Default constructor. */
+	Policer() { reset(); }
+
+	/** Reset the policer to its initial state. */
+	void reset() { lastTime = -1; bitCredit = pktCredit = 0; }
+
+	/** Determine if an arriving packet conforms to the policer rates.
+	 *  If it does, the packet's credits are deducted from the buckets.
+	 *  @param leng is the length of the packet on the link, in bytes
+	 *  @param now is the current time in ns
+	 *  @param rs is a rate spec whose bitRateUp and pktRateUp fields
+	 *  define the allowed rates; if either is not positive, no
+	 *  policing is done
+	 *  @return true if the packet conforms, false if it should be dropped
+	 */
+	bool conform(int leng, int64_t now, const RateSpec& rs) {
+		if (rs.bitRateUp <= 0 || rs.pktRateUp <= 0) return true;
+		int64_t bitMax = max(rs.bitRateUp * BURST,
+				     2*8*1000000*int64_t(Forest::BUF_SIZ));
+		int64_t pktMax = max(rs.pktRateUp * BURST,
+				     2*int64_t(1000000000));
+		if (lastTime < 0) {
+			bitCredit = bitMax; pktCredit = pktMax;
+		} else {
+			int64_t dt = now - lastTime;
+			if (dt > BURST) dt = BURST;
+			bitCredit = min(bitCredit + rs.bitRateUp * dt, bitMax);
+			pktCredit = min(pktCredit + rs.pktRateUp * dt, pktMax);
+		}
+		lastTime = now;
+
+		int64_t bitCost = 8*1000000*int64_t(leng);
+		int64_t pktCost = 1000000000;
+		if (bitCredit < bitCost || pktCredit < pktCost) return false;
+		bitCredit -= bitCost; pktCredit -= pktCost;
+		return true;
+	}
+private:
+	int64_t	lastTime;		///< time of last update, or -1
+	int64_t	bitCredit;		///< bit credits (10^-6 bits)
+	int64_t	pktCredit;		///< packet credits (10^-9 packets)
+};
+
+} // ends namespace
+
+
+#endif
@@ -65,8 +65,9 @@ public:
 	void 	getStats(int, int, int&, int&, int&);
 
 	// enq and deq packets
-	void	enq(int, int, uint64_t);
+	bool	enq(int, int, uint64_t);
 	int	deq(int&, uint64_t);
+	uint64_t nextDue() const;
 	
 private:
 	int	nL;			///< number of links
@@ -146,6 +147,15 @@ inline bool QuManager::setQLimits(int qid, int np, int nb) {
 	return true;
 }
 
+/** Get the time when the next packet will be ready to go out.
+ *  @return the earliest time at which deq can return a packet,
+ *  or the largest 64 bit value if no packets are queued
+ */
+inline uint64_t QuManager::nextDue() const {
+	if (active->empty()) return UINT64_MAX;
+	return active->key(active->findmin());
+}
+
 /** Sample the statistics counters.
  *  @param lnk is a link number
  *  @param qid is a queue identifier
@@ -16,7 +16,8 @@
 #include "stdinc.h"
 #include "Forest.h"
 #include "Pair.h"
-#include "Dheap.h"
+#include "Packet.h"
+#include "TimerWheel.h"
 #include "Hash.h"
 #include "HashMap.h"
 
@@ -25,23 +26,70 @@ using namespace grafalgo;
 
 namespace forest {
 
-/** Class to aid in handling repeated control packets. */
+/** Class to aid in handling repeated control packets.
+ *
+ *  A record is kept for each request received, identified by the
+ *  sender's address and the request's sequence number. Once the
+ *  request has been answered, the record also holds a copy of the
+ *  reply, so that the reply can be sent again if the request is
+ *  repeated. Replies are stored compactly: the header fields are kept
+ *  in the record and the rest of the packet in a chain of 64 byte
+ *  chunks taken from a shared slab, rather than in packet buffers.
+ *  Records are discarded 20 seconds after the request arrives; they
+ *  are found in batches using a timing wheel with 100 ms ticks.
+ */
 class RepeatHandler {
 public:
 		RepeatHandler(int);
 		~RepeatHandler();
 
 	int	find(fAdr_t, int64_t);
-	bool	saveReq(int, fAdr_t, int64_t, int64_t);
-	int	saveRep(int, fAdr_t, int64_t);
+	bool	replied(int) const;
+	bool	getReply(int, Packet&) const;
+	bool	saveReq(fAdr_t, int64_t, int64_t);
+	bool	saveRep(fAdr_t, int64_t, const Packet&);
 	int	expired(int64_t);
 private:
+	static const int64_t TICK = 100000000;	///< 100 ms wheel tick
+	static const int SLOTS = 256;		///< # of slots in wheel
+	static const int64_t HOLD = 20000000000; ///< time to keep records
+	static const int CHUNK = 64;		///< bytes per slab chunk
+	static const int CHUNKS_PER_REC = 4;	///< average chunks per record
+
+	/** saved reply; type is 0 until the reply is saved */
+	struct Reply {
+	comt_t	comtree;		///< reply's comtree
+	fAdr_t	srcAdr;			///< reply's source address
+	fAdr_t	dstAdr;			///< reply's destination address
+	uint16_t length;		///< reply's length
+	uint8_t	type;			///< reply's packet type
+	uint8_t	flags;			///< reply's flags
+	int	chunk;			///< first chunk of rest of packet
+	};
+
 	int	n;
-	HashMap<Pair<fAdr_t,int64_t>, int, Hash::s32s64> *pmap;
-					///< maps seqNum->(pktx,repCount)
-	Dheap<int64_t> *deadlines;	///< heap of packets waiting on replies
+	HashMap<Pair<fAdr_t,int64_t>, Reply, Hash::s32s64> *pmap;
+					///< maps (peerAdr,seqNum)->reply
+	TimerWheel *deadlines;		///< when to discard records
+
+	int	nChunks;		///< number of chunks in slab
+	char	*slab;			///< storage for saved packets
+	int	*nextChunk;		///< next chunk in chain, or free list
+	int	freeChunk;		///< first free chunk
+
+	void	discard(int);
+	int	allocChunks(int);
+	void	freeChunks(int);
 };
 
+/** Determine if a reply has been saved for a request.
+ *  @param x is the index of a record returned by find
+ *  @return true if the record contains a reply
+ */
+inline bool RepeatHandler::replied(int x) const {
+	return pmap->getValue(x).type != 0;
+}
+
 } // ends namespace
 
 #endif
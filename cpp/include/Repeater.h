@@ -16,7 +16,7 @@
 #include "stdinc.h"
 #include "Forest.h"
 #include "Pair.h"
-#include "Dheap.h"
+#include "TimerWheel.h"
 #include "Hash.h"
 #include "HashMap.h"
 
@@ -25,22 +25,93 @@ using namespace grafalgo;
 
 namespace forest {
 
-/** Class to manage repeated sending of control packets. */
+/** Class to manage repeated sending of control packets.
+ *  Deadlines are kept in a timing wheel with 10 ms ticks, and
+ *  overdue requests are collected in batches.
+ *
+ *  The retransmission timeout is set separately for each peer, from
+ *  a smoothed estimate of the round-trip time to that peer and its
+ *  variation, as in TCP (RFC 6298). Only replies to requests that
+ *  were sent once are used to measure the round-trip time (Karn's
+ *  rule). Each time a request is repeated, its timeout is doubled,
+ *  up to a limit, and the peer keeps the larger timeout until the next
+ *  good measurement.
+ */
 class Repeater {
 public:
 		Repeater(int);
 		~Repeater();
 
-	int	saveReq(int, int64_t, int64_t, int=0);
-	pair<int,int> deleteMatch(int64_t);
-	pair<int,int> overdue(int64_t);
+	/** round-trip statistics for one peer */
+	struct PeerStats {
+	int64_t	srtt;			///< smoothed round-trip time in ns,
+					///< or 0 if not yet measured
+	int64_t	rttvar;			///< round-trip time variation in ns
+	int64_t	rto;			///< current retransmission timeout
+	uint64_t nSamples;		///< # of round-trip measurements
+	uint64_t nSent;			///< # of requests sent to peer
+	uint64_t nRetrans;		///< # of times a request was repeated
+	uint64_t nFailed;		///< # of requests that got no reply
+	};
+
+	int	saveReq(int, int64_t, fAdr_t, int64_t, int=0);
+	pair<int,int> deleteMatch(int64_t, int64_t);
+	int	overdue(int64_t, pair<int,int>*, int);
+
+	int64_t	getRto(fAdr_t) const;
+	bool	getStats(fAdr_t, PeerStats&) const;
+	string	toString() const;
 private:
+	static const int64_t TICK = 10000000;	///< 10 ms wheel tick
+	static const int SLOTS = 256;		///< # of slots in wheel
+	static const int64_t INIT_RTO = 1000000000; ///< timeout used before
+						///< first measurement
+	static const int64_t MIN_RTO = 2*TICK;	///< lower bound on timeout
+	static const int64_t MAX_RTO = 8000000000; ///< upper bound on timeout
+	static const int MAX_REPEATS = 3;	///< # of times to repeat
+
+	/** a saved request */
+	struct Request {
+	int	cx;			///< index of saved copy of packet
+	int	repCount;		///< # of repeats left
+	fAdr_t	peer;			///< address the request was sent to
+	int64_t	sendTime;		///< time request was first sent
+	int64_t	rto;			///< timeout in effect for request
+	};
+
 	int	n;
-	HashMap<int64_t, Pair<int,int>, Hash::s64> *pmap;
-					///< maps seqNum->(pktx,repCount)
-	Dheap<int64_t> *deadlines;	///< heap of packets waiting on replies
+	HashMap<int64_t, Request, Hash::s64> *pmap;
+					///< maps seqNum to saved request
+	TimerWheel *deadlines;		///< packets waiting on replies
+	HashMap<fAdr_t, PeerStats, Hash::s32> *peers;
+					///< maps peer address to its stats
+
+	PeerStats& peerEntry(fAdr_t);
+	void	sample(PeerStats&, int64_t);
 };
 
+/** Get the retransmission timeout currently used for a peer.
+ *  @param peer is the forest address of a peer
+ *  @return the timeout in ns
+ */
+inline int64_t Repeater::getRto(fAdr_t peer) const {
+	int x = peers->find(peer);
+	return (x == 0 ? INIT_RTO : peers->getValue(x).rto);
+}
+
+/** Get the round-trip statistics for a peer.
+ *  @param peer is the forest address of a peer
+ *  @param ps is a reference to a PeerStats struct in which the
+ *  statistics are returned
+ *  @return true on success, false if no requests have been sent to peer
+ */
+inline bool Repeater::getStats(fAdr_t peer, PeerStats& ps) const {
+	int x = peers->find(peer);
+	if (x == 0) return false;
+	ps = peers->getValue(x);
+	return true;
+}
+
 } // ends namespace
 
 #endif
@@ -49,11 +49,13 @@ public:
 	int	nextClx(int, int) const;
 
 	// access methods
+	int	maxRoute() const;
 	int	getRtx(comt_t, fAdr_t) const;
 	comt_t	getComtree(int) const;
 	fAdr_t	getAddress(int) const;	
 	int	getClnk(int, int) const;
 	int 	getLinkCount(int) const; 		
+	int	getUcastQ(int, int, int) const;
 
 	// modifiers
 	bool	addLink(int,int);
@@ -86,6 +88,11 @@ private:
 	bool 	readRoute(istream&);	
 };
 
+/** Get the largest route index.
+ *  @return the largest route index that can be used
+ */
+inline int RouteTable::maxRoute() const { return maxRtx; }
+
 /** Verify that a route index is valid.
  *  @param rtx is an index into the routing table
  *  @return true if rtx corresponds to a valid route, else false
@@ -191,6 +198,21 @@ inline int RouteTable::getClnk(int rtx, int clx) const {
 	return rteMap->getValue(rtx).retrieve(clx);
 }
 
+/** Get the output queue for a unicast packet that has a route.
+ *  This is the forwarding decision for unicast packets; the router and
+ *  the network simulator both use it, so they forward the same way.
+ *  @param rtx is the index of a unicast route
+ *  @param ctx is the comtree table index of the route's comtree
+ *  @param inLnk is the link on which the packet arrived
+ *  @return the queue for the route's comtree link, or 0 if the route
+ *  leads back out the link on which the packet arrived
+ */
+inline int RouteTable::getUcastQ(int rtx, int ctx, int inLnk) const {
+	int cLnk = getClnk(rtx,firstClx(rtx));
+	if (ctt->getLink(ctx,cLnk) == inLnk) return 0;
+	return ctt->getClnkQ(ctx,cLnk);
+}
+
 /** Get the number of links used by a route.
  *  @param rtx is a route index
  *  @return the number of outgoing links used by this route;
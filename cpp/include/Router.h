@@ -29,6 +29,14 @@
 #include "PacketStore.h"
 #include "PacketLog.h"
 #include "QuManager.h"
+#include "HeavyHitters.h"
+#include "PktIo.h"
+#include "PktRing.h"
+#include "LinkSocks.h"
+#include "ShmLink.h"
+#include "PktTrace.h"
+#include "TableSnap.h"
+#include "StageTrace.h"
 
 using namespace std::chrono;
 using std::thread;
@@ -40,6 +48,7 @@ namespace forest {
 class RouterInProc;
 class RouterOutProc;
 class RouterControl;
+class CtlExecutor;
 
 /** Structure used to carry information about a router.
  *  Used during initialization process.
@@ -60,9 +69,21 @@ struct RouterInfo {
         string  lnkTbl; 	///< name of link table file
         string  comtTbl; 	///< name of comtree table file
         string  rteTbl; 	///< name of route table file
+        string  snapFile; 	///< name of binary table snapshot file
         string  statSpec; 	///< name of statistics specification file
 
         seconds runLength; 	///< number of seconds for router to run
+        milliseconds subWindow;	///< aggregation window for subscriptions
+        string  ioMode;		///< packet I/O backend (socket, mmsg, gso, uring)
+        microseconds aggWindow;	///< latency budget for aggregation
+        bool    connLinks;	///< use connected sockets for router links
+        string  traceFile;	///< file to record arriving packets in
+        string  replayFile;	///< trace to replay in place of live input
+        bool    replayTimed;	///< replay at recorded times, not max speed
+        int     replayReps;	///< number of times to replay the trace
+        string  captureFile;	///< pcapng file for logged packets
+        int     stageSample;	///< trace every n-th packet (0 for none)
+        string  traceDir;	///< directory for pipeline trace dumps
 };
 
 class Router {
@@ -71,8 +92,11 @@ public:
 		~Router();
 
 	bool	readTables(const RouterInfo&);
+	bool	loadTables(const RouterInfo&);
+	bool	saveTables();
 	bool	setup();
 	bool	setupIface(int);
+	bool	setupShmLinks();
 	bool	setupAllIfaces();
 	bool	setLeafAdrRange(fAdr_t, fAdr_t);
 	void	run();
@@ -88,7 +112,11 @@ private:
 	fAdr_t	ccAdr;			///< address of comtree controller
 
         seconds runLength; 		///< # of seconds for router to run
+	milliseconds subWindow;		///< aggregation window for SUB_UNSUB
+	microseconds aggWindow;		///< max delay of packets aggregated
+					///< on router links; 0 to disable
 	high_resolution_clock::time_point tZero; ///< router start time
+	uint64_t epoch;			///< wall-clock time of tZero, in ns
 
 	atomic<uint64_t> seqNum;	///< sequence number for ctl packets
 	uint64_t nextSeqNum() { return seqNum++; }
@@ -99,6 +127,8 @@ private:
 
 	/// XferQ used to transfer packets from input thread to output thread.
 	NonblockingQ11<int> xferQ;
+	const static int xferQsize = 1000; ///< max # of packets in xferQ
+	atomic<uint64_t> xferOut;	///< # of packets removed from xferQ
 
 	IfaceTable *ift;		///< table defining interfaces
 	LinkTable *lt;			///< table defining links
@@ -107,6 +137,7 @@ private:
 	PacketStore *ps;		///< packet buffers and headers
 	PacketLog *pktLog;		///< log for recording sample of packets
 	QuManager *qm;			///< queues and link schedulers
+	HeavyHitters *hh;		///< heaviest sources of arriving traffic
 
 	mutex	iftMtx;			///< lock for iface table
 	mutex	ltMtx;			///< lock for link table
@@ -115,11 +146,30 @@ private:
 
 	int	*sock;			///< vector of socket numbers
 	int	maxSockNum;		///< largest socket number used
+	PktIo	*pio;			///< packet I/O for interface sockets
+	PktRing	*ring;			///< packet I/O for ring mode ifaces
+	LinkSocks *lsocks;		///< connected sockets for router links,
+					///< or 0 if not used
+	ShmLinks *shm;			///< shared-memory rings for co-located
+					///< peers, or 0 if not used
+	vector<LinkIo*> linkIo;		///< per link transports in use
+
+	string	snapFile;		///< binary snapshot of the tables,
+					///< or "" if not used
+	PktTrace *trace;		///< trace of arriving packets, or 0
+	PktTrace *replay;		///< trace to replay, or 0
+	StageTrace *strace;		///< events of sampled packets as they
+					///< pass through the pipeline
+	string	traceDir;		///< directory that pipeline traces
+					///< are written to, or "" if none
+	bool	replayTimed;		///< replay at recorded times
+	int	replayReps;		///< number of times to replay
 
 	// sub-components of the router - run as separate threads
 	friend class RouterInProc;
 	friend class RouterOutProc;
 	friend class RouterControl;
+	friend class CtlExecutor;
 
 	RouterInProc *rip;
 	RouterOutProc *rop;
@@ -17,6 +17,7 @@
 #include "Router.h"
 #include "Packet.h"
 #include "CtlPkt.h"
+#include "CtlExecutor.h"
 
 using namespace chrono;
 using std::thread;
@@ -32,15 +33,17 @@ class Router;
 /** This class handles incoming and outgoing control packets on
  *  behalf of a router core.
  *
+ *  Each worker thread of the router's CtlExecutor has its own
+ *  RouterControl object, which it uses to run control tasks.
  *  It is a friend of the RouterCore, giving it access to private data.
  */
 class RouterControl {
 public:
-		RouterControl(Router*, int,
-			      BlockingQ<int>*, BlockingQ<pair<int,int>>*);
+		RouterControl(Router*, int, BlockingQ<pair<int,int>>*);
 		RouterControl() {};
 		~RouterControl();
-	static void start(RouterControl*);
+
+	void	handle(int, CtlExecutor::Task&);
 
 private:
 	Router	*rtr;
@@ -53,14 +56,32 @@ private:
 	PacketLog *pktLog;		///< log for recording sample of packets
 	QuManager *qm;			///< queues and link schedulers
 
-	int	myThx;			///< my thread index
-	BlockingQ<int> *inQ;		///< input queue for this thread
+	int	myThx;			///< my worker index
+	int	curTx;			///< index of task being run
 	BlockingQ<pair<int,int>> *outQ;	///< output queue, shared among threads
 
-	void	run();
+	bool	tablesLocked;		///< true while a compound request
+					///< holds the table locks
+	vector<pktx> deferred;		///< packets to be sent when a
+					///< compound request completes
+
+	// flags identifying the tables used by an operation
+	static const int IFT = 1, LT = 2, CTT = 4, RT = 8;
+
+	/** information needed to undo one operation of a compound request */
+	struct Undo {
+	CtlPkt::CpType type;		///< type of operation that undoes it
+	comt_t	comt;			///< comtree
+	int	lnk;			///< link
+	fAdr_t	adr;			///< destination address
+	int	coreFlag;		///< previous core flag
+	int	plnk;			///< previous parent link
+	RateSpec rates;			///< previous rates
+	};
 
 	// methods for handling incoming signalling requests
 	void	handleRequest(pktx, CtlPkt&);
+	void	dispatch(CtlPkt&);
 	void	returnToSender(pktx, CtlPkt&);
 
 	// interface table packets
@@ -97,6 +118,14 @@ private:
 	void	getRoute(CtlPkt&);
 	void	modRoute(CtlPkt&);
 	void 	getRouteSet(CtlPkt&);
+	void	addRouteBatch(CtlPkt&);
+	void	dropRouteBatch(CtlPkt&);
+
+	// bulk table transfer
+	void	getTable(CtlPkt&);
+	void	saveTables(CtlPkt&);
+	void	stageTrace(CtlPkt&);
+	void	getRouterStats(CtlPkt&);
 
 	// filter table packets
 	void	addFilter(CtlPkt&);
@@ -106,10 +135,18 @@ private:
 	void	getFilterSet(CtlPkt&);
 	void	getLoggedPackets(CtlPkt&);
 	void	enablePacketLog(CtlPkt&);
+	void	getHeavyHitters(CtlPkt&);
 
 	// configuration
 	void	setLeafRange(CtlPkt&);
 
+	// compound requests
+	void	compound(CtlPkt&);
+	int	compoundTables(CtlPkt::CpType);
+	void	bindLink(CtlPkt&, int);
+	void	saveUndo(CtlPkt&, Undo&);
+	void	fmtUndo(Undo&, CtlPkt&);
+
 	// comtree setup packets
 	void	joinComtree(CtlPkt&);
 	void	leaveComtree(CtlPkt&);
@@ -22,13 +22,20 @@
 #include "PacketStore.h"
 #include "Router.h"
 #include "RouterControl.h"
+#include "CtlExecutor.h"
 #include "Repeater.h"
 #include "RepeatHandler.h"
+#include "RteReqCache.h"
+#include "SubCoalescer.h"
 #include "CtlPkt.h"
 #include "QuManager.h"
 #include "BlockingQ.h"
 #include "StatCounts.h"
 #include "PacketLog.h"
+#include "PktTrace.h"
+#ifdef COUNT_ALLOCS
+#include "AllocCount.h"
+#endif
 
 using namespace std::chrono;
 using std::thread;
@@ -46,14 +53,37 @@ public:
 		~RouterInProc();
 
 	static void start(RouterInProc*);
+	void	replayTrace();
+	string	getStats();
 private:
-	const static int numThreads = 100; ///< max number in thread pool
+	const static int maxCtlTasks = 10000; ///< max # of control tasks
+					      ///< in progress
 	const static int maxReplies = 10000; ///< max # of remembered replies
 	const static int MAXFANOUT = 512; ///< limit on packet fanout
+	const static int maxRteReqs = 10000; ///< max # of route request entries
+	const static int maxSubComts = 5000; ///< max # of comtrees with
+					     ///< pending subscription changes
 	typedef high_resolution_clock::time_point timePoint;
 
-	uint64_t now;			///< relative to router start time
-	bool overload;			///< set when xferQ fills
+	int64_t now;			///< relative to router start time
+
+	// overload control
+	bool	overload;		///< true when xferQ or packet store
+					///< is close to full
+	int	psSize;			///< max # of packets in packet store
+	uint64_t xferIn;		///< # of packets added to xferQ
+	uint64_t overloadCnt;		///< # of times router became overloaded
+
+	/** packet classes used for overload statistics */
+	enum PktClass {
+		DATA_CLASS=0, SIG_CLASS, SUB_CLASS, CONN_CLASS, RTE_CLASS,
+		OTHER_CLASS, NUM_CLASSES
+	};
+	uint64_t shedCnt[NUM_CLASSES];	///< # of packets shed on input
+	uint64_t xferDrops[NUM_CLASSES];///< # of packets lost when xferQ full
+	static int pktClass(Forest::ptyp_t);
+	void	checkOverload();
+	bool	xfer(pktx);
 
 	Router	*rtr;			///< pointer to main router object
 
@@ -65,26 +95,44 @@ private:
 	PacketLog *pktLog;		///< log for recording sample of packets
 	QuManager *qm;			///< queues and link schedulers
 
-	fd_set	*sockets;		///< file descr set for open sockets
-	int	cIf;			///< number of "current interface"
-	int	nRdy;			///< number of ready sockets
-
-	/// info for worker thread used to process an incoming control packet
-	struct ThreadInfo {
-                thread	thred;		///< thread object
-		RouterControl rc;	///< per thread RouterControl object
-                BlockingQ<pktx> q;	///< used to send packets to thread
-		int64_t rcvSeqNum;	///< rcvSeqNum of last packet to thred
-		ThreadInfo() {};
-        };
-	ThreadInfo *tpool;		///< pointer to thread pool
-	List	freeThreads;		///< list of unassigned thread indexs
-	BlockingQ<pair<int,int>> retQ;	///< queue coming from worker threads
-	int64_t rcvSeqNum;		///< used to coordinate thread dealloc
-
-	HashSet<comt_t, Hash::u32> *comtSet; ///< maps comt->thx
+	const static int rcvBatch = 32;	///< max # of packets per recv call
+	pktx	rcvPkt[rcvBatch];	///< packets from last recv call
+	int	rcvIf[rcvBatch];	///< interfaces they arrived on
+	int	nRcv;			///< number of packets in rcvPkt
+	int	nextRcv;		///< index of next packet in rcvPkt
+
+	// packets split from an aggregate datagram
+	const static int maxAgg = 64;	///< max # of packets per aggregate
+	pktx	aggPkt[maxAgg];		///< packets from last aggregate
+	int	aggIf[maxAgg];		///< interfaces they arrived on
+	int	nAgg;			///< number of packets in aggPkt
+	int	nextAgg;		///< index of next packet in aggPkt
+	uint64_t aggRcvd;		///< # of aggregates received
+	uint64_t aggRejected;		///< # of aggregates from links that
+					///< did not negotiate aggregation
+
+	bool	lsockTried[Forest::MAXLNK+1]; ///< true once a connected
+					///< socket has been tried for a link
+
+	CtlExecutor *exec;		///< runs control handlers
+	BlockingQ<pair<int,int>> retQ;	///< queue coming from control tasks
+	int64_t rcvSeqNum;		///< sequence # of last received packet
+
+	const static int64_t timerTick = 10000000; ///< ns between timer checks
+	int64_t nextTimerCheck;		///< time of next timer check
+	void	checkTimers();
+
+	const static int64_t statsInterval = 1000000000; ///< ns between
+					///< updates of published statistics
+	int64_t nextStatsUpdate;	///< time of next update
+	string	stats;			///< statistics, as last published
+	mutex	statsMtx;		///< protects stats
+	string	statsString() const;
+
 	Repeater *rptr;			///< for repeating control packets
 	RepeatHandler *repH;		///< for handling received repeats
+	RteReqCache *rrc;		///< for limiting route request floods
+	SubCoalescer *subq;		///< for aggregating subscription changes
 
 	void	run();
 	bool	mainline();
@@ -98,9 +146,14 @@ private:
 
 	// forwarding 
 	pktx	receive();
+	pktx	nextDatagram(int&);
+	bool	aggLink(pktx, int);
+	int	split(pktx, int);
+	void	openLinkSock(int);
 	bool	pktCheck(pktx,int);
 	void	forward(pktx, int);
 	void	multiForward(pktx, int, int);
+	void	releaseHeld(comt_t, fAdr_t, int);
 
 	// control packets
 	void 	handleControl(pktx, int);
@@ -109,8 +162,24 @@ private:
 	void	sendRteReply(pktx,int);	
 	void	returnAck(pktx,int,bool);	
 	void	subUnsub(pktx,int);
+	void	sendSubUnsub();
 };
 
+/** Get the class of a packet, for use in overload statistics.
+ *  @param ptype is a packet type
+ *  @return the packet class
+ */
+inline int RouterInProc::pktClass(Forest::ptyp_t ptype) {
+	switch (ptype) {
+	case Forest::CLIENT_DATA: return DATA_CLASS;
+	case Forest::CLIENT_SIG: case Forest::NET_SIG: return SIG_CLASS;
+	case Forest::SUB_UNSUB: return SUB_CLASS;
+	case Forest::CONNECT: case Forest::DISCONNECT: return CONN_CLASS;
+	case Forest::RTE_REPLY: return RTE_CLASS;
+	default: return OTHER_CLASS;
+	}
+}
+
 } // ends namespace
 
 #endif
@@ -56,7 +56,29 @@ private:
 	PacketLog *pktLog;		///< log for recording sample of packets
 	QuManager *qm;			///< queues and link schedulers
 
+	// packet aggregation on router links
+	static const int aggMax = 1472;	///< max bytes in aggregate datagram
+	static const int aggPkts = 64;	///< max packets per aggregate
+	/** aggregate being assembled for a link */
+	struct AggState {
+	pktx	px;			///< held packet or aggregate, or 0
+	bool	wrapped;		///< true if px is an aggregate
+	int	n;			///< number of packets in px
+	int	len;			///< length of aggregate (bytes)
+	int64_t	deadline;		///< time at which px must be sent
+	};
+	AggState agg[Forest::MAXLNK+1];	///< per link aggregation state
+	int	aggLnk[Forest::MAXLNK+1]; ///< links with a held packet
+	int	nAggLnk;		///< number of entries in aggLnk
+	uint64_t aggSent;		///< # of aggregates sent
+	uint64_t aggPktCnt;		///< # of packets sent in aggregates
+
+	void	enqueue(pktx,int);
 	void	send(pktx,int);
+	void	sendRaw(pktx,int);
+	void	aggregate(pktx,int);
+	void	sendAgg(int);
+	void	checkAgg();
 };
 
 
@@ -0,0 +1,100 @@
+/** @file RteReqCache.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef RTEREQCACHE_H
+#define RTEREQCACHE_H
+
+#include "stdinc.h"
+#include "Forest.h"
+#include "Dheap.h"
+#include "Hash.h"
+#include "HashMap.h"
+
+using namespace grafalgo;
+
+namespace forest {
+
+/** Class used to limit the flooding of route requests.
+ *
+ *  When a router has no route to a unicast destination, it floods
+ *  the packet to its neighboring routers in the comtree with the
+ *  RTE_REQ flag set. Without some restraint, a burst of packets
+ *  to an unreachable destination produces a burst of floods at
+ *  every router in the comtree backbone.
+ *
+ *  A RteReqCache remembers, for each (comtree, destination) pair,
+ *  when a route request was last flooded. While a request is outstanding,
+ *  additional packets for the same destination are held (up to a small
+ *  limit) rather than flooded; they are released when a route reply
+ *  that installs a route arrives, or discarded when the request
+ *  times out. The cache also remembers
+ *  destinations that were recently reported as unknown, so that packets
+ *  for them can be discarded without flooding.
+ *
+ *  Entries are discarded when they time out. The object is used only by
+ *  the input thread, so no locking is done.
+ */
+class RteReqCache {
+public:
+		RteReqCache(int, int64_t, int64_t);
+		~RteReqCache();
+
+	static const int MAXHELD = 4;	///< max packets held per entry
+
+	// predicates
+	bool	negative(comt_t, fAdr_t, int64_t);
+
+	// modifiers
+	bool	flood(comt_t, fAdr_t, int64_t);
+	bool	hold(comt_t, fAdr_t, pktx);
+	void	setNegative(comt_t, fAdr_t, int64_t);
+	int	release(comt_t, fAdr_t, pktx*);
+	int	expired(int64_t, pktx*);
+
+	string	toString() const;
+private:
+	int	n;			///< max number of entries
+	int64_t	reqTimeout;		///< min time between floods (ns)
+	int64_t	negTimeout;		///< lifetime of negative entries (ns)
+
+	struct Entry {
+	int64_t	floodTime;		///< time of last flood, or -1
+	int64_t	negExpiry;		///< negative entry valid until then
+	int	nHeld;			///< number of held packets
+	pktx	held[MAXHELD];		///< packets awaiting route reply
+	};
+	HashMap<uint64_t,Entry,Hash::u64> *map; ///< (comt,adr) -> Entry
+	Dheap<int64_t> *deadlines;	///< entries ordered by expiration time
+
+	// statistics
+	uint64_t floods;		///< number of floods allowed
+	uint64_t suppressed;		///< number of floods suppressed
+	uint64_t heldCount;		///< number of packets held
+	uint64_t released;		///< number of held packets released
+	uint64_t timedOut;		///< number of held packets discarded
+					///< when their request timed out
+	uint64_t negHits;		///< number of packets dropped due to
+					///< negative entries
+
+	uint64_t key(comt_t, fAdr_t) const;
+	int	getEntry(comt_t, fAdr_t, int64_t);
+	void	setDeadline(int);
+};
+
+/** Compute the hash key for a (comtree, address) pair.
+ *  @param comt is a comtree number
+ *  @param adr is a forest address
+ *  @return a 64 bit key
+ */
+inline uint64_t RteReqCache::key(comt_t comt, fAdr_t adr) const {
+	return (uint64_t(comt) << 32) | (uint64_t(adr) & 0xffffffff);
+}
+
+} // ends namespace
+
+#endif
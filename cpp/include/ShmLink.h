@@ -0,0 +1,162 @@
+/** @file ShmLink.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef SHMLINK_H
+#define SHMLINK_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <sys/un.h>
+#include "Forest.h"
+#include "PacketStore.h"
+#include "LinkIo.h"
+
+using std::atomic;
+using std::mutex;
+
+namespace forest {
+
+/** One end of a shared-memory link between two processes on the same
+ *  machine, such as a router and a co-located host or controller.
+ *
+ *  The link is a memory region holding a pair of single-producer,
+ *  single-consumer rings, one for each direction. Each ring slot holds
+ *  one packet, in the same format as a PacketStore buffer. Sending or
+ *  receiving a packet is a copy to or from a slot plus an update of one
+ *  shared index, with no system call.
+ *
+ *  Each ring also has an eventfd "doorbell". A consumer that wants to
+ *  block rather than poll sets a flag in the ring and waits on the
+ *  doorbell; a producer rings the doorbell only when that flag is set.
+ *  A consumer that polls (like the router's input thread) never sets the
+ *  flag, so the producer never makes a system call.
+ *
+ *  The region is created by the "server" end (the router), using
+ *  memfd_create. The other end attaches by connecting to an abstract
+ *  unix socket named after the link; the server passes the memory and
+ *  eventfd file descriptors to it over that socket. A peer that
+ *  restarts can attach again; the rings are emptied when it does, so
+ *  packets left over from the previous peer are not delivered. The
+ *  server does not send on the ring until a peer has attached, since
+ *  nothing would read it.
+ */
+class ShmLink {
+public:
+		~ShmLink();
+
+	static ShmLink* create(const string&);
+	static ShmLink* attach(const string&);
+
+	bool	accept();
+	bool	attached() const;
+	bool	send(const void*, int);
+	int	recv(void*, int);
+	bool	wait(int);
+	int	doorbell() const;
+private:
+	static const uint32_t MAGIC = 0x46534d31;	///< "FSM1"
+	static const uint32_t SLOTS = 256;	///< packets per ring
+
+	/** one direction of the link; the indexes are on separate cache
+	 *  lines, so producer and consumer don't contend for them */
+	struct Ring {
+	alignas(64) atomic<uint32_t> head; ///< next slot to be read
+	alignas(64) atomic<uint32_t> tail; ///< next slot to be written
+	alignas(64) atomic<uint32_t> asleep; ///< set when consumer waits
+	uint16_t len[SLOTS];		///< length of packet in each slot
+	buffer_t slot[SLOTS];		///< packet buffers
+	};
+	/** shared memory region */
+	struct Region {
+	uint32_t magic;			///< identifies an initialized region
+	Ring	ring[2];		///< ring[0] is server to client
+	};
+
+	Region	*rgn;			///< mapped region
+	int	memFd;			///< file descriptor for region
+	int	bell[2];		///< bell[i] is doorbell for ring[i]
+	int	listenSock;		///< server's socket for attach requests
+	Ring	*tx;			///< ring we send on
+	Ring	*rx;			///< ring we receive on
+	int	txBell;			///< doorbell of peer
+	int	rxBell;			///< our doorbell
+	atomic<bool> peer;		///< true once a peer has attached
+
+		ShmLink();
+	bool	map(bool);
+	static socklen_t sockAdr(const string&, sockaddr_un&);
+};
+
+/** Get the doorbell for arriving packets.
+ *  The doorbell becomes readable only while wait is in progress,
+ *  so callers that multiplex several descriptors should poll it
+ *  with a short timeout, or call recv before blocking.
+ *  @return the eventfd for this end of the link
+ */
+inline int ShmLink::doorbell() const { return rxBell; }
+
+/** Determine if the other end of the link is in use.
+ *  @return true if a peer has attached (always true at the client end)
+ */
+inline bool ShmLink::attached() const { return peer.load(); }
+
+/** The shared-memory links of a router, one ShmLink per link.
+ *  Links are opened at startup, from entries in the link table.
+ *  Until the peer on a link attaches to its ring, the link is not
+ *  reported by hasLink, so packets for it are sent over UDP.
+ */
+class ShmLinks : public LinkIo {
+public:
+		ShmLinks(PacketStore*, int);
+		~ShmLinks();
+
+	bool	open(int, const string&, ipa_t, ipp_t);
+	void	close(int);
+	bool	hasLink(int) const;
+
+	int	recv(pktx*, int*, int);
+	bool	send(int, pktx);
+
+	string	toString() const;
+private:
+	static const int ACCEPT_INTERVAL = 1024; ///< recv calls per check
+						 ///< for attaching peers
+	PacketStore *ps;		///< packet store for received packets
+	int	maxLnk;			///< largest link number
+	atomic<ShmLink*> *link;		///< link[lnk] is endpoint for lnk
+	ipa_t	*peerIp;		///< peerIp[lnk] is IP address of peer
+	ipp_t	*peerPort;		///< peerPort[lnk] is port of peer
+
+	int	lnkList[Forest::MAXLNK+1]; ///< links that have been opened
+	atomic<int> nLnks;		///< number of entries in lnkList
+	int	nextLnk;		///< index in lnkList to poll next
+	int	polls;			///< recv calls since last accept check
+
+	std::vector<ShmLink*> retired;	///< closed endpoints
+	mutex	mtx;			///< lock for open, close
+
+	// statistics
+	uint64_t rcvPkts;		///< # of packets received
+	uint64_t sndPkts;		///< # of packets sent
+	uint64_t sndFull;		///< # of packets dropped, ring full
+};
+
+/** Determine if a link uses a shared-memory ring.
+ *  @param lnk is a link number
+ *  @return true if lnk has a ShmLink and its peer has attached
+ */
+inline bool ShmLinks::hasLink(int lnk) const {
+	if (lnk < 1 || lnk > maxLnk) return false;
+	ShmLink *l = link[lnk].load();
+	return l != 0 && l->attached();
+}
+
+} // ends namespace
+
+#endif
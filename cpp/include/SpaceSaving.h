@@ -0,0 +1,95 @@
+/** @file SpaceSaving.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef SPACESAVING_H
+#define SPACESAVING_H
+
+#include "stdinc.h"
+#include "Dheap.h"
+#include "Hash.h"
+#include "HashMap.h"
+
+using namespace grafalgo;
+
+namespace forest {
+
+/** This class implements the Space-Saving algorithm for finding the
+ *  heavy hitters in a stream of weighted keys, using a fixed amount
+ *  of memory.
+ *
+ *  At most n keys are monitored at once. When an unmonitored key
+ *  arrives and all n counters are in use, the key with the smallest
+ *  count is replaced by the new key, which inherits the old count.
+ *  So, the count for a key never underestimates its true weight, and
+ *  overestimates it by at most the inherited count (which is reported
+ *  as the error bound). Any key whose weight exceeds 1/n of the total
+ *  is guaranteed to be monitored.
+ *
+ *  The object does no locking; callers that share it between
+ *  threads must provide their own.
+ */
+class SpaceSaving {
+public:
+		SpaceSaving(int);
+		~SpaceSaving();
+
+	/** information about one monitored key */
+	struct Counter {
+	uint64_t key;			///< key being monitored
+	uint64_t pkts;			///< estimated packet count
+	uint64_t bytes;			///< estimated byte count
+	uint64_t err;			///< max overestimate of byte count
+	};
+
+	void	update(uint64_t, int);
+	int	top(int, vector<Counter>&) const;
+	void	clear();
+	uint64_t total() const;
+private:
+	int	n;			///< max number of monitored keys
+	uint64_t totalBytes;		///< total weight of all updates
+	HashMap<uint64_t,Counter,Hash::u64> *map; ///< key -> Counter
+	Dheap<uint64_t> *counts;	///< counters ordered by byte count
+};
+
+/** Record an occurrence of a key.
+ *  @param key is the key
+ *  @param bytes is the weight of this occurrence
+ */
+inline void SpaceSaving::update(uint64_t key, int bytes) {
+	totalBytes += bytes;
+	int x = map->find(key);
+	if (x != 0) {
+		Counter& c = map->getValue(x);
+		c.pkts++; c.bytes += bytes;
+		counts->changekey(x, c.bytes);
+		return;
+	}
+	if (map->size() < n) {
+		Counter c; c.key = key; c.pkts = 1; c.bytes = bytes; c.err = 0;
+		x = map->put(key, c);
+		if (x != 0) counts->insert(x, c.bytes);
+		return;
+	}
+	// replace the key with the smallest count
+	x = counts->findmin();
+	Counter& c = map->getValue(x);
+	if (!map->rekey(x, key)) return;
+	c.key = key; c.err = c.bytes;
+	c.pkts++; c.bytes += bytes;
+	counts->changekey(x, c.bytes);
+}
+
+/** Get the total weight of all updates since the last clear.
+ *  @return the total weight
+ */
+inline uint64_t SpaceSaving::total() const { return totalBytes; }
+
+} // ends namespace
+
+#endif
@@ -0,0 +1,161 @@
+/** @file StageTrace.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef STAGETRACE_H
+#define STAGETRACE_H
+
+#include <atomic>
+#include "Forest.h"
+
+using std::atomic;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+
+namespace forest {
+
+/** Records the times at which sampled packets pass through the stages
+ *  of the router's packet processing pipeline.
+ *
+ *  Each thread that records events has its own ring of fixed-size
+ *  events, so recording takes no locks. A ring holds the most recent
+ *  events; older ones are overwritten. A packet is sampled if its
+ *  receive sequence number is a multiple of the sample rate, so all the
+ *  events for a sampled packet are recorded, whichever thread handles
+ *  them. On request, the rings are dumped to a file in the Chrome trace
+ *  event format (JSON), which can be loaded into chrome://tracing or
+ *  the Perfetto UI. Each thread appears as a track of instant events,
+ *  and each packet appears as a series of spans, one per stage.
+ *
+ *  Trace points are written using the TRACE_STAGE macro, which expands
+ *  to nothing unless the router is compiled with PIPELINE_TRACE defined.
+ */
+class StageTrace {
+public:
+	/** stages of the pipeline */
+	enum Stage {
+		RECV = 1,		///< packet received by input thread
+		FORWARD = 2,		///< unicast forwarding
+		MFORWARD = 3,		///< multicast forwarding
+		XFER_ENQ = 4,		///< added to transfer queue
+		XFER_DEQ = 5,		///< removed from transfer queue
+		QM_ENQ = 6,		///< added to link queue
+		QM_DEQ = 7,		///< removed from link queue
+		SEND = 8,		///< sent on link
+		DROP = 9		///< discarded
+	};
+	static const int IN_THREAD = 0;		///< ring for input thread
+	static const int OUT_THREAD = 1;	///< ring for output thread
+
+		StageTrace(int, int);
+		~StageTrace();
+
+	bool	sampled(int64_t) const;
+	void	record(int, uint64_t, Stage, pktx, int64_t, int, int);
+
+	void	setSampleRate(int);
+	int	getSampleRate() const;
+	int	dump(const string&, uint64_t);
+
+	static string stage2string(Stage);
+private:
+	/** a single event */
+	struct Event {
+	uint64_t time;			///< time of event
+	uint32_t seq;			///< receive sequence # of packet
+	uint32_t px;			///< packet index
+	uint32_t qid;			///< queue number, or 0
+	uint16_t link;			///< link number, or 0
+	uint8_t	stage;			///< pipeline stage
+	uint8_t	thread;			///< thread that recorded the event
+	};
+
+	/** a ring of events written by one thread */
+	struct Ring {
+	Event	*ev;			///< storage for events
+	char	pad0[64];
+	atomic<uint64_t> count;		///< number of events ever recorded
+	char	pad1[64];
+	};
+
+	int	nRings;			///< number of rings
+	int	nEvents;		///< events per ring (a power of 2)
+	Ring	*ring;			///< ring[r] is ring number r
+	atomic<int> rate;		///< sample rate, 0 to disable
+
+	void	snapshot(int, vector<Event>&) const;
+	static bool bySeq(const Event&, const Event&);
+};
+
+#ifdef PIPELINE_TRACE
+/** Record a pipeline event for a packet, if it is sampled.
+ *  @param st is a pointer to a StageTrace object
+ *  @param thrd is the ring of the calling thread
+ *  @param t is the current time
+ *  @param stage is the stage (StageTrace::Stage, without the prefix)
+ *  @param px is the packet index
+ *  @param p is the Packet for px
+ *  @param lnk is the link number, or 0
+ *  @param qid is the queue number, or 0
+ */
+#define TRACE_STAGE(st, thrd, t, stage, px, p, lnk, qid) \
+	do { \
+		const Packet& tp_ = (p); \
+		if ((st)->sampled(tp_.rcvSeqNum)) \
+			(st)->record(thrd, t, StageTrace::stage, px, \
+				     tp_.rcvSeqNum, lnk, qid); \
+	} while (0)
+#else
+#define TRACE_STAGE(st, thrd, t, stage, px, p, lnk, qid) do {} while (0)
+#endif
+
+/** Determine if a packet should be traced.
+ *  @param seq is the packet's receive sequence number; packets created
+ *  by the router itself have none (0) and are never traced
+ *  @return true if events for the packet should be recorded
+ */
+inline bool StageTrace::sampled(int64_t seq) const {
+	int n = rate.load(memory_order_relaxed);
+	return n > 0 && seq > 0 && (seq % n) == 0;
+}
+
+/** Record an event.
+ *  Must only be called by the thread that owns the ring.
+ *  @param r is the ring of the calling thread
+ *  @param now is the current time
+ *  @param stage is the pipeline stage
+ *  @param px is the packet index
+ *  @param seq is the packet's receive sequence number
+ *  @param lnk is the link number, or 0
+ *  @param qid is the queue number, or 0
+ */
+inline void StageTrace::record(int r, uint64_t now, Stage stage, pktx px,
+			       int64_t seq, int lnk, int qid) {
+	Ring& rg = ring[r];
+	uint64_t c = rg.count.load(memory_order_relaxed);
+	Event& e = rg.ev[c & (nEvents-1)];
+	e.time = now; e.seq = seq; e.px = px; e.qid = qid;
+	e.link = lnk; e.stage = stage; e.thread = r;
+	rg.count.store(c+1, memory_order_release);
+}
+
+/** Set the sample rate.
+ *  @param n means that every n-th packet is traced; 0 turns tracing off
+ */
+inline void StageTrace::setSampleRate(int n) {
+	rate.store(max(n,0), memory_order_relaxed);
+}
+
+/** Get the sample rate.  */
+inline int StageTrace::getSampleRate() const {
+	return rate.load(memory_order_relaxed);
+}
+
+} // ends namespace
+
+#endif
@@ -0,0 +1,110 @@
+/** @file SubCoalescer.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef SUBCOALESCER_H
+#define SUBCOALESCER_H
+
+#include "stdinc.h"
+#include "Forest.h"
+#include "Dheap.h"
+#include "Hash.h"
+#include "HashMap.h"
+
+using namespace grafalgo;
+
+namespace forest {
+
+/** Class used to aggregate subscription changes before they are
+ *  propagated towards the core of a comtree.
+ *
+ *  When a non-core router adds or removes a multicast route in
+ *  response to a SUB_UNSUB packet, it must inform its parent.
+ *  Rather than doing this for every packet, the changes are collected
+ *  for a short period (the window) and then sent in a single SUB_UNSUB
+ *  packet. An add and a drop of the same multicast address within
+ *  the same window cancel one another and are not sent at all.
+ *  Changes for a comtree that arrive when the table of comtrees is
+ *  full are held in a spill list and sent once no window has ended.
+ *  Changes that could not be sent are returned using requeue.
+ *
+ *  The object is used only by the input thread, so no locking is done.
+ */
+class SubCoalescer {
+public:
+		SubCoalescer(int, int, int64_t);
+		~SubCoalescer();
+
+	static const int MAXADRS = 350;	///< max addresses in one packet
+
+	void	add(comt_t, fAdr_t, int64_t);
+	void	drop(comt_t, fAdr_t, int64_t);
+	comt_t	expired(int64_t, vector<fAdr_t>&, vector<fAdr_t>&);
+	void	requeue(comt_t, const vector<fAdr_t>&,
+			const vector<fAdr_t>&, int64_t);
+
+	string	toString() const;
+private:
+	int	nComt;			///< max number of comtrees with changes
+	int	nAdr;			///< max number of pending changes
+	int64_t	window;			///< aggregation window in ns
+
+	/** pending changes for one comtree */
+	struct Batch {
+	vector<fAdr_t> adrs;		///< addresses with pending changes
+	};
+	HashMap<comt_t,Batch,Hash::u32> *batches; ///< comt -> Batch
+	Dheap<int64_t> *deadlines;	///< batches ordered by send time
+
+	/** maps (comt,adr) to +1 for a pending add, -1 for a pending drop */
+	HashMap<uint64_t,int,Hash::u64> *pending;
+	vector<uint64_t> spill;		///< keys of pending changes for
+					///< comtrees with no Batch
+
+	// statistics
+	uint64_t changes;		///< number of changes recorded
+	uint64_t cancelled;		///< number of changes cancelled
+	uint64_t sent;			///< number of changes sent
+	uint64_t pkts;			///< number of batches sent
+	uint64_t requeued;		///< number of changes requeued
+
+	uint64_t key(comt_t, fAdr_t) const;
+	void	update(comt_t, fAdr_t, int, int64_t);
+	void	queue(comt_t, fAdr_t, int64_t, bool);
+	comt_t	expiredSpill(vector<fAdr_t>&, vector<fAdr_t>&);
+};
+
+/** Compute the key for a (comtree, address) pair.
+ *  @param comt is a comtree number
+ *  @param adr is a multicast address
+ *  @return a 64 bit key
+ */
+inline uint64_t SubCoalescer::key(comt_t comt, fAdr_t adr) const {
+	return (uint64_t(comt) << 32) | (uint64_t(adr) & 0xffffffff);
+}
+
+/** Record a new subscription to be sent to the parent.
+ *  @param comt is a comtree number
+ *  @param adr is a multicast address
+ *  @param now is the current time
+ */
+inline void SubCoalescer::add(comt_t comt, fAdr_t adr, int64_t now) {
+	update(comt,adr,+1,now);
+}
+
+/** Record a dropped subscription to be sent to the parent.
+ *  @param comt is a comtree number
+ *  @param adr is a multicast address
+ *  @param now is the current time
+ */
+inline void SubCoalescer::drop(comt_t comt, fAdr_t adr, int64_t now) {
+	update(comt,adr,-1,now);
+}
+
+} // ends namespace
+
+#endif
@@ -20,6 +20,7 @@
 #include "Controller.h"
 #include "Repeater.h"
 #include "RepeatHandler.h"
+#include "ShmLink.h"
 #include <thread> 
 #include <mutex> 
 #include <chrono> 
@@ -49,6 +50,7 @@ public:
 	void	setRtrPort(ipp_t);
 	void	setNonce(uint64_t);
 	void	setRtrReady(bool);
+	void	setShmName(const string&);
 
 private:
 	fAdr_t	myAdr;		///< Forest address of self
@@ -73,6 +75,9 @@ private:
 	int	dgPort;		///< port number used for datagram socket
 	int	listenSock;	///< listening stream socket
 	int	listenPort;	///< port number for listening socket
+	string	shmName;	///< name of shared-memory ring to router,
+				///< or "" if not co-located
+	ShmLink	*shm;		///< shared-memory ring, once attached
 	
 	PacketStore *ps;	///< pointer to packet store
 	Logger *logger;		///< error message logger
@@ -92,6 +97,7 @@ private:
 inline void Substrate::setRtrPort(ipp_t port) { rtrPort = port; }
 inline void Substrate::setNonce(uint64_t nonce1) { nonce = nonce1; }
 inline void Substrate::setRtrReady(bool ready) { rtrReady = ready; }
+inline void Substrate::setShmName(const string& name) { shmName = name; }
 
 } // ends namespace
 
@@ -0,0 +1,97 @@
+/** @file TableSnap.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef TABLESNAP_H
+#define TABLESNAP_H
+
+#include "Forest.h"
+#include "IfaceTable.h"
+#include "LinkTable.h"
+#include "ComtreeTable.h"
+#include "RouteTable.h"
+
+namespace forest {
+
+/** A binary snapshot of a router's interface, link, comtree and route
+ *  tables, used to restart a router quickly.
+ *
+ *  The file starts with a 32 byte header: a magic number, a version
+ *  number, the forest address of the router that wrote it, the number
+ *  of sections, the wall-clock time (ns since the epoch) when it was
+ *  written and the total file size. Each table then has a 16 byte
+ *  section header giving the table, the number of entries, the number
+ *  of 32 bit words that follow and a checksum of those words. Each
+ *  entry is a word count followed by that many words of fields:
+ *
+ *  interface	iface, ip, port, rates (4 words), device name
+ *  link	link, iface, peer ip, peer port, peer type, peer address,
+ *		rates (4 words), nonce (2 words), shared-memory ring name
+ *  comtree	comtree, core flag, parent link, number of links, then
+ *		for each comtree link: link, flags (1 for a router link,
+ *		2 for a core link), dest, rates (4 words)
+ *  route	comtree, address, number of links, link numbers
+ *
+ *  Strings are stored as a length followed by the characters, padded
+ *  to a whole number of words. Numbers are in host byte order.
+ *
+ *  A snapshot is written to a temporary file that is renamed when it is
+ *  complete, so a crash never leaves a partial snapshot in place. For
+ *  loading, the file is mapped into memory and the header, sizes and
+ *  checksums are all verified before any table is touched.
+ */
+class TableSnap {
+public:
+	static bool write(const string&, fAdr_t, IfaceTable*, LinkTable*,
+			  ComtreeTable*, RouteTable*);
+	static bool load(const string&, fAdr_t, IfaceTable*, LinkTable*,
+			 ComtreeTable*, RouteTable*, bool&);
+private:
+	static const uint32_t MAGIC = 0x46545331;	///< "FTS1"
+	static const uint32_t VERSION = 1;
+
+	/** table identifiers used in section headers */
+	enum SecType { IFACES = 1, LINKS = 2, COMTREES = 3, ROUTES = 4 };
+
+	/** file header */
+	struct FileHdr {
+	uint32_t magic;			///< identifies a snapshot file
+	uint32_t version;		///< version of file format
+	int32_t	myAdr;			///< address of router that wrote it
+	uint32_t nSecs;			///< number of sections
+	uint64_t time;			///< when snapshot was written
+	uint64_t size;			///< total length of file in bytes
+	};
+	/** section header */
+	struct SecHdr {
+	uint32_t table;			///< table in this section
+	uint32_t count;			///< number of entries
+	uint32_t nWords;		///< number of words of entries
+	uint32_t cksum;			///< checksum of entry words
+	};
+
+	static uint32_t checksum(const int32_t*, int);
+	static void packRates(const RateSpec&, vector<int32_t>&);
+	static void packString(const string&, vector<int32_t>&);
+	static bool unpackString(const int32_t*&, const int32_t*, string&);
+
+	static int packIfaces(IfaceTable*, vector<int32_t>&);
+	static int packLinks(LinkTable*, vector<int32_t>&);
+	static int packComtrees(ComtreeTable*, vector<int32_t>&);
+	static int packRoutes(ComtreeTable*, RouteTable*, vector<int32_t>&);
+
+	static bool loadIface(const int32_t*, const int32_t*, IfaceTable*);
+	static bool loadLink(const int32_t*, const int32_t*, LinkTable*);
+	static bool loadComtree(const int32_t*, const int32_t*,
+				ComtreeTable*);
+	static bool loadRoute(const int32_t*, const int32_t*,
+			      ComtreeTable*, RouteTable*);
+};
+
+} // ends namespace
+
+#endif
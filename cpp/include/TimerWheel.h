@@ -0,0 +1,88 @@
+/** @file TimerWheel.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "Forest.h"
+
+namespace forest {
+
+/** A hashed timing wheel, used to keep track of deadlines.
+ *
+ *  Timers are identified by integers 1..n, chosen by the user (usually
+ *  the index of an entry in some hash table). Time is divided into
+ *  ticks and each timer is placed in the slot of the wheel for the tick
+ *  containing its deadline, modulo the number of slots. Inserting or
+ *  removing a timer takes constant time. Expired timers are collected
+ *  in batches by expired(), which visits the slots for the ticks that
+ *  have passed since the last call. Timers more than one revolution in
+ *  the future share a slot with nearer ones and are skipped until
+ *  their deadline is reached.
+ */
+class TimerWheel {
+public:
+		TimerWheel(int, int64_t, int);
+		~TimerWheel();
+
+	bool	member(int) const;
+	int64_t	deadline(int) const;
+	int	size() const;
+
+	void	insert(int, int64_t);
+	void	remove(int);
+	void	changeDeadline(int, int64_t);
+
+	int	expired(int64_t, int*, int);
+	int	earliest() const;
+private:
+	int	n;			///< timers are numbered 1..n
+	int64_t	tick;			///< length of a tick in ns
+	int	nSlots;			///< number of slots in wheel
+	int	count;			///< number of timers in wheel
+	int64_t	curTick;		///< tick of slot that expired() will
+					///< visit next
+
+	int	*head;			///< head[s] is first timer in slot s
+	int	*next;			///< next[i] is timer after i in its slot
+	int	*prev;			///< prev[i] is timer before i, or
+					///< -(s+1) if i is first in slot s
+	int64_t	*dl;			///< dl[i] is deadline of i, or -1
+					///< if i is not in the wheel
+};
+
+/** Determine if a timer is in the wheel.
+ *  @param i is a timer number
+ *  @return true if i is set
+ */
+inline bool TimerWheel::member(int i) const {
+	return 1 <= i && i <= n && dl[i] >= 0;
+}
+
+/** Get the deadline of a timer.
+ *  @param i is a timer in the wheel
+ *  @return the deadline of i
+ */
+inline int64_t TimerWheel::deadline(int i) const { return dl[i]; }
+
+/** Get the number of timers in the wheel.
+ *  @return the number of timers that are set
+ */
+inline int TimerWheel::size() const { return count; }
+
+/** Change the deadline of a timer.
+ *  @param i is a timer in the wheel
+ *  @param d is its new deadline
+ */
+inline void TimerWheel::changeDeadline(int i, int64_t d) {
+	remove(i); insert(i, d);
+}
+
+} // ends namespace
+
+#endif
@@ -0,0 +1,133 @@
+/** @file TrafGen.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef TRAFGEN_H
+#define TRAFGEN_H
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <chrono>
+
+using namespace std::chrono;
+
+#include "Forest.h"
+#include "Packet.h"
+#include "PacketStore.h"
+#include "PktIo.h"
+
+namespace forest {
+
+/** TrafGen is a load generator for forest routers.
+ *
+ *  A set of sender threads generates CLIENT_DATA packets for a
+ *  collection of flows, where each flow has its own source address
+ *  and comtree. Each sender has its own socket, packet store and
+ *  batched packet I/O backend, so senders share nothing but the
+ *  counters that are read at the end. The sending rate is set by a
+ *  token bucket in each sender, driven by a monotonic nanosecond clock.
+ *
+ *  The first words of each packet's payload hold a magic number, a
+ *  flow number, a sequence number and the time the packet was sent.
+ *  A receiver thread uses these to measure the loss and reordering in
+ *  each flow and the one-way latency of each packet. Latencies are kept
+ *  in a log-linear histogram, from which percentiles are reported.
+ *  Send times come from the system clock, so the one-way latency is only
+ *  meaningful when sender and receiver are on the same host, or on
+ *  hosts with synchronized clocks.
+ */
+class TrafGen {
+public:
+	/** configuration, shared by all threads */
+	struct Config {
+	ipa_t	myIp;			///< IP address to send from
+	ipa_t	rtrIp;			///< IP address of router
+	ipp_t	rtrPort;		///< port number of router
+	ipp_t	rcvPort;		///< port used by receiver
+	double	rate;			///< total sending rate (packets/sec)
+	int	pktLen;			///< forest packet length in bytes
+	int	nThreads;		///< number of sender threads
+	int	finTime;		///< number of seconds to send
+	fAdr_t	srcAdr;			///< first source address
+	int	nSrc;			///< number of source addresses
+	comt_t	comt;			///< first comtree
+	int	nComt;			///< number of comtrees
+	fAdr_t	dstAdr;			///< destination address
+	bool	send;			///< true if senders should run
+	bool	recv;			///< true if receiver should run
+	string	ioMode;			///< packet I/O backend
+	};
+
+		TrafGen(const Config&);
+		~TrafGen();
+
+	bool	init();
+	void	run();
+	string	toString() const;
+
+	static const uint32_t MAGIC = 0x54524731;	///< "TRG1"
+	static const int PAYLOAD = 6;	///< words of payload used
+private:
+	/** per-sender state */
+	struct Sender {
+	int	sock;			///< socket used by sender
+	PacketStore *ps;		///< packets for this sender
+	PktIo	*pio;			///< batched packet I/O
+	uint64_t nSent;			///< number of packets sent
+	uint64_t nFail;			///< number of failed sends
+	thread	thred;			///< thread running sender
+	};
+
+	/** per-flow receive state */
+	struct Flow {
+	uint64_t rcvd;			///< number of packets received
+	uint64_t nextSeq;		///< next expected sequence number
+	uint64_t late;			///< packets received out of order
+	};
+
+	/** log-linear latency histogram; bucket b covers a power of two
+	 *  that is divided into SUB equal parts */
+	static const int SUB = 16;
+	static const int NBKT = 64 * SUB;
+
+	Config	cfg;
+	int	nFlows;			///< number of flows
+	steady_clock::time_point t0;	///< start time
+	atomic<bool> stop;		///< set to stop the receiver
+
+	Sender	*snd;			///< array of senders
+	int	rsock;			///< socket used by receiver
+	PacketStore *rps;		///< packets for receiver
+	PktIo	*rio;			///< batched packet I/O for receiver
+	std::vector<Flow> flows;	///< receive state for each flow
+	uint64_t hist[NBKT];		///< latency histogram
+	uint64_t nRcvd;			///< number of packets received
+	uint64_t nBad;			///< packets not from one of our flows
+	uint64_t maxLat;		///< largest latency seen
+	uint64_t rcvTime;		///< time receiver ran (ns)
+
+	static uint64_t wallTime();
+	static int bucket(uint64_t);
+	static uint64_t bucketValue(int);
+	uint64_t percentile(double) const;
+
+	void	sender(int);
+	void	receiver();
+};
+
+/** Get the current time on the system clock.
+ *  @return the number of ns since the epoch
+ */
+inline uint64_t TrafGen::wallTime() {
+	return duration_cast<nanoseconds>(
+			system_clock::now().time_since_epoch()).count();
+}
+
+} // ends namespace
+
+#endif
@@ -0,0 +1,109 @@
+/** @file UringIo.h
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#ifndef URINGIO_H
+#define URINGIO_H
+
+#ifdef HAVE_LIBURING
+
+#include <liburing.h>
+#include "PktIo.h"
+
+namespace forest {
+
+/** Packet I/O backend based on io_uring.
+ *
+ *  The receive side uses a separate ring from the send side, so that
+ *  the input and output threads never share a ring. Each interface socket
+ *  has a multishot recvmsg request outstanding, which selects its buffers
+ *  from a ring of provided buffers. The provided buffers are the buffers
+ *  of packets allocated from the PacketStore, so a received packet needs
+ *  no copy to a second buffer. The kernel places a small header and the
+ *  source address ahead of the packet, so the packet is moved to the
+ *  start of its buffer before it is returned. As buffers are consumed,
+ *  they are replaced with newly allocated packets. If the provided buffers
+ *  run out, the multishot request ends and is re-armed on a later call.
+ *
+ *  The send side prepares a sendmsg request for each outgoing packet
+ *  and submits them to the kernel in batches. Completions are reaped
+ *  (and the packets freed) by flush, which the output thread should call
+ *  whenever it has nothing else to do. A send that fails with an error
+ *  that a later send may not repeat (a full socket buffer, or an ICMP
+ *  error from the peer) just loses its packet, as with the other
+ *  backends. Any other error is reported by the next call to send or
+ *  flush.
+ */
+class UringIo : public PktIo {
+public:
+		UringIo(PacketStore*);
+		~UringIo();
+
+	static const int NBUFS = 256;	///< # of provided buffers
+	static const int TXSLOTS = 256;	///< max # of sends in progress
+	static const int BATCH = 32;	///< sends per submission
+
+	bool	init();
+	int	recv(pktx*, int*, int);
+	bool	send(int, pktx, const sockaddr_in&);
+	bool	flush();
+
+	string	toString() const;
+private:
+	static const int BGID = 1;	///< id of provided buffer group
+
+	bool	rxReady;		///< true once rx ring is initialized
+	bool	txReady;		///< true once tx ring is initialized
+
+	// receive side
+	struct io_uring rx;		///< ring used by input thread
+	struct io_uring_buf_ring *br;	///< ring of provided buffers
+	pktx	bufPkt[NBUFS];		///< bufPkt[b] is packet for buffer b
+	int	emptyBuf[NBUFS];	///< buffer ids with no packet
+	int	nEmpty;			///< number of entries in emptyBuf
+	bool	armed[Forest::MAXINTF+1]; ///< true if recvmsg outstanding
+	struct msghdr rxMsg;		///< layout for multishot recvmsg
+	int	rxErr;			///< error code of a failed receive
+					///< not yet reported, or 0
+
+	// send side
+	struct io_uring tx;		///< ring used by output thread
+	struct TxSlot {
+	pktx	px;			///< packet being sent
+	sockaddr_in sa;			///< destination address
+	iovec	iov;			///< buffer descriptor
+	msghdr	msg;			///< sendmsg argument
+	};
+	TxSlot	txSlot[TXSLOTS];	///< state of sends in progress
+	int	freeSlot[TXSLOTS];	///< unused entries in txSlot
+	int	nFree;			///< number of entries in freeSlot
+	int	nPending;		///< # of sends not yet submitted
+	int	txErr;			///< error code of a failed send
+					///< not yet reported, or 0
+	uint64_t sndErrs;		///< # of packets lost to send errors
+
+	void	refill();
+	void	arm(int);
+	void	reap(bool);
+	static bool transient(int);
+};
+
+/** Determine if a send error affects only the packet being sent.
+ *  @param err is an errno value
+ *  @return true if later sends may succeed
+ */
+inline bool UringIo::transient(int err) {
+	return err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS ||
+	       err == ECONNREFUSED || err == EHOSTUNREACH ||
+	       err == ENETUNREACH;
+}
+
+} // ends namespace
+
+#endif
+
+#endif
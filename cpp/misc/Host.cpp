@@ -12,7 +12,7 @@ using namespace forest;
 
 /**
  *  usage:
- *       Host myIpAdr rtrIpAdr repeatFlag delta finTime
+ *       Host myIpAdr rtrIpAdr repeatFlag delta finTime [shm=name]
  * 
  *  Host is a simple packet generator for a forest host.
  *  MyIpAdr and rtrIpAdr are the IP addresses of the host itself
@@ -21,6 +21,10 @@ using namespace forest;
  *  ignored. Delta is the minimum number of nanoseconds
  *  between successive packet transmissions.
  *  FinTime is the number of seconds that the host should run.
+ *  If the host is on the same machine as the router, the optional
+ *  last argument names the shared-memory ring defined for the host
+ *  in the router's link table; packets are then exchanged through the
+ *  ring rather than through UDP.
  * 
  *  The packets generated by Host are determined by a packet
  *  specification that is read from stdin. The input may include
@@ -57,18 +61,19 @@ int main(int argc, char *argv[]) {
 	ipa_t myIpAdr, rtrIpAdr;
 	int repeatFlag, delta, finTime;
 
-	if (argc != 6 ||
+	if ((argc != 6 && argc != 7) ||
 	    (myIpAdr = Np4d::ipAddress(argv[1])) == 0 ||
 	    (rtrIpAdr = Np4d::ipAddress(argv[2])) == 0 ||
 	    sscanf(argv[3],"%d", &repeatFlag) != 1 ||
 	    sscanf(argv[4],"%d", &delta) != 1 ||
-	    sscanf(argv[5],"%d", &finTime) != 1) {
+	    sscanf(argv[5],"%d", &finTime) != 1 ||
+	    (argc == 7 && strncmp(argv[6],"shm=",4) != 0)) {
 		Util::fatal("usage: fHost myIpAdr routerIpAdr repeatCnt "
-		      "delta finTime");
+		      "delta finTime [shm=name]");
 		exit(0); // redundant, but makes compiler happy
 	}
 
-	Host host(myIpAdr,rtrIpAdr);
+	Host host(myIpAdr,rtrIpAdr,(argc == 7 ? &argv[6][4] : ""));
 	if (!host.init()) Util::fatal("Host:: initialization failure");
 	host.run((repeatFlag ? true : false), (int64_t) delta, finTime);
 }
@@ -76,20 +81,25 @@ int main(int argc, char *argv[]) {
 namespace forest {
 
 // Constructor for Host, allocates space and initializes private data
-Host::Host(ipa_t mipa, ipa_t ripa) : myIpAdr(mipa) , rtrIpAdr(ripa) {
+Host::Host(ipa_t mipa, ipa_t ripa, const string& shmName1)
+	   : myIpAdr(mipa) , rtrIpAdr(ripa), shmName(shmName1) {
 	nPkts = 10000;
 	ps = new PacketStore(nPkts+1, nPkts+1);
+	shm = 0;
 }
 
-Host::~Host() { delete ps; }
+Host::~Host() { delete ps; delete shm; }
 
 /** Initialize IO. Return true on success, false on failure.
  *  Configure socket for non-blocking access, so that we don't
  *  block when there are no input packets available.
+ *  If a shared-memory ring was named, attach to it.
  */
 bool Host::init() {
 	sock = Np4d::datagramSocket();
 
+	if (shmName.length() > 0 && (shm = ShmLink::attach(shmName)) == 0)
+		return false;
 	return  sock >= 0 &&
         	Np4d::bind4d(sock, myIpAdr, 0) &&
 		Np4d::nonblock(sock);
@@ -186,7 +196,8 @@ cerr << i << " " << pkt[i].pause << " " << pkt[i].cnt << endl;
 		now = temp.count();
 
 		if (nextTime > now + 1200000) {
-			this_thread::sleep_for(milliseconds(1));
+			if (shm != 0) shm->wait(1); // wakes early on arrival
+			else this_thread::sleep_for(milliseconds(1));
 			temp = high_resolution_clock::now() - t0;
 			now = temp.count();
 		}
@@ -225,6 +236,11 @@ bool Host::readPacket(pktx px, int64_t& pause, int& cnt) {
 void Host::send(pktx px) {
 // Send packet and recycle storage.
 	Packet& p = ps->getPacket(px);
+	if (shm != 0) {
+		if (!shm->send((void *) p.buffer, p.length))
+			cerr << "Host::send: shared-memory ring full\n";
+		return;
+	}
 	int rv = Np4d::sendto4d(sock,(void *) p.buffer, p.length,
 		    		rtrIpAdr, Forest::ROUTER_PORT);
 	if (rv == -1) Util::fatal("Host::send: failure in sendto");
@@ -238,6 +254,14 @@ int Host::receive() {
 	if (px == 0) return 0;
 	Packet& p = ps->getPacket(px);
 
+	if (shm != 0) {
+		nbytes = shm->recv((void *) p.buffer, Forest::BUF_SIZ);
+		if (nbytes == 0) { ps->free(px); return 0; }
+		p.bufferLen = nbytes;
+		p.tunIp = rtrIpAdr; p.tunPort = Forest::ROUTER_PORT;
+		return px;
+	}
+
 	ipa_t remoteIp; ipp_t remotePort;
         nbytes = Np4d::recvfrom4d(sock, p.buffer, 1500,
                           	  remoteIp, remotePort);
@@ -0,0 +1,366 @@
+/** @file TrafGen.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include <poll.h>
+#include "TrafGen.h"
+
+using namespace forest;
+
+/** usage:
+ *       TrafGen myIp=ip rtrIp=ip [name=value ...]
+ *
+ *  TrafGen is a multi-threaded load generator for a forest router.
+ *  MyIp is the IP address of the interface to send from and rtrIp is
+ *  the IP address of the router. The remaining arguments are optional.
+ *
+ *  mode=send|recv|both	whether to run the senders, the receiver or both
+ *  rate=pps		total sending rate; 0 means as fast as possible
+ *  threads=n		number of sender threads
+ *  pktLen=n		forest packet length in bytes
+ *  finTime=s		number of seconds to send (or receive)
+ *  srcAdr=z.l		first source address
+ *  nSrc=n		number of source addresses (successive local parts)
+ *  comt=n		first comtree
+ *  nComt=n		number of comtrees
+ *  dstAdr=z.l		destination address
+ *  rtrPort=n		router's port number
+ *  rcvPort=n		port the receiver listens on
+ *  io=mmsg|gso|socket	packet I/O backend
+ *
+ *  There is one flow for each combination of source address and comtree;
+ *  the flows are divided among the sender threads. The router must be
+ *  configured to accept the source addresses and comtrees used, and to
+ *  deliver packets for the destination to the receiver's address.
+ *  At the end, TrafGen prints the number of packets sent and, if the
+ *  receiver was run, the loss, reordering and latency percentiles.
+ */
+int main(int argc, char *argv[]) {
+	TrafGen::Config cfg;
+	cfg.myIp = cfg.rtrIp = 0;
+	cfg.rtrPort = Forest::ROUTER_PORT; cfg.rcvPort = 0;
+	cfg.rate = 100000; cfg.pktLen = 100; cfg.nThreads = 1;
+	cfg.finTime = 10;
+	cfg.srcAdr = Forest::forestAdr(1,1); cfg.nSrc = 1;
+	cfg.comt = 1001; cfg.nComt = 1;
+	cfg.dstAdr = Forest::forestAdr(1,2);
+	cfg.send = cfg.recv = true; cfg.ioMode = "mmsg";
+
+	for (int i = 1; i < argc; i++) {
+		string s(argv[i]);
+		size_t k = s.find('=');
+		if (k == string::npos) Util::fatal("TrafGen: bad argument " + s);
+		string name = s.substr(0,k); const char *val = &argv[i][k+1];
+		int x = atoi(val);
+		if (name == "myIp")		cfg.myIp = Np4d::ipAddress(val);
+		else if (name == "rtrIp")	cfg.rtrIp = Np4d::ipAddress(val);
+		else if (name == "rtrPort")	cfg.rtrPort = x;
+		else if (name == "rcvPort")	cfg.rcvPort = x;
+		else if (name == "rate")	cfg.rate = atof(val);
+		else if (name == "threads")	cfg.nThreads = x;
+		else if (name == "pktLen")	cfg.pktLen = x;
+		else if (name == "finTime")	cfg.finTime = x;
+		else if (name == "srcAdr")	cfg.srcAdr = Forest::forestAdr(val);
+		else if (name == "nSrc")	cfg.nSrc = x;
+		else if (name == "comt")	cfg.comt = x;
+		else if (name == "nComt")	cfg.nComt = x;
+		else if (name == "dstAdr")	cfg.dstAdr = Forest::forestAdr(val);
+		else if (name == "io")		cfg.ioMode = val;
+		else if (name == "mode") {
+			cfg.send = (strcmp(val,"recv") != 0);
+			cfg.recv = (strcmp(val,"send") != 0);
+		} else Util::fatal("TrafGen: unknown argument " + s);
+	}
+	int minLen = Forest::OVERHEAD + 4*TrafGen::PAYLOAD;
+	if (cfg.myIp == 0 || (cfg.send && cfg.rtrIp == 0) ||
+	    cfg.nThreads < 1 || cfg.nSrc < 1 || cfg.nComt < 1 ||
+	    cfg.pktLen < minLen || cfg.pktLen > 1500 || cfg.rate < 0) {
+		Util::fatal("usage: TrafGen myIp=ip rtrIp=ip [mode=send|recv|"
+			    "both] [rate=pps] [threads=n] [pktLen=n] "
+			    "[finTime=s] [srcAdr=z.l] [nSrc=n] [comt=n] "
+			    "[nComt=n] [dstAdr=z.l] [rtrPort=n] [rcvPort=n] "
+			    "[io=mmsg|gso|socket]");
+	}
+
+	TrafGen tg(cfg);
+	if (!tg.init()) Util::fatal("TrafGen: initialization failure");
+	tg.run();
+	cout << tg.toString();
+	exit(0);
+}
+
+namespace forest {
+
+/** Constructor for TrafGen.
+ *  @param cfg1 is the configuration
+ */
+TrafGen::TrafGen(const Config& cfg1) : cfg(cfg1) {
+	nFlows = cfg.nSrc * cfg.nComt;
+	stop = false;
+	snd = new Sender[cfg.nThreads];
+	for (int i = 0; i < cfg.nThreads; i++) {
+		snd[i].sock = -1; snd[i].ps = 0; snd[i].pio = 0;
+		snd[i].nSent = snd[i].nFail = 0;
+	}
+	rsock = -1; rps = 0; rio = 0;
+	for (int b = 0; b < NBKT; b++) hist[b] = 0;
+	nRcvd = nBad = maxLat = rcvTime = 0;
+}
+
+TrafGen::~TrafGen() {
+	for (int i = 0; i < cfg.nThreads; i++) {
+		delete snd[i].pio; delete snd[i].ps;
+		if (snd[i].sock >= 0) close(snd[i].sock);
+	}
+	delete [] snd;
+	delete rio; delete rps;
+	if (rsock >= 0) close(rsock);
+}
+
+/** Open the sockets and create the packet I/O backends.
+ *  @return true on success, false on failure
+ */
+bool TrafGen::init() {
+	if (cfg.send) {
+		for (int i = 0; i < cfg.nThreads; i++) {
+			Sender& s = snd[i];
+			s.sock = Np4d::datagramSocket();
+			if (s.sock < 0 || !Np4d::bind4d(s.sock, cfg.myIp, 0) ||
+			    !Np4d::nonblock(s.sock))
+				return false;
+			s.ps = new PacketStore(1000, 1000);
+			s.pio = PktIo::create(cfg.ioMode, s.ps);
+			if (s.pio == 0 || !s.pio->addSock(1, s.sock))
+				return false;
+		}
+	}
+	if (cfg.recv) {
+		rsock = Np4d::datagramSocket();
+		if (rsock < 0 || !Np4d::bind4d(rsock, cfg.myIp, cfg.rcvPort) ||
+		    !Np4d::nonblock(rsock))
+			return false;
+		int bufSize = 1 << 24;
+		setsockopt(rsock, SOL_SOCKET, SO_RCVBUF, &bufSize,
+			   sizeof(bufSize));
+		rps = new PacketStore(1000, 1000);
+		rio = PktIo::create(cfg.ioMode, rps);
+		if (rio == 0 || !rio->addSock(1, rsock)) return false;
+		flows.resize(nFlows);
+		for (Flow& f : flows) f.rcvd = f.nextSeq = f.late = 0;
+	}
+	return true;
+}
+
+/** Run the senders and/or the receiver.
+ *  The receiver keeps running for a second after the senders finish,
+ *  to collect packets that are still in flight.
+ */
+void TrafGen::run() {
+	t0 = steady_clock::now();
+	thread rcvThread;
+	if (cfg.recv) rcvThread = thread(&TrafGen::receiver, this);
+	if (cfg.send) {
+		for (int i = 0; i < cfg.nThreads; i++)
+			snd[i].thred = thread(&TrafGen::sender, this, i);
+		for (int i = 0; i < cfg.nThreads; i++)
+			snd[i].thred.join();
+	}
+	if (cfg.recv) {
+		if (cfg.send) this_thread::sleep_for(seconds(1));
+		else this_thread::sleep_for(seconds(cfg.finTime));
+		stop = true;
+		rcvThread.join();
+	}
+}
+
+/** Mainline for a sender thread.
+ *  The sender handles flows i, i+nThreads, i+2*nThreads, ... in
+ *  round-robin order. Its share of the sending rate is enforced by
+ *  a token bucket that holds up to one batch of packets. When the
+ *  bucket is empty, the sender sleeps if the next token is far off,
+ *  and spins otherwise, since sleeps are not precise enough to pace
+ *  packets a few microseconds apart.
+ *  @param i is the index of the sender
+ */
+void TrafGen::sender(int i) {
+	Sender& s = snd[i];
+	sockaddr_in sa; Np4d::initSockAdr(cfg.rtrIp, cfg.rtrPort, sa);
+
+	std::vector<int> myFlows;
+	for (int f = i; f < nFlows; f += cfg.nThreads) myFlows.push_back(f);
+	if (myFlows.size() == 0) return;
+	std::vector<uint64_t> seq(myFlows.size(), 0);
+	size_t next = 0;
+
+	const int burst = MmsgIo::BATCH;
+	double rate = cfg.rate / cfg.nThreads;	// packets per second
+	double perNs = rate / 1.0e9;
+	double tokens = burst;
+	steady_clock::time_point tEnd = t0 + seconds(cfg.finTime);
+	steady_clock::time_point last = steady_clock::now();
+
+	while (true) {
+		steady_clock::time_point now = steady_clock::now();
+		if (now >= tEnd) break;
+		int n = burst;
+		if (rate > 0) {
+			tokens += duration_cast<nanoseconds>(now - last).count()
+				  * perNs;
+			if (tokens > burst) tokens = burst;
+			last = now;
+			n = (int) tokens;
+			if (n == 0) {
+				int64_t wait = (int64_t) ((1 - tokens) / perNs);
+				if (wait > 100000) this_thread::sleep_for(
+						nanoseconds(wait - 50000));
+				continue;
+			}
+			tokens -= n;
+		}
+		for (int j = 0; j < n; j++) {
+			pktx px = s.ps->alloc();
+			if (px == 0) { s.nFail++; break; }
+			int k = next; if (++next == myFlows.size()) next = 0;
+			int f = myFlows[k];
+			Packet& p = s.ps->getPacket(px);
+			p.version = Forest::FOREST_VERSION;
+			p.length = cfg.pktLen; p.type = Forest::CLIENT_DATA;
+			p.flags = 0;
+			p.comtree = cfg.comt + f / cfg.nSrc;
+			p.srcAdr = cfg.srcAdr + f % cfg.nSrc;
+			p.dstAdr = cfg.dstAdr;
+			p.pack();
+			uint32_t *w = p.payload();
+			w[0] = htonl(MAGIC); w[1] = htonl(f);
+			Np4d::pack64(seq[k]++, &w[2]);
+			Np4d::pack64(wallTime(), &w[4]);
+			if (s.pio->send(s.sock, px, sa)) s.nSent++;
+			else s.nFail++;
+		}
+		s.pio->flush();
+	}
+	s.pio->flush();
+}
+
+/** Mainline for the receiver thread.
+ *  Each packet's sequence number is compared to the next one expected
+ *  for its flow; a packet with a smaller number is counted as late,
+ *  and a gap is counted as lost, unless the missing packets turn up
+ *  later. The latency is the difference between the arrival time and
+ *  the send time carried in the packet.
+ */
+void TrafGen::receiver() {
+	const int n = MmsgIo::BATCH;
+	pktx pxv[n]; int ifv[n];
+	pollfd pfd; pfd.fd = rsock; pfd.events = POLLIN;
+	steady_clock::time_point start = steady_clock::now();
+	while (!stop) {
+		int cnt = rio->recv(pxv, ifv, n);
+		if (cnt <= 0) { poll(&pfd, 1, 1); continue; }
+		uint64_t now = wallTime();
+		for (int i = 0; i < cnt; i++) {
+			Packet& p = rps->getPacket(pxv[i]);
+			uint32_t *w = p.payload();
+			if (!p.unpack() || p.type != Forest::CLIENT_DATA ||
+			    p.length < Forest::OVERHEAD + 4*PAYLOAD ||
+			    ntohl(w[0]) != MAGIC) {
+				nBad++; rps->free(pxv[i]); continue;
+			}
+			uint32_t f = ntohl(w[1]);
+			uint64_t sq = Np4d::unpack64(&w[2]);
+			uint64_t sent = Np4d::unpack64(&w[4]);
+			rps->free(pxv[i]);
+			if (f >= flows.size()) { nBad++; continue; }
+			Flow& fl = flows[f];
+			fl.rcvd++;
+			if (sq >= fl.nextSeq) fl.nextSeq = sq + 1;
+			else fl.late++;
+			uint64_t lat = (now > sent ? now - sent : 0);
+			hist[bucket(lat)]++;
+			if (lat > maxLat) maxLat = lat;
+			nRcvd++;
+		}
+	}
+	rcvTime = duration_cast<nanoseconds>(
+			steady_clock::now() - start).count();
+}
+
+/** Get the histogram bucket for a latency.
+ *  Values below SUB have a bucket each; above that, each power
+ *  of two is split into SUB buckets.
+ *  @param v is a latency in ns
+ *  @return the index of the bucket for v
+ */
+int TrafGen::bucket(uint64_t v) {
+	if (v < (uint64_t) SUB) return v;
+	int e = 63 - __builtin_clzll(v);
+	return (e - 3) * SUB + ((v >> (e - 4)) & (SUB - 1));
+}
+
+/** Get the smallest latency that falls in a bucket.
+ *  @param b is a bucket index
+ *  @return the lower bound of the range of bucket b
+ */
+uint64_t TrafGen::bucketValue(int b) {
+	if (b < SUB) return b;
+	int e = b / SUB + 3;
+	return ((uint64_t) (SUB + b % SUB)) << (e - 4);
+}
+
+/** Get a percentile of the latency distribution.
+ *  @param q is a fraction between 0 and 1
+ *  @return the smallest latency (to within the bucket resolution)
+ *  that is at least as large as the fraction q of all latencies
+ */
+uint64_t TrafGen::percentile(double q) const {
+	if (nRcvd == 0) return 0;
+	uint64_t target = (uint64_t) (q * nRcvd);
+	if (target >= nRcvd) target = nRcvd - 1;
+	uint64_t sum = 0;
+	for (int b = 0; b < NBKT; b++) {
+		sum += hist[b];
+		if (sum > target) return bucketValue(b);
+	}
+	return maxLat;
+}
+
+/** Create a string that reports the results of a run.
+ *  @return the string
+ */
+string TrafGen::toString() const {
+	stringstream ss;
+	uint64_t sent = 0, fail = 0;
+	if (cfg.send) {
+		for (int i = 0; i < cfg.nThreads; i++) {
+			sent += snd[i].nSent; fail += snd[i].nFail;
+		}
+		ss << sent << " packets sent by " << cfg.nThreads
+		   << " threads in " << cfg.finTime << " s ("
+		   << (sent / max(cfg.finTime,1)) << " pps), "
+		   << fail << " send failures\n";
+		for (int i = 0; i < cfg.nThreads; i++)
+			ss << "sender " << i << ": " << snd[i].pio->toString();
+	}
+	if (!cfg.recv) return ss.str();
+
+	uint64_t expect = 0, late = 0;
+	for (const Flow& f : flows) { expect += f.nextSeq; late += f.late; }
+	if (sent > expect) expect = sent; // include losses at end of flows
+	uint64_t lost = (expect > nRcvd ? expect - nRcvd : 0);
+	ss << nRcvd << " packets received in " << (rcvTime/1000000) << " ms, "
+	   << nBad << " not recognized\n";
+	ss << lost << " lost (" << (expect > 0 ? (100.0*lost)/expect : 0)
+	   << "%), " << late << " out of order\n";
+	ss << "one-way latency (us): p50=" << percentile(.5)/1000.0
+	   << " p90=" << percentile(.9)/1000.0
+	   << " p99=" << percentile(.99)/1000.0
+	   << " p99.9=" << percentile(.999)/1000.0
+	   << " max=" << maxLat/1000.0 << endl;
+	return ss.str();
+}
+
+} // ends namespace
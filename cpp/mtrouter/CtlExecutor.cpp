@@ -0,0 +1,157 @@
+/** @file CtlExecutor.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include "CtlExecutor.h"
+#include "RouterControl.h"
+
+namespace forest {
+
+/** Constructor for CtlExecutor, allocates space and starts the workers.
+ *  @param rtr1 is the router whose control requests are handled
+ *  @param nWorkers1 is the number of worker threads; if zero, one
+ *  worker is started for each core not needed by the input and output
+ *  threads
+ *  @param maxTasks1 is the maximum number of tasks in progress
+ *  @param outQ is the queue on which workers return packets to the
+ *  input thread, as (task index, packet index) pairs
+ */
+CtlExecutor::CtlExecutor(Router *rtr1, int nWorkers1, int maxTasks1,
+			 BlockingQ<pair<int,int>> *outQ)
+		: rtr(rtr1), nWorkers(nWorkers1), maxTasks(maxTasks1) {
+	if (nWorkers <= 0)
+		nWorkers = max(1, (int) thread::hardware_concurrency() - 2);
+	stopping = false;
+	tasks = new Task[maxTasks+1];
+	freeTasks = new List(maxTasks);
+	for (int i = 1; i <= maxTasks; i++) freeTasks->addLast(i);
+	ready = new List(maxTasks);
+	waiting = new HashMap<comt_t,Pair<int,int>,Hash::u32>(maxTasks,false);
+	nSubmit = nDelayed = nRejected = 0; maxActive = 0;
+
+	rc = new RouterControl[nWorkers];
+	thred = new thread[nWorkers];
+	for (int i = 0; i < nWorkers; i++) {
+		rc[i] = RouterControl(rtr, i+1, outQ);
+		thred[i] = thread(&CtlExecutor::run, this, i);
+	}
+}
+
+CtlExecutor::~CtlExecutor() {
+	stop();
+	delete [] thred; delete [] rc;
+	delete [] tasks; delete freeTasks; delete ready; delete waiting;
+}
+
+/** Stop the worker threads and wait for them to finish.
+ *  Tasks that have not run are abandoned.
+ */
+void CtlExecutor::stop() {
+	unique_lock<mutex> lck(mtx);
+	if (stopping) return;
+	stopping = true;
+	lck.unlock();
+	readyCond.notify_all();
+	for (int i = 0; i < nWorkers; i++)
+		if (thred[i].joinable()) thred[i].join();
+}
+
+/** Submit a new request.
+ *  @param key is the comtree that the request modifies, or 0 if the
+ *  request may run concurrently with any other request
+ *  @param px is the request packet
+ *  @return true if the request was accepted, false if there are
+ *  already maxTasks tasks in progress
+ */
+bool CtlExecutor::submit(comt_t key, pktx px) {
+	unique_lock<mutex> lck(mtx);
+	int tx = freeTasks->first();
+	if (tx == 0) { nRejected++; return false; }
+	freeTasks->removeFirst();
+	Task& t = tasks[tx];
+	t.px = px; t.key = key; t.next = 0; t.status = QUEUED;
+	nSubmit++;
+	maxActive = max(maxActive, maxTasks - freeTasks->length());
+
+	if (key != 0) {
+		int x = waiting->find(key);
+		if (x == 0) {
+			// key not busy; claim it, with no tasks waiting
+			waiting->put(key, Pair<int,int>(0,0));
+		} else {
+			// queue the task behind the others for this key
+			Pair<int,int>& w = waiting->getValue(x);
+			if (w.first == 0) w.first = tx;
+			else tasks[w.second].next = tx;
+			w.second = tx;
+			nDelayed++;
+			return true;
+		}
+	}
+	ready->addLast(tx);
+	lck.unlock();
+	readyCond.notify_one();
+	return true;
+}
+
+/** Complete a task.
+ *  The task's key is passed to the first task waiting for it, if any.
+ *  Caller must hold the lock.
+ *  @param tx is the index of the task
+ */
+void CtlExecutor::finish(int tx) {
+	Task& t = tasks[tx];
+	if (t.key != 0) {
+		int x = waiting->find(t.key);
+		Pair<int,int>& w = waiting->getValue(x);
+		if (w.first == 0) {
+			waiting->remove(t.key);
+		} else {
+			int nx = w.first;
+			w.first = tasks[nx].next;
+			if (w.first == 0) w.second = 0;
+			tasks[nx].next = 0;
+			tasks[nx].status = QUEUED;
+			ready->addLast(nx);
+			readyCond.notify_one();
+		}
+	}
+	freeTasks->addFirst(tx);
+}
+
+/** Mainline for a worker thread.
+ *  Repeatedly takes the first ready task and runs it to completion.
+ *  @param i is the index of the worker
+ */
+void CtlExecutor::run(int i) {
+	unique_lock<mutex> lck(mtx);
+	while (true) {
+		while (ready->empty() && !stopping) readyCond.wait(lck);
+		if (stopping) return;
+		int tx = ready->first(); ready->removeFirst();
+		Task& t = tasks[tx];
+		t.status = RUNNING;
+		lck.unlock();
+		rc[i].handle(tx, t);
+		lck.lock();
+		finish(tx);
+	}
+}
+
+/** Create a string that reports executor statistics.
+ *  @return the string
+ */
+string CtlExecutor::toString() const {
+	unique_lock<mutex> lck(mtx);
+	stringstream ss;
+	ss << nWorkers << " workers, " << nSubmit << " tasks, "
+	   << nDelayed << " delayed by key, "
+	   << nRejected << " rejected, max " << maxActive << " in progress";
+	return ss.str();
+}
+
+} // ends namespace
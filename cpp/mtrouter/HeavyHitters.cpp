@@ -0,0 +1,94 @@
+/** @file HeavyHitters.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include "HeavyHitters.h"
+
+namespace forest {
+
+/** Constructor for HeavyHitters.
+ *  @param size is the number of keys monitored by each sketch
+ *  @param now is the current time
+ */
+HeavyHitters::HeavyHitters(int size, int64_t now) : startTime(now) {
+	for (int i = 0; i < NUM_KEYS; i++) {
+		sketch[i] = new SpaceSaving(size); total[i] = 0;
+	}
+	snapReq.store(false); resetReq.store(false);
+	snapStart = snapTime = now; snapCount = 0;
+}
+
+/** Destructor for HeavyHitters. */
+HeavyHitters::~HeavyHitters() {
+	for (int i = 0; i < NUM_KEYS; i++) delete sketch[i];
+}
+
+/** Handle requests from readers.
+ *  Called periodically by the input thread. If a snapshot has been
+ *  requested, the heaviest keys of each sketch are copied to the
+ *  snapshot and waiting readers are woken. Then, if a reset has been
+ *  requested, the sketches are cleared and a new measurement period
+ *  starts. Does nothing (beyond two loads) if there are no requests.
+ *  @param now is the current time
+ */
+void HeavyHitters::publish(int64_t now) {
+	if (snapReq.load(std::memory_order_relaxed) &&
+	    snapReq.exchange(false)) {
+		vector<SpaceSaving::Counter> v[NUM_KEYS];
+		for (int i = 0; i < NUM_KEYS; i++) sketch[i]->top(MAXTOP, v[i]);
+		unique_lock<mutex> lck(mtx);
+		for (int i = 0; i < NUM_KEYS; i++) {
+			top[i].swap(v[i]); total[i] = sketch[i]->total();
+		}
+		snapStart = startTime; snapTime = now; snapCount++;
+		lck.unlock();
+		snapReady.notify_all();
+	}
+	if (resetReq.load(std::memory_order_relaxed) &&
+	    resetReq.exchange(false)) {
+		for (int i = 0; i < NUM_KEYS; i++) sketch[i]->clear();
+		startTime = now;
+	}
+}
+
+/** Create a string listing the heaviest keys of a given type.
+ *  Requests a new snapshot from the input thread and waits briefly
+ *  for it; if none arrives, the most recent snapshot is used.
+ *  Each line of the string lists a key, its estimated packet and byte
+ *  counts, the error bound on the byte count and the estimated packet
+ *  rate (p/s) and bit rate (Kb/s) over the measurement period up to
+ *  the time of the snapshot.
+ *  @param kt is the key type (BY_SRC, BY_COMT or BY_LINK)
+ *  @param k is the number of keys to list (at most MAXTOP)
+ *  @return the string
+ */
+string HeavyHitters::toString(int kt, int k) {
+	if (kt < 0 || kt >= NUM_KEYS) return "";
+	unique_lock<mutex> lck(mtx);
+	uint64_t cnt = snapCount;
+	snapReq.store(true);
+	snapReady.wait_for(lck, std::chrono::milliseconds(100),
+			   [this,cnt]{ return snapCount != cnt; });
+	vector<SpaceSaving::Counter> v(top[kt].begin(),
+		top[kt].begin() + min(max(k,0), (int) top[kt].size()));
+	uint64_t tot = total[kt];
+	double secs = max(1.0e-9 * (snapTime - snapStart), 1.0e-3);
+	lck.unlock();
+
+	stringstream ss;
+	ss << "period=" << secs << "s total=" << tot << "\n";
+	for (auto& c : v) {
+		if (kt == BY_SRC) ss << Forest::fAdr2string((fAdr_t) c.key);
+		else ss << c.key;
+		ss << " " << c.pkts << " " << c.bytes << " " << c.err
+		   << " " << (int64_t) (c.pkts / secs)
+		   << " " << (int64_t) ((8*c.bytes) / (1000 * secs)) << "\n";
+	}
+	return ss.str();
+}
+
+} // ends namespace
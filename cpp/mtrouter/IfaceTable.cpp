@@ -35,6 +35,7 @@ bool IfaceTable::addEntry(int iface, ipa_t ipa, ipp_t ipp, RateSpec& rs) {
 	Entry& e = getEntry(iface);
 	e.ipa = ipa; e.port = ipp;
 	e.rates = e.availRates = rs;
+	e.dev = "";
 	return true;
 }
 
@@ -51,7 +52,10 @@ void IfaceTable::removeEntry(int iface) {
  *  The input stream is assumed to be positioned at the start of
  *  an interface table entry. An entry is consists of an interface
  *  number, an IP address followed by a colon and port number,
- *  a maximum bit rate (in Kb/s) and a maximum packet rate (in p/s).
+ *  a maximum bit rate (in Kb/s) and a maximum packet rate (in p/s),
+ *  optionally followed by "ring=dev", where dev is the name of a network
+ *  device; in that case, the interface receives and sends packets
+ *  through AF_PACKET rings bound to the device.
  *  Each field is separated by one or more spaces.
  *  Comments in the input stream are ignored. A comment starts with
  *  a # sign and continues to the end of the line. Non-blank lines that do
@@ -69,9 +73,18 @@ int IfaceTable::readEntry(istream& in) {
 	    !Util::readInt(in,port) || !rs.read(in)) {
 		return 0;
 	}
+	string dev;
+	while (in.peek() == ' ' || in.peek() == '\t') in.get();
+	if (isalpha(in.peek())) {
+		string word; in >> word;
+		if (word.compare(0,5,"ring=") != 0 || word.length() == 5)
+			return 0;
+		dev = word.substr(5);
+	}
 	Util::nextLine(in);
 
 	if (!addEntry(ifnum,ipa,port,rs)) return 0;
+	getEntry(ifnum).dev = dev;
 	return ifnum;
 }
 
@@ -108,7 +121,9 @@ string IfaceTable::entry2string(int iface) const {
 	stringstream ss;
 	ss << setw(5) << iface << "   " << Np4d::ip2string(ift[iface].ipa)
 	   << ":" << ift[iface].port << " "
-	   << ift[iface].rates.toString() << endl;
+	   << ift[iface].rates.toString();
+	if (ift[iface].dev.length() > 0) ss << " ring=" << ift[iface].dev;
+	ss << endl;
 	return ss.str();
 }
 
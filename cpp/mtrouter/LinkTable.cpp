@@ -154,7 +154,11 @@ cerr << "revert " << lnk << endl;
  *  endpoint, the IP address and port number of the peer,
  *  the type of the peer, the forest address of the peer,
  *  the maximum bit rate for the link (in Kb/s) and 
- *  its maximum packet rate (in p/s).
+ *  its maximum packet rate (in p/s), and the nonce,
+ *  optionally followed by "shm=name"; in that case, the peer is on
+ *  the same machine and packets are exchanged through a shared-memory
+ *  ring, to which the peer attaches using the given name. The peer's
+ *  IP address and port should still be specified.
  * 
  *  If the link number specified in the input is already in use,
  *  the call to readEntry will fail, in which case 0 is returned.
@@ -179,6 +183,14 @@ int LinkTable::readEntry(istream& in) {
 	     !rs.read(in) || !Util::readInt(in,nonce)) {
 		return 0;
 	}
+	string shm;
+	while (in.peek() == ' ' || in.peek() == '\t') in.get();
+	if (isalpha(in.peek())) {
+		string word; in >> word;
+		if (word.compare(0,4,"shm=") != 0 || word.length() == 4)
+			return 0;
+		shm = word.substr(4);
+	}
 	Util::nextLine(in);
 
 	peerType = Forest::getNodeType(typStr);
@@ -188,7 +200,7 @@ int LinkTable::readEntry(istream& in) {
 	Entry& e = getEntry(lnk);
 	e.iface = iface; 
         e.peerType = (Forest::ntyp_t) peerType; e.peerAdr = peerAdr;
-	e.rates = rs; e.availRates = rs;
+	e.rates = rs; e.availRates = rs; e.shm = shm;
 
 	if (!checkEntry(lnk)) { removeEntry(lnk); return 0; }
 
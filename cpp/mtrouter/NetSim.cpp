@@ -0,0 +1,632 @@
+/** @file NetSim.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include "NetSim.h"
+
+using namespace forest;
+
+/** Simulate a forest network in a single process.
+ *
+ *  usage: NetSim topoFile [name=value ...]
+ *
+ *  The topology file has the same format as the one read by NetMgr.
+ *  The optional arguments are
+ *
+ *	finTime=s	number of seconds of network time to simulate (1)
+ *	rate=pps	packets per second sent by each comtree node (100)
+ *	pktLen=n	length of the packets sent, in bytes (200)
+ *	delay=ns	propagation delay per unit of link length (1000)
+ *	minDelay=ns	propagation delay added to every link (0)
+ *	nPkts=n		number of packets in the packet store (16384)
+ *	routes=n	max number of routes at each router (1000)
+ *	showLinks=yes	report the utilization of every link
+ */
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		cerr << "usage: NetSim topoFile [finTime=s] [rate=pps] "
+			"[pktLen=n] [delay=ns] [minDelay=ns] [nPkts=n] "
+			"[routes=n] [showLinks=yes]\n";
+		exit(1);
+	}
+	double finTime = 1; double rate = 100; int pktLen = 200;
+	int delay = 1000; int minDelay = 0;
+	int nPkts = 1 << 14; int nRts = 1000; bool showLinks = false;
+
+	string s;
+	for (int i = 2; i < argc; i++) {
+		s = argv[i];
+		if (s.compare(0,8,"finTime=") == 0) {
+			sscanf(&argv[i][8],"%lf",&finTime);
+		} else if (s.compare(0,5,"rate=") == 0) {
+			sscanf(&argv[i][5],"%lf",&rate);
+		} else if (s.compare(0,7,"pktLen=") == 0) {
+			sscanf(&argv[i][7],"%d",&pktLen);
+		} else if (s.compare(0,6,"delay=") == 0) {
+			sscanf(&argv[i][6],"%d",&delay);
+		} else if (s.compare(0,9,"minDelay=") == 0) {
+			sscanf(&argv[i][9],"%d",&minDelay);
+		} else if (s.compare(0,6,"nPkts=") == 0) {
+			sscanf(&argv[i][6],"%d",&nPkts);
+		} else if (s.compare(0,7,"routes=") == 0) {
+			sscanf(&argv[i][7],"%d",&nRts);
+		} else if (s.compare(0,10,"showLinks=") == 0) {
+			showLinks = (s.compare(10,3,"yes") == 0 ||
+				     s.compare(10,1,"1") == 0);
+		} else {
+			cerr << "unrecognized argument: " << argv[i] << endl;
+			exit(1);
+		}
+	}
+	pktLen = max(pktLen, Forest::OVERHEAD + 8);
+	pktLen = min(pktLen, 1500);
+
+	int maxNode = 100000; int maxLink = 100000; int maxRtr = 10000;
+	int maxComtree = 10000;
+	NetInfo *net = new NetInfo(maxNode, maxLink, maxRtr);
+	ComtInfo *comtrees = new ComtInfo(maxComtree, *net);
+
+	ifstream fs; fs.open(argv[1]);
+	if (fs.fail() || !net->read(fs) || !comtrees->read(fs)) {
+		cerr << "NetSim: could not read topology file, or error "
+		      	"in topology file\n";
+		exit(1);
+	}
+	fs.close();
+
+	NetSim sim(net, comtrees, nPkts, nRts);
+	if (!sim.setup(delay, minDelay)) {
+		cerr << "NetSim: could not configure routers\n";
+		exit(1);
+	}
+	sim.setTraffic(rate, pktLen);
+	sim.run((uint64_t) (finTime * 1000000000));
+
+	cout << sim.toString();
+	if (showLinks) cout << endl << sim.linkStats();
+	return 0;
+}
+
+namespace forest {
+
+/** Constructor for NetSim, allocates space and initializes statistics.
+ *  @param net1 is the network topology
+ *  @param comtrees1 is the comtree topology
+ *  @param nPkts1 is the number of packets in the packet store that is
+ *  shared by all routers
+ *  @param nRts1 is the maximum number of routes at each router
+ */
+NetSim::NetSim(NetInfo *net1, ComtInfo *comtrees1, int nPkts1, int nRts1)
+	       : net(net1), comtrees(comtrees1), nPkts(nPkts1), nRts(nRts1) {
+	ps = new PacketStore(nPkts, nPkts);
+	maxRtr = net->getMaxRouter();
+	rtr = new SimRtr[maxRtr+1];
+	for (int r = 0; r <= maxRtr; r++) {
+		rtr[r].lt = 0; rtr[r].ctt = 0; rtr[r].rt = 0;
+		rtr[r].qm = 0; rtr[r].lnk = 0;
+	}
+	comtSet = new HashSet<comt_t,Hash::u32>(100);
+	comts.resize(1);
+	evt = 0; evq = 0; maxEv = 0;
+	meanGap = 0; pktLen = 0;
+
+	now = 0;
+	nEvents = sentPkts = rcvdPkts = rcvdBytes = 0;
+	totDelay = maxDelay = 0;
+	noBufs = noRoute = qDrops = routes = 0;
+	simTime = 0; wallTime = 0;
+}
+
+NetSim::~NetSim() {
+	for (int r = 0; r <= maxRtr; r++) {
+		delete rtr[r].rt; delete rtr[r].ctt; delete rtr[r].lt;
+		delete rtr[r].qm; delete [] rtr[r].lnk;
+	}
+	delete [] rtr; delete comtSet;
+	delete [] evt; delete evq;
+	delete ps;
+}
+
+/** Configure the simulated routers.
+ *  @param nsPerUnit is the propagation delay per unit of link length
+ *  @param minDelay is a propagation delay added to every link
+ *  @return true on success, false on failure
+ */
+bool NetSim::setup(uint64_t nsPerUnit, uint64_t minDelay) {
+	// count the comtrees and comtree links at each router, so
+	// that tables can be sized to fit
+	vector<int> nComt(maxRtr+1,0), nClnk(maxRtr+1,0);
+	for (int ctx = comtrees->firstComtree(); ctx != 0;
+		 ctx = comtrees->nextComtree(ctx)) {
+		for (fAdr_t ra = comtrees->firstRouter(ctx); ra != 0;
+			    ra = comtrees->nextRouter(ctx,ra)) {
+			nComt[net->getNodeNum(ra)]++;
+			fAdr_t pa = comtrees->getParent(ctx,ra);
+			if (pa == 0) continue;
+			nClnk[net->getNodeNum(ra)]++;
+			nClnk[net->getNodeNum(pa)]++;
+		}
+		for (fAdr_t la = comtrees->firstLeaf(ctx); la != 0;
+			    la = comtrees->nextLeaf(ctx,la)) {
+			nClnk[net->getNodeNum(comtrees->getParent(ctx,la))]++;
+		}
+	}
+	try {
+		for (int r = net->firstRouter(); r != 0;
+			 r = net->nextRouter(r)) {
+			if (!setupRouter(r, nComt[r], nClnk[r],
+					 nsPerUnit, minDelay))
+				return false;
+		}
+		if (!setupComtrees()) return false;
+		setupSources();
+
+		// each packet has at most one arrival pending, each router
+		// at most one service event and each source one packet
+		maxEv = nPkts + maxRtr + srcs.size();
+		evt = new Event[maxEv+1];
+		evq = new Dheap<uint64_t>(maxEv,4);
+	} catch (std::bad_alloc& e) {
+		cerr << "NetSim::setup: unable to allocate space\n";
+		return false;
+	}
+	for (int e = maxEv; e >= 1; e--) freeEv.push_back(e);
+	return true;
+}
+
+/** Configure the tables of one simulated router.
+ *  @param r is the node number of the router
+ *  @param nComt is the number of comtrees that include r
+ *  @param nClnk is the number of comtree links at r
+ *  @param nsPerUnit is the propagation delay per unit of link length
+ *  @param minDelay is a propagation delay added to every link
+ *  @return true on success, false on failure
+ */
+bool NetSim::setupRouter(int r, int nComt, int nClnk,
+			 uint64_t nsPerUnit, uint64_t minDelay) {
+	SimRtr& sr = rtr[r];
+	sr.adr = net->getNodeAdr(r);
+	sr.svcEv = 0; sr.fwdPkts = 0;
+
+	int maxLnk = 1;
+	for (int glnk = net->firstLinkAt(r); glnk != 0;
+		 glnk = net->nextLinkAt(r,glnk)) {
+		maxLnk = max(maxLnk, net->getLLnum(glnk,r));
+	}
+	sr.maxLnk = maxLnk;
+	sr.lt = new LinkTable(maxLnk);
+	sr.ctt = new ComtreeTable(maxLnk+1, max(nComt,1));
+	sr.rt = new RouteTable(nRts, sr.adr, sr.ctt);
+	sr.qm = new QuManager(maxLnk, nPkts, max(nClnk,1),
+			      min(50,5*nPkts/maxLnk), ps);
+	sr.lnk = new SimLink[maxLnk+1];
+	for (int lnk = 0; lnk <= maxLnk; lnk++) {
+		SimLink& sl = sr.lnk[lnk];
+		sl.peer = sl.peerLnk = 0; sl.nsPerByte = 0;
+		sl.delay = sl.busy = sl.pkts = sl.bytes = 0;
+	}
+
+	for (int glnk = net->firstLinkAt(r); glnk != 0;
+		 glnk = net->nextLinkAt(r,glnk)) {
+		int lnk = net->getLLnum(glnk,r);
+		int peer = net->getPeer(r,glnk);
+		// nonce identifies the entry while the link is "disconnected"
+		uint64_t nonce = net->getNonce(glnk);
+		if (sr.lt->addEntry(lnk,0,0,(nonce != 0 ? nonce : glnk)) != lnk)
+			return false;
+		LinkTable::Entry& lte = sr.lt->getEntry(lnk);
+		lte.peerType = net->getNodeType(peer);
+		sr.lt->setPeerAdr(lnk,net->getNodeAdr(peer));
+		// link rates are specified from the left endpoint's perspective
+		lte.rates = net->getLinkRates(glnk);
+		if (r != net->getLeft(glnk)) lte.rates.flip();
+		sr.qm->setLinkRates(lnk,lte.rates);
+
+		SimLink& sl = sr.lnk[lnk];
+		sl.peer = peer;
+		sl.peerLnk = net->getLLnum(glnk,peer);
+		int br = min(max(lte.rates.bitRateDown,1),8000000);
+		sl.nsPerByte = 8000000/br;
+		sl.delay = minDelay + nsPerUnit * net->getLinkLength(glnk);
+	}
+	return true;
+}
+
+/** Add the comtrees to the simulated routers.
+ *  Each router gets an entry for each comtree that includes it, with
+ *  a queue for each comtree link, as in Router::setupQueues.
+ *  @return true on success, false on failure
+ */
+bool NetSim::setupComtrees() {
+	bool status = true;
+	for (int ctx = comtrees->firstComtree(); ctx != 0;
+		 ctx = comtrees->nextComtree(ctx)) {
+		if (!status) continue;
+		comt_t comt = comtrees->getComtree(ctx);
+		int sc = comtSet->insert(comt);
+		if (sc == 0) { status = false; continue; }
+		if (sc >= (int) comts.size()) comts.resize(sc+1);
+		SimComt& c = comts[sc];
+		c.comt = comt; c.ctx = ctx;
+
+		for (fAdr_t ra = comtrees->firstRouter(ctx); ra != 0;
+			    ra = comtrees->nextRouter(ctx,ra)) {
+			SimRtr& sr = rtr[net->getNodeNum(ra)];
+			int cx = sr.ctt->addEntry(comt);
+			if (cx == 0) { status = false; break; }
+			sr.ctt->setCoreFlag(cx,comtrees->isCoreNode(ctx,ra));
+			c.nodes.push_back(ra);
+		}
+		for (fAdr_t ra = comtrees->firstRouter(ctx); ra != 0 && status;
+			    ra = comtrees->nextRouter(ctx,ra)) {
+			fAdr_t pa = comtrees->getParent(ctx,ra);
+			if (pa == 0) continue;
+			int r = net->getNodeNum(ra);
+			int pr = net->getNodeNum(pa);
+			int lnk = localLink(ctx,r,ra);
+			if (!addComtLink(r,comt,lnk,true,
+					 comtrees->isCoreNode(ctx,pa)) ||
+			    !addComtLink(pr,comt,localLink(ctx,pr,ra),true,
+					 comtrees->isCoreNode(ctx,ra))) {
+				status = false; break;
+			}
+			SimRtr& sr = rtr[r];
+			sr.ctt->setPlink(sr.ctt->getComtIndex(comt),lnk);
+		}
+		for (fAdr_t la = comtrees->firstLeaf(ctx); la != 0 && status;
+			    la = comtrees->nextLeaf(ctx,la)) {
+			int pr = net->getNodeNum(comtrees->getParent(ctx,la));
+			if (pr == 0 || !addComtLink(pr,comt,localLink(ctx,pr,la),
+						    false,false)) {
+				status = false; break;
+			}
+			c.nodes.push_back(la);
+		}
+	}
+	return status;
+}
+
+/** Add a comtree link at a router and allocate a queue for it.
+ *  @param r is the node number of the router
+ *  @param comt is the comtree number
+ *  @param lnk is the local link number at r
+ *  @param isRtr is true if the peer is a router
+ *  @param isCore is true if the peer is a core router for comt
+ *  @return true on success, false on failure
+ */
+bool NetSim::addComtLink(int r, comt_t comt, int lnk, bool isRtr, bool isCore) {
+	SimRtr& sr = rtr[r];
+	int cx = sr.ctt->getComtIndex(comt);
+	if (lnk == 0 || !sr.ctt->addLink(cx,lnk,isRtr,isCore)) return false;
+	int qid = sr.qm->allocQ(lnk);
+	if (qid == 0) return false;
+	sr.ctt->setLinkQ(cx,sr.ctt->getClnkNum(comt,lnk),qid);
+	RateSpec rs(Forest::MINBITRATE,Forest::MINBITRATE,
+		    Forest::MINPKTRATE,Forest::MINPKTRATE);
+	sr.qm->setQRates(qid,rs);
+	if (isRtr)	sr.qm->setQLimits(qid,100,200000);
+	else		sr.qm->setQLimits(qid,50,100000);
+	return true;
+}
+
+/** Create a traffic source for every node of every comtree with at
+ *  least two nodes. A leaf sends on its access link; a router's own
+ *  packets are forwarded as though they arrived from a local client.
+ */
+void NetSim::setupSources() {
+	for (int sc = comtSet->first(); sc != 0; sc = comtSet->next(sc)) {
+		SimComt& c = comts[sc];
+		if (c.nodes.size() < 2) continue;
+		for (fAdr_t adr : c.nodes) {
+			Source src;
+			src.sc = sc; src.adr = adr;
+			int n = net->getNodeNum(adr);
+			if (net->isRouter(n)) {
+				src.rtr = n; src.lnk = 0; src.delay = 0;
+			} else {
+				fAdr_t pa = comtrees->getParent(c.ctx,adr);
+				src.rtr = net->getNodeNum(pa);
+				src.lnk = localLink(c.ctx,src.rtr,adr);
+				src.delay = rtr[src.rtr].lnk[src.lnk].delay;
+			}
+			srcs.push_back(src);
+		}
+	}
+}
+
+/** Find the local link number of a comtree node's parent link.
+ *  @param ctx is the index of the comtree in comtrees
+ *  @param r is the node number of a router at one end of the link
+ *  @param adr is the address of the comtree node
+ *  @return the local link number used by r for the link that joins
+ *  adr to its parent, or 0 if there is no such link
+ */
+int NetSim::localLink(int ctx, int r, fAdr_t adr) const {
+	if (net->isLeaf(net->getNodeNum(adr)))
+		return comtrees->getPlink(ctx,adr);
+	return net->getLLnum(comtrees->getPlink(ctx,adr),r);
+}
+
+/** Set the traffic sent by each source.
+ *  @param rate is the average number of packets per second that each
+ *  comtree node sends
+ *  @param len is the length of each packet, in bytes
+ */
+void NetSim::setTraffic(double rate, int len) {
+	meanGap = (rate > 0 ? 1000000000/rate : 0); pktLen = len;
+}
+
+/** Choose the time until a source sends its next packet.
+ *  @return an exponentially distributed time interval, in ns
+ */
+inline uint64_t NetSim::gap() const {
+	return 1 + (uint64_t) (-meanGap * log(1.0 - Util::randfrac()));
+}
+
+/** Run the simulation.
+ *  May be called more than once, to continue a simulation.
+ *  @param runLength is the amount of network time to simulate, in ns
+ */
+void NetSim::run(uint64_t runLength) {
+	uint64_t start = now;
+	uint64_t finish = now + runLength;
+	if (evq->empty() && meanGap > 0) {
+		for (int i = 0; i < (int) srcs.size(); i++)
+			schedule(now + gap(), SOURCE, i, 0, 0);
+	}
+
+	high_resolution_clock::time_point t0 = high_resolution_clock::now();
+	while (!evq->empty()) {
+		int e = evq->findmin();
+		if (evq->key(e) > finish) break;
+		now = evq->key(e); evq->deletemin();
+		Event ev = evt[e]; freeEv.push_back(e);
+		nEvents++;
+		switch (ev.type) {
+		case SOURCE:
+			schedule(now + gap(), SOURCE, ev.node, 0, 0);
+			inject(ev.node);
+			break;
+		case ARRIVE:
+			ps->getPacket(ev.px).inLink = ev.lnk;
+			forward(ev.node, ev.px);
+			break;
+		case SERVICE:
+			rtr[ev.node].svcEv = 0;
+			service(ev.node);
+			break;
+		}
+	}
+	now = finish;
+	simTime += now - start;
+	wallTime += duration<double>(high_resolution_clock::now()-t0).count();
+}
+
+/** Schedule an event.
+ *  @param t is the time of the event
+ *  @param type is the event type
+ *  @param node is a source index, for a SOURCE event, or the node number
+ *  of a router, for others
+ *  @param lnk is the link on which a packet arrives (ARRIVE only)
+ *  @param px is the arriving packet (ARRIVE only)
+ *  @return the index of the event
+ */
+int NetSim::schedule(uint64_t t, EvType type, int node, int lnk, pktx px) {
+	// can't run out, since maxEv bounds the number of pending events
+	if (freeEv.empty()) Util::fatal("NetSim::schedule: out of events");
+	int e = freeEv.back(); freeEv.pop_back();
+	Event& ev = evt[e];
+	ev.type = type; ev.node = node; ev.lnk = lnk; ev.px = px;
+	evq->insert(e,t);
+	return e;
+}
+
+/** Send a packet from a source to a random node in its comtree.
+ *  @param i is the index of the source
+ */
+void NetSim::inject(int i) {
+	Source& src = srcs[i];
+	SimComt& c = comts[src.sc];
+	int n = c.nodes.size();
+	fAdr_t dst = c.nodes[Util::randint(0,n-2)];
+	if (dst == src.adr) dst = c.nodes[n-1];
+
+	pktx px = ps->alloc();
+	if (px == 0) { noBufs++; return; }
+	Packet& p = ps->getPacket(px);
+	p.length = pktLen; p.type = Forest::CLIENT_DATA; p.flags = 0;
+	p.comtree = c.comt; p.srcAdr = src.adr; p.dstAdr = dst;
+	// time stamp in payload, for latency
+	uint32_t* pp = p.payload();
+	pp[0] = (uint32_t) (now >> 32); pp[1] = (uint32_t) now;
+	sentPkts++;
+
+	if (src.lnk == 0) {
+		p.inLink = 0; forward(src.rtr, px);
+	} else {
+		schedule(now + src.delay, ARRIVE, src.rtr, src.lnk, px);
+	}
+}
+
+/** Forward a packet that has arrived at a router.
+ *  The output queue is chosen by RouteTable::getUcastQ, as in
+ *  RouterInProc::forward.
+ *  @param r is the node number of the router
+ *  @param px is the packet index; its inLink field identifies the link
+ *  it arrived on
+ */
+void NetSim::forward(int r, pktx px) {
+	SimRtr& sr = rtr[r];
+	Packet& p = ps->getPacket(px);
+	if (p.dstAdr == sr.adr) { deliver(px, now); return; }
+
+	int ctx = sr.ctt->getComtIndex(p.comtree);
+	int rtx = sr.rt->getRtx(p.comtree,p.dstAdr);
+	if (rtx == 0 && ctx != 0) rtx = learnRoute(r,ctx,p);
+	int qid = (rtx != 0 ? sr.rt->getUcastQ(rtx,ctx,p.inLink) : 0);
+	if (qid == 0) {
+		noRoute++; ps->free(px); return;
+	}
+	if (!sr.qm->enq(px,qid,now)) {
+		qDrops++; ps->free(px); return;
+	}
+	sr.fwdPkts++;
+	service(r);
+}
+
+/** Find and install a route at a router.
+ *  A live router learns a route by flooding a route request; here, the
+ *  route is found from the comtree topology. If the destination is
+ *  below the router in the comtree, the route leads to the child that
+ *  is its ancestor; otherwise, it leads to the router's parent.
+ *  @param r is the node number of the router
+ *  @param ctx is the index of the packet's comtree at r
+ *  @param p is the packet being forwarded
+ *  @return the index of the route, or 0 if none could be added
+ */
+int NetSim::learnRoute(int r, int ctx, Packet& p) {
+	SimRtr& sr = rtr[r];
+	int sc = comtSet->find(p.comtree);
+	if (sc == 0) return 0;
+	int cctx = comts[sc].ctx;
+
+	// walk up from the destination until we reach r or the root
+	fAdr_t x = p.dstAdr; fAdr_t prev = 0;
+	while (x != 0 && x != sr.adr) {
+		prev = x; x = comtrees->getParent(cctx,x);
+	}
+	int lnk = (x != 0 ? localLink(cctx,r,prev) : localLink(cctx,r,sr.adr));
+	if (lnk == 0) return 0;
+	int cLnk = sr.ctt->getClnkNum(p.comtree,lnk);
+	if (cLnk == 0) return 0;
+	int rtx = sr.rt->addRoute(p.comtree,p.dstAdr,cLnk);
+	if (rtx != 0) routes++;
+	return rtx;
+}
+
+/** Send all packets that a router's queue manager has ready to go,
+ *  and schedule the router's next service event.
+ *  @param r is the node number of the router
+ */
+void NetSim::service(int r) {
+	SimRtr& sr = rtr[r];
+	int lnk; pktx px;
+	while ((px = sr.qm->deq(lnk,now)) != 0) depart(r,lnk,px);
+
+	uint64_t due = sr.qm->nextDue();
+	if (due == UINT64_MAX) {
+		if (sr.svcEv != 0) {
+			evq->remove(sr.svcEv); freeEv.push_back(sr.svcEv);
+			sr.svcEv = 0;
+		}
+	} else if (sr.svcEv != 0) {
+		evq->changekey(sr.svcEv,due);
+	} else {
+		sr.svcEv = schedule(due, SERVICE, r, 0, 0);
+	}
+}
+
+/** Send a packet on a link.
+ *  The packet reaches the far end once it has been transmitted and
+ *  has propagated along the link.
+ *  @param r is the node number of the sending router
+ *  @param lnk is the local link number of the outgoing link
+ *  @param px is the packet index
+ */
+void NetSim::depart(int r, int lnk, pktx px) {
+	SimLink& sl = rtr[r].lnk[lnk];
+	Packet& p = ps->getPacket(px);
+	uint64_t xmit = sl.nsPerByte; xmit *= Forest::truPktLeng(p.length);
+	sl.busy += xmit; sl.pkts++; sl.bytes += p.length;
+	uint64_t t = now + xmit + sl.delay;
+	if (sl.peerLnk == 0) deliver(px, t); // peer is a leaf
+	else schedule(t, ARRIVE, sl.peer, sl.peerLnk, px);
+}
+
+/** Deliver a packet to its destination.
+ *  @param px is the packet index
+ *  @param t is the time the packet reaches its destination
+ */
+void NetSim::deliver(pktx px, uint64_t t) {
+	Packet& p = ps->getPacket(px);
+	uint32_t* pp = p.payload();
+	uint64_t sent = pp[0]; sent = (sent << 32) | pp[1];
+	uint64_t d = t - sent;
+	rcvdPkts++; rcvdBytes += p.length;
+	totDelay += d; maxDelay = max(maxDelay, d);
+	ps->free(px);
+}
+
+/** Create a string summarizing the results of the simulation.
+ *  @return the string
+ */
+string NetSim::toString() const {
+	stringstream ss;
+	double secs = simTime/1000000000.0;
+	int nRtrs = 0; int nLnks = 0; int busyLnks = 0;
+	uint64_t fwdPkts = 0; double sumUtil = 0; double maxUtil = 0;
+	for (int r = net->firstRouter(); r != 0; r = net->nextRouter(r)) {
+		nRtrs++; fwdPkts += rtr[r].fwdPkts;
+		for (int lnk = 1; lnk <= rtr[r].maxLnk; lnk++) {
+			const SimLink& sl = rtr[r].lnk[lnk];
+			if (sl.peer == 0) continue;
+			double util = (simTime > 0 ? sl.busy/(double) simTime : 0);
+			nLnks++; sumUtil += util; maxUtil = max(maxUtil, util);
+			if (util > .9) busyLnks++;
+		}
+	}
+	ss << "simulated " << secs << " seconds of network time in "
+	   << wallTime << " seconds\n";
+	ss << nRtrs << " routers, " << comtSet->size() << " comtrees, "
+	   << srcs.size() << " traffic sources\n";
+	ss << nEvents << " events";
+	if (wallTime > 0) ss << ", " << (uint64_t) (nEvents/wallTime)
+			     << " per second";
+	ss << endl;
+	ss << "packets sent " << sentPkts << ", delivered " << rcvdPkts
+	   << ", discarded " << qDrops << " at full queues, " << noRoute
+	   << " with no route; " << noBufs << " not sent (no buffers)\n";
+	if (secs > 0) {
+		ss << "forwarding throughput " << (uint64_t) (fwdPkts/secs)
+		   << " packets/s over all routers, delivered "
+		   << (8*rcvdBytes/secs)/1000000 << " Mb/s\n";
+	}
+	if (rcvdPkts > 0) {
+		ss << "latency mean " << (totDelay/rcvdPkts)/1000
+		   << " us, max " << maxDelay/1000 << " us, "
+		   << routes << " routes learned\n";
+	}
+	if (nLnks > 0) {
+		ss << "link utilization mean " << 100*sumUtil/nLnks
+		   << "%, max " << 100*maxUtil << "%, " << busyLnks
+		   << " of " << nLnks << " links over 90%\n";
+	}
+	return ss.str();
+}
+
+/** Create a string listing the traffic sent on each router link.
+ *  Each line gives the router, the local link number, the peer, the
+ *  numbers of packets and bytes sent and the link's utilization.
+ *  @return the string
+ */
+string NetSim::linkStats() const {
+	stringstream ss;
+	for (int r = net->firstRouter(); r != 0; r = net->nextRouter(r)) {
+		for (int lnk = 1; lnk <= rtr[r].maxLnk; lnk++) {
+			const SimLink& sl = rtr[r].lnk[lnk];
+			if (sl.peer == 0) continue;
+			double util = (simTime > 0 ? sl.busy/(double) simTime : 0);
+			ss << net->getNodeName(r) << "." << lnk << " -> "
+			   << net->getNodeName(sl.peer) << " " << sl.pkts
+			   << " packets " << sl.bytes << " bytes "
+			   << 100*util << "%\n";
+		}
+	}
+	return ss.str();
+}
+
+} // ends namespace
@@ -98,15 +98,16 @@ void QuManager::freeQ(int qid) {
 
 /** Enqueue a packet.
  *  If the queue is full or the link has reached the maximum allowed,
- *  the packet is silently discarded.
+ *  the packet is not queued; the caller remains responsible for it.
  *  @param p is the packet number of the packet to be queued
  *  @param q is the the qid for the queue for the packet
  *  @param now is the current time
+ *  @return true if the packet was queued, else false
  */
-void QuManager::enq(int px, int qid, uint64_t now) {
+bool QuManager::enq(int px, int qid, uint64_t now) {
 	//unique_lock<mutex> lck(mtx);
 	if (px == 0 || qid < 0 || qid > nQ || quInfo[qid].pktLim < 0)
-		return;
+		return false;
 	QuInfo& q = quInfo[qid]; int lnk = q.lnk;
 	int pleng = Forest::truPktLeng((ps->getPacket(px)).length);
 
@@ -114,7 +115,7 @@ void QuManager::enq(int px, int qid, uint64_t now) {
 	// or if queue is past its limits
 	if (lnkInfo[lnk].pktCount >= maxppl ||
 	    q.pktCount >= q.pktLim || q.byteCount + pleng > q.byteLim) {
-		return;
+		return false;
 	}
 
 	if (queues->empty(qid)) {
@@ -147,7 +148,7 @@ void QuManager::enq(int px, int qid, uint64_t now) {
 	// add packet to queue
 	queues->addLast(px,qid);
 	lnkInfo[lnk].pktCount++; q.pktCount++; q.byteCount += pleng;
-	return;
+	return true;
 }
 
 /** Dequeue the next packet that is ready to go out.
@@ -28,8 +28,15 @@ bool processArgs(int argc, char *argv[], RouterInfo& args) {
 	args.myAdr = args.bootIp = args.nmAdr = args.nmIp = 0;
 	args.ccAdr = args.firstLeafAdr = args.lastLeafAdr = 0;
 	args.ifTbl = ""; args.lnkTbl = ""; args.comtTbl = "";
-	args.rteTbl = ""; args.statSpec = ""; 
+	args.rteTbl = ""; args.statSpec = ""; args.snapFile = "";
 	args.portNum = 0; args.runLength = seconds(0);
+	args.subWindow = milliseconds(50);
+	args.ioMode = "socket";
+	args.aggWindow = microseconds(0);
+	args.connLinks = false;
+	args.traceFile = ""; args.replayFile = "";
+	args.replayTimed = false; args.replayReps = 1;
+	args.captureFile = ""; args.stageSample = 0; args.traceDir = "";
 
 	string s;
 	for (int i = 1; i < argc; i++) {
@@ -60,6 +67,8 @@ bool processArgs(int argc, char *argv[], RouterInfo& args) {
 			args.comtTbl = &argv[i][8];
 		} else if (s.compare(0,7,"rteTbl=") == 0) {
 			args.rteTbl = &argv[i][7];
+		} else if (s.compare(0,9,"snapshot=") == 0) {
+			args.snapFile = &argv[i][9];
 		} else if (s.compare(0,9,"statSpec=") == 0) {
 			args.statSpec = &argv[i][9];
 		} else if (s.compare(0,8,"portNum=") == 0) {
@@ -68,6 +77,33 @@ bool processArgs(int argc, char *argv[], RouterInfo& args) {
 			int runtime;
 			sscanf(&argv[i][8],"%d",&runtime);
 			args.runLength = seconds(runtime);
+		} else if (s.compare(0,10,"subWindow=") == 0) {
+			int window;
+			sscanf(&argv[i][10],"%d",&window);
+			args.subWindow = milliseconds(window);
+		} else if (s.compare(0,7,"ioMode=") == 0) {
+			args.ioMode = &argv[i][7];
+		} else if (s.compare(0,10,"aggWindow=") == 0) {
+			int window;
+			sscanf(&argv[i][10],"%d",&window);
+			args.aggWindow = microseconds(window);
+		} else if (s.compare(0,10,"connLinks=") == 0) {
+			args.connLinks = (s.compare(10,3,"yes") == 0 ||
+					  s.compare(10,1,"1") == 0);
+		} else if (s.compare(0,6,"trace=") == 0) {
+			args.traceFile = &argv[i][6];
+		} else if (s.compare(0,7,"replay=") == 0) {
+			args.replayFile = &argv[i][7];
+		} else if (s.compare(0,11,"replayMode=") == 0) {
+			args.replayTimed = (s.compare(11,5,"timed") == 0);
+		} else if (s.compare(0,11,"replayReps=") == 0) {
+			sscanf(&argv[i][11],"%d",&args.replayReps);
+		} else if (s.compare(0,8,"capture=") == 0) {
+			args.captureFile = &argv[i][8];
+		} else if (s.compare(0,12,"stageSample=") == 0) {
+			sscanf(&argv[i][12],"%d",&args.stageSample);
+		} else if (s.compare(0,9,"traceDir=") == 0) {
+			args.traceDir = &argv[i][9];
 		} else {
 			cerr << "unrecognized argument: " << argv[i] << endl;
 			return false;
@@ -114,6 +150,7 @@ Router::Router(const RouterInfo& config) {
 	int nPkts = 1 << 17;
 	int nBufs = 1 << 16;
 	int nQus = 10000;
+	int nHitters = 100;
 
 	myAdr = config.myAdr;
 	bootIp = config.bootIp;
@@ -121,7 +158,10 @@ Router::Router(const RouterInfo& config) {
 	nmIp = config.nmIp;
 	ccAdr = config.ccAdr;
 	runLength = config.runLength;
+	subWindow = config.subWindow;
+	aggWindow = config.aggWindow;
 	leafAdr = 0;
+	snapFile = config.snapFile;
 
 	try {
 		ps = new PacketStore(nPkts, nBufs);
@@ -132,38 +172,76 @@ Router::Router(const RouterInfo& config) {
 		pktLog = new PacketLog(ps);
 		qm = new QuManager(nLnks, nPkts, nQus, min(50,5*nPkts/nLnks),
 				   ps);
+		hh = new HeavyHitters(nHitters, 0);
+		pio = PktIo::create(config.ioMode, ps);
+		ring = 0;
+		lsocks = (config.connLinks ? new LinkSocks(ps, nLnks) : 0);
+		if (lsocks != 0) linkIo.push_back(lsocks);
+		shm = 0;
+		trace = replay = 0;
+		strace = new StageTrace(1 << 16, config.stageSample);
+		traceDir = config.traceDir;
+		replayTimed = config.replayTimed;
+		replayReps = max(config.replayReps,1);
 		sock = new int[nIfaces+1];
 		maxSockNum = -1;
 	
 		rip = new RouterInProc(this);
 		rop = new RouterOutProc(this);
 
-		xferQ.resize(1000);
+		xferQ.resize(xferQsize);
 
 		setLeafAdrRange(config.firstLeafAdr, config.lastLeafAdr);
 	} catch (std::bad_alloc e) {
 		Util::fatal("Router: unable to allocate space for Router");
         }
+	if (pio == 0) {
+		cerr << "Router: I/O mode " << config.ioMode
+		     << " is not supported\n";
+		Util::fatal("Router: unable to create I/O backend");
+	}
+
+	if (config.traceFile.compare("") != 0) {
+		trace = new PktTrace();
+		if (!trace->create(config.traceFile))
+			Util::fatal("Router: can't create trace file");
+	}
+	if (config.replayFile.compare("") != 0) {
+		replay = new PktTrace();
+		if (!replay->open(config.replayFile))
+			Util::fatal("Router: can't read trace file to replay");
+	}
 
 	if (config.mode.compare("local") == 0) {
 cerr << "P\n";
 		booting = false;
-		if (!readTables(config) || !setup())
+		if (!loadTables(config) || !setup())
 			Util::fatal("Router: could not complete local "
 					"configuration\n");
 	} else {
 cerr << "Q\n";
 		booting = true;
 	}
-	seqNum = 0;
+	seqNum = 0; xferOut = 0;
 	tZero = high_resolution_clock::now();
-	pktLog->turnOnLogging(false);
+	epoch = duration_cast<nanoseconds>(
+			system_clock::now().time_since_epoch()).count();
+	if (config.captureFile.compare("") != 0) {
+		// log packets to capture file, rather than cout
+		if (!pktLog->openPcap(config.captureFile, epoch))
+			Util::fatal("Router: can't create capture file");
+		pktLog->enableLocalLog(false);
+		pktLog->turnOnLogging(true);
+	} else {
+		pktLog->turnOnLogging(false);
+	}
 }
 
 Router::~Router() {
 // consider thread cleanup
 	delete rip; delete rop; delete rop;
-	delete pktLog; delete qm; 
+	delete pktLog; delete qm; delete hh; delete pio; delete ring;
+	delete lsocks; delete shm; delete trace; delete replay; delete strace;
 	delete rt; delete ctt; delete lt; delete ift; delete ps;
 	delete leafAdr; delete [] sock;
 }
@@ -214,6 +292,41 @@ bool Router::readTables(const RouterInfo& config) {
 	return true;
 }
 
+/** Configure router tables at startup.
+ *  If a snapshot file was specified and holds a valid snapshot, the
+ *  tables are loaded from it. Otherwise, they are read from the text
+ *  table files, if any.
+ *  @param config is a RouterInfo structure which has been initialized to
+ *  specify various router parameters
+ *  @return true on success, false on failure
+ */
+bool Router::loadTables(const RouterInfo& config) {
+	if (snapFile.compare("") != 0) {
+		bool touched;
+		if (TableSnap::load(snapFile, myAdr, ift, lt, ctt, rt, touched))
+			return true;
+		if (touched) {
+			cerr << "Router::loadTables: error in snapshot "
+			     << snapFile << endl;
+			return false;
+		}
+		cerr << "Router::loadTables: no usable snapshot in "
+		     << snapFile << ", reading table files\n";
+	}
+	return readTables(config);
+}
+
+/** Write a snapshot of the router tables.
+ *  The caller must hold the locks on all four tables, or otherwise
+ *  ensure that they do not change while the snapshot is taken.
+ *  @return true on success, false on failure or if no snapshot file
+ *  was specified
+ */
+bool Router::saveTables() {
+	if (snapFile.compare("") == 0) return false;
+	return TableSnap::write(snapFile, myAdr, ift, lt, ctt, rt);
+}
+
 /** Setup router after tables and interfaces have been configured.
  *  Invokes several setup and verification methods to ensure that the
  *  initial configuration is fully consistent.
@@ -222,6 +335,7 @@ bool Router::setup() {
 cerr << "setting up\n";
 	dump(cout);
 	if (!setupAllIfaces()) return false;
+	if (!setupShmLinks()) return false;
 	if (!setupLeafAddresses()) return false;
 	if (!setupQueues()) return false;
 	if (!checkTables()) return false;
@@ -263,6 +377,12 @@ bool Router::setupIface(int i) {
         }
 	maxSockNum = max(maxSockNum, sock[i]);
 
+	// let router links have their own sockets on the same port
+	if (lsocks != 0 && !LinkSocks::shareSock(sock[i])) {
+		cerr << "Router::setup: could not set SO_REUSEPORT\n";
+		return false;
+	}
+
 	// bind it to an address and port
 	IfaceTable::Entry& ifte = ift->getEntry(i);
         if (!Np4d::bind4d(sock[i], ifte.ipa, ifte.port)) {
@@ -288,6 +408,40 @@ bool Router::setupIface(int i) {
 	}
 	cout << "receive socket buffer size: " << bsiz2 << endl;
 
+	if (ifte.dev.length() == 0) {
+		pio->addSock(i, sock[i]);
+		return true;
+	}
+	// ring mode
+	if (ring == 0) ring = new PktRing(ps);
+	if (!ring->addRing(i, sock[i], ifte.dev, ifte.ipa, ifte.port)) {
+		perror("");
+		cerr << "Router::setupIface: could not setup packet ring on "
+		     << ifte.dev << endl;
+		return false;
+	}
+
+	return true;
+}
+
+/** Create shared-memory rings for links that specify them.
+ *  @return true on success, false on failure
+ */
+bool Router::setupShmLinks() {
+	for (int lnk = lt->firstLink(); lnk != 0; lnk = lt->nextLink(lnk)) {
+		LinkTable::Entry& lte = lt->getEntry(lnk);
+		if (lte.shm.length() == 0) continue;
+		if (shm == 0) {
+			shm = new ShmLinks(ps, lt->maxLink());
+			linkIo.push_back(shm);
+		}
+		if (!shm->open(lnk, lte.shm, lte.peerIp, lte.peerPort)) {
+			perror("");
+			cerr << "Router::setupShmLinks: could not create "
+				"shared-memory ring " << lte.shm << endl;
+			return false;
+		}
+	}
 	return true;
 }
 
@@ -563,6 +717,11 @@ void Router::dump(ostream& out) {
 }
 
 void Router::run() {
+	if (replay != 0) {
+		// benchmark the input path; no output thread is needed
+		rip->replayTrace();
+		return;
+	}
 	// start input and output threads
 cerr << "launching inProc, outProc\n";
 	thread inThred(RouterInProc::start,rip);
@@ -574,6 +733,10 @@ cerr << "waiting for  inProc, outProc\n";
 	outThred.join();
 cerr << "and done\n";
 
+	if (snapFile.compare("") != 0 && !saveTables())
+		cerr << "Router::run: could not write snapshot "
+		     << snapFile << endl;
+
 	cout << endl;
 	dump(cout); 		// print final tables
 	cout << endl;
@@ -0,0 +1,397 @@
+/** @file RouterBench.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include <fstream>
+#include "Bench.h"
+#include "PacketStore.h"
+#include "QuManager.h"
+#include "ComtreeTable.h"
+#include "RouteTable.h"
+#include "LinkTable.h"
+#include "Repeater.h"
+#include "RepeatHandler.h"
+#include "CtlPkt.h"
+
+using namespace forest;
+
+namespace forest {
+
+void benchPacketStore(Bench&);
+void benchQuManager(Bench&);
+void benchRouteTable(Bench&);
+void benchComtreeTable(Bench&);
+void benchLinkTable(Bench&);
+void benchRepeater(Bench&);
+void benchCtlPkt(Bench&);
+
+} // ends namespace
+
+/** Run microbenchmarks on the router's data structures.
+ *
+ *  usage: RouterBench [format=csv|json|text] [reps=n] [tag=s]
+ *			[filter=s] [out=file]
+ *
+ *  Each benchmark is run once to warm up and then reps times (5);
+ *  the fastest run is reported. Tag is a label included with each
+ *  result, normally the commit being measured. If filter is given,
+ *  only benchmarks whose names contain it are run. The results are
+ *  written to the named file, or to stdout; progress is written to
+ *  stderr.
+ */
+int main(int argc, char *argv[]) {
+	string format = "csv", tag, filter, outFile;
+	int reps = 5;
+	for (int i = 1; i < argc; i++) {
+		string s(argv[i]);
+		size_t k = s.find('=');
+		if (k == string::npos)
+			Util::fatal("RouterBench: bad argument " + s);
+		string name = s.substr(0,k), val = s.substr(k+1);
+		if (name == "format")		format = val;
+		else if (name == "reps")	reps = atoi(val.c_str());
+		else if (name == "tag")		tag = val;
+		else if (name == "filter")	filter = val;
+		else if (name == "out")		outFile = val;
+		else Util::fatal("usage: RouterBench [format=csv|json|text] "
+				 "[reps=n] [tag=s] [filter=s] [out=file]");
+	}
+
+	Bench b(reps, tag);
+	b.setFilter(filter);
+	benchPacketStore(b);
+	benchQuManager(b);
+	benchRouteTable(b);
+	benchComtreeTable(b);
+	benchLinkTable(b);
+	benchRepeater(b);
+	benchCtlPkt(b);
+
+	string result = (format == "json" ? b.toJson() :
+			 (format == "text" ? b.toString() : b.toCsv()));
+	if (outFile.length() == 0) {
+		cout << result;
+	} else {
+		ofstream out(outFile);
+		if (!out) Util::fatal("RouterBench: cannot open " + outFile);
+		out << result;
+	}
+	exit(0);
+}
+
+namespace forest {
+
+/** Benchmark packet allocation, with and without the per-thread caches.
+ *  Each run allocates a batch of packets and then frees them, so the
+ *  batch size determines how far down the free stacks we reach.
+ */
+void benchPacketStore(Bench& b) {
+	const int N = 100000; const int rounds = 1000;
+	PacketStore ps(N+1, N+1);
+	int cx = ps.newCache();
+	for (int batch : {1, 64, 1024}) {
+		vector<pktx> v(batch);
+		string params = "batch=" + to_string(batch);
+		uint64_t ops = 2 * (uint64_t) batch * rounds;
+		b.run("PacketStore.alloc_free", params, ops, [&]() {
+			for (int r = 0; r < rounds; r++) {
+				for (int i = 0; i < batch; i++) v[i] = ps.alloc();
+				for (int i = 0; i < batch; i++) ps.free(v[i]);
+			}
+		});
+		b.run("PacketStore.alloc_free_cached", params, ops, [&]() {
+			for (int r = 0; r < rounds; r++) {
+				for (int i = 0; i < batch; i++)
+					v[i] = ps.alloc(cx);
+				for (int i = 0; i < batch; i++)
+					ps.free(v[i],cx);
+			}
+		});
+		pktx px = ps.alloc();
+		b.run("PacketStore.clone_free", params, ops, [&]() {
+			for (int r = 0; r < rounds; r++) {
+				for (int i = 0; i < batch; i++)
+					v[i] = ps.clone(px);
+				for (int i = 0; i < batch; i++) ps.free(v[i]);
+			}
+		});
+		b.run("PacketStore.clone_free_cached", params, ops, [&]() {
+			for (int r = 0; r < rounds; r++) {
+				for (int i = 0; i < batch; i++)
+					v[i] = ps.clone(px,cx);
+				for (int i = 0; i < batch; i++)
+					ps.free(v[i],cx);
+			}
+		});
+		ps.free(px);
+	}
+}
+
+/** Benchmark the queue manager.
+ *  Each run enqueues a set of packets, spread round-robin over all
+ *  queues, and then dequeues them all. The links run at the maximum
+ *  rate and the clock is advanced on every dequeue, so the scheduler
+ *  never has to hold packets back.
+ */
+void benchQuManager(Bench& b) {
+	const int nPkts = 10000;
+	struct { int nL, qpl; } cfg[] = { {4,1}, {16,4}, {64,16}, {256,16} };
+	for (auto c : cfg) {
+		int nQ = c.nL * c.qpl;
+		PacketStore ps(nPkts+1, nPkts+1);
+		QuManager qm(c.nL, nPkts, nQ, nPkts, &ps);
+		RateSpec rs(Forest::MAXBITRATE,Forest::MAXBITRATE,
+			    Forest::MAXPKTRATE,Forest::MAXPKTRATE);
+		vector<int> qv;
+		for (int lnk = 1; lnk <= c.nL; lnk++) {
+			qm.setLinkRates(lnk,rs);
+			for (int j = 0; j < c.qpl; j++) {
+				int qid = qm.allocQ(lnk);
+				qm.setQRates(qid,rs);
+				qm.setQLimits(qid,nPkts,nPkts*1500);
+				qv.push_back(qid);
+			}
+		}
+		vector<pktx> pv(nPkts);
+		for (int i = 0; i < nPkts; i++) {
+			pv[i] = ps.alloc();
+			ps.getPacket(pv[i]).length = 100;
+		}
+		uint64_t now = 1;
+		string params = "links=" + to_string(c.nL) +
+				" queues=" + to_string(nQ);
+		b.run("QuManager.enq_deq", params, 2*nPkts, [&]() {
+			for (int i = 0; i < nPkts; i++)
+				qm.enq(pv[i], qv[i % nQ], now);
+			int lnk;
+			for (int n = 0; n < nPkts; ) {
+				now += 1000000;
+				while (qm.deq(lnk,now) != 0) n++;
+			}
+		});
+		for (int i = 0; i < nPkts; i++) ps.free(pv[i]);
+	}
+}
+
+/** Benchmark route lookups and route table updates at several sizes.
+ *  Lookups are for randomly chosen routes that are in the table.
+ *  Updates add a batch of new routes and then remove them.
+ */
+void benchRouteTable(Bench& b) {
+	const int nLookups = 100000; const int nUpdates = 1000;
+	const comt_t comt = 1001;
+	for (int size : {1000, 10000, 100000}) {
+		ComtreeTable ctt(2, 1);
+		int ctx = ctt.addEntry(comt);
+		ctt.addLink(ctx,1,false,false);
+		int cLnk = ctt.getClnkNum(comt,1);
+		RouteTable rt(size + nUpdates, Forest::forestAdr(1,1), &ctt);
+
+		// fill table with routes to distinct random addresses
+		vector<fAdr_t> adr;
+		while ((int) adr.size() < size) {
+			fAdr_t a = Forest::forestAdr(Util::randint(1,1000),
+						     Util::randint(1,30000));
+			if (rt.getRtx(comt,a) != 0) continue;
+			rt.addRoute(comt,a,cLnk); adr.push_back(a);
+		}
+		vector<fAdr_t> probe(nLookups);
+		for (int i = 0; i < nLookups; i++)
+			probe[i] = adr[Util::randint(0,size-1)];
+		vector<fAdr_t> extra;
+		while ((int) extra.size() < nUpdates) {
+			fAdr_t a = Forest::forestAdr(Util::randint(1001,2000),
+						     Util::randint(1,30000));
+			bool dup = false;
+			for (fAdr_t x : extra) if (x == a) { dup = true; break; }
+			if (!dup) extra.push_back(a);
+		}
+		vector<int> rtx(nUpdates);
+
+		string params = "routes=" + to_string(size);
+		volatile int sink = 0;
+		b.run("RouteTable.getRtx", params, nLookups, [&]() {
+			int s = 0;
+			for (int i = 0; i < nLookups; i++)
+				s += rt.getRtx(comt,probe[i]);
+			sink = s;
+		});
+		b.run("RouteTable.add_remove", params, 2*nUpdates, [&]() {
+			for (int i = 0; i < nUpdates; i++)
+				rtx[i] = rt.addRoute(comt,extra[i],cLnk);
+			for (int i = 0; i < nUpdates; i++)
+				rt.removeRoute(rtx[i]);
+		});
+		(void) sink;
+	}
+}
+
+/** Benchmark comtree link lookups.
+ *  Each comtree has the same number of links; the lookups are for
+ *  randomly chosen (comtree, link) pairs.
+ */
+void benchComtreeTable(Bench& b) {
+	const int nLookups = 100000;
+	struct { int nComt, lpc; } cfg[] = { {100,4}, {1000,16}, {10000,4} };
+	for (auto c : cfg) {
+		int nLnk = 4 * c.lpc;
+		ComtreeTable ctt(nLnk+1, c.nComt);
+		for (int i = 0; i < c.nComt; i++) {
+			int ctx = ctt.addEntry(1001+i);
+			for (int j = 0; j < c.lpc; j++) {
+				int lnk = 1 + (i + j*4) % nLnk;
+				ctt.addLink(ctx,lnk,false,false);
+				ctt.setLinkQ(ctx,ctt.getClnkNum(1001+i,lnk),j+1);
+			}
+		}
+		vector<comt_t> pc(nLookups); vector<int> pl(nLookups);
+		vector<int> pctx(nLookups), pcl(nLookups);
+		for (int k = 0; k < nLookups; k++) {
+			int i = Util::randint(0,c.nComt-1);
+			int j = Util::randint(0,c.lpc-1);
+			pc[k] = 1001+i; pl[k] = 1 + (i + j*4) % nLnk;
+			pctx[k] = ctt.getComtIndex(pc[k]);
+			pcl[k] = ctt.getClnkNum(pc[k],pl[k]);
+		}
+		string params = "comtrees=" + to_string(c.nComt) +
+				" links=" + to_string(c.lpc);
+		volatile int sink = 0;
+		b.run("ComtreeTable.getClnkNum", params, nLookups, [&]() {
+			int s = 0;
+			for (int k = 0; k < nLookups; k++)
+				s += ctt.getClnkNum(pc[k],pl[k]);
+			sink = s;
+		});
+		b.run("ComtreeTable.getClnkQ", params, nLookups, [&]() {
+			int s = 0;
+			for (int k = 0; k < nLookups; k++)
+				s += ctt.getClnkQ(pctx[k],pcl[k]);
+			sink = s;
+		});
+		(void) sink;
+	}
+}
+
+/** Benchmark link table lookups, by nonce and by peer address.
+ *  Links are left disconnected, so the lookup by nonce uses the same
+ *  hash table that connected links use for their (ip,port) key.
+ */
+void benchLinkTable(Bench& b) {
+	const int nLookups = 100000;
+	for (int nLnk : {16, 256, 4000}) {
+		LinkTable lt(nLnk);
+		vector<uint64_t> nonce(nLnk+1);
+		for (int lnk = 1; lnk <= nLnk; lnk++) {
+			nonce[lnk] = ((uint64_t) Util::randint(1,1<<30) << 32)
+				     | lnk;
+			lt.addEntry(lnk, Np4d::ipAddress("10.0.0.1")+lnk,
+				    Forest::ROUTER_PORT, nonce[lnk]);
+			lt.setPeerAdr(lnk,Forest::forestAdr(2,lnk));
+		}
+		vector<int> pl(nLookups);
+		for (int k = 0; k < nLookups; k++)
+			pl[k] = Util::randint(1,nLnk);
+		string params = "links=" + to_string(nLnk);
+		volatile int sink = 0;
+		b.run("LinkTable.lookup_nonce", params, nLookups, [&]() {
+			int s = 0;
+			for (int k = 0; k < nLookups; k++)
+				s += lt.lookup(nonce[pl[k]]);
+			sink = s;
+		});
+		b.run("LinkTable.lookup_peerAdr", params, nLookups, [&]() {
+			int s = 0;
+			for (int k = 0; k < nLookups; k++)
+				s += lt.lookup(Forest::forestAdr(2,pl[k]));
+			sink = s;
+		});
+		(void) sink;
+	}
+}
+
+/** Benchmark the control packet repeat machinery.
+ *  For the Repeater, each run saves a batch of requests, checks for
+ *  overdue ones and then matches replies to all of them. For the
+ *  RepeatHandler, each run records a batch of requests, looks each one
+ *  up, saves replies for them and then expires the records.
+ */
+void benchRepeater(Bench& b) {
+	for (int n : {100, 10000}) {
+		Repeater rep(n);
+		RepeatHandler rh(n);
+		int64_t seq = 1, now = 1;
+		string params = "pending=" + to_string(n);
+		pair<int,int> pv[64];
+		PacketStore ps(2, 2);
+		pktx px = ps.alloc();
+		Packet& p = ps.getPacket(px);
+		p.length = 100; p.type = Forest::NET_SIG;
+		b.run("Repeater.churn", params, 3*n, [&]() {
+			int64_t s0 = seq;
+			for (int i = 0; i < n; i++)
+				rep.saveReq(i+1,seq++,Forest::forestAdr(1,i%16+1),
+					    now);
+			for (int i = 0; i < n; i += 64) rep.overdue(now,pv,64);
+			for (int64_t s = s0; s < seq; s++)
+				rep.deleteMatch(s,now+500);
+			now += 1000;
+		});
+		b.run("RepeatHandler.churn", params, 4*n, [&]() {
+			int64_t s0 = seq;
+			for (int i = 0; i < n; i++)
+				rh.saveReq(Forest::forestAdr(1,i+1),seq++,now);
+			for (int i = 0; i < n; i++)
+				rh.find(Forest::forestAdr(1,i+1),s0+i);
+			for (int i = 0; i < n; i++)
+				rh.saveRep(Forest::forestAdr(1,i+1),s0+i,p);
+			now += 30000000000;
+			rh.expired(now);
+		});
+		ps.free(px);
+	}
+}
+
+/** Benchmark formatting and extraction of control packets, for a
+ *  request with a few integer fields and a reply with a string.
+ */
+void benchCtlPkt(Bench& b) {
+	const int n = 100000;
+	PacketStore ps(2, 2);
+	pktx px = ps.alloc();
+	Packet& p = ps.getPacket(px);
+	string msg = "comtree 1001 link 5 queue 7 rates 1000 1000 500 500";
+	volatile int sink = 0;
+	b.run("CtlPkt.fmt_xtr_addRoute", "", 2*n, [&]() {
+		int s = 0;
+		for (int i = 0; i < n; i++) {
+			CtlPkt cp(p);
+			cp.fmtAddRoute(1001, Forest::forestAdr(1,i&0xffff), 3, i+1);
+			p.length = Forest::OVERHEAD + cp.paylen;
+			CtlPkt cp2(p);
+			comt_t comt; fAdr_t adr; int lnk;
+			if (cp2.xtrAddRoute(comt,adr,lnk)) s += lnk;
+		}
+		sink = s;
+	});
+	b.run("CtlPkt.fmt_xtr_string", "", 2*n, [&]() {
+		int s = 0;
+		for (int i = 0; i < n; i++) {
+			CtlPkt cp(p);
+			cp.type = CtlPkt::GET_LINK;
+			cp.fmtError(msg, i+1);
+			p.length = Forest::OVERHEAD + cp.paylen;
+			CtlPkt cp2(p);
+			string m;
+			if (cp2.xtrError(m)) s += m.length();
+		}
+		sink = s;
+	});
+	(void) sink;
+	ps.free(px);
+}
+
+} // ends namespace
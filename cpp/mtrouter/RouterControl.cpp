@@ -7,14 +7,21 @@
  */
 
 #include "RouterControl.h"
+#include "RouterInProc.h"
 
 namespace forest {
 
+/** Constructor for RouterControl.
+ *  @param rtr1 is the router whose requests are handled
+ *  @param thx is the index of the worker thread using this object
+ *  @param outQ1 is the queue used to return packets to the input thread
+ */
 RouterControl::RouterControl(Router *rtr1, int thx,
-			BlockingQ<int> *inQ1, BlockingQ<pair<int,int>> *outQ1) 
-			: rtr(rtr1), myThx(thx), inQ(inQ1), outQ(outQ1) {
+			BlockingQ<pair<int,int>> *outQ1) 
+			: rtr(rtr1), myThx(thx), outQ(outQ1) {
 	ift = rtr->ift; lt = rtr->lt; ctt = rtr->ctt; rt = rtr->rt;
 	ps = rtr->ps; qm = rtr->qm; pktLog = rtr->pktLog;
+	curTx = 0; tablesLocked = false;
 }
 
 RouterControl::~RouterControl() {
@@ -22,25 +29,32 @@ RouterControl::~RouterControl() {
 	ps = 0; qm = 0; pktLog = 0;
 }
 
-void RouterControl::start(RouterControl *self) { self->run(); }
-	
-void RouterControl::run() {
-	while (true) {
-		pktx px = inQ->deq(); // wait for incoming request packet
-		Packet& p = ps->getPacket(px);
-		if (p.type != Forest::CLIENT_SIG && p.type != Forest::NET_SIG)
-			return;
-		CtlPkt cp(p);
-		handleRequest(px,cp);
-	}
+/** Run a control task.
+ *  @param tx is the index of the task
+ *  @param t is the task
+ */
+void RouterControl::handle(int tx, CtlExecutor::Task& t) {
+	curTx = tx;
+	Packet& p = ps->getPacket(t.px);
+	CtlPkt cp(p);
+	handleRequest(t.px,cp);
 }
-	
+
 /** Handle incoming signalling requests addressed to the router.
  *  Assumes packet has passed all basic checks.
  *  @param px is the index of some packet
  *  @param cp is a reference to a control packet unpacked from the payload
  */
 void RouterControl::handleRequest(int px, CtlPkt& cp) {
+	dispatch(cp);
+	returnToSender(px,cp);
+}
+
+/** Pass a request to the handler for its type.
+ *  @param cp is a reference to a control packet unpacked from the
+ *  payload of a request; on return, it is modified to form the reply
+ */
+void RouterControl::dispatch(CtlPkt& cp) {
 	switch (cp.type) {
 
 	// configuring logical interfaces
@@ -75,6 +89,14 @@ void RouterControl::handleRequest(int px, CtlPkt& cp) {
         case CtlPkt::GET_ROUTE:		getRoute(cp); break;
         case CtlPkt::MOD_ROUTE:		modRoute(cp); break;
     	case CtlPkt::GET_ROUTE_SET:	getRouteSet(cp); break;
+	case CtlPkt::ADD_ROUTE_BATCH:	addRouteBatch(cp); break;
+	case CtlPkt::DROP_ROUTE_BATCH:	dropRouteBatch(cp); break;
+
+	// bulk transfer of tables
+	case CtlPkt::GET_TABLE:		getTable(cp); break;
+	case CtlPkt::SAVE_TABLES:	saveTables(cp); break;
+	case CtlPkt::STAGE_TRACE:	stageTrace(cp); break;
+	case CtlPkt::GET_ROUTER_STATS:	getRouterStats(cp); break;
 
 	// configuring filters and retrieving packets
         case CtlPkt::ADD_FILTER:	addFilter(cp); break;
@@ -84,10 +106,14 @@ void RouterControl::handleRequest(int px, CtlPkt& cp) {
         case CtlPkt::GET_FILTER_SET:	getFilterSet(cp); break;
         case CtlPkt::GET_LOGGED_PACKETS: getLoggedPackets(cp); break;
         case CtlPkt::ENABLE_PACKET_LOG:	enablePacketLog(cp); break;
+        case CtlPkt::GET_HEAVY_HITTERS:	getHeavyHitters(cp); break;
 
 	// setting parameters
 	case CtlPkt::SET_LEAF_RANGE:	setLeafRange(cp); break;
 
+	// several operations applied together
+	case CtlPkt::COMPOUND:		compound(cp); break;
+
 	// comtree setup
 /*
 	case CtlPkt::JOIN:		joinComtree(cp); break
@@ -104,8 +130,6 @@ void RouterControl::handleRequest(int px, CtlPkt& cp) {
 		cp.fmtError("invalid control packet for router");
 		break;
 	}
-	returnToSender(px,cp);
-	return;
 }
 
 /** Send packet back to sender.
@@ -116,12 +140,12 @@ void RouterControl::handleRequest(int px, CtlPkt& cp) {
 void RouterControl::returnToSender(pktx px, CtlPkt& cp) {
 	Packet& p = ps->getPacket(px);
 	p.length = Packet::OVERHEAD + cp.paylen;
-	p.length = (p.length + 3)/4; // round up to next multiple of 4
+	p.length = 4*((p.length + 3)/4); // round up to next multiple of 4
 	p.flags = 0;
 	p.dstAdr = p.srcAdr;
 	p.srcAdr = rtr->myAdr;
 	p.pack();
-	outQ->enq(pair<int,int>(myThx,px));
+	outQ->enq(pair<int,int>(curTx,px));
 }
 
 /** Handle an ADD_IFACE control packet.
@@ -141,7 +165,8 @@ void RouterControl::addIface(CtlPkt& cp) {
 	rates.pktRateUp   = max(min(rates.pktRateUp,  maxp),minp);
 	rates.pktRateDown = max(min(rates.pktRateDown,maxp),minp);
 
-	unique_lock<mutex> iftLock(rtr->iftMtx);
+	unique_lock<mutex> iftLock(rtr->iftMtx,defer_lock);
+	if (!tablesLocked) iftLock.lock();
 	if (ift->valid(iface)) {
 		cp.fmtError("addIface: requested interface "
 			    "conflicts with existing interface");
@@ -166,7 +191,8 @@ void RouterControl::dropIface(CtlPkt& cp) {
 	int iface; if (!cp.xtrDropIface(iface)) { 
 		cp.fmtError("unable to unpack control packet"); return;
 	}
-	unique_lock<mutex> iftLock(rtr->iftMtx);
+	unique_lock<mutex> iftLock(rtr->iftMtx,defer_lock);
+	if (!tablesLocked) iftLock.lock();
 	ift->removeEntry(iface);
 	cp.fmtDropIfaceReply();
 }
@@ -180,7 +206,8 @@ void RouterControl::getIface(CtlPkt& cp) {
 	int iface; if (!cp.xtrGetIface(iface)) { 
 		cp.fmtError("unable to unpack control packet"); return;
 	}
-	unique_lock<mutex> iftLock(rtr->iftMtx);
+	unique_lock<mutex> iftLock(rtr->iftMtx,defer_lock);
+	if (!tablesLocked) iftLock.lock();
 	if (ift->valid(iface)) {
 		IfaceTable::Entry& ifte = ift->getEntry(iface);
 		cp.fmtGetIfaceReply(iface, ifte.ipa, ifte.port,
@@ -201,7 +228,8 @@ void RouterControl::modIface(CtlPkt& cp) {
 	if (!cp.xtrModIface(iface, rates)) { 
 		cp.fmtError("unable to unpack control packet"); return;
 	}
-	unique_lock<mutex> iftLock(rtr->iftMtx);
+	unique_lock<mutex> iftLock(rtr->iftMtx,defer_lock);
+	if (!tablesLocked) iftLock.lock();
 	if (ift->valid(iface)) {
 		IfaceTable::Entry& ifte = ift->getEntry(iface);
 		ifte.rates = rates;
@@ -224,7 +252,8 @@ void RouterControl::getIfaceSet(CtlPkt& cp) {
 	if (!cp.xtrGetIfaceSet(iface, count)) { 
 		cp.fmtError("unable to unpack control packet"); return;
 	}
-	unique_lock<mutex> iftLock(rtr->iftMtx);
+	unique_lock<mutex> iftLock(rtr->iftMtx,defer_lock);
+	if (!tablesLocked) iftLock.lock();
 	if (iface == 0) iface = ift->firstIface(); // 0 means 1st iface
 	else if (!ift->valid(iface)) {
 		cp.fmtError("get iface set: invalid iface number");
@@ -259,7 +288,7 @@ void RouterControl::addLink(CtlPkt& cp) {
 	// lock both iface table and link table
 	unique_lock<mutex> iftLock(rtr->iftMtx,defer_lock);
 	unique_lock<mutex>  ltLock( rtr->ltMtx,defer_lock);
-	lock(iftLock, ltLock);
+	if (!tablesLocked) lock(iftLock, ltLock);
 
 	if (lt->lookup(peerIp, peerPort) != 0 ||
 	    (lnk != 0 && lt->valid(lnk))) {
@@ -322,8 +351,10 @@ void RouterControl::addLink(CtlPkt& cp) {
 		pktx px = ps->alloc();
 		Packet& p = ps->getPacket(px);
 
-		p.length = Forest::OVERHEAD + 8;
+		p.length = Forest::OVERHEAD + 2*sizeof(uint64_t);
 		p.type = Forest::CONNECT; p.flags = 0;
+		// offer to accept aggregate datagrams from peer
+		if (rtr->aggWindow.count() > 0) p.flags = Forest::AGG_FLAG;
 		p.comtree = Forest::NABOR_COMT;
 		p.srcAdr = rtr->myAdr; p.dstAdr = lte.peerAdr;
 		int64_t seqNum = rtr->nextSeqNum();
@@ -332,9 +363,10 @@ void RouterControl::addLink(CtlPkt& cp) {
 		p.outLink = lnk;
 		p.pack();
 		p.hdrErrUpdate();p.payErrUpdate();
-		outQ->enq(pair<int,int>(myThx,px));
+		if (tablesLocked) deferred.push_back(px);
+		else outQ->enq(pair<int,int>(curTx,px));
 	}
-	cp.fmtAddLinkReply(lnk,peerAdr);
+	cp.fmtAddLinkReply(lnk,lte.peerAdr);
 	return;
 }
 
@@ -355,7 +387,7 @@ void RouterControl::dropLink(CtlPkt& cp) {
 	unique_lock<mutex>  ltLock( rtr->ltMtx,defer_lock);
 	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
 	unique_lock<mutex>  rtLock( rtr->rtMtx,defer_lock);
-	lock(iftLock, ltLock, cttLock, rtLock);
+	if (!tablesLocked) lock(iftLock, ltLock, cttLock, rtLock);
 
 	if (lnk == 0) lnk = lt->lookup(peerAdr);
 
@@ -375,6 +407,7 @@ void RouterControl::dropLink(CtlPkt& cp) {
 	rtr->freeLeafAdr(lte.peerAdr); // ignores addrs outside leaf adr range
 
 	// and finally, remove the link from the link table
+	for (LinkIo *lio : rtr->linkIo) lio->close(lnk);
 	lt->removeEntry(lnk);
 	cp.fmtDropLinkReply();
 }
@@ -384,7 +417,8 @@ void RouterControl::getLink(CtlPkt& cp) {
 	if (!cp.xtrGetLink(lnk)) { 
 		cp.fmtError("unable to unpack control packet"); return;
 	}
-	unique_lock<mutex> ltLock(rtr->ltMtx);
+	unique_lock<mutex> ltLock(rtr->ltMtx,defer_lock);
+	if (!tablesLocked) ltLock.lock();
 	if (lt->valid(lnk)) {
 		LinkTable::Entry& lte = lt->getEntry(lnk);
 		cp.fmtGetLinkReply(lnk, lte.iface, lte.peerType, lte.peerIp,
@@ -410,7 +444,8 @@ void RouterControl::getLinkSet(CtlPkt& cp) {
 	int lnk, count;
 	cp.xtrGetLinkSet(lnk,count);
 
-	unique_lock<mutex> ltLock(rtr->ltMtx);
+	unique_lock<mutex> ltLock(rtr->ltMtx,defer_lock);
+	if (!tablesLocked) ltLock.lock();
 	if (lnk == 0) lnk = lt->firstLink(); // 0 means start with first
 	else if (!lt->valid(lnk)) {
 		cp.fmtError("get link set: invalid link number");
@@ -440,7 +475,7 @@ void RouterControl::modLink(CtlPkt& cp) {
 
 	unique_lock<mutex> iftLock(rtr->iftMtx,defer_lock);
 	unique_lock<mutex> ltLock(rtr->ltMtx,defer_lock);
-	lock(iftLock, ltLock);
+	if (!tablesLocked) lock(iftLock, ltLock);
 
 	if (!lt->valid(lnk)) {
 		cp.fmtError("get link: invalid link number");
@@ -469,7 +504,8 @@ void RouterControl::addComtree(CtlPkt& cp) {
 		cp.fmtError("unable to unpack control packet"); return;
 	}
 
-	unique_lock<mutex> cttLock(rtr->cttMtx);
+	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
+	if (!tablesLocked) cttLock.lock();
 	if(ctt->validComtree(comt) || ctt->addEntry(comt) != 0) {
 		cp.fmtAddComtreeReply();
 		return;
@@ -487,7 +523,7 @@ void RouterControl::dropComtree(CtlPkt& cp) {
 	unique_lock<mutex> ltLock(rtr->ltMtx,defer_lock);
 	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
 	unique_lock<mutex> rtLock(rtr->rtMtx,defer_lock);
-	lock(ltLock, cttLock, rtLock);
+	if (!tablesLocked) lock(ltLock, cttLock, rtLock);
 
 	int ctx = ctt->getComtIndex(comt);
 	if (ctx == 0) {
@@ -526,7 +562,8 @@ void RouterControl::getComtree(CtlPkt& cp) {
 		cp.fmtError("unable to unpack control packet"); return;
 	}
 
-	unique_lock<mutex> cttLock(rtr->cttMtx);
+	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
+	if (!tablesLocked) cttLock.lock();
 	int ctx = ctt->getComtIndex(comt);
 	if (ctx == 0) {
 		cp.fmtError("get comtree: invalid comtree");
@@ -543,14 +580,17 @@ void RouterControl::modComtree(CtlPkt& cp) {
 	if (!cp.xtrModComtree(comt, coreFlag, plnk)) { 
 		cp.fmtError("unable to unpack control packet"); return;
 	}
-	unique_lock<mutex> cttLock(rtr->cttMtx);
+	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
+	if (!tablesLocked) cttLock.lock();
 
 	int ctx = ctt->getComtIndex(comt);
 	if (ctx != 0) {
 		ComtreeTable::Entry& cte = ctt->getEntry(ctx);
 		if (coreFlag >= 0)
 			cte.coreFlag = coreFlag;
-		if (plnk != 0) {
+		if (plnk < 0) { // clear parent link
+			cte.pLnk = 0; cte.pClnk = 0;
+		} else if (plnk != 0) {
 			if (plnk != 0 && !ctt->isLink(ctx,plnk)) {
 				cp.fmtError("specified link does "
 						"not belong to comtree");
@@ -587,7 +627,8 @@ void RouterControl::getComtreeSet(CtlPkt& cp) {
 		cp.fmtError("unable to unpack control packet"); return;
 	}
 
-	unique_lock<mutex> cttLock(rtr->cttMtx);
+	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
+	if (!tablesLocked) cttLock.lock();
 	int ctx;
 	if (comt == 0) // 0 means first
 		ctx = ctt->firstComt();
@@ -621,7 +662,7 @@ void RouterControl::addComtreeLink(CtlPkt& cp) {
 	unique_lock<mutex>  ltLock(rtr->ltMtx,defer_lock);
 	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
 	unique_lock<mutex>  rtLock(rtr->rtMtx,defer_lock);
-	lock(ltLock, cttLock, rtLock);
+	if (!tablesLocked) lock(ltLock, cttLock, rtLock);
 	int ctx = ctt->getComtIndex(comt);
 	if (ctx == 0) {
 		cp.fmtError("add comtree link: invalid comtree");
@@ -712,7 +753,7 @@ void RouterControl::dropComtreeLink(CtlPkt& cp) {
 	unique_lock<mutex>  ltLock(rtr->ltMtx,defer_lock);
 	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
 	unique_lock<mutex>  rtLock(rtr->rtMtx,defer_lock);
-	lock(ltLock, cttLock, rtLock);
+	if (!tablesLocked) lock(ltLock, cttLock, rtLock);
 	int ctx = ctt->getComtIndex(comt);
 	if (ctx == 0) {
 		cp.fmtError("drop comtree link: invalid comtree");
@@ -755,7 +796,7 @@ void RouterControl::modComtreeLink(CtlPkt& cp) {
 
 	unique_lock<mutex>  ltLock(rtr->ltMtx,defer_lock);
 	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
-	lock(ltLock, cttLock);
+	if (!tablesLocked) lock(ltLock, cttLock);
 	int ctx = ctt->getComtIndex(comt);
 	if (ctx == 0) {
 		cp.fmtError("modify comtree link: invalid comtree");
@@ -795,7 +836,7 @@ void RouterControl::getComtreeLink(CtlPkt& cp) {
 
 	unique_lock<mutex>  ltLock(rtr->ltMtx,defer_lock);
 	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
-	lock(ltLock, cttLock);
+	if (!tablesLocked) lock(ltLock, cttLock);
 	int ctx = ctt->getComtIndex(comt);
 	if (ctx == 0) {
 		cp.fmtError("get comtree link: invalid comtree");
@@ -824,7 +865,7 @@ void RouterControl::addRoute(CtlPkt& cp) {
 
 	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
 	unique_lock<mutex>  rtLock(rtr->rtMtx,defer_lock);
-	lock(cttLock, rtLock);
+	if (!tablesLocked) lock(cttLock, rtLock);
 	if (!ctt->validComtree(comt)) {
 		cp.fmtError("comtree not defined at this router\n");
 		return;
@@ -855,7 +896,7 @@ void RouterControl::dropRoute(CtlPkt& cp) {
 
 	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
 	unique_lock<mutex>  rtLock(rtr->rtMtx,defer_lock);
-	lock(cttLock, rtLock);
+	if (!tablesLocked) lock(cttLock, rtLock);
 	if (!ctt->validComtree(comt)) {
 		cp.fmtError("comtree not defined at this router\n");
 		return;
@@ -877,7 +918,7 @@ void RouterControl::getRoute(CtlPkt& cp) {
 
 	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
 	unique_lock<mutex>  rtLock(rtr->rtMtx,defer_lock);
-	lock(cttLock, rtLock);
+	if (!tablesLocked) lock(cttLock, rtLock);
 	int ctx = ctt->getComtIndex(comt);
 	if (ctx == 0) {
 		cp.fmtError("comtree not defined at this router\n");
@@ -907,7 +948,7 @@ void RouterControl::modRoute(CtlPkt& cp) {
 
 	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
 	unique_lock<mutex>  rtLock(rtr->rtMtx,defer_lock);
-	lock(cttLock, rtLock);
+	if (!tablesLocked) lock(cttLock, rtLock);
 	if (!ctt->validComtree(comt)) {
 		cp.fmtError("comtree not defined at this router\n");
 		return;
@@ -949,7 +990,7 @@ void RouterControl::getRouteSet(CtlPkt& cp) {
 
 	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
 	unique_lock<mutex>  rtLock(rtr->rtMtx,defer_lock);
-	lock(cttLock, rtLock);
+	if (!tablesLocked) lock(cttLock, rtLock);
 // think about re-doing this to use (comt,dest) pairs rather than rtx values
 	if (rtx == 0) {
 		rtx = rt->firstRtx(); // 0 means first route
@@ -973,6 +1014,278 @@ void RouterControl::getRouteSet(CtlPkt& cp) {
 	return;
 }
 
+/** Respond to an ADD_ROUTE_BATCH control packet.
+ *  The whole batch is applied under one hold of the route table lock.
+ *  Each tuple adds a route, or updates an existing one: a unicast route
+ *  must have exactly one link, which replaces its current link, while
+ *  the links of a multicast route are added to those it already has.
+ *  A tuple is rejected if its comtree is not defined, its address is
+ *  not valid or one of its links is not in the comtree; the others are
+ *  still applied.
+ *  @param cp is the control packet structure for some received packet;
+ *  on return, it is modified to form the reply
+ */
+void RouterControl::addRouteBatch(CtlPkt& cp) {
+	int pos; vector<int32_t> v;
+	if (!cp.xtrAddRouteBatch(pos, v)) {
+		cp.fmtError("unable to unpack control packet"); return;
+	}
+	for (int i = 0; i < (int) v.size(); ) {
+		if (!CtlPkt::nextRouteTuple(v,i)) {
+			cp.fmtError("add route batch: malformed route tuple");
+			return;
+		}
+	}
+
+	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
+	unique_lock<mutex>  rtLock(rtr->rtMtx,defer_lock);
+	if (!tablesLocked) lock(cttLock, rtLock);
+	int count = 0; vector<int32_t> failed;
+	vector<int> clnks;
+	for (int i = 0, k = pos; i < (int) v.size(); k++) {
+		comt_t comt = v[i]; fAdr_t adr = v[i+1]; int nl = v[i+2];
+		int lx = i+3; CtlPkt::nextRouteTuple(v,i);
+
+		bool mcast = Forest::mcastAdr(adr);
+		bool ok = ctt->validComtree(comt) && nl > 0 &&
+			  (mcast || (Forest::validUcastAdr(adr) && nl == 1));
+		clnks.clear();
+		for (int j = 0; ok && j < nl; j++) {
+			int cLnk = ctt->getClnkNum(comt,v[lx+j]);
+			if (cLnk == 0) ok = false;
+			clnks.push_back(cLnk);
+		}
+		int rtx = (ok ? rt->getRtx(comt,adr) : 0);
+		if (ok && rtx == 0) {
+			rtx = rt->addRoute(comt, adr, clnks[0]);
+			if (rtx == 0) ok = false;
+		} else if (ok && !mcast) {
+			rt->setLink(rtx, clnks[0]);
+		}
+		if (!ok) { failed.push_back(k); continue; }
+		if (mcast) {
+			for (int cLnk : clnks)
+				if (!rt->isLink(rtx,cLnk)) rt->addLink(rtx,cLnk);
+		}
+		count++;
+	}
+	cp.fmtAddRouteBatchReply(pos, count, failed);
+}
+
+/** Respond to a DROP_ROUTE_BATCH control packet.
+ *  The whole batch is applied under one hold of the route table lock.
+ *  A tuple with no links removes its route. Otherwise, the listed links
+ *  are removed from a multicast route (which goes away when its last
+ *  link does), while a unicast route is removed only if its link is
+ *  one of those listed. A tuple for a route that does not exist is
+ *  counted as applied, so a batch may safely be repeated.
+ *  @param cp is the control packet structure for some received packet;
+ *  on return, it is modified to form the reply
+ */
+void RouterControl::dropRouteBatch(CtlPkt& cp) {
+	int pos; vector<int32_t> v;
+	if (!cp.xtrDropRouteBatch(pos, v)) {
+		cp.fmtError("unable to unpack control packet"); return;
+	}
+	for (int i = 0; i < (int) v.size(); ) {
+		if (!CtlPkt::nextRouteTuple(v,i)) {
+			cp.fmtError("drop route batch: malformed route tuple");
+			return;
+		}
+	}
+
+	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
+	unique_lock<mutex>  rtLock(rtr->rtMtx,defer_lock);
+	if (!tablesLocked) lock(cttLock, rtLock);
+	int count = 0; vector<int32_t> failed;
+	for (int i = 0, k = pos; i < (int) v.size(); k++) {
+		comt_t comt = v[i]; fAdr_t adr = v[i+1]; int nl = v[i+2];
+		int lx = i+3; CtlPkt::nextRouteTuple(v,i);
+
+		if (!ctt->validComtree(comt) ||
+		    (!Forest::validUcastAdr(adr) && !Forest::mcastAdr(adr))) {
+			failed.push_back(k); continue;
+		}
+		count++;
+		int rtx = rt->getRtx(comt,adr);
+		if (rtx == 0) continue;
+		if (nl == 0) { rt->removeRoute(rtx); continue; }
+		for (int j = 0; j < nl && rt->validRtx(rtx); j++) {
+			int cLnk = ctt->getClnkNum(comt,v[lx+j]);
+			if (cLnk == 0 || !rt->isLink(rtx,cLnk)) continue;
+			if (Forest::mcastAdr(adr)) rt->removeLink(rtx,cLnk);
+			else rt->removeRoute(rtx);
+		}
+	}
+	cp.fmtDropRouteBatchReply(pos, count, failed);
+}
+
+/** Add a rate spec to an encoded table entry.
+ *  @param rs is a rate spec
+ *  @param v is a vector to which the four rates are appended
+ */
+static void packRates(const RateSpec& rs, vector<int32_t>& v) {
+	v.push_back(rs.bitRateUp); v.push_back(rs.bitRateDown);
+	v.push_back(rs.pktRateUp); v.push_back(rs.pktRateDown);
+}
+
+/** Respond to a GET_TABLE control packet.
+ *  The entries of the requested table whose indexes fall in the
+ *  requested range are encoded in binary (see CtlPkt) and packed into
+ *  the reply, in index order, until the packet is full. The reply
+ *  gives the index at which a follow-up request should start, or 0 if
+ *  the range was completed.
+ *  @param cp is the control packet structure for some received packet;
+ *  on return, it is modified to form the reply
+ */
+void RouterControl::getTable(CtlPkt& cp) {
+	int table, first, last;
+	if (!cp.xtrGetTable(table, first, last)) {
+		cp.fmtError("unable to unpack control packet"); return;
+	}
+	unique_lock<mutex> iftLock(rtr->iftMtx,defer_lock);
+	unique_lock<mutex>  ltLock( rtr->ltMtx,defer_lock);
+	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
+	unique_lock<mutex>  rtLock( rtr->rtMtx,defer_lock);
+	int limit;
+	switch (table) {
+	case CtlPkt::IFACE_TABLE:
+		if (!tablesLocked) iftLock.lock();
+		limit = ift->maxIface(); break;
+	case CtlPkt::LINK_TABLE:
+		if (!tablesLocked) ltLock.lock();
+		limit = lt->maxLink(); break;
+	case CtlPkt::COMTREE_TABLE:
+		if (!tablesLocked) cttLock.lock();
+		limit = ctt->maxComtIndex(); break;
+	case CtlPkt::ROUTE_TABLE:
+		if (!tablesLocked) lock(cttLock, rtLock);
+		limit = rt->maxRoute(); break;
+	default:
+		cp.fmtError("get table: invalid table"); return;
+	}
+	if (first < 1) first = 1;
+	if (last <= 0 || last > limit) last = limit;
+
+	// room for the entries, after the base fields and the other
+	// attributes of the reply
+	const int maxWords = (Forest::MAX_PLENG - Forest::OVERHEAD - 64)/4;
+	vector<int32_t> v; v.reserve(maxWords + 64);
+	int i;
+	for (i = first; i <= last; i++) {
+		int n0 = v.size();
+		v.push_back(i); v.push_back(0);
+		if (table == CtlPkt::IFACE_TABLE) {
+			if (!ift->valid(i)) { v.resize(n0); continue; }
+			IfaceTable::Entry& ifte = ift->getEntry(i);
+			v.push_back(ifte.ipa); v.push_back(ifte.port);
+			packRates(ifte.rates,v); packRates(ifte.availRates,v);
+		} else if (table == CtlPkt::LINK_TABLE) {
+			if (!lt->valid(i)) { v.resize(n0); continue; }
+			LinkTable::Entry& lte = lt->getEntry(i);
+			v.push_back(lte.iface); v.push_back(lte.peerType);
+			v.push_back(lte.peerIp); v.push_back(lte.peerPort);
+			v.push_back(lte.peerAdr);
+			packRates(lte.rates,v); packRates(lte.availRates,v);
+		} else if (table == CtlPkt::COMTREE_TABLE) {
+			if (!ctt->validCtx(i)) { v.resize(n0); continue; }
+			ComtreeTable::Entry& cte = ctt->getEntry(i);
+			v.push_back(ctt->getComtree(i));
+			v.push_back(cte.coreFlag); v.push_back(cte.pLnk);
+			for (int cLnk = ctt->firstComtLink(i); cLnk != 0;
+				 cLnk = ctt->nextComtLink(i,cLnk)) {
+				ComtreeTable::ClnkInfo& cli =
+					ctt->getClnkInfo(i,cLnk);
+				v.push_back(ctt->getLink(i,cLnk));
+				v.push_back(cli.dest); packRates(cli.rates,v);
+			}
+		} else {
+			if (!rt->validRtx(i)) { v.resize(n0); continue; }
+			comt_t comt = rt->getComtree(i);
+			int ctx = ctt->getComtIndex(comt);
+			v.push_back(comt); v.push_back(rt->getAddress(i));
+			for (int clx = rt->firstClx(i); clx != 0;
+				 clx = rt->nextClx(i,clx))
+				v.push_back(ctt->getLink(ctx,rt->getClnk(i,clx)));
+		}
+		v[n0+1] = v.size() - (n0+2);
+		if ((int) v.size() > maxWords) { v.resize(n0); break; }
+	}
+	int nxt = (i > last ? 0 : i);
+	if (nxt == first) {
+		cp.fmtError("get table: entry too large for packet"); return;
+	}
+	cp.fmtGetTableReply(table, first, nxt, limit, v);
+}
+
+/** Respond to a SAVE_TABLES control packet.
+ *  Writes a snapshot of the router's tables to its snapshot file,
+ *  holding all the table locks while the snapshot is taken.
+ *  @param cp is the control packet structure for some received packet;
+ *  on return, it is modified to form the reply
+ */
+void RouterControl::saveTables(CtlPkt& cp) {
+	if (!cp.xtrSaveTables()) {
+		cp.fmtError("unable to unpack control packet"); return;
+	}
+	unique_lock<mutex> iftLock(rtr->iftMtx,defer_lock);
+	unique_lock<mutex>  ltLock( rtr->ltMtx,defer_lock);
+	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
+	unique_lock<mutex>  rtLock( rtr->rtMtx,defer_lock);
+	if (!tablesLocked) lock(iftLock, ltLock, cttLock, rtLock);
+	if (!rtr->saveTables()) {
+		cp.fmtError("save tables: could not write snapshot"); return;
+	}
+	cp.fmtSaveTablesReply();
+}
+
+/** Respond to a STAGE_TRACE control packet.
+ *  Optionally writes the recorded pipeline events to a file on the
+ *  router, then optionally changes the sample rate. The file must be
+ *  a plain file name; it is placed in the trace directory given on
+ *  the command line, and dumps are refused if there is none.
+ *  @param cp is the control packet structure for some received packet;
+ *  on return, it is modified to form the reply
+ */
+void RouterControl::stageTrace(CtlPkt& cp) {
+	int rate; string fileName;
+	if (!cp.xtrStageTrace(rate, fileName)) {
+		cp.fmtError("unable to unpack control packet"); return;
+	}
+	int count = 0;
+	if (fileName.length() > 0) {
+		if (rtr->traceDir.length() == 0) {
+			cp.fmtError("stage trace: no trace directory"); return;
+		}
+		if (fileName.find('/') != string::npos || fileName[0] == '.') {
+			cp.fmtError("stage trace: invalid file name"); return;
+		}
+		count = rtr->strace->dump(rtr->traceDir + "/" + fileName,
+					  rtr->epoch);
+		if (count < 0) {
+			cp.fmtError("stage trace: could not write trace file");
+			return;
+		}
+	}
+	if (rate >= 0) rtr->strace->setSampleRate(rate);
+	cp.fmtStageTraceReply(rtr->strace->getSampleRate(), count);
+}
+
+/** Report the statistics kept by the router's input thread.
+ *  The input thread refreshes them once a second, so they may be
+ *  up to a second old.
+ *  @param cp is the control packet structure for some received packet;
+ *  on return, it is modified to form the reply
+ */
+void RouterControl::getRouterStats(CtlPkt& cp) {
+	if (!cp.xtrGetRouterStats()) {
+		cp.fmtError("unable to unpack control packet"); return;
+	}
+	string s = rtr->rip->getStats();
+	if (s.length() > 1300) s.resize(1300);
+	cp.fmtGetRouterStatsReply(s);
+}
+
 /** Handle an add filter control packet.
  *  Adds the specified interface and prepares a reply packet.
  *  @param cp is the control packet structure (already unpacked)
@@ -1031,8 +1344,12 @@ void RouterControl::modFilter(CtlPkt& cp) {
 		cp.fmtError("mod filter: invalid filter index");
 		return;
 	}
-	PacketFilter& f = pktLog->getFilter(fx);
-	f.fromString(s);
+	PacketFilter f = pktLog->getFilter(fx);
+	if (!f.fromString(s)) {
+		cp.fmtError("mod filter: misformatted filter");
+		return;
+	}
+	pktLog->setFilter(fx, f);
 	cp.fmtReply();
 	return;
 }
@@ -1063,7 +1380,7 @@ void RouterControl::getFilterSet(CtlPkt& cp) {
 	int i = 0;
 	stringstream ss;
 	while (i < count && fx != 0) {
-		PacketFilter& f = pktLog->getFilter(fx);
+		const PacketFilter& f = pktLog->getFilter(fx);
 		ss << fx << " " << f.toString() << "\n";
 
 		if (ss.str().length() > 1300) {
@@ -1110,13 +1427,36 @@ void RouterControl::enablePacketLog(CtlPkt& cp) {
 	return;
 }
 
+/** Report the heaviest sources of traffic arriving at the router.
+ *  @param cp is a reference to a received get heavy hitters control packet
+ */
+void RouterControl::getHeavyHitters(CtlPkt& cp) {
+	int keyType, count, reset;
+	if (!cp.xtrGetHeavyHitters(keyType, count, reset)) { 
+		cp.fmtError("unable to unpack control packet"); return;
+	}
+	if (keyType < 0 || keyType >= HeavyHitters::NUM_KEYS) {
+		cp.fmtError("get heavy hitters: invalid key type"); return;
+	}
+	count = max(0,min(HeavyHitters::MAXTOP,count));
+	string s = rtr->hh->toString(keyType, count);
+	if (s.length() > 1300) {
+		cp.fmtError("get heavy hitters: error while formatting reply");
+		return;
+	}
+	if (reset) rtr->hh->reset();
+	cp.fmtGetHeavyHittersReply(count, s);
+	return;
+}
+
 /** Handle an incoming set leaf range request from a client.
  *  @param cp is a reference to the received request packet
  */
 void RouterControl::setLeafRange(CtlPkt& cp) {
 	fAdr_t first, last;
 	cp.xtrSetLeafRange(first, last);
-	unique_lock<mutex> lck(rtr->ltMtx);
+	unique_lock<mutex> lck(rtr->ltMtx,defer_lock);
+	if (!tablesLocked) lck.lock();
 	if (!rtr->setLeafAdrRange(first, last)) {
 		cp.fmtError("could not set leaf address range"); return;
 	}
@@ -1124,6 +1464,239 @@ void RouterControl::setLeafRange(CtlPkt& cp) {
 	return;
 }
 
+/** Handle a COMPOUND request.
+ *  The operations in the request are applied in order, while holding
+ *  the locks on all the tables they use, so no other request sees the
+ *  tables part way through. If every operation succeeds, the reply
+ *  carries the reply to each operation, in order. If one fails, the
+ *  ones already applied are undone, in reverse order, and the reply is
+ *  an error that identifies the failed operation. Packets that the
+ *  operations send (such as CONNECT packets for new links) are held
+ *  back until the outcome is known. An operation that gives 0 as its
+ *  link applies to the link added by the most recent ADD_LINK or
+ *  ADD_COMTREE_LINK operation before it (see bindLink), so a link
+ *  whose number the router assigns can be configured in the same
+ *  request that adds it.
+ *  @param cp is the control packet structure for some received packet;
+ *  on return, it is modified to form the reply
+ */
+void RouterControl::compound(CtlPkt& cp) {
+	if (!cp.xtrCompound()) {
+		cp.fmtError("unable to unpack control packet"); return;
+	}
+	// check the operations and find the tables they need
+	CtlPkt op; int nOps = 0; int need = 0;
+	while (cp.getOp(op)) {
+		nOps++;
+		int tables = compoundTables(op.type);
+		if (tables == 0 || op.mode != CtlPkt::REQUEST) {
+			cp.fmtError("compound: operation " + to_string(nOps) +
+				    " (" + CtlPkt::cpType2string(op.type) +
+				    ") not allowed in compound request");
+			return;
+		}
+		need |= tables;
+	}
+	if (nOps == 0) { cp.fmtError("compound: no operations"); return; }
+
+	// lock tables in a fixed order
+	unique_lock<mutex> iftLock(rtr->iftMtx,defer_lock);
+	unique_lock<mutex>  ltLock( rtr->ltMtx,defer_lock);
+	unique_lock<mutex> cttLock(rtr->cttMtx,defer_lock);
+	unique_lock<mutex>  rtLock( rtr->rtMtx,defer_lock);
+	if (need & IFT) iftLock.lock();
+	if (need & LT)   ltLock.lock();
+	if (need & CTT) cttLock.lock();
+	if (need & RT)   rtLock.lock();
+	tablesLocked = true;
+
+	char opBuf[Forest::MAX_PLENG], repBuf[Forest::MAX_PLENG];
+	CtlPkt rep; rep.payload = repBuf; rep.seqNum = cp.seqNum;
+	rep.fmtCompoundReply();
+	vector<Undo> undo(nOps); int nUndo = 0;
+	string err; int i = 0; int newLnk = 0;
+	cp.xtrCompound();
+	while (cp.getOp(op)) {
+		i++;
+		// work on a copy, since the reply may be longer than the request
+		CtlPkt sub; sub.payload = opBuf; sub.paylen = op.paylen;
+		std::copy(op.payload, op.payload + op.paylen, opBuf);
+		sub.xtrBase(); bindLink(sub,newLnk);
+		Undo& u = undo[nUndo]; saveUndo(sub,u);
+		sub.xtrBase(); dispatch(sub);
+		if (sub.mode != CtlPkt::POS_REPLY) {
+			string s; sub.xtrBase(); sub.xtrError(s);
+			err = "compound: operation " + to_string(i) + " (" +
+			      CtlPkt::cpType2string(op.type) + ") failed: " + s;
+			break;
+		}
+		sub.xtrBase();
+		if (u.type == CtlPkt::DROP_LINK) {
+			fAdr_t adr;
+			if (!sub.xtrAddLinkReply(u.lnk,adr))
+				u.type = CtlPkt::UNDEF_CPTYPE;
+			else newLnk = u.lnk;
+		} else if (u.type == CtlPkt::DROP_COMTREE_LINK) {
+			RateSpec rs;
+			if (!sub.xtrAddComtreeLinkReply(u.lnk,rs))
+				u.type = CtlPkt::UNDEF_CPTYPE;
+			else newLnk = u.lnk;
+		}
+		if (u.type != CtlPkt::UNDEF_CPTYPE) nUndo++;
+		if (!rep.putOp(sub)) {
+			err = "compound: reply too long at operation " +
+			      to_string(i);
+			break;
+		}
+	}
+	if (err.length() != 0) {
+		// roll back, most recent operation first
+		for (int j = nUndo-1; j >= 0; j--) {
+			CtlPkt inv; inv.payload = opBuf;
+			fmtUndo(undo[j],inv); inv.xtrBase(); dispatch(inv);
+		}
+		tablesLocked = false;
+		for (pktx px : deferred) ps->free(px);
+		deferred.clear();
+		cp.fmtError(err);
+		return;
+	}
+	tablesLocked = false;
+	for (pktx px : deferred) outQ->enq(pair<int,int>(curTx,px));
+	deferred.clear();
+	std::copy(repBuf, repBuf + rep.paylen, cp.payload);
+	cp.mode = CtlPkt::POS_REPLY; cp.paylen = rep.paylen;
+}
+
+/** Fill in the link of an operation in a compound request, when it
+ *  refers to a link added earlier in the same request. Such operations
+ *  give 0 as their link (and ADD_COMTREE_LINK gives no peer address
+ *  either), since that link's number is assigned by the router.
+ *  @param cp is the operation, with its base fields extracted; if its
+ *  link is filled in, it is reformatted in place
+ *  @param newLnk is the link added by the most recent ADD_LINK or
+ *  ADD_COMTREE_LINK in the request, or 0 if there is none
+ */
+void RouterControl::bindLink(CtlPkt& cp, int newLnk) {
+	if (newLnk == 0) return;
+	comt_t comt; int lnk, coreFlag; ipa_t ip; ipp_t port; fAdr_t adr;
+	RateSpec rates; int64_t sn = cp.seqNum;
+	switch (cp.type) {
+	case CtlPkt::MOD_LINK:
+		if (cp.xtrModLink(lnk,rates) && lnk == 0)
+			cp.fmtModLink(newLnk,rates,sn);
+		break;
+	case CtlPkt::ADD_COMTREE_LINK:
+		if (cp.xtrAddComtreeLink(comt,lnk,coreFlag,ip,port,adr) &&
+		    lnk == 0 && ip == 0 && adr == 0)
+			cp.fmtAddComtreeLink(comt,newLnk,coreFlag,ip,port,adr,sn);
+		break;
+	case CtlPkt::MOD_COMTREE_LINK:
+		if (cp.xtrModComtreeLink(comt,lnk,rates,adr) && lnk == 0)
+			cp.fmtModComtreeLink(comt,newLnk,rates,adr,sn);
+		break;
+	default: break;
+	}
+	cp.xtrBase();
+}
+
+/** Determine which tables an operation in a compound request uses.
+ *  This includes the tables used by the operation that undoes it.
+ *  @param type is the type of the operation
+ *  @return a set of table flags, or 0 if the operation is not allowed
+ *  in a compound request
+ */
+int RouterControl::compoundTables(CtlPkt::CpType type) {
+	switch (type) {
+	case CtlPkt::ADD_LINK:		return IFT | LT | CTT | RT;
+	case CtlPkt::MOD_LINK:		return IFT | LT;
+	case CtlPkt::ADD_COMTREE:	return LT | CTT | RT;
+	case CtlPkt::MOD_COMTREE:	return CTT;
+	case CtlPkt::ADD_COMTREE_LINK:	return LT | CTT | RT;
+	case CtlPkt::MOD_COMTREE_LINK:	return LT | CTT;
+	case CtlPkt::ADD_ROUTE:		return CTT | RT;
+	default: return 0;
+	}
+}
+
+/** Record what is needed to undo an operation, before it is applied.
+ *  Caller must hold the table locks.
+ *  @param cp is the operation, with its base fields extracted
+ *  @param u is the record to fill in; its type is the type of the
+ *  operation that undoes cp, or UNDEF_CPTYPE if nothing needs undoing;
+ *  for ADD_LINK and ADD_COMTREE_LINK the link is filled in from the
+ *  reply, once the operation has succeeded
+ */
+void RouterControl::saveUndo(CtlPkt& cp, Undo& u) {
+	u.type = CtlPkt::UNDEF_CPTYPE;
+	u.comt = 0; u.lnk = 0; u.adr = 0; u.coreFlag = -1; u.plnk = 0;
+	int lnk, coreFlag, plnk; comt_t comt; fAdr_t adr;
+	ipa_t ip; ipp_t port; RateSpec rates;
+	switch (cp.type) {
+	case CtlPkt::ADD_LINK:
+		u.type = CtlPkt::DROP_LINK; break;
+	case CtlPkt::MOD_LINK:
+		if (!cp.xtrModLink(lnk,rates) || !lt->valid(lnk)) break;
+		u.type = CtlPkt::MOD_LINK; u.lnk = lnk;
+		u.rates = lt->getEntry(lnk).rates;
+		break;
+	case CtlPkt::ADD_COMTREE:
+		if (!cp.xtrAddComtree(comt) || ctt->validComtree(comt)) break;
+		u.type = CtlPkt::DROP_COMTREE; u.comt = comt;
+		break;
+	case CtlPkt::MOD_COMTREE: {
+		if (!cp.xtrModComtree(comt,coreFlag,plnk)) break;
+		int ctx = ctt->getComtIndex(comt);
+		if (ctx == 0) break;
+		ComtreeTable::Entry& cte = ctt->getEntry(ctx);
+		u.type = CtlPkt::MOD_COMTREE; u.comt = comt;
+		u.coreFlag = cte.coreFlag; u.plnk = cte.pLnk;
+		break;
+		}
+	case CtlPkt::ADD_COMTREE_LINK:
+		if (!cp.xtrAddComtreeLink(comt,lnk,coreFlag,ip,port,adr)) break;
+		u.type = CtlPkt::DROP_COMTREE_LINK; u.comt = comt;
+		break;
+	case CtlPkt::MOD_COMTREE_LINK: {
+		if (!cp.xtrModComtreeLink(comt,lnk,rates,adr)) break;
+		int ctx = ctt->getComtIndex(comt);
+		int cLnk = (ctx == 0 ? 0 : ctt->getClnkNum(comt,lnk));
+		if (cLnk == 0) break;
+		ComtreeTable::ClnkInfo& cli = ctt->getClnkInfo(ctx,cLnk);
+		u.type = CtlPkt::MOD_COMTREE_LINK; u.comt = comt; u.lnk = lnk;
+		u.rates = cli.rates; u.adr = cli.dest;
+		break;
+		}
+	case CtlPkt::ADD_ROUTE:
+		if (!cp.xtrAddRoute(comt,adr,lnk)) break;
+		if (rt->getRtx(comt,adr) != 0) break;
+		u.type = CtlPkt::DROP_ROUTE; u.comt = comt; u.adr = adr;
+		break;
+	default: break;
+	}
+}
+
+/** Format the request that undoes an operation.
+ *  @param u is the undo record for the operation
+ *  @param cp is a control packet in which the request is formatted
+ */
+void RouterControl::fmtUndo(Undo& u, CtlPkt& cp) {
+	switch (u.type) {
+	case CtlPkt::DROP_LINK:	cp.fmtDropLink(u.lnk,0); break;
+	case CtlPkt::MOD_LINK:	cp.fmtModLink(u.lnk,u.rates); break;
+	case CtlPkt::DROP_COMTREE: cp.fmtDropComtree(u.comt); break;
+	case CtlPkt::MOD_COMTREE:
+		cp.fmtModComtree(u.comt,u.coreFlag,u.plnk == 0 ? -1 : u.plnk);
+		break;
+	case CtlPkt::DROP_COMTREE_LINK:
+		cp.fmtDropComtreeLink(u.comt,u.lnk,0,0,0); break;
+	case CtlPkt::MOD_COMTREE_LINK:
+		cp.fmtModComtreeLink(u.comt,u.lnk,u.rates,u.adr); break;
+	case CtlPkt::DROP_ROUTE: cp.fmtDropRoute(u.comt,u.adr); break;
+	default: break;
+	}
+}
+
 /** Handle an incoming join request from a client.
  *  @param cp is a reference to the received request packet
  *  @param rcp is a reference to the reply packet with fields to be
@@ -18,26 +18,31 @@ RouterInProc::RouterInProc(Router *rtr1) : rtr(rtr1) {
 	ps = rtr->ps; qm = rtr->qm;
 	pktLog = rtr->pktLog;
 
-	nRdy = 0; 
-	sockets = new fd_set;
+	nRcv = nextRcv = 0;
+	nAgg = nextAgg = 0; aggRcvd = aggRejected = 0;
+	for (int i = 0; i <= Forest::MAXLNK; i++) lsockTried[i] = false;
 
-	// setup thread pool
-	retQ.resize(4*numThreads + 100);
-	tpool = new ThreadInfo[numThreads+1];
-	for (int i = 1; i <= numThreads; i++) {
-		tpool[i].q.resize(50);
-		tpool[i].rc = RouterControl(rtr, i, &(tpool[i].q), &retQ);
-		tpool[i].thred = thread(RouterControl::start,&tpool[i].rc);
-	}
+	overload = false; psSize = ps->capacity();
+	xferIn = overloadCnt = 0;
+	for (int i = 0; i < NUM_CLASSES; i++) shedCnt[i] = xferDrops[i] = 0;
 
-	comtSet = new HashSet<comt_t,Hash::u32>(numThreads,false);
-	rptr = new Repeater(numThreads);
+	// setup control executor; one worker per spare core
+	rcvSeqNum = 0; nextTimerCheck = 0; nextStatsUpdate = 0;
+	retQ.resize(maxCtlTasks);
+	exec = new CtlExecutor(rtr, 0, maxCtlTasks, &retQ);
+	rptr = new Repeater(maxCtlTasks);
 	repH = new RepeatHandler(maxReplies);
+	// flood a given destination at most every 500 ms and
+	// remember unknown destinations for 2 seconds
+	rrc = new RteReqCache(maxRteReqs, 500000000, 2000000000);
+	subq = new SubCoalescer(maxSubComts, 1000,
+				nanoseconds(rtr->subWindow).count());
 }
 
 RouterInProc::~RouterInProc() {
-	delete sockets; delete [] tpool; 
-	delete comtSet; delete rptr; delete repH;
+	delete exec;
+	delete rptr; delete repH; delete rrc;
+	delete subq;
 }
 
 /** Start input processor.
@@ -79,8 +84,21 @@ void RouterInProc::run() {
 		temp = high_resolution_clock::now() - rtr->tZero;
 		now = temp.count();
 
-		int px = repH->expired(now);
-		if (px != 0) ps->free(px); 
+		// once per tick, discard old replies and resend
+		// overdue requests
+		if (now >= nextTimerCheck) {
+			checkTimers();
+			nextTimerCheck = now + timerTick;
+		}
+
+		// discard packets held for route requests that went unanswered
+		pktx held[RteReqCache::MAXHELD]; int cnt;
+		while ((cnt = rrc->expired(now, held)) >= 0) {
+			for (int i = 0; i < cnt; i++) ps->free(held[i]);
+		}
+
+		// send subscription changes whose window has ended
+		sendSubUnsub();
 
 		if (!mainline()) {
 		//	this_thread::sleep_for(milliseconds(1));
@@ -89,6 +107,180 @@ void RouterInProc::run() {
 
 	cerr << "   getting: " << i1 << " " << (d1.count()/i1) << endl;
 	cerr << "forwarding: " << i2 << " " << (d2.count()/i2) << endl;
+	cerr << statsString();
+	cerr << "           I/O: " << rtr->pio->toString() << endl;
+	if (rtr->ring != 0)
+		cerr << "   packet ring: " << rtr->ring->toString() << endl;
+	for (LinkIo *lio : rtr->linkIo)
+		cerr << "    link I/O: " << lio->toString() << endl;
+	cerr << "control peers:\n" << rptr->toString();
+	if (rtr->trace != 0) {
+		cerr << "         trace: " << rtr->trace->count()
+		     << " packets recorded\n";
+		rtr->trace->close();
+	}
+
+	for (int lnk = lt->firstLink(); lnk != 0; lnk = lt->nextLink(lnk)) {
+		LinkTable::Entry& lte = lt->getEntry(lnk);
+		if (lte.policedPkts == 0) continue;
+		cerr << "link " << lnk << ": policer dropped "
+		     << lte.policedPkts << " packets, "
+		     << lte.policedBytes << " bytes\n";
+	}
+}
+
+/** Create a string listing the statistics kept by the input thread.
+ *  @return the string
+ */
+string RouterInProc::statsString() const {
+	static const char* className[NUM_CLASSES] = {
+		"data", "signalling", "sub_unsub", "conn/disc",
+		"rte_reply", "other"
+	};
+	stringstream ss;
+	ss << "route requests: " << rrc->toString() << endl;
+	ss << "       control: " << exec->toString() << endl;
+	ss << " subscriptions: " << subq->toString() << endl;
+	if (aggRcvd != 0 || aggRejected != 0)
+		ss << "    aggregates: " << aggRcvd << " received, "
+		   << aggRejected << " rejected\n";
+	// packets discarded by the I/O backends when the packet store
+	// was exhausted count as shed on input
+	uint64_t shed[NUM_CLASSES];
+	for (int i = 0; i < NUM_CLASSES; i++) shed[i] = shedCnt[i];
+	for (int t = 0; t < 256; t++) {
+		Forest::ptyp_t ptype = (Forest::ptyp_t) t;
+		uint64_t n = rtr->pio->discards(ptype);
+		if (rtr->ring != 0) n += rtr->ring->discards(ptype);
+		shed[pktClass(ptype)] += n;
+	}
+	ss << "overloaded " << overloadCnt << " times\n";
+	for (int i = 0; i < NUM_CLASSES; i++) {
+		if (shed[i] == 0 && xferDrops[i] == 0) continue;
+		ss << "   " << className[i] << " packets shed: "
+		   << shed[i] << " on input, " << xferDrops[i]
+		   << " at xferQ\n";
+	}
+	return ss.str();
+}
+
+/** Get the statistics most recently published by the input thread.
+ *  May be called by any thread.
+ *  @return a string listing the statistics
+ */
+string RouterInProc::getStats() {
+	unique_lock<mutex> lck(statsMtx);
+	return stats;
+}
+
+/** Replay a packet trace through the input processing path.
+ *  Each packet is copied from the trace into a fresh buffer and then
+ *  handled as mainline handles a packet from receive: it is unpacked,
+ *  checked by pktCheck and passed to forward. Packets addressed to the
+ *  router itself are counted and discarded. There is no output thread;
+ *  packets that forward passes to the transfer queue are removed from it
+ *  and discarded, so the results measure the input thread alone.
+ *
+ *  The router's clock follows the timestamps in the trace, so policers
+ *  and caches see the recorded traffic rates. The trace is replayed
+ *  either as fast as possible, or at the recorded rate. At the end,
+ *  the number of packets per second and the time per packet in each
+ *  stage are reported. If the router is compiled with COUNT_ALLOCS
+ *  defined, the number of heap allocations per packet is reported too;
+ *  this replaces the global operator new for all the router's threads,
+ *  so it should not be used in a production build.
+ */
+void RouterInProc::replayTrace() {
+	if (rtr->booting) {
+		cerr << "RouterInProc::replayTrace: replay requires a locally "
+			"configured router\n";
+		return;
+	}
+	PktTrace& tr = *rtr->replay;
+	uint64_t nPkts = 0, nBytes = 0, rejected = 0, local = 0;
+	uint64_t noBufs = 0, xferred = 0;
+	nanoseconds dUnpack(0), dCheck(0), dFwd(0);
+	int psFree = ps->numFree();
+#ifdef COUNT_ALLOCS
+	uint64_t allocs = AllocCount::count();
+#endif
+
+	uint64_t t; int lnk; const char *buf; int len;
+	uint64_t first = (tr.next(t,lnk,buf,len) ? t : 0);
+	uint64_t span = 0; // time covered by one pass through trace
+	timePoint start = high_resolution_clock::now();
+	for (int rep = 0; rep < rtr->replayReps; rep++) {
+		tr.rewind();
+		while (tr.next(t,lnk,buf,len)) {
+			span = max(span, t - first + 1);
+			now = (t - first) + rep*span;
+			if (rtr->replayTimed) {
+				this_thread::sleep_until(start + nanoseconds(now));
+			}
+			timePoint t0 = high_resolution_clock::now();
+			pktx px = ps->alloc();
+			if (px == 0) { noBufs++; continue; }
+			Packet& p = ps->getPacket(px);
+			memcpy(p.buffer, buf, len); p.bufferLen = len;
+			nPkts++; nBytes += len;
+			p.unpack();
+			if (!p.hdrErrCheck() || !lt->valid(lnk)) {
+				rejected++; ps->free(px); continue;
+			}
+			p.inLink = lnk;
+			LinkTable::Entry& lte = lt->getEntry(lnk);
+			p.tunIp = lte.peerIp; p.tunPort = lte.peerPort;
+			lt->countIncoming(lnk,Forest::truPktLeng(len));
+			timePoint t1 = high_resolution_clock::now();
+			dUnpack += t1 - t0;
+
+			rtr->hh->update(p.srcAdr, p.comtree, p.inLink, p.length);
+			p.outQueue = 0;
+			((uint32_t*) p.buffer)[1500] = 0;
+			p.rcvSeqNum = ++rcvSeqNum;
+			int ctx = ctt->getComtIndex(p.comtree);
+			bool ok = pktCheck(px,ctx);
+			timePoint t2 = high_resolution_clock::now();
+			dCheck += t2 - t1;
+			if (!ok) { rejected++; ps->free(px); continue; }
+			if (p.dstAdr == rtr->myAdr) {
+				local++; ps->free(px); continue;
+			}
+			forward(px,ctx);
+			dFwd += high_resolution_clock::now() - t2;
+
+			// play the part of the output thread
+			while ((px = rtr->xferQ.deq()) != 0) {
+				rtr->xferOut.store(++xferred,memory_order_relaxed);
+				ps->free(px);
+			}
+		}
+	}
+	double secs = duration<double>(high_resolution_clock::now()
+				       - start).count();
+#ifdef COUNT_ALLOCS
+	allocs = AllocCount::count() - allocs;
+#endif
+	int held = psFree - ps->numFree();
+
+	uint64_t n = max(nPkts, (uint64_t) 1);
+	cout << "replayed " << tr.count() << " packets " << rtr->replayReps
+	     << " times in " << secs << " seconds ("
+	     << (rtr->replayTimed ? "recorded timing" : "max speed") << ")\n";
+	cout << (uint64_t) (nPkts/secs) << " packets/s, "
+	     << (8*nBytes/secs)/1000000 << " Mb/s\n";
+	cout << "ns per packet: unpack " << dUnpack.count()/n
+	     << ", check " << dCheck.count()/n
+	     << ", forward " << dFwd.count()/(n - min(n-1,rejected+local))
+	     << "\n";
+	cout << nPkts << " packets: " << xferred << " queued for output, "
+	     << rejected << " rejected, " << local << " for router, "
+	     << noBufs << " not replayed (no buffers)\n";
+#ifdef COUNT_ALLOCS
+	cout << "heap allocations: " << allocs << " ("
+	     << ((double) allocs)/n << " per packet)\n";
+#endif
+	cout << held << " packet buffers still in use\n";
 }
 
 /** Send a boot request and then process configuration packets from NetMgr.
@@ -104,11 +296,10 @@ bool RouterInProc::bootRouter() {
 		now = temp.count();
 
 		// check for old entries in RepeatHandler and discard
-		int px = repH->expired(now);
-		if (px != 0) ps->free(px);
+		repH->expired(now);
 
 		// first check for arriving packet from NetMgr
-		px = bootReceive();
+		pktx px = bootReceive();
 		if (px != 0) {
 			// bootReceive verifies packets are from netMgr
 			Packet& p = ps->getPacket(px);
@@ -134,42 +325,33 @@ bool RouterInProc::bootRouter() {
 				ps->free(px); continue;
 			}
 			// typical case of request from NetMgr
-			pktx sx;
+			int sx;
 			if ((sx = repH->find(p.srcAdr,cp.seqNum)) != 0) {
 				// repeat of a request we've already received
-				ps->free(px);
-				Packet& saved = ps->getPacket(sx);
-				CtlPkt scp(saved);
-				if (scp.mode != CtlPkt::REQUEST) {
+				if (repH->replied(sx)) {
 					// already replied to this request,
 					// reply again
-					pktx cx = ps->clone(sx);
-					bootSend(cx);
+					repH->getReply(sx,p);
+					bootSend(px);
+				} else {
+					// working on request, have not
+					// yet replied
+					ps->free(px);
 				}
-				// working on request, have not yet replied
 				continue;
 			}
 			// new request packet
-			// assign worker thread
-			int thx = freeThreads.first();
-			if (thx == 0) {
+			int64_t seqNum = cp.seqNum; fAdr_t srcAdr = p.srcAdr;
+			// and pass original to the control executor
+			if (!exec->submit(0,px)) {
 				// this should never happen
 				cerr << "RouterInProc::bootRouter: "
-					"ran out of threads while "
+					"too many control tasks while "
 					"booting\n";
 				return false;
 			}
-			freeThreads.removeFirst();
-			tpool[thx].rcvSeqNum = p.rcvSeqNum;
-			// save a copy, so we can detect repeats
-			pktx cx = ps->clone(px);
-			pktx ox = repH->saveReq(cx,p.srcAdr,
-						cp.seqNum,now);
-			if (ox != 0) { // old entry removed to make room
-				ps->free(ox);
-			}
-			// and send original to the thread
-			tpool[thx].q.enq(px);
+			// remember it, so we can detect repeats
+			repH->saveReq(srcAdr,seqNum,now);
 			continue;
 		}
 
@@ -182,32 +364,13 @@ bool RouterInProc::bootRouter() {
 		// process outgoing packet from RouterControl
 		// note: can only be a reply to NetMgr request
 		pair<int,int> retp = retQ.deq();
-	
-		int thx = retp.first; 	// index of sending thread
 		px = retp.second; 	// packet index of outgoing packet
 		
 		Packet& p = ps->getPacket(px);
-		if (thx < 0) {
-			// means thread is ready to be released and packet is
-			// a dummy used to pass rcvSeqNum back to ensure clean
-			// deallocation of thread
-			//
-			// needed to handle comtree signalling
-			thx = -thx; // restore proper thread index
-			if (tpool[thx].rcvSeqNum == p.rcvSeqNum) {
-				if (comtSet->valid(thx))
-					comtSet->remove(comtSet->retrieve(thx));
-				freeThreads.addFirst(thx);
-			}
-			ps->free(px); return true;
-		}
 		CtlPkt cp(p);
-		// make copy, send original, save copy in repeat handler
-		// recycle request that was stored in repeat handler
-		pktx cx = ps->clone(px);
+		// save copy in repeat handler, then send
+		repH->saveRep(p.dstAdr, cp.seqNum, p);
 		bootSend(px);
-		int sx = repH->saveRep(cx, p.dstAdr, cp.seqNum);
-		if (sx != 0) ps->free(sx);
 	}
 }
 
@@ -320,16 +483,22 @@ bool RouterInProc::mainline() {
 	unique_lock<mutex>  rtLock(rtr->rtMtx,defer_lock);
 	//lock(iftLock,ltLock);
 
+	checkOverload();
 t1 = high_resolution_clock::now();
 	px = receive();
 	if (px != 0) {
 d1 += (high_resolution_clock::now() - t1); i1++;
 		Packet& p = ps->getPacket(px);
 //if (i1 < 10) cerr << p.toString();
+		if (rtr->trace != 0)
+			rtr->trace->write(now,p.inLink,p.buffer,p.bufferLen);
+		rtr->hh->update(p.srcAdr, p.comtree, p.inLink, p.length);
 		p.outQueue = 0;
 		((uint32_t*) p.buffer)[1500] = 0; // clear multicast qids
 		p.rcvSeqNum = ++rcvSeqNum;
-		//pktLog->log(px,p.inLink,false,now);
+		TRACE_STAGE(rtr->strace, StageTrace::IN_THREAD, now, RECV,
+			    px, p, p.inLink, 0);
+		pktLog->log(px,p.inLink,false,now);
 		//lock(cttLock, rtLock);
 		int ctx = ctt->getComtIndex(p.comtree);
 		if (!pktCheck(px,ctx)) {
@@ -347,50 +516,16 @@ d2 += high_resolution_clock::now() - t2; i2++;
 		return true;
 	}
 	// check for outgoing packet from RouterControl
-	if (retQ.empty()) { 
-		// check for overdue packet and resend
-		pair<int,int> pp = rptr->overdue(now);
-		if (pp.first == 0) return false;
-		if (pp.first > 0) {
-			pktx cx = ps->clone(pp.first);
-			if (cx == 0) return true;
-			//lock(cttLock, rtLock);
-			int ctx = ctt->getComtIndex(ps->getPacket(cx).comtree);
-			forward(cx,ctx); return true;
-		} 
-		// no more retries, return to thread
-		// with a NO_REPLY mode
-		int px = -pp.first;
-		Packet& p = ps->getPacket(px);
-		CtlPkt cp(p); cp.mode = CtlPkt::NO_REPLY; cp.fmtBase();
-		p.length = Forest::OVERHEAD + cp.paylen;
-		p.pack();
-		tpool[pp.second].q.enq(px);
-		return true;
-	}
+	if (retQ.empty()) return false;
 	// process outgoing packet from RouterControl
 	pair<int,int> retp = retQ.deq();
 
-	int thx = retp.first; 	// index of sending thread
+	int tx = retp.first; 	// index of sending task
 	px = retp.second; 	// packet index of outgoing packet
 	
 	Packet& p = ps->getPacket(px);
-	if (thx < 0) {
-		// means thread is ready to be released and packet is
-		// a dummy used to pass rcvSeqNum back to ensure clean
-		// deallocation of thread
-		//
-		// needed to handle comtree signalling
-		thx = -thx; // restore proper thread index
-		if (tpool[thx].rcvSeqNum == p.rcvSeqNum) {
-			if (comtSet->valid(thx))
-				comtSet->remove(comtSet->retrieve(thx));
-			freeThreads.addFirst(thx);
-		}
-		ps->free(px); return true;
-	}
-	if (p.type != Forest::CLIENT_SIG || p.type != Forest::NET_SIG) {
-		if (rtr->xferQ.enq(px) == 0) ps->free(px);
+	if (p.type != Forest::CLIENT_SIG && p.type != Forest::NET_SIG) {
+		xfer(px);
 		return true;
 	}
 	CtlPkt cp(p);
@@ -403,22 +538,58 @@ d2 += high_resolution_clock::now() - t2; i2++;
 		//lock(cttLock, rtLock);
 		int ctx = ctt->getComtIndex(p.comtree);
 		if (ctx == 0) { ps->free(px); return true; }
+		fAdr_t peer = p.dstAdr;
 		forward(px,ctx);
-		rptr->saveReq(cx, cp.seqNum, now, thx);
+		rptr->saveReq(cx, cp.seqNum, peer, now, tx);
 		return true;
 	}
-	// it's a reply, make copy, send original, save copy in repeat handler
-	// and recycle corresponding request that was stored in repeat handler
-	pktx cx = ps->clone(px);
+	// it's a reply, save copy in repeat handler and send
 	//lock(cttLock, rtLock);
 	int ctx = ctt->getComtIndex(p.comtree);
 	if (ctx == 0) { ps->free(px); return true; }
+	repH->saveRep(p.dstAdr, cp.seqNum, p);
 	forward(px,ctx);
-	int sx = repH->saveRep(cx, p.dstAdr, cp.seqNum);
-	if (sx != 0) ps->free(sx);
 	return true;
 }
 
+/** Process expired timers, in batches.
+ *  Replies that have been held long enough are discarded and overdue
+ *  requests are resent; requests that have been sent too many times
+ *  are discarded.
+ *  Requests for heavy hitter snapshots are also handled here, and the
+ *  statistics returned by getStats are refreshed once a second.
+ */
+void RouterInProc::checkTimers() {
+	repH->expired(now);
+	rtr->hh->publish(now);
+	if (now >= nextStatsUpdate) {
+		string s = statsString();
+		unique_lock<mutex> lck(statsMtx);
+		stats.swap(s);
+		nextStatsUpdate = now + statsInterval;
+	}
+
+	const int BATCH = 64;
+	pair<int,int> pv[BATCH];
+	int cnt;
+	do {
+		cnt = rptr->overdue(now, pv, BATCH);
+		for (int i = 0; i < cnt; i++) {
+			if (pv[i].first > 0) {
+				pktx cx = ps->clone(pv[i].first);
+				if (cx == 0) continue;
+				//lock(cttLock, rtLock);
+				int ctx = ctt->getComtIndex(
+						ps->getPacket(cx).comtree);
+				forward(cx,ctx); continue;
+			}
+			// no more retries; control tasks do not wait for
+			// replies, so just give up
+			ps->free(-pv[i].first);
+		}
+	} while (cnt == BATCH);
+}
+
 /** Handle a received control packet.
  *  Caller is assumed to hold the comtree table and route table locks.
  *  @param px is the control packet index
@@ -426,10 +597,14 @@ d2 += high_resolution_clock::now() - t2; i2++;
  */
 void RouterInProc::handleControl(pktx px, int ctx) {
 	Packet& p = ps->getPacket(px);
+	if (p.type == Forest::CONNECT || p.type == Forest::DISCONNECT) {
+		// including acks, which complete the link setup
+		handleConnDisc(px); return;
+	}
 	if (p.flags & Forest::ACK_FLAG) {
 		// find and remove matching request
 		int64_t seqNum = Np4d::unpack64(p.payload());
-		pair<int,int> pp = rptr->deleteMatch(seqNum);
+		pair<int,int> pp = rptr->deleteMatch(seqNum, now);
 		if (pp.first != 0) ps->free(pp.first);
 		ps->free(px); return;
 	}
@@ -439,9 +614,6 @@ void RouterInProc::handleControl(pktx px, int ctx) {
 	if (p.type == Forest::RTE_REPLY) {
 		handleRteReply(px,ctx); return;
 	}
-	if (p.type == Forest::CONNECT || p.type == Forest::DISCONNECT) {
-		handleConnDisc(px); return;
-	}
 	if (p.type != Forest::NET_SIG && p.type != Forest::CLIENT_SIG) {
 		ps->free(px); return;
 	}
@@ -449,77 +621,42 @@ void RouterInProc::handleControl(pktx px, int ctx) {
 	CtlPkt cp(p);
 	if (cp.mode != CtlPkt::REQUEST) {
 		// reply to a request sent earlier
-		pair<int,int> pp =rptr->deleteMatch(cp.seqNum);
+		pair<int,int> pp = rptr->deleteMatch(cp.seqNum, now);
 		if (pp.first == 0) { // no matching request
 			ps->free(px); return;
 		}
-		ps->free(pp.first); // free saved copy of request
-		// pass reply to responsible thread; remember rcvSeqNum
-		tpool[pp.second].rcvSeqNum = p.rcvSeqNum;
-		tpool[pp.second].q.enq(px);
+		// the request is complete; no task waits for the reply
+		ps->free(pp.first); ps->free(px);
 		return;
 	}
-	pktx sx;
+	int sx;
 	if ((sx = repH->find(p.srcAdr,cp.seqNum)) != 0) {
 		// repeat of a request we've already received
-		ps->free(px);
-		Packet& saved = ps->getPacket(sx);
-		CtlPkt scp(saved);
-		if (scp.mode != CtlPkt::REQUEST) {
+		if (repH->replied(sx)) {
 			// already replied to this request, reply again
-			pktx cx = ps->clone(sx);
-			forward(cx,ctx);
-		}
-		return;
-	}
-	// new request packet
-	if (Forest::isSigComt(p.comtree)) {
-		// so not a comtree control packet
-		// assign worker thread
-		int thx = freeThreads.first();
-		if (thx == 0) {
-			// no threads available to handle it
-			// return negative reply
-			cp.fmtError("to busy to handle request, "
-				    "retry later");
-			p.dstAdr = p.srcAdr;
-			p.srcAdr = rtr->myAdr;
-			p.pack();
+			repH->getReply(sx,p);
 			forward(px,ctx);
-			return;
-		}
-		freeThreads.removeFirst();
-		tpool[thx].rcvSeqNum = p.rcvSeqNum;
-		// save a copy, so we can detect repeats
-		pktx cx = ps->clone(px);
-		pktx ox = repH->saveReq(cx,p.srcAdr,cp.seqNum,now);
-		if (ox != 0) { // old entry was removed to make room
-			ps->free(ox);
+		} else {
+			ps->free(px);
 		}
-		// and send original to the thread
-		tpool[thx].q.enq(px);
 		return;
 	}
-	// request for changing comtree
-	int thx = comtSet->find(p.comtree);
-	if (thx == 0) {
-		// no thread assigned to this comtree yet
-		// assign a worker thread
-		thx = freeThreads.first();
-		if (thx == 0) {
-			cp.fmtError("too busy to handle request,"
-				    " retry later");
-			p.dstAdr = p.srcAdr;
-			p.srcAdr = rtr->myAdr;
-			p.pack();
-			forward(px,ctx);
-			return;
-		}
-		freeThreads.removeFirst();
-		comtSet->insert(p.comtree,thx);
+	// new request packet; requests that modify a comtree are
+	// serialized on the comtree, others may run concurrently
+	comt_t key = (Forest::isSigComt(p.comtree) ? 0 : p.comtree);
+	int64_t seqNum = cp.seqNum; fAdr_t srcAdr = p.srcAdr;
+	if (!exec->submit(key,px)) {
+		// too many requests in progress, return negative reply
+		cp.fmtError("too busy to handle request, retry later");
+		p.length = Forest::OVERHEAD + cp.paylen;
+		p.dstAdr = p.srcAdr;
+		p.srcAdr = rtr->myAdr;
+		p.pack();
+		forward(px,ctx);
+		return;
 	}
-	tpool[thx].rcvSeqNum = p.rcvSeqNum;
-	tpool[thx].q.enq(px);
+	// remember it, so we can detect repeats
+	repH->saveReq(srcAdr,seqNum,now);
 	return;
 }
 
@@ -531,7 +668,16 @@ void RouterInProc::handleControl(pktx px, int ctx) {
  */
 void RouterInProc::forward(pktx px, int ctx) {
 	Packet& p = ps->getPacket(px);
+	TRACE_STAGE(rtr->strace, StageTrace::IN_THREAD, now, FORWARD,
+		    px, p, p.inLink, 0);
 	p.outQueue = 0;
+	if (p.type == Forest::UNKNOWN_DEST) {
+		// remember unknown destination, so we don't keep flooding it
+		rrc->setNegative(p.comtree, ntohl((p.payload())[0]), now);
+	} else if (p.type == Forest::RTE_REPLY) {
+		// release packets held at this router while waiting for reply
+		releaseHeld(p.comtree, ntohl((p.payload())[0]), ctx);
+	}
 	int rtx = rt->getRtx(p.comtree,p.dstAdr);
 	if (rtx != 0) { // valid route case
 		if ((p.flags & Forest::RTE_REQ)) {
@@ -541,15 +687,9 @@ void RouterInProc::forward(pktx px, int ctx) {
 			p.pack(); p.hdrErrUpdate();
 		}
 		if (Forest::validUcastAdr(p.dstAdr)) {
-			int rcLnk = rt->getClnk(rtx,rt->firstClx(rtx));
-			if (ctt->getLink(ctx,rcLnk) == p.inLink) {
-				ps->free(px);
-			} else {
-				p.outQueue = ctt->getClnkQ(ctx,rcLnk);
-				if (rtr->xferQ.enq(px) == 0) {
-					ps->free(px);
-				}
-			}
+			p.outQueue = rt->getUcastQ(rtx,ctx,p.inLink);
+			if (p.outQueue == 0) ps->free(px);
+			else xfer(px);
 			return;
 		}
 		// multicast data packet
@@ -568,7 +708,16 @@ void RouterInProc::forward(pktx px, int ctx) {
 			p.length = Forest::OVERHEAD + sizeof(fAdr_t);
 			p.pack(); p.hdrErrUpdate(); p.payErrUpdate();
 			p.outQueue = ctt->getLinkQ(ctx,p.inLink);
-			if (rtr->xferQ.enq(px) == 0) ps->free(px);
+			xfer(px);
+			return;
+		}
+		// limit the rate at which we flood requests for this dest
+		if (rrc->negative(p.comtree,p.dstAdr,now)) {
+			ps->free(px); return;
+		}
+		if (!rrc->flood(p.comtree,p.dstAdr,now)) {
+			// request already outstanding
+			if (!rrc->hold(p.comtree,p.dstAdr,px)) ps->free(px);
 			return;
 		}
 		// send to neighboring routers in comtree
@@ -590,6 +739,8 @@ void RouterInProc::forward(pktx px, int ctx) {
  */
 void RouterInProc::multiForward(pktx px, int ctx, int rtx) {
 	Packet& p = ps->getPacket(px);
+	TRACE_STAGE(rtr->strace, StageTrace::IN_THREAD, now, MFORWARD,
+		    px, p, p.inLink, 0);
 	int next = 1500;	// offset in p.buffer where qids are stored
 
 	int inLink = p.inLink;
@@ -637,7 +788,23 @@ void RouterInProc::multiForward(pktx px, int ctx, int rtx) {
 		}
 	}
 	buf[next] = 0;
-	if (rtr->xferQ.enq(px) == 0) ps->free(px);
+	xfer(px);
+}
+
+/** Forward packets that were held while a route request was outstanding.
+ *  Packets are released only once a route has been learned, and are
+ *  forwarded on that route. A route reply that passes through this
+ *  router without installing a route leaves them held; they are
+ *  released by a later reply, or discarded when the request times out.
+ *  @param comt is the comtree of the held packets
+ *  @param adr is the destination address of the held packets
+ *  @param ctx is the comtree index for comt
+ */
+void RouterInProc::releaseHeld(comt_t comt, fAdr_t adr, int ctx) {
+	if (rt->getRtx(comt,adr) == 0) return;
+	pktx held[RteReqCache::MAXHELD];
+	int cnt = rrc->release(comt, adr, held);
+	for (int i = 0; i < cnt; i++) forward(held[i],ctx);
 }
 
 /** Send route reply back towards p's source.
@@ -664,7 +831,7 @@ void RouterInProc::sendRteReply(pktx px, int ctx) {
 	p1.hdrErrUpdate(); p.payErrUpdate();
 
 	p.outQueue = ctt->getLinkQ(ctx,p.inLink);
-	if (rtr->xferQ.enq(px) == 0) ps->free(px);
+	xfer(px);
 }
 
 /** Handle a route reply packet.
@@ -684,9 +851,10 @@ void RouterInProc::handleRteReply(pktx px, int ctx) {
 	if ((p.flags & Forest::RTE_REQ) && rtx != 0)
 		sendRteReply(px,ctx);
 	int adr = ntohl((p.payload())[0]);
-	if (Forest::validUcastAdr(adr) &&
-	    rt->getRtx(p.comtree,adr) == 0) {
-		rt->addRoute(p.comtree,adr,cLnk); 
+	if (Forest::validUcastAdr(adr)) {
+		if (rt->getRtx(p.comtree,adr) == 0)
+			rt->addRoute(p.comtree,adr,cLnk); 
+		releaseHeld(p.comtree,adr,ctx);
 	}
 	if (rtx == 0) {
 		// send to neighboring routers in comtree
@@ -700,7 +868,7 @@ void RouterInProc::handleRteReply(pktx px, int ctx) {
 	int lnk = ctt->getLink(ctx,dcLnk);
 	if (lt->getEntry(lnk).peerType == Forest::ROUTER) {
 		p.outQueue = ctt->getClnkQ(ctx,dcLnk);
-		if (rtr->xferQ.enq(px) ==0) ps->free(px);
+		xfer(px);
 	} else {
 		ps->free(px);
 	}
@@ -718,13 +886,15 @@ void RouterInProc::returnAck(pktx px, int ctx, bool ackNack) {
 	p.flags |= (ackNack ? Forest::ACK_FLAG : Forest::NACK_FLAG);
 	p.pack(); p.hdrErrUpdate();
 	p.outQueue = ctt->getLinkQ(ctx,p.inLink);
-	if (rtr->xferQ.enq(px) == 0) ps->free(px);
+	xfer(px);
 }
 
 /** Perform subscription processing on a packet.
  *  The packet contains two lists of multicast addresses,
  *  each preceded by its length. The combined list lengths
- *  is limited to 350.
+ *  is limited to 350. Routes that are added or removed as a result
+ *  are recorded in the SubCoalescer, which aggregates them before
+ *  they are propagated to the parent (see sendSubUnsub).
  *  @param px is a packet number
  *  @param ctx is the comtree index for p's comtree
  */
@@ -733,7 +903,7 @@ void RouterInProc::subUnsub(pktx px, int ctx) {
 	uint32_t *pp = p.payload();
 
 	// add/remove branches from routes
-	// if non-core node, also propagate requests upward as appropriate
+	// if non-core node, also propagate changes upward as appropriate
 	int comt = ctt->getComtree(ctx);
 	int inLink = p.inLink;
 	int cLnk = ctt->getClnkNum(comt,inLink);
@@ -757,11 +927,9 @@ void RouterInProc::subUnsub(pktx px, int ctx) {
 		return;
 	}
 
-	// make copy to be used for ack
-	pktx cx = ps->fullCopy(px);
+	bool propagate = !ctt->inCore(ctx) && ctt->getPlink(ctx) != 0;
 
 	// add subscriptions
-	bool propagate = false;
 	int rtx; fAdr_t addr;
 	for (int i = 3; i <= addcnt + 2; i++) {
 		addr = ntohl(pp[i]);
@@ -769,10 +937,9 @@ void RouterInProc::subUnsub(pktx px, int ctx) {
 		rtx = rt->getRtx(comt,addr);
 		if (rtx == 0) { 
 			rtx = rt->addRoute(comt,addr,cLnk);
-			propagate = true;
+			if (propagate) subq->add(comt,addr,now);
 		} else if (!rt->isLink(rtx,cLnk)) {
 			rt->addLink(rtx,cLnk);
-			pp[i] = 0; // so, parent will ignore
 		}
 	}
 	// remove subscriptions
@@ -784,36 +951,62 @@ void RouterInProc::subUnsub(pktx px, int ctx) {
 		rt->removeLink(rtx,cLnk);
 		if (rt->noLinks(rtx)) {
 			rt->removeRoute(rtx);
-			propagate = true;
-		} else {
-			pp[i] = 0;
-		}		
-	}
-	// propagate subscription packet to parent if not a core node
-	if (propagate && !ctt->inCore(ctx) && ctt->getPlink(ctx) != 0) {
-		Np4d::pack64(rtr->nextSeqNum(),pp);
-		p.srcAdr = rtr->myAdr;
-		int lnk = ctt->getPlink(ctx);
-		p.dstAdr = lt->getEntry(lnk).peerAdr;
-		p.outQueue = ctt->getLinkQ(ctx,lnk);
-		uint64_t seqNum = rtr->nextSeqNum();
-		Np4d::pack64(seqNum, p.payload());
-		p.hdrErrUpdate(); p.payErrUpdate();
-		int cx = ps->clone(px);
-		if (cx != 0) {
-			rptr->saveReq(cx, seqNum, now);
-		};
-		if (rtr->xferQ.enq(px) == 0) ps->free(px);
-	} else {
-		ps->free(px);
+			if (propagate) subq->drop(comt,addr,now);
+		}
 	}
 	// send ack back to sender
-	// note that we send ack before getting ack from sender
+	// note that we send ack before getting ack from parent
 	// this is by design
-	returnAck(cx,ctx,true);
+	returnAck(px,ctx,true);
 	return;
 }
 
+/** Send aggregated subscription changes to a comtree parent.
+ *  Sends a single SUB_UNSUB packet for the next comtree whose
+ *  aggregation window has ended, if any. A copy is saved in the
+ *  Repeater, so the packet is resent if the parent does not ack it.
+ *  If the packet cannot be sent, or the comtree has no parent link
+ *  at the moment, the changes are returned to the SubCoalescer, to be
+ *  tried again later.
+ */
+void RouterInProc::sendSubUnsub() {
+	vector<fAdr_t> adds, drops;
+	comt_t comt = subq->expired(now, adds, drops);
+	if (comt == 0 || (adds.empty() && drops.empty())) return;
+	int ctx = ctt->getComtIndex(comt);
+	if (ctx == 0 || ctt->inCore(ctx)) return; // no parent to inform
+	int lnk = ctt->getPlink(ctx);
+	if (lnk == 0) { subq->requeue(comt, adds, drops, now); return; }
+
+	pktx px = ps->alloc();
+	if (px == 0) { subq->requeue(comt, adds, drops, now); return; }
+	Packet& p = ps->getPacket(px);
+	uint32_t *pp = p.payload();
+	uint64_t seqNum = rtr->nextSeqNum();
+	Np4d::pack64(seqNum, pp);
+	int i = 2;
+	pp[i++] = htonl(adds.size());
+	for (fAdr_t adr : adds) pp[i++] = htonl(adr);
+	pp[i++] = htonl(drops.size());
+	for (fAdr_t adr : drops) pp[i++] = htonl(adr);
+
+	p.length = Forest::OVERHEAD + 4*i;
+	p.type = Forest::SUB_UNSUB; p.flags = 0;
+	p.comtree = comt;
+	p.srcAdr = rtr->myAdr;
+	p.dstAdr = lt->getEntry(lnk).peerAdr;
+	p.pack(); p.hdrErrUpdate(); p.payErrUpdate();
+	p.outQueue = ctt->getLinkQ(ctx,lnk);
+
+	pktx cx = ps->clone(px);
+	if (cx == 0 || rptr->saveReq(cx, seqNum, p.dstAdr, now) == 0) {
+		if (cx != 0) ps->free(cx);
+		ps->free(px);
+		subq->requeue(comt, adds, drops, now); return;
+	}
+	xfer(px);
+}
+
 /** Handle a CONNECT or DISCONNECT packet.
  *  @param px is the packet number of the packet to be handled.
  */
@@ -823,16 +1016,34 @@ void RouterInProc::handleConnDisc(pktx px) {
 	int ctx = ctt->getComtIndex(p.comtree);
 
 	LinkTable::Entry& lte = lt->getEntry(inLnk);
-	if (p.srcAdr != lte.peerAdr ||
-	    p.length != Forest::OVERHEAD + 2*sizeof(uint64_t)) {
-		returnAck(px,ctx,false); return;
+	bool valid = (p.srcAdr == lte.peerAdr &&
+		      p.length == Forest::OVERHEAD + 2*sizeof(uint64_t) &&
+		      Np4d::unpack64(p.payload()+2) == lte.nonce);
+	if (p.flags & (Forest::ACK_FLAG | Forest::NACK_FLAG)) {
+		// peer's reply to a connect or disconnect we sent
+		if (valid && p.type == Forest::CONNECT &&
+		    (p.flags & Forest::ACK_FLAG)) {
+			lte.aggregate = (p.flags & Forest::AGG_ACK) != 0 &&
+					rtr->aggWindow.count() > 0;
+			openLinkSock(inLnk);
+		}
+		int64_t seqNum = Np4d::unpack64(p.payload());
+		pair<int,int> pp = rptr->deleteMatch(seqNum, now);
+		if (pp.first != 0) ps->free(pp.first);
+		ps->free(px); return;
 	}
-
-	uint64_t nonce = Np4d::unpack64(p.payload()+2);
-	if (nonce != lte.nonce) {
+	if (!valid) {
 		returnAck(px,ctx,false); return;
 	}
 	if (p.type == Forest::CONNECT) {
+		// aggregate if peer accepts it and it's enabled here
+		bool aggOk = (p.flags & Forest::AGG_FLAG) &&
+			     lte.peerType == Forest::ROUTER &&
+			     rtr->aggWindow.count() > 0;
+		p.flags &= ~(Forest::AGG_FLAG | Forest::AGG_ACK);
+		if (aggOk) p.flags |= Forest::AGG_ACK;
+		lte.aggregate = aggOk;
+
 		if (lte.isConnected &&
 		    !lt->revertEntry(inLnk)) {
 			returnAck(px,ctx,false); return;
@@ -841,6 +1052,7 @@ void RouterInProc::handleConnDisc(pktx px) {
 		    !lt->remapEntry(inLnk,p.tunIp,p.tunPort)) {
 			returnAck(px,ctx,false); return;
 		}
+		openLinkSock(inLnk);
 		if (rtr->nmAdr != 0 && lte.peerType==Forest::CLIENT) {
 			pktx rx = ps->alloc();
 			if (rx == 0) { returnAck(px,ctx,false); return; }
@@ -855,7 +1067,9 @@ void RouterInProc::handleConnDisc(pktx px) {
 			forward(rx, ctt->getComtIndex(p.comtree));
 		}
 	} else if (p.type == Forest::DISCONNECT) {
-		lte.isConnected = false;
+		lte.isConnected = false; lte.aggregate = false;
+		if (rtr->lsocks != 0) rtr->lsocks->close(inLnk);
+		lsockTried[inLnk] = false;
 		lt->revertEntry(inLnk);
 		if (rtr->nmAdr != 0 && lte.peerType == Forest::CLIENT) {
 			pktx rx = ps->alloc();
@@ -876,79 +1090,215 @@ void RouterInProc::handleConnDisc(pktx px) {
 	return;
 }
 
+/** Open a connected socket for a link to a peer router.
+ *  Does nothing unless the router uses connected link sockets, or if
+ *  the link already has one.
+ *  Failure is not an error; the link then uses its interface's socket.
+ *  @param lnk is a link that has just been connected
+ */
+void RouterInProc::openLinkSock(int lnk) {
+	if (rtr->lsocks == 0) return;
+	lsockTried[lnk] = true;
+	if (rtr->lsocks->hasLink(lnk)) return;
+	LinkTable::Entry& lte = lt->getEntry(lnk);
+	IfaceTable::Entry& ifte = ift->getEntry(lte.iface);
+	if (lte.peerType != Forest::ROUTER || ifte.dev.length() != 0 ||
+	    lte.shm.length() != 0 || lte.peerIp == 0 || lte.peerPort == 0)
+		return;
+	if (!rtr->lsocks->open(lnk, ifte.ipa, ifte.port,
+			       lte.peerIp, lte.peerPort) ||
+	    !rtr->lsocks->hasLink(lnk)) {
+		cerr << "RouterInProc::openLinkSock: could not open socket "
+			"for link " << lnk << endl;
+	}
+}
+
 // Return next waiting packet or 0 if there is none. 
 pktx RouterInProc::receive() { 
-	if (nRdy == 0) { // if no ready interface check for new arrivals
-		FD_ZERO(sockets);
-		for (int i = ift->firstIface(); i != 0; i = ift->nextIface(i)) {
-			FD_SET(rtr->sock[i],sockets);
-		}
-		struct timeval zero; zero.tv_sec = zero.tv_usec = 0;
-		int cnt = 0;
-		do {
-			nRdy = select(rtr->maxSockNum+1,sockets,
-			       (fd_set *)NULL, (fd_set *)NULL, &zero);
-		} while (nRdy < 0 && cnt++ < 10);
-		if (cnt > 5) {
-			cerr << "RouterInProc::receive: select failed "
-			     << cnt-1 << " times\n";
-		}
-		if (nRdy < 0) {
-			Util::fatal("RouterInProc::receive: select failed");
-		}
-		if (nRdy == 0) return 0;
-		cIf = 0;
-	}
-	while (1) { // find next ready interface
-		cIf++;
-		if (cIf > Forest::MAXINTF) return 0; // should never reach here
-		if (ift->valid(cIf) && FD_ISSET(rtr->sock[cIf],sockets)) {
-			nRdy--; break;
-		}
-	}
-	// Now, read the packet from the interface
-	pktx px = ps->alloc();
-	if (px == 0) {
-		static int cnt = 0;
-		if (cnt++ < 10)
-			cerr << "RouterInProc:receive: out of packets\n";
-		return 0;
+	pktx px; int iface;
+	if (nextAgg < nAgg) { // next packet from an aggregate datagram
+		px = aggPkt[nextAgg]; iface = aggIf[nextAgg]; nextAgg++;
+	} else {
+		px = nextDatagram(iface);
+		if (px == 0) return 0;
+		uint32_t x = ntohl((*ps->getPacket(px).buffer)[0]);
+		if (((x >> 28) & 0xf) == Forest::AGG_VERSION) {
+			if (!aggLink(px, iface)) {
+				aggRejected++; ps->free(px); return 0;
+			}
+			if (split(px, iface) == 0) return 0;
+			px = aggPkt[0]; nextAgg = 1;
+		}
 	}
 	Packet& p = ps->getPacket(px);
 	buffer_t& b = *p.buffer;
 
-	ipa_t sIpAdr; ipp_t sPort;
-	int nbytes = Np4d::recvfrom4d(rtr->sock[cIf], (void *) &b[0], 1500,
-				  sIpAdr, sPort);
-	if (nbytes < 0) 
-		Util::fatal("RouterInProc::receive: error in recvfrom call");
+	if (overload) {
+		// shed data packets before doing any table lookups
+		Forest::ptyp_t ptype = (Forest::ptyp_t)
+					((ntohl(b[0]) >> 8) & 0xff);
+		if (ptype == Forest::CLIENT_DATA) {
+			shedCnt[DATA_CLASS]++;
+			ps->free(px); return 0;
+		}
+	}
 
 	p.unpack();
 
 	if (!p.hdrErrCheck()) { ps->free(px); return 0; }
-	int lnk = lt->lookup(sIpAdr, sPort);
+	if (p.inLink != 0) { // arrived on link's own socket
+		lt->countIncoming(p.inLink,Forest::truPktLeng(p.bufferLen));
+		return px;
+	}
+	int lnk = lt->lookup(p.tunIp, p.tunPort);
 	if (lnk == 0 && p.type == Forest::CONNECT
 		     && p.length == Forest::OVERHEAD+2*sizeof(uint64_t)) {
 		uint64_t nonce = Np4d::unpack64(&(p.payload()[2]));
 		lnk = lt->lookup(nonce); // check for "startup" entry
 	}
-	if (lnk == 0 || cIf != lt->getEntry(lnk).iface) {
+	if (lnk == 0 || iface != lt->getEntry(lnk).iface) {
 		cerr << "RouterInProc::receive: bad packet: lnk=" << lnk << " "
 		     << p.toString();
-		cerr << "sender=(" << Np4d::ip2string(sIpAdr) << ","
-		     << sPort << ")\n";
+		cerr << "sender=(" << Np4d::ip2string(p.tunIp) << ","
+		     << p.tunPort << ")\n";
 		ps->free(px); return 0;
 	}
 	
 	p.inLink = lnk;
-	p.bufferLen = nbytes;
-	p.tunIp = sIpAdr; p.tunPort = sPort;
+	if (rtr->lsocks != 0 && !lsockTried[lnk] &&
+	    p.type != Forest::CONNECT && p.type != Forest::DISCONNECT) {
+		// packet from a peer came in on the interface socket, so this
+		// end of the link has no connected socket yet; this happens
+		// for links configured at both ends, which never see a CONNECT
+		openLinkSock(lnk);
+	}
 
-	lt->countIncoming(lnk,Forest::truPktLeng(nbytes));
+	lt->countIncoming(lnk,Forest::truPktLeng(p.bufferLen));
 
 	return px;
 }
 
+/** Get the next datagram from the I/O backends.
+ *  @param iface is a reference to an integer in which the interface
+ *  that received the datagram is returned
+ *  @return the packet index for the datagram, or 0 if there is none
+ */
+pktx RouterInProc::nextDatagram(int& iface) {
+	if (nextRcv >= nRcv) { // get next batch from the I/O backend
+		nRcv = rtr->pio->recv(rcvPkt, rcvIf, rcvBatch);
+		if (nRcv >= 0 && rtr->ring != 0) {
+			int k = rtr->ring->recv(&rcvPkt[nRcv], &rcvIf[nRcv],
+						rcvBatch - nRcv);
+			nRcv = (k < 0 ? k : nRcv + k);
+		}
+		for (int i = 0; i < nRcv; i++)
+			ps->getPacket(rcvPkt[i]).inLink = 0;
+		for (LinkIo *lio : rtr->linkIo) {
+			if (nRcv < 0 || nRcv >= rcvBatch) break;
+			// these packets have inLink set already
+			int k = lio->recv(&rcvPkt[nRcv], &rcvIf[nRcv],
+					  rcvBatch - nRcv);
+			for (int i = nRcv; i < nRcv + k; i++)
+				rcvIf[i] = lt->getEntry(rcvIf[i]).iface;
+			nRcv = (k < 0 ? k : nRcv + k);
+		}
+		if (nRcv < 0) 
+			Util::fatal("RouterInProc::receive: error in recv call");
+		nextRcv = 0;
+		if (nRcv == 0) return 0;
+	}
+	iface = rcvIf[nextRcv];
+	return rcvPkt[nextRcv++];
+}
+
+/** Determine if an aggregate datagram came from a link on which
+ *  aggregation was negotiated with the peer.
+ *  @param px is the packet index of an aggregate datagram
+ *  @param iface is the interface on which it was received
+ *  @return true if the datagram may be split
+ */
+bool RouterInProc::aggLink(pktx px, int iface) {
+	Packet& ap = ps->getPacket(px);
+	int lnk = ap.inLink;
+	if (lnk == 0) lnk = lt->lookup(ap.tunIp, ap.tunPort);
+	if (lnk == 0) return false;
+	LinkTable::Entry& lte = lt->getEntry(lnk);
+	return lte.aggregate && lte.iface == iface;
+}
+
+/** Split an aggregate datagram into separate packets.
+ *  An aggregate datagram consists of a four byte header, with
+ *  AGG_VERSION in the version field, followed by a sequence of Forest
+ *  packets, each padded to a multiple of four bytes. The packets are
+ *  copied to new packets that are saved in aggPkt; the aggregate is freed.
+ *  @param px is the packet index of an aggregate datagram
+ *  @param iface is the interface on which it was received
+ *  @return the number of packets placed in aggPkt
+ */
+int RouterInProc::split(pktx px, int iface) {
+	Packet& ap = ps->getPacket(px);
+	char *base = (char *) ap.buffer;
+	int total = ap.bufferLen;
+	nAgg = nextAgg = 0; aggRcvd++;
+	int offset = sizeof(uint32_t);
+	while (offset + Forest::OVERHEAD <= total && nAgg < maxAgg) {
+		uint32_t x; memcpy(&x, base + offset, sizeof(x));
+		int leng = (ntohl(x) >> 16) & 0xfff;
+		if (leng < Forest::OVERHEAD || offset + leng > total) break;
+		pktx cx = ps->alloc();
+		if (cx == 0) break;
+		Packet& p = ps->getPacket(cx);
+		memcpy((void *) p.buffer, base + offset, leng);
+		p.bufferLen = leng; p.tunIp = ap.tunIp; p.tunPort = ap.tunPort;
+		p.inLink = ap.inLink;
+		aggPkt[nAgg] = cx; aggIf[nAgg] = iface; nAgg++;
+		offset += (leng + 3) & ~3;
+	}
+	ps->free(px);
+	return nAgg;
+}
+
+/** Update the overload state of the router.
+ *  The router becomes overloaded when the transfer queue to the
+ *  output thread is 3/4 full, or fewer than 1/16 of the packets in
+ *  the packet store are free. To avoid oscillation, it stays
+ *  overloaded until the queue is below 1/4 full and at least 1/8 of
+ *  the packets are free. While overloaded, arriving data packets are
+ *  discarded by receive; control packets are processed as usual.
+ */
+void RouterInProc::checkOverload() {
+	int qlen = xferIn - rtr->xferOut.load(memory_order_relaxed);
+	int nfree = ps->numFree();
+	if (!overload) {
+		overload = (qlen >= (3*Router::xferQsize)/4 ||
+			    nfree < psSize/16);
+		if (overload) overloadCnt++;
+	} else {
+		overload = (qlen >= Router::xferQsize/4 || nfree < psSize/8);
+	}
+}
+
+/** Transfer a packet to the output thread.
+ *  If the transfer queue is full, the packet is discarded and the
+ *  router enters the overload state.
+ *  @param px is the index of the packet
+ *  @return true on success, false if the packet was discarded
+ */
+bool RouterInProc::xfer(pktx px) {
+	TRACE_STAGE(rtr->strace, StageTrace::IN_THREAD, now, XFER_ENQ,
+		    px, ps->getPacket(px), 0, ps->getPacket(px).outQueue);
+	if (rtr->xferQ.enq(px) == 0) {
+		TRACE_STAGE(rtr->strace, StageTrace::IN_THREAD, now, DROP,
+			    px, ps->getPacket(px), 0, 0);
+		xferDrops[pktClass(ps->getPacket(px).type)]++;
+		ps->free(px);
+		if (!overload) { overload = true; overloadCnt++; }
+		return false;
+	}
+	xferIn++;
+	return true;
+}
+
 /** Perform error checks on forest packet.
  *  @param px is a packet index
  *  @param ctx is the comtree index for p's comtree
@@ -1003,6 +1353,13 @@ bool RouterInProc::pktCheck(pktx px, int ctx) {
 		if (ptype == Forest::CLIENT_SIG &&
 		    comt != (int) Forest::CLIENT_SIG_COMT)
 			return false;
+		// enforce the inbound rates for the comtree link
+		ComtreeTable::ClnkInfo& cli = ctt->getClnkInfo(ctx,cLnk);
+		if (!cli.pol.conform(Forest::truPktLeng(p.length),now,
+				     cli.rates)) {
+			lte.policedPkts++; lte.policedBytes += p.length;
+			return false;
+		}
 	} else if (ctx == 0) {
 		return p.type == Forest::NET_SIG;
 	}
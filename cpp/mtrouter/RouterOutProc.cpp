@@ -19,6 +19,8 @@ namespace forest {
 RouterOutProc::RouterOutProc(Router *rtr1) : rtr(rtr1) {
 	ift = rtr->ift; lt = rtr->lt;
 	ps = rtr->ps; qm = rtr->qm; pktLog = rtr->pktLog;
+	for (int lnk = 0; lnk <= Forest::MAXLNK; lnk++) agg[lnk].px = 0;
+	nAggLnk = 0; aggSent = aggPktCnt = 0;
 }
 
 RouterOutProc::~RouterOutProc() {
@@ -46,6 +48,7 @@ nanoseconds d1(0), d2(0), d3(0), d4(0);
 	now = temp.count(); // time since router started running
 	int64_t runTime = nanoseconds(rtr->runLength).count();
 	int64_t finishTime = now + runTime;
+	uint64_t xferCnt = 0;
 	while (runTime == 0 || now < finishTime) {
 		// update time
 		nanoseconds temp = high_resolution_clock::now() - rtr->tZero;
@@ -59,12 +62,16 @@ t1 = high_resolution_clock::now();
 		if (px != 0) {
 d1 += high_resolution_clock::now() - t1; i1++;
 			didNothing = false;
+			// let input thread track xferQ occupancy
+			rtr->xferOut.store(++xferCnt, memory_order_relaxed);
 
 			Packet& p = ps->getPacket(px);
+			TRACE_STAGE(rtr->strace, StageTrace::OUT_THREAD, now,
+				    XFER_DEQ, px, p, 0, p.outQueue);
 			uint32_t* buf = (uint32_t*) p.buffer;
 			if (p.outQueue != 0) {
 t2 = high_resolution_clock::now();
-				qm->enq(px,p.outQueue,now);
+				enqueue(px,p.outQueue);
 d2 += high_resolution_clock::now() - t2; i2++;
 			} else if (buf[1500] == 0) {
 				ps->free(px);
@@ -74,11 +81,11 @@ t2 = high_resolution_clock::now();
 				while (buf[i+1] != 0) {
 					// not yet the last copy
 					int cx = ps->clone(px);
-					qm->enq(cx,buf[i],now);
+					enqueue(cx,buf[i]);
 					i++;
 				}
 				// and finally, enqueue p itself
-				qm->enq(px,buf[i],now);
+				enqueue(px,buf[i]);
 d2 += high_resolution_clock::now() - t2; i2++;
 			}
 		}
@@ -90,13 +97,23 @@ t3 = high_resolution_clock::now();
 		if ((px = qm->deq(lnk, now)) != 0) {
 d3 += high_resolution_clock::now() - t3; i3++;
 			didNothing = false;
-			//pktLog->log(px,lnk,true,now);
+			TRACE_STAGE(rtr->strace, StageTrace::OUT_THREAD, now,
+				    QM_DEQ, px, ps->getPacket(px), lnk, 0);
+			pktLog->log(px,lnk,true,now);
 t4 = high_resolution_clock::now();
 			send(px,lnk);
 d4 += high_resolution_clock::now() - t4; i4++;
+		} else if (!rtr->pio->flush() ||
+			   (rtr->ring != 0 && !rtr->ring->flush())) {
+			// nothing ready to go, so push out pending packets
+			perror("RouterOutProc::run: failure in send");
+			exit(1);
 		}
 		//ltLock.unlock();
 
+		// send aggregates whose time is up
+		if (nAggLnk > 0) checkAgg();
+
 		// if did nothing on that pass, sleep for a millisecond.
 		//if (didNothing) 
 		//	this_thread::sleep_for(chrono::milliseconds(1));
@@ -107,6 +124,12 @@ cerr << "from xferQ: " << i1 << " " << (d1.count()/i1) << endl;
 cerr << "       enq: " << i2 << " " << (d2.count()/i2) << endl;
 cerr << "       deq: " << i3 << " " << (d3.count()/i3) << endl;
 cerr << "      send: " << i4 << " " << (d4.count()/i4) << endl;
+	while (nAggLnk > 0) sendAgg(aggLnk[0]);
+	if (aggSent != 0)
+		cerr << "aggregates: " << aggSent << " sent, containing "
+		     << aggPktCnt << " packets\n";
+	rtr->pio->flush();
+	if (rtr->ring != 0) rtr->ring->flush();
 
 	// write out recorded events
 	pktLog->write(cout);
@@ -122,30 +145,131 @@ cerr << "      send: " << i4 << " " << (d4.count()/i4) << endl;
 	     << leafStats.pktsOut << " to clients\n";
 }
 
-/** Send packet on specified link and recycle storage.
+/** Add a packet to a link queue, discarding it if the queue is full.
+ *  @param px is the packet index
+ *  @param qid is the queue number
+ */
+void RouterOutProc::enqueue(pktx px, int qid) {
+	if (!qm->enq(px,qid,now)) {
+		TRACE_STAGE(rtr->strace, StageTrace::OUT_THREAD, now, DROP,
+			    px, ps->getPacket(px), 0, qid);
+		ps->free(px);
+		return;
+	}
+	TRACE_STAGE(rtr->strace, StageTrace::OUT_THREAD, now, QM_ENQ,
+		    px, ps->getPacket(px), 0, qid);
+}
+
+/** Send packet on specified link.
+ *  If the link carries aggregates, the packet may be held briefly,
+ *  so that it can share a datagram with packets that follow it.
  *  @param px is the packet index of the outgoing packet
  *  @param lnk is its link number
  */
 void RouterOutProc::send(pktx px, int lnk) {
-	Packet& p = ps->getPacket(px);
+	TRACE_STAGE(rtr->strace, StageTrace::OUT_THREAD, now, SEND,
+		    px, ps->getPacket(px), lnk, 0);
 	LinkTable::Entry& lte = lt->getEntry(lnk);
 	if (lte.peerIp == 0 || lte.peerPort == 0) {
 		ps->free(px); return;
 	}
-	int rv, lim = 0;
+	if (lte.aggregate || agg[lnk].px != 0) aggregate(px, lnk);
+	else sendRaw(px, lnk);
+}
+
+/** Send packet or aggregate datagram on specified link.
+ *  The I/O backend recycles the storage once the packet has been sent.
+ *  @param px is the packet index of the outgoing packet
+ *  @param lnk is its link number
+ */
+void RouterOutProc::sendRaw(pktx px, int lnk) {
+	for (LinkIo *lio : rtr->linkIo) {
+		if (!lio->hasLink(lnk)) continue;
+		if (!lio->send(lnk, px)) {
+			perror("RouterOutProc::send: failure in send");
+			exit(1);
+		}
+		return;
+	}
+	LinkTable::Entry& lte = lt->getEntry(lnk);
 	//unique_lock<mutex> iftLock(rtr->iftMtx);
 	int sock = rtr->sock[lte.iface];
 	//iftLock.unlock();
-	do {
-		rv = Np4d::sendto4d(sock, (void *) p.buffer, p.length, lte.sa);
-	} while (rv == -1 && errno == EAGAIN && lim++ < 10);
-if (lim > 0) { cerr << "lim=" << lim << endl; exit(1); }
-	if (rv == -1) {
+	PktIo *io = (rtr->ring != 0 && rtr->ring->hasIface(lte.iface) ?
+		     rtr->ring : rtr->pio);
+	if (!io->send(sock, px, lte.sa)) {
 		perror("RouterOutProc::send: failure in sendto");
 		exit(1);
 	}
 	//lt->countOutgoing(lnk,Forest::truPktLeng(p.length));
+}
+
+/** Add a packet to the aggregate for a link.
+ *  The first packet is simply held. When a second packet arrives, an
+ *  aggregate datagram is started and both are copied into it.
+ *  An aggregate is sent when the next packet will not fit, or when
+ *  the first packet in it has waited for aggWindow.
+ *  @param px is the packet index of the outgoing packet
+ *  @param lnk is its link number
+ */
+void RouterOutProc::aggregate(pktx px, int lnk) {
+	AggState& a = agg[lnk];
+	int leng = ps->getPacket(px).length;
+	int padded = (leng + 3) & ~3;
+	if (a.px != 0 && (a.len + padded > aggMax || a.n >= aggPkts ||
+			  !lt->getEntry(lnk).aggregate))
+		sendAgg(lnk);
+	if (sizeof(uint32_t) + padded > aggMax ||
+	    !lt->getEntry(lnk).aggregate) {
+		sendRaw(px, lnk); return;
+	}
+	if (a.px == 0) { // hold packet, waiting for others
+		a.px = px; a.wrapped = false; a.n = 1;
+		a.len = sizeof(uint32_t) + padded;
+		a.deadline = now + nanoseconds(rtr->aggWindow).count();
+		aggLnk[nAggLnk++] = lnk;
+		return;
+	}
+	if (!a.wrapped) { // copy held packet into a new aggregate
+		pktx ax = ps->alloc();
+		if (ax == 0) { sendAgg(lnk); sendRaw(px, lnk); return; }
+		Packet& h = ps->getPacket(a.px);
+		memcpy(((char *) ps->getPacket(ax).buffer) + sizeof(uint32_t),
+		       (void *) h.buffer, h.length);
+		ps->free(a.px);
+		a.px = ax; a.wrapped = true;
+	}
+	char *base = (char *) ps->getPacket(a.px).buffer;
+	memcpy(base + a.len, (void *) ps->getPacket(px).buffer, leng);
+	a.len += padded; a.n++;
 	ps->free(px);
 }
 
+/** Send the packet or aggregate held for a link.
+ *  @param lnk is a link with a held packet
+ */
+void RouterOutProc::sendAgg(int lnk) {
+	AggState& a = agg[lnk];
+	for (int i = 0; i < nAggLnk; i++) {
+		if (aggLnk[i] == lnk) { aggLnk[i] = aggLnk[--nAggLnk]; break; }
+	}
+	pktx px = a.px; a.px = 0;
+	if (!a.wrapped) { sendRaw(px, lnk); return; }
+	Packet& p = ps->getPacket(px);
+	(*p.buffer)[0] = htonl((Forest::AGG_VERSION << 28) |
+			       ((a.len & 0xfff) << 16) | a.n);
+	p.length = p.bufferLen = a.len;
+	aggSent++; aggPktCnt += a.n;
+	sendRaw(px, lnk);
+}
+
+/** Send all held packets and aggregates whose deadlines have passed.
+ */
+void RouterOutProc::checkAgg() {
+	for (int i = nAggLnk - 1; i >= 0; i--) {
+		int lnk = aggLnk[i];
+		if (now >= agg[lnk].deadline) sendAgg(lnk);
+	}
+}
+
 } // ends namespace
@@ -0,0 +1,170 @@
+/** @file RteReqCache.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include "RteReqCache.h"
+
+namespace forest {
+
+/** Constructor for RteReqCache.
+ *  @param size is the maximum number of entries in the cache
+ *  @param reqTimeout1 is the minimum time (in ns) between successive
+ *  floods for the same destination
+ *  @param negTimeout1 is the time (in ns) for which an unknown
+ *  destination is remembered
+ */
+RteReqCache::RteReqCache(int size, int64_t reqTimeout1, int64_t negTimeout1)
+		 : n(size), reqTimeout(reqTimeout1), negTimeout(negTimeout1) {
+	map = new HashMap<uint64_t,Entry,Hash::u64>(n,false);
+	deadlines = new Dheap<int64_t>(n);
+	floods = suppressed = heldCount = negHits = 0;
+	released = timedOut = 0;
+}
+
+/** Destructor for RteReqCache. */
+RteReqCache::~RteReqCache() { delete map; delete deadlines; }
+
+/** Determine if a destination was recently reported as unknown.
+ *  @param comt is a comtree number
+ *  @param adr is a unicast forest address
+ *  @param now is the current time
+ *  @return true if there is an unexpired negative entry for (comt,adr)
+ */
+bool RteReqCache::negative(comt_t comt, fAdr_t adr, int64_t now) {
+	int x = map->find(key(comt,adr));
+	if (x == 0 || now >= map->getValue(x).negExpiry) return false;
+	negHits++;
+	return true;
+}
+
+/** Decide if a route request for a destination should be flooded.
+ *  A flood is allowed if no request for (comt,adr) has been flooded
+ *  within the last reqTimeout ns; in that case the flood time is recorded.
+ *  @param comt is a comtree number
+ *  @param adr is a unicast forest address
+ *  @param now is the current time
+ *  @return true if the caller should flood the packet, false if a request
+ *  is already outstanding
+ */
+bool RteReqCache::flood(comt_t comt, fAdr_t adr, int64_t now) {
+	int x = getEntry(comt,adr,now);
+	if (x == 0) { floods++; return true; } // cache full, flood anyway
+	Entry& e = map->getValue(x);
+	if (e.floodTime >= 0 && now < e.floodTime + reqTimeout) {
+		suppressed++; return false;
+	}
+	e.floodTime = now; setDeadline(x);
+	floods++;
+	return true;
+}
+
+/** Hold a packet until a route request is answered.
+ *  @param comt is a comtree number
+ *  @param adr is a unicast forest address
+ *  @param px is the index of a packet addressed to adr
+ *  @return true if the packet was saved, false if there is no entry
+ *  for (comt,adr) or no room is left in the entry; in the latter case,
+ *  the caller is responsible for the packet
+ */
+bool RteReqCache::hold(comt_t comt, fAdr_t adr, pktx px) {
+	int x = map->find(key(comt,adr));
+	if (x == 0) return false;
+	Entry& e = map->getValue(x);
+	if (e.nHeld >= MAXHELD) return false;
+	e.held[e.nHeld++] = px; heldCount++;
+	return true;
+}
+
+/** Record that a destination has been reported as unknown.
+ *  @param comt is a comtree number
+ *  @param adr is a unicast forest address
+ *  @param now is the current time
+ */
+void RteReqCache::setNegative(comt_t comt, fAdr_t adr, int64_t now) {
+	int x = getEntry(comt,adr,now);
+	if (x == 0) return;
+	map->getValue(x).negExpiry = now + negTimeout; setDeadline(x);
+}
+
+/** Remove the entry for a destination, once a route has been learned.
+ *  @param comt is a comtree number
+ *  @param adr is a unicast forest address
+ *  @param held is an array of at least MAXHELD packet indexes in which
+ *  the packets held by the entry are returned
+ *  @return the number of packets returned in held
+ */
+int RteReqCache::release(comt_t comt, fAdr_t adr, pktx *held) {
+	int x = map->find(key(comt,adr));
+	if (x == 0) return 0;
+	Entry& e = map->getValue(x);
+	int cnt = e.nHeld;
+	for (int i = 0; i < cnt; i++) held[i] = e.held[i];
+	deadlines->remove(x);
+	map->remove(key(comt,adr));
+	released += cnt;
+	return cnt;
+}
+
+/** Check for an expired entry and delete it.
+ *  @param now is the current time
+ *  @param held is an array of at least MAXHELD packet indexes in which
+ *  the packets held by the expired entry are returned
+ *  @return the number of packets returned in held, or -1 if there is
+ *  no expired entry
+ */
+int RteReqCache::expired(int64_t now, pktx *held) {
+	int x = deadlines->findmin();
+	if (x == 0 || now < deadlines->key(x)) return -1;
+	Entry& e = map->getValue(x);
+	int cnt = e.nHeld;
+	for (int i = 0; i < cnt; i++) held[i] = e.held[i];
+	deadlines->remove(x);
+	map->remove(map->getKey(x));
+	timedOut += cnt;
+	return cnt;
+}
+
+/** Find or create the entry for a (comtree, address) pair.
+ *  @param comt is a comtree number
+ *  @param adr is a unicast forest address
+ *  @param now is the current time
+ *  @return the index of the entry, or 0 if the cache is full
+ */
+int RteReqCache::getEntry(comt_t comt, fAdr_t adr, int64_t now) {
+	int x = map->find(key(comt,adr));
+	if (x != 0) return x;
+	if (map->size() >= n) return 0;
+	Entry e; e.floodTime = e.negExpiry = -1; e.nHeld = 0;
+	x = map->put(key(comt,adr),e);
+	if (x != 0) deadlines->insert(x, now);
+	return x;
+}
+
+/** Set the expiration time of an entry to the later of its flood timeout
+ *  and its negative timeout.
+ *  @param x is the index of an entry
+ */
+void RteReqCache::setDeadline(int x) {
+	Entry& e = map->getValue(x);
+	int64_t d = e.floodTime + reqTimeout;
+	if (e.negExpiry > d) d = e.negExpiry;
+	deadlines->changekey(x,d);
+}
+
+/** Create a string representation of the cache statistics.
+ *  @return the string
+ */
+string RteReqCache::toString() const {
+	stringstream ss;
+	ss << "floods=" << floods << " suppressed=" << suppressed
+	   << " held=" << heldCount << " released=" << released
+	   << " timedOut=" << timedOut << " negHits=" << negHits
+	   << " entries=" << map->size();
+	return ss.str();
+}
+
+} // ends namespace
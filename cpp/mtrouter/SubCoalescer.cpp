@@ -0,0 +1,182 @@
+/** @file SubCoalescer.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include "SubCoalescer.h"
+
+namespace forest {
+
+/** Constructor for SubCoalescer.
+ *  @param nComt1 is the maximum number of comtrees that may have
+ *  pending changes at the same time
+ *  @param nAdr1 is the initial size of the table of pending changes;
+ *  the table expands as needed
+ *  @param window1 is the length of the aggregation window in ns
+ */
+SubCoalescer::SubCoalescer(int nComt1, int nAdr1, int64_t window1)
+			   : nComt(nComt1), nAdr(nAdr1), window(window1) {
+	batches = new HashMap<comt_t,Batch,Hash::u32>(nComt,false);
+	deadlines = new Dheap<int64_t>(nComt);
+	pending = new HashMap<uint64_t,int,Hash::u64>(nAdr);
+	changes = cancelled = sent = pkts = requeued = 0;
+}
+
+/** Destructor for SubCoalescer. */
+SubCoalescer::~SubCoalescer() {
+	delete batches; delete deadlines; delete pending;
+}
+
+/** Record a subscription change.
+ *  If the change reverses a pending change for the same address,
+ *  the two cancel and the pending change is removed.
+ *  @param comt is a comtree number
+ *  @param adr is a multicast address
+ *  @param delta is +1 for an added subscription, -1 for a dropped one
+ *  @param now is the current time
+ */
+void SubCoalescer::update(comt_t comt, fAdr_t adr, int delta, int64_t now) {
+	changes++;
+	uint64_t kee = key(comt,adr);
+	int x = pending->find(kee);
+	if (x != 0) {
+		if (pending->getValue(x) != delta) {
+			pending->remove(kee); cancelled += 2;
+		}
+		return;
+	}
+	pending->put(kee,delta);
+	queue(comt,adr,now,false);
+}
+
+/** Add an address with a pending change to its comtree's batch.
+ *  If the comtree has no batch and none can be created, the change
+ *  is added to the spill list instead.
+ *  @param comt is a comtree number
+ *  @param adr is a multicast address
+ *  @param now is the current time
+ *  @param first is true if the address should go at the front of the
+ *  batch, so it is sent before newer changes
+ */
+void SubCoalescer::queue(comt_t comt, fAdr_t adr, int64_t now, bool first) {
+	int bx = batches->find(comt);
+	if (bx == 0) {
+		bx = batches->put(comt,Batch());
+		if (bx == 0) { spill.push_back(key(comt,adr)); return; }
+		deadlines->insert(bx, now + window);
+	}
+	vector<fAdr_t>& adrs = batches->getValue(bx).adrs;
+	if (first) adrs.insert(adrs.begin(), adr);
+	else adrs.push_back(adr);
+}
+
+/** Get the changes for a comtree whose aggregation window has ended.
+ *  At most MAXADRS changes are returned at once; if more remain,
+ *  the comtree is returned again on the next call. If no window has
+ *  ended, changes from the spill list are returned, if there are any.
+ *  The returned changes are no longer pending; if they cannot be sent,
+ *  the caller must return them using requeue.
+ *  @param now is the current time
+ *  @param adds is a vector in which the added addresses are returned
+ *  @param drops is a vector in which the dropped addresses are returned
+ *  @return the comtree number for the changes, or 0 if no comtree's
+ *  window has ended; note that adds and drops may both be empty,
+ *  if all the changes for the comtree cancelled
+ */
+comt_t SubCoalescer::expired(int64_t now, vector<fAdr_t>& adds,
+				 vector<fAdr_t>& drops) {
+	adds.clear(); drops.clear();
+	int bx = deadlines->findmin();
+	if (bx == 0 || now < deadlines->key(bx)) return expiredSpill(adds,drops);
+	comt_t comt = batches->getKey(bx);
+	vector<fAdr_t>& adrs = batches->getValue(bx).adrs;
+	unsigned int i;
+	for (i = 0; i < adrs.size() &&
+		    adds.size() + drops.size() < MAXADRS; i++) {
+		uint64_t kee = key(comt,adrs[i]);
+		int x = pending->find(kee);
+		if (x == 0) continue; // cancelled, or duplicate
+		if (pending->getValue(x) > 0) adds.push_back(adrs[i]);
+		else drops.push_back(adrs[i]);
+		pending->remove(kee);
+	}
+	if (i < adrs.size()) {
+		// leave the rest for next time
+		adrs.erase(adrs.begin(), adrs.begin() + i);
+	} else {
+		deadlines->remove(bx); batches->remove(comt);
+	}
+	if (adds.size() + drops.size() > 0) {
+		sent += adds.size() + drops.size(); pkts++;
+	}
+	return comt;
+}
+
+/** Get spilled changes for the comtree of the oldest spilled change.
+ *  @param adds is a vector in which the added addresses are returned
+ *  @param drops is a vector in which the dropped addresses are returned
+ *  @return the comtree number for the changes, or 0 if there are none
+ */
+comt_t SubCoalescer::expiredSpill(vector<fAdr_t>& adds,
+				  vector<fAdr_t>& drops) {
+	if (spill.empty()) return 0;
+	comt_t comt = spill[0] >> 32;
+	unsigned int j = 0;
+	for (unsigned int i = 0; i < spill.size(); i++) {
+		uint64_t kee = spill[i];
+		if ((comt_t) (kee >> 32) != comt ||
+		    adds.size() + drops.size() >= MAXADRS) {
+			spill[j++] = kee; continue;
+		}
+		int x = pending->find(kee);
+		if (x == 0) continue; // cancelled, or duplicate
+		fAdr_t adr = (fAdr_t) (kee & 0xffffffff);
+		if (pending->getValue(x) > 0) adds.push_back(adr);
+		else drops.push_back(adr);
+		pending->remove(kee);
+	}
+	spill.resize(j);
+	if (adds.size() + drops.size() > 0) {
+		sent += adds.size() + drops.size(); pkts++;
+	}
+	return comt;
+}
+
+/** Return changes that were obtained from expired but not sent.
+ *  They become pending again, ahead of any newer changes for the
+ *  comtree, and are returned by expired once the comtree's window
+ *  ends (a new window is started if the comtree has none).
+ *  @param comt is the comtree number
+ *  @param adds is a list of added addresses
+ *  @param drops is a list of dropped addresses
+ *  @param now is the current time
+ */
+void SubCoalescer::requeue(comt_t comt, const vector<fAdr_t>& adds,
+			   const vector<fAdr_t>& drops, int64_t now) {
+	sent -= adds.size() + drops.size(); pkts--;
+	requeued += adds.size() + drops.size();
+	for (int i = drops.size()-1; i >= 0; i--) {
+		pending->put(key(comt,drops[i]),-1);
+		queue(comt,drops[i],now,true);
+	}
+	for (int i = adds.size()-1; i >= 0; i--) {
+		pending->put(key(comt,adds[i]),+1);
+		queue(comt,adds[i],now,true);
+	}
+}
+
+/** Create a string representation of the aggregation statistics.
+ *  @return the string
+ */
+string SubCoalescer::toString() const {
+	stringstream ss;
+	ss << "changes=" << changes << " cancelled=" << cancelled
+	   << " sent=" << sent << " packets=" << pkts
+	   << " requeued=" << requeued << " spilled=" << spill.size();
+	return ss.str();
+}
+
+} // ends namespace
@@ -0,0 +1,398 @@
+/** @file TableSnap.cpp
+ *
+ *  @author Jon Turner
+ *  @date 2014
+ *  This is open source software licensed under the Apache 2.0 license.
+ *  See http://www.apache.org/licenses/LICENSE-2.0 for details.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "TableSnap.h"
+
+using namespace std::chrono;
+
+namespace forest {
+
+/** Write a snapshot of the router tables to a file.
+ *  The caller must hold the locks on all four tables, or otherwise
+ *  ensure that they do not change while the snapshot is taken.
+ *  @param fileName is the name of the file; an existing snapshot is
+ *  replaced only once the new one has been completely written
+ *  @param myAdr is the forest address of the router
+ *  @param ift is the router's interface table
+ *  @param lt is the router's link table
+ *  @param ctt is the router's comtree table
+ *  @param rt is the router's route table
+ *  @return true on success, false on failure
+ */
+bool TableSnap::write(const string& fileName, fAdr_t myAdr,
+		      IfaceTable* ift, LinkTable* lt,
+		      ComtreeTable* ctt, RouteTable* rt) {
+	const int nSecs = 4;
+	vector<int32_t> words[nSecs]; SecHdr sh[nSecs];
+	sh[0].count = packIfaces(ift, words[0]);
+	sh[1].count = packLinks(lt, words[1]);
+	sh[2].count = packComtrees(ctt, words[2]);
+	sh[3].count = packRoutes(ctt, rt, words[3]);
+
+	FileHdr h;
+	h.magic = MAGIC; h.version = VERSION; h.myAdr = myAdr;
+	h.nSecs = nSecs;
+	h.time = duration_cast<nanoseconds>(
+			system_clock::now().time_since_epoch()).count();
+	h.size = sizeof(FileHdr);
+	for (int i = 0; i < nSecs; i++) {
+		sh[i].table = i+1; sh[i].nWords = words[i].size();
+		sh[i].cksum = checksum(words[i].data(), words[i].size());
+		h.size += sizeof(SecHdr) + sizeof(int32_t)*words[i].size();
+	}
+
+	string tmpName = fileName + ".tmp";
+	FILE *fp = fopen(tmpName.c_str(), "wb");
+	if (fp == 0) return false;
+	bool ok = (fwrite(&h, sizeof(h), 1, fp) == 1);
+	for (int i = 0; ok && i < nSecs; i++) {
+		ok = fwrite(&sh[i], sizeof(SecHdr), 1, fp) == 1 &&
+		     fwrite(words[i].data(), sizeof(int32_t), words[i].size(),
+			    fp) == words[i].size();
+	}
+	ok = (fflush(fp) == 0) && ok && (fsync(fileno(fp)) == 0);
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok || rename(tmpName.c_str(), fileName.c_str()) != 0) {
+		remove(tmpName.c_str()); return false;
+	}
+	return true;
+}
+
+/** Load the router tables from a snapshot file.
+ *  The tables are expected to be empty. The whole file is checked
+ *  before any table is modified, so if the file is missing, was
+ *  written by another router or is damaged, the tables are left
+ *  alone and the caller may fall back on some other configuration.
+ *  @param fileName is the name of the file
+ *  @param myAdr is the forest address of the router
+ *  @param ift is the router's interface table
+ *  @param lt is the router's link table
+ *  @param ctt is the router's comtree table
+ *  @param rt is the router's route table
+ *  @param touched is set to true if the tables were modified, even
+ *  if the operation then failed
+ *  @return true on success, false on failure
+ */
+bool TableSnap::load(const string& fileName, fAdr_t myAdr,
+		     IfaceTable* ift, LinkTable* lt,
+		     ComtreeTable* ctt, RouteTable* rt, bool& touched) {
+	touched = false;
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat sb;
+	if (fstat(fd, &sb) != 0 || sb.st_size < (off_t) sizeof(FileHdr)) {
+		close(fd); return false;
+	}
+	size_t size = sb.st_size;
+	void *m = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED) return false;
+	madvise(m, size, MADV_SEQUENTIAL);
+
+	// check the header and locate the sections
+	const char *data = (const char*) m;
+	const FileHdr *h = (const FileHdr*) data;
+	const int nSecs = 4;
+	const int32_t *sec[nSecs]; const SecHdr *sh[nSecs];
+	bool ok = h->magic == MAGIC && h->version == VERSION &&
+		  h->myAdr == myAdr && h->nSecs == (uint32_t) nSecs &&
+		  h->size == size;
+	size_t pos = sizeof(FileHdr);
+	for (int i = 0; ok && i < nSecs; i++) {
+		if (pos + sizeof(SecHdr) > size) { ok = false; break; }
+		sh[i] = (const SecHdr*) &data[pos];
+		pos += sizeof(SecHdr);
+		sec[i] = (const int32_t*) &data[pos];
+		size_t len = sizeof(int32_t) * (size_t) sh[i]->nWords;
+		if (sh[i]->table != (uint32_t) i+1 || pos + len > size ||
+		    checksum(sec[i], sh[i]->nWords) != sh[i]->cksum) {
+			ok = false; break;
+		}
+		pos += len;
+		// check that entries exactly fill the section
+		uint32_t n = 0; const int32_t *p = sec[i];
+		const int32_t *end = sec[i] + sh[i]->nWords;
+		while (p < end && *p >= 0 && *p < end - p) {
+			p += 1 + *p; n++;
+		}
+		if (p != end || n != sh[i]->count) ok = false;
+	}
+	if (!ok || pos != size) {
+		munmap(m, size); return false;
+	}
+
+	// now fill in the tables
+	touched = true;
+	for (int i = 0; ok && i < nSecs; i++) {
+		const int32_t *p = sec[i];
+		const int32_t *end = sec[i] + sh[i]->nWords;
+		while (ok && p < end) {
+			const int32_t *q = p + 1, *qend = p + 1 + *p;
+			switch (i+1) {
+			case IFACES:   ok = loadIface(q, qend, ift); break;
+			case LINKS:    ok = loadLink(q, qend, lt); break;
+			case COMTREES: ok = loadComtree(q, qend, ctt); break;
+			case ROUTES:   ok = loadRoute(q, qend, ctt, rt); break;
+			}
+			if (!ok) {
+				cerr << "TableSnap::load: bad entry in "
+				     << "section " << i+1 << " at word "
+				     << (p - sec[i]) << endl;
+			}
+			p = qend;
+		}
+	}
+	munmap(m, size);
+	return ok;
+}
+
+/** Compute a checksum of a sequence of words (32 bit FNV-1a).
+ *  @param p points to the first word
+ *  @param n is the number of words
+ *  @return the checksum
+ */
+uint32_t TableSnap::checksum(const int32_t* p, int n) {
+	uint32_t h = 2166136261u;
+	for (int i = 0; i < n; i++) {
+		h ^= (uint32_t) p[i]; h *= 16777619u;
+	}
+	return h;
+}
+
+/** Add a rate spec to an entry.
+ *  @param rs is a rate spec
+ *  @param v is a vector to which the four rates are appended
+ */
+void TableSnap::packRates(const RateSpec& rs, vector<int32_t>& v) {
+	v.push_back(rs.bitRateUp); v.push_back(rs.bitRateDown);
+	v.push_back(rs.pktRateUp); v.push_back(rs.pktRateDown);
+}
+
+/** Add a string to an entry.
+ *  @param s is a string
+ *  @param v is a vector to which the length of s and its characters
+ *  are appended
+ */
+void TableSnap::packString(const string& s, vector<int32_t>& v) {
+	int n = v.size();
+	v.push_back(s.length());
+	v.resize(n + 1 + (s.length() + 3)/4, 0);
+	if (s.length() > 0)
+		std::copy(s.begin(), s.end(), (char*) &v[n+1]);
+}
+
+/** Get a string from an entry.
+ *  @param p is a reference to a pointer to the start of the string;
+ *  on return, it points to the word following the string
+ *  @param end points just past the end of the entry
+ *  @param s is a reference to a string in which the result is returned
+ *  @return true on success, false if the string does not fit in the
+ *  entry
+ */
+bool TableSnap::unpackString(const int32_t*& p, const int32_t* end,
+			     string& s) {
+	if (p >= end || *p < 0 || *p > 4*(end - (p+1))) return false;
+	int len = *p++;
+	s.assign((const char*) p, len);
+	p += (len + 3)/4;
+	return true;
+}
+
+/** Encode the interface table.
+ *  @param ift is the table
+ *  @param v is a vector to which the encoded entries are appended
+ *  @return the number of entries
+ */
+int TableSnap::packIfaces(IfaceTable* ift, vector<int32_t>& v) {
+	int count = 0;
+	for (int i = ift->firstIface(); i != 0; i = ift->nextIface(i)) {
+		IfaceTable::Entry& e = ift->getEntry(i);
+		int n0 = v.size(); v.push_back(0);
+		v.push_back(i); v.push_back(e.ipa); v.push_back(e.port);
+		packRates(e.rates, v); packString(e.dev, v);
+		v[n0] = v.size() - (n0+1); count++;
+	}
+	return count;
+}
+
+/** Encode the link table.
+ *  @param lt is the table
+ *  @param v is a vector to which the encoded entries are appended
+ *  @return the number of entries
+ */
+int TableSnap::packLinks(LinkTable* lt, vector<int32_t>& v) {
+	int count = 0;
+	for (int i = lt->firstLink(); i != 0; i = lt->nextLink(i)) {
+		LinkTable::Entry& e = lt->getEntry(i);
+		int n0 = v.size(); v.push_back(0);
+		v.push_back(i); v.push_back(e.iface);
+		v.push_back(e.peerIp); v.push_back(e.peerPort);
+		v.push_back(e.peerType); v.push_back(e.peerAdr);
+		packRates(e.rates, v);
+		v.push_back((int32_t) (e.nonce >> 32));
+		v.push_back((int32_t) (e.nonce & 0xffffffff));
+		packString(e.shm, v);
+		v[n0] = v.size() - (n0+1); count++;
+	}
+	return count;
+}
+
+/** Encode the comtree table.
+ *  @param ctt is the table
+ *  @param v is a vector to which the encoded entries are appended
+ *  @return the number of entries
+ */
+int TableSnap::packComtrees(ComtreeTable* ctt, vector<int32_t>& v) {
+	int count = 0;
+	for (int ctx = ctt->firstComt(); ctx != 0; ctx = ctt->nextComt(ctx)) {
+		ComtreeTable::Entry& e = ctt->getEntry(ctx);
+		int n0 = v.size(); v.push_back(0);
+		v.push_back(ctt->getComtree(ctx)); v.push_back(e.coreFlag);
+		v.push_back(e.pLnk); v.push_back(ctt->getLinkCount(ctx));
+		for (int cLnk = ctt->firstComtLink(ctx); cLnk != 0;
+			 cLnk = ctt->nextComtLink(ctx,cLnk)) {
+			ComtreeTable::ClnkInfo& cli =
+				ctt->getClnkInfo(ctx,cLnk);
+			v.push_back(ctt->getLink(ctx,cLnk));
+			v.push_back((ctt->isRtrLink(ctx,cLnk) ? 1 : 0) |
+				    (ctt->isCoreLink(ctx,cLnk) ? 2 : 0));
+			v.push_back(cli.dest); packRates(cli.rates, v);
+		}
+		v[n0] = v.size() - (n0+1); count++;
+	}
+	return count;
+}
+
+/** Encode the route table.
+ *  @param ctt is the comtree table, used to map comtree link numbers
+ *  to link numbers
+ *  @param rt is the route table
+ *  @param v is a vector to which the encoded entries are appended
+ *  @return the number of entries
+ */
+int TableSnap::packRoutes(ComtreeTable* ctt, RouteTable* rt,
+			  vector<int32_t>& v) {
+	int count = 0;
+	for (int rtx = rt->firstRtx(); rtx != 0; rtx = rt->nextRtx(rtx)) {
+		comt_t comt = rt->getComtree(rtx);
+		int ctx = ctt->getComtIndex(comt);
+		int n0 = v.size(); v.push_back(0);
+		v.push_back(comt); v.push_back(rt->getAddress(rtx));
+		v.push_back(rt->getLinkCount(rtx));
+		for (int clx = rt->firstClx(rtx); clx != 0;
+			 clx = rt->nextClx(rtx,clx))
+			v.push_back(ctt->getLink(ctx,rt->getClnk(rtx,clx)));
+		v[n0] = v.size() - (n0+1); count++;
+	}
+	return count;
+}
+
+/** Add an interface table entry from a snapshot.
+ *  @param p points to the first field of the entry
+ *  @param end points just past the last field
+ *  @param ift is the interface table
+ *  @return true on success, false on failure
+ */
+bool TableSnap::loadIface(const int32_t* p, const int32_t* end,
+			  IfaceTable* ift) {
+	if (end - p < 8) return false;
+	int iface = p[0];
+	RateSpec rs(p[3], p[4], p[5], p[6]);
+	string dev; const int32_t *q = p + 7;
+	if (!unpackString(q, end, dev)) return false;
+	if (!ift->addEntry(iface, p[1], p[2], rs)) return false;
+	ift->getEntry(iface).dev = dev;
+	return true;
+}
+
+/** Add a link table entry from a snapshot.
+ *  @param p points to the first field of the entry
+ *  @param end points just past the last field
+ *  @param lt is the link table
+ *  @return true on success, false on failure
+ */
+bool TableSnap::loadLink(const int32_t* p, const int32_t* end,
+			 LinkTable* lt) {
+	if (end - p < 13) return false;
+	int lnk = p[0];
+	Forest::ntyp_t peerType = (Forest::ntyp_t) p[4];
+	if (peerType == Forest::UNDEF_NODE) return false;
+	uint64_t nonce = ((uint64_t) (uint32_t) p[10] << 32) | (uint32_t) p[11];
+	string shm; const int32_t *q = p + 12;
+	if (!unpackString(q, end, shm)) return false;
+
+	if (!lt->addEntry(lnk, p[2], p[3], nonce)) return false;
+	LinkTable::Entry& e = lt->getEntry(lnk);
+	e.iface = p[1]; e.peerType = peerType; e.peerAdr = p[5];
+	e.rates.set(p[6], p[7], p[8], p[9]); e.availRates = e.rates;
+	e.shm = shm;
+	if (!lt->checkEntry(lnk)) { lt->removeEntry(lnk); return false; }
+	return true;
+}
+
+/** Add a comtree table entry from a snapshot.
+ *  @param p points to the first field of the entry
+ *  @param end points just past the last field
+ *  @param ctt is the comtree table
+ *  @return true on success, false on failure
+ */
+bool TableSnap::loadComtree(const int32_t* p, const int32_t* end,
+			    ComtreeTable* ctt) {
+	if (end - p < 4) return false;
+	comt_t comt = p[0]; int nl = p[3];
+	if (nl < 0 || end - (p+4) != 7*nl) return false;
+	int ctx = ctt->addEntry(comt);
+	if (ctx == 0) return false;
+	ctt->setCoreFlag(ctx, p[1] != 0);
+	for (const int32_t *q = p + 4; q < end; q += 7) {
+		int lnk = q[0];
+		if (!ctt->addLink(ctx, lnk, (q[1] & 1) != 0, (q[1] & 2) != 0)) {
+			ctt->removeEntry(ctx); return false;
+		}
+		ComtreeTable::ClnkInfo& cli =
+			ctt->getClnkInfo(ctx, ctt->getClnkNum(comt,lnk));
+		cli.dest = q[2]; cli.rates.set(q[3], q[4], q[5], q[6]);
+	}
+	ctt->setPlink(ctx, p[2]); // must be done after links are defined
+	if (!ctt->checkEntry(ctx)) { ctt->removeEntry(ctx); return false; }
+	return true;
+}
+
+/** Add a route table entry from a snapshot.
+ *  @param p points to the first field of the entry
+ *  @param end points just past the last field
+ *  @param ctt is the comtree table, used to map link numbers to
+ *  comtree link numbers
+ *  @param rt is the route table
+ *  @return true on success, false on failure
+ */
+bool TableSnap::loadRoute(const int32_t* p, const int32_t* end,
+			  ComtreeTable* ctt, RouteTable* rt) {
+	if (end - p < 3) return false;
+	comt_t comt = p[0]; fAdr_t adr = p[1]; int nl = p[2];
+	bool mcast = Forest::mcastAdr(adr);
+	if (nl < 1 || end - (p+3) != nl || (!mcast && nl != 1))
+		return false;
+	int rtx = rt->addRoute(comt, adr, 0);
+	if (rtx == 0) return false;
+	for (int i = 0; i < nl; i++) {
+		int cLnk = ctt->getClnkNum(comt, p[3+i]);
+		if (cLnk == 0) { rt->removeRoute(rtx); return false; }
+		if (mcast) rt->addLink(rtx, cLnk);
+		else rt->setLink(rtx, cLnk);
+	}
+	return true;
+}
+
+} // ends namespace